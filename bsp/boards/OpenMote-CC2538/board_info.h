@@ -92,6 +92,10 @@
 
 #define SYNC_ACCURACY                       1     // ticks
 
+//===== neighbor table size
+
+#define MAXNUMNEIGHBORS                     32    // enough RAM for dense networks
+
 //===== per-board number of sensors
 
 #define NUMSENSORS 7
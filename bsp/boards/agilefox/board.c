@@ -92,7 +92,19 @@ void board_init()
 }
 
 void board_sleep() {
-    uint16_t sleepTime = radiotimer_getPeriod() - radiotimer_getCapturedTime();
+    PORT_RADIOTIMER_WIDTH period     = radiotimer_getPeriod();
+    PORT_RADIOTIMER_WIDTH sleepStart = radiotimer_getCapturedTime();
+    PORT_RADIOTIMER_WIDTH sleepEnd;
+    uint32_t              sleepTime;
+    
+    // the bsp_timer stops in Stop mode, only the RTC (radiotimer) wakes the
+    // board up, at the end of the slot: stay in Sleep mode if an opentimer
+    // fires before that
+    if (opentimers_getTimeToNextTimeout() <= (uint32_t)(period-sleepStart)*2) {
+        __WFI();
+        return;
+    }
+    
     DBGMCU_Config(DBGMCU_STOP, ENABLE);
     
     // Enable PWR and BKP clock
@@ -102,6 +114,14 @@ void board_sleep() {
 
     PWR_EnterSTOPMode(PWR_Regulator_ON,PWR_STOPEntry_WFI);
     
+    // correct the opentimers with the time actually slept, the RTC wraps
+    // around at the end of the slot
+    sleepEnd = radiotimer_getCapturedTime();
+    if (sleepEnd >= sleepStart) {
+        sleepTime = sleepEnd - sleepStart;
+    } else {
+        sleepTime = (period - sleepStart) + sleepEnd;
+    }
     if(sleepTime > 0)
     opentimers_sleepTimeCompesation(sleepTime*2);
 }
@@ -65,6 +65,10 @@ to return the board's description.
 
 #define SYNC_ACCURACY                       2     // ticks
 
+//===== neighbor table size
+
+#define MAXNUMNEIGHBORS                     32    // enough RAM for dense networks
+
 //=========================== variables =======================================
 
 static const uint8_t rreg_uriquery[]        = "h=ucb";
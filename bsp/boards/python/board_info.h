@@ -74,6 +74,10 @@
 
 #define SYNC_ACCURACY                       1 // when using openmoteSTM, change to 2
 
+//===== neighbor table size
+
+#define MAXNUMNEIGHBORS                     32    // enough RAM for dense networks
+
 //=========================== typedef  ========================================
 
 //=========================== variables =======================================
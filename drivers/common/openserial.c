@@ -20,6 +20,7 @@
 #include "openhdlc.h"
 #include "schedule.h"
 #include "icmpv6rpl.h"
+#include "scheduler.h"
 
 //=========================== variables =======================================
 
@@ -220,8 +221,9 @@ owerror_t openserial_printCritical(uint8_t calling_component, uint8_t error_code
    // blink error LED, this is serious
    leds_error_blink();
    
-   // schedule for the mote to reboot in 10s
-   opentimers_start(10000,
+   // schedule for the mote to reboot in 10s (give or take 1s)
+   opentimers_startWithSlack(10000,
+                    1000,
                     TIMER_ONESHOT,TIME_MS,
                     openserial_board_reset_cb);
    
@@ -359,6 +361,26 @@ void openserial_startOutput() {
          if (debugPrint_kaPeriod()==TRUE) {
             break;
          }
+      case STATUS_TASKSTATS:
+         if (debugPrint_taskStats()==TRUE) {
+            break;
+         }
+      case STATUS_QUEUEMEM:
+         if (debugPrint_queueMemory()==TRUE) {
+            break;
+         }
+      case STATUS_QUEUEDROPS:
+         if (debugPrint_queueDrops()==TRUE) {
+            break;
+         }
+      case STATUS_TIMERSTATS:
+         if (debugPrint_timerStats()==TRUE) {
+            break;
+         }
+      case STATUS_SLOTPROFILE:
+         if (debugPrint_slotProfile()==TRUE) {
+            break;
+         }
       default:
          DISABLE_INTERRUPTS();
          openserial_vars.debugPrintCounter=0;
@@ -550,6 +572,9 @@ void openserial_goldenImageCommands(void){
        case COMMAND_SET_FRAMELENGTH: // two bytes
            schedule_setFrameLength(comandParam_16);
            break;
+       case COMMAND_SET_MAXACTIVESLOTS: // one byte, for the minimal slotframe
+           schedule_setMaxActiveSlots(schedule_getFrameHandle(),comandParam_8);
+           break;
        case COMMAND_SET_ACK_STATUS:
            if (comandParam_8 == 1) {
                ieee154e_setIsAckEnabled(TRUE);
@@ -598,9 +623,26 @@ void openserial_goldenImageCommands(void){
                 sixtop_addORremoveCellByInfo(commandId-8,&neighbor,cellList);
             }
             break;
+       case COMMAND_SET_6P_ADD_BURST: // one byte, the number of cells, 0 to clear them
+            // get preferred parent
+            foundNeighbor = neighbors_getPreferredParentEui64(&neighbor);
+            if (foundNeighbor==FALSE) {
+                break;
+            }
+            
+            sixtop_setHandler(SIX_HANDLER_OTF);
+            if (comandParam_8==0) {
+                sixtop_requestInBurstSlotframe(IANA_6TOP_CMD_CLEAR,&neighbor,0);
+            } else {
+                sixtop_requestInBurstSlotframe(IANA_6TOP_CMD_ADD,&neighbor,comandParam_8);
+            }
+            break;
        case COMMAND_SET_SLOTDURATION:
             ieee154e_setSlotDuration(comandParam_16);
             break;
+       case COMMAND_SET_TIMESLOT_TEMPLATE: // one byte, the template ID
+            ieee154e_setTimeslotTemplate(comandParam_8);
+            break;
        case COMMAND_SET_6PRESPONSE_STATUS:
             if (comandParam_8 ==1) {
                sixtop_setIsResponseEnabled(TRUE);
@@ -638,6 +680,47 @@ bool debugPrint_outBufferIndexes() {
    return TRUE;
 }
 
+/**
+\brief Print the scheduler's statistics for one task priority.
+
+Each call prints the next priority for which at least one task has run, so
+all priorities are covered over successive calls. Nothing is printed unless
+the kernel is compiled with SCHEDULER_STATS.
+
+\returns TRUE if this function printed something, FALSE otherwise.
+*/
+bool debugPrint_taskStats() {
+   debugTaskStatsEntry_t temp;
+   uint8_t          i;
+   
+   for (i=0;i<TASKPRIO_NUM;i++) {
+      openserial_vars.debugPrintTaskPrio = (openserial_vars.debugPrintTaskPrio+1)%TASKPRIO_NUM;
+      if (scheduler_getPrioStats(openserial_vars.debugPrintTaskPrio,&temp.stats)==TRUE) {
+         temp.prio = openserial_vars.debugPrintTaskPrio;
+         openserial_printStatus(STATUS_TASKSTATS,(uint8_t*)&temp,sizeof(debugTaskStatsEntry_t));
+         return TRUE;
+      }
+   }
+   return FALSE;
+}
+
+/**
+\brief Print the statistics of the opentimers driver.
+
+numArmsAvoided counts the timer expiries which shared a wakeup with an earlier
+deadline thanks to their slack, i.e. the compare events the bsp_timer did not
+need.
+
+\returns TRUE if this function printed something, FALSE otherwise.
+*/
+bool debugPrint_timerStats() {
+   opentimers_stats_t temp;
+
+   opentimers_getStats(&temp);
+   openserial_printStatus(STATUS_TIMERSTATS,(uint8_t*)&temp,sizeof(opentimers_stats_t));
+   return TRUE;
+}
+
 //=========================== private =========================================
 
 //===== hdlc (output)
@@ -75,7 +75,10 @@ enum {
    COMMAND_SET_6P_CLEAR          = 13,
    COMMAND_SET_SLOTDURATION      = 14,
    COMMAND_SET_6PRESPONSE_STATUS = 15,
-   COMMAND_MAX                   = 16,
+   COMMAND_SET_MAXACTIVESLOTS    = 16,
+   COMMAND_SET_TIMESLOT_TEMPLATE = 17,
+   COMMAND_SET_6P_ADD_BURST      = 18,
+   COMMAND_MAX                   = 19,
 };
 
 //=========================== module variables ================================
@@ -84,6 +87,7 @@ typedef struct {
    // admin
    uint8_t    mode;
    uint8_t    debugPrintCounter;
+   uint8_t    debugPrintTaskPrio;
    // input
    uint8_t    reqFrame[1+1+2+1]; // flag (1B), command (2B), CRC (2B), flag (1B)
    uint8_t    reqFrameIdx;
@@ -122,6 +126,8 @@ void    openserial_startInput(void);
 void    openserial_startOutput(void);
 void    openserial_stop(void);
 bool    debugPrint_outBufferIndexes(void);
+bool    debugPrint_taskStats(void);
+bool    debugPrint_timerStats(void);
 void    openserial_echo(uint8_t* but, uint8_t bufLen);
 
 // interrupt handlers
@@ -4,6 +4,27 @@
 This driver uses a single hardware timer, which it virtualizes to support
 at most MAX_NUM_TIMERS timers.
 
+Each running timer is keyed on its absolute expiry time (its deadline), counted
+in ticks from the same time base as the compare events of the hardware timer.
+Running timers are kept in a binary min-heap, so the next timer to expire is
+always at the root: starting, stopping and expiring a timer cost O(log n)
+rather than a walk over all MAX_NUM_TIMERS entries. Idle timers are chained in
+a free list, so that starting a timer does not have to search for a free entry.
+The list is FIFO: a timer which was just stopped is the last one to be handed
+out again, as its owner may still restart it.
+
+A timer started with some slack (see opentimers_startWithSlack()) may fire up
+to that many ticks after its deadline. The compare event is then scheduled as
+late as every timer's slack allows, so that timers whose deadlines fall within
+each other's slack fire together, in a single wakeup.
+
+The id returned by opentimers_start() is the index of the timer in
+opentimers_vars.timersBuf and never changes while the timer is in use; only the
+(internal) heap position of a timer moves.
+
+The heap and the idle list are also modified by the bsp_timer interrupt, so the
+public functions only touch them with interrupts disabled.
+
 \author Xavi Vilajosana <xvilajosana@eecs.berkeley.edu>, March 2012.
  */
 
@@ -14,6 +35,9 @@ at most MAX_NUM_TIMERS timers.
 
 //=========================== define ==========================================
 
+/// wrap-around safe "deadline a is before deadline b"
+#define OPENTIMERS_IS_BEFORE(a,b) ((int32_t)((uint32_t)(a)-(uint32_t)(b))<0)
+
 //=========================== variables =======================================
 
 opentimers_vars_t opentimers_vars;
@@ -21,7 +45,20 @@ opentimers_vars_t opentimers_vars;
 
 //=========================== prototypes ======================================
 
-void opentimers_timer_callback(void);
+void     opentimers_timer_callback(void);
+uint32_t opentimers_toTicks(uint32_t duration, time_type_t timetype);
+void     opentimers_arm(opentimer_id_t id, uint32_t ticks);
+void     opentimers_release(opentimer_id_t id);
+void     opentimers_heapInsert(opentimer_id_t id);
+void     opentimers_heapRemove(opentimer_id_t id);
+void     opentimers_heapSiftUp(uint8_t pos);
+void     opentimers_heapSiftDown(uint8_t pos);
+uint32_t opentimers_heapFireTime(uint8_t pos, uint32_t fireTime);
+uint32_t opentimers_fireTime(void);
+PORT_TIMER_WIDTH opentimers_nextTimeout(void);
+void     opentimers_scheduleCompare(PORT_TIMER_WIDTH ticks);
+void     opentimers_reschedule(void);
+void     opentimers_expire(void);
 
 //=========================== public ==========================================
 
@@ -34,15 +71,29 @@ void opentimers_init(){
    uint8_t i;
 
    // initialize local variables
-   opentimers_vars.running=FALSE;
+   opentimers_vars.running        = FALSE;
+   opentimers_vars.isDispatching  = FALSE;
+   opentimers_vars.heapSize       = 0;
+   opentimers_vars.currentTime    = 0;
+   opentimers_vars.currentTimeout = 0;
+   opentimers_vars.lastCompareValue = 0;
+   memset(&opentimers_vars.stats,0,sizeof(opentimers_stats_t));
    for (i=0;i<MAX_NUM_TIMERS;i++) {
       opentimers_vars.timersBuf[i].period_ticks       = 0;
-      opentimers_vars.timersBuf[i].ticks_remaining    = 0;
+      opentimers_vars.timersBuf[i].slack_ticks        = 0;
+      opentimers_vars.timersBuf[i].deadline           = 0;
       opentimers_vars.timersBuf[i].type               = TIMER_ONESHOT;
       opentimers_vars.timersBuf[i].isrunning          = FALSE;
       opentimers_vars.timersBuf[i].callback           = NULL;
-      opentimers_vars.timersBuf[i].hasExpired         = FALSE;
+      // chain all timers in the idle list, lowest id first
+      if (i+1<MAX_NUM_TIMERS) {
+         opentimers_vars.timersBuf[i].index           = i+1;
+      } else {
+         opentimers_vars.timersBuf[i].index           = TOO_MANY_TIMERS_ERROR;
+      }
    }
+   opentimers_vars.idleHead       = 0;
+   opentimers_vars.idleTail       = MAX_NUM_TIMERS-1;
 
    // set callback for bsp_timers module
    bsp_timer_set_callback(opentimers_timer_callback);
@@ -52,10 +103,10 @@ void opentimers_init(){
 \brief Start a timer.
 
 The timer works as follows:
-- currentTimeout is the number of ticks before the next timer expires.
-- if a new timer is inserted, we check that it is not earlier than the soonest
-- if it is earliest, replace it
-- if not, insert it in the list
+- the first idle timer is taken from the idle list
+- its deadline is set <tt>duration</tt> after the last compare event, and it
+  is inserted in the heap
+- if it is now the earliest timer, the hardware timer is re-scheduled
 
 \param duration Number milli-seconds after which the timer will fire.
 \param type     Type of timer:
@@ -71,293 +122,583 @@ The timer works as follows:
 \returns TOO_MANY_TIMERS_ERROR if the timer could NOT be started.
  */
 opentimer_id_t opentimers_start(uint32_t duration, timer_type_t type, time_type_t timetype, opentimers_cbt callback) {
+   return opentimers_startWithSlack(duration,0,type,timetype,callback);
+}
 
-   uint8_t  id;
+/**
+\brief Start a timer which tolerates firing late.
 
-   // find an unused timer
-   for (id=0; id<MAX_NUM_TIMERS && opentimers_vars.timersBuf[id].isrunning==TRUE; id++);
+Same as opentimers_start(), but the timer may fire up to <tt>slack</tt> after
+it elapses, so that it can share a wakeup with other timers. A periodic timer
+keeps its period: every deadline is one period after the previous one, not
+after the time it actually fired.
 
-   if (id<MAX_NUM_TIMERS) {
-      // we found an unused timer
+\param duration Number milli-seconds after which the timer will fire.
+\param slack    How late the timer may fire, in the same units as
+   <tt>duration</tt>.
+\param type     Type of timer (see opentimers_start()).
+\param timetype Units of the <tt>duration</tt> and the <tt>slack</tt>.
+\param callback The function to call when the timer fires.
 
-      // register the timer
-      if (timetype==TIME_MS) {
-         opentimers_vars.timersBuf[id].period_ticks      = duration*PORT_TICS_PER_MS;
-         opentimers_vars.timersBuf[id].wraps_remaining   = (duration*PORT_TICS_PER_MS/MAX_TICKS_IN_SINGLE_CLOCK);//65535=maxValue of uint16_t
-      } else if (timetype==TIME_TICS) {
-         opentimers_vars.timersBuf[id].period_ticks      = duration;
-         opentimers_vars.timersBuf[id].wraps_remaining   = (duration/MAX_TICKS_IN_SINGLE_CLOCK);//65535=maxValue of uint16_t  
-      } else {
-         while (1); //error
-      }
-      //if the number of ticks falls below a 16bit value, use it, otherwise set to max 16bit value
-      if(opentimers_vars.timersBuf[id].wraps_remaining==0){
-         if (timetype==TIME_MS){ 
-            opentimers_vars.timersBuf[id].ticks_remaining   = duration*PORT_TICS_PER_MS;
-         } else if (timetype==TIME_TICS) {
-            opentimers_vars.timersBuf[id].ticks_remaining   = duration;
-         } else {
-            // this should never happpen!
-   
-            // we can not print from within the drivers. Instead:
-            // blink the error LED
-            leds_error_blink();
-            // reset the board
-            board_reset();
-         }
-      }else{
-         opentimers_vars.timersBuf[id].ticks_remaining = MAX_TICKS_IN_SINGLE_CLOCK;
-      }                                                   
-      opentimers_vars.timersBuf[id].type              = type;
-      opentimers_vars.timersBuf[id].isrunning         = TRUE;
-      opentimers_vars.timersBuf[id].callback          = callback;
-      opentimers_vars.timersBuf[id].hasExpired        = FALSE;
-
-      // re-schedule the running timer, if needed
-      if (
-            (opentimers_vars.running==FALSE)
-            ||
-            (opentimers_vars.timersBuf[id].ticks_remaining < opentimers_vars.currentTimeout)
-      ) {  
-         opentimers_vars.currentTimeout            = opentimers_vars.timersBuf[id].ticks_remaining;
-         if (opentimers_vars.running==FALSE) {
-            bsp_timer_reset();
-         }
-         bsp_timer_scheduleIn(opentimers_vars.timersBuf[id].ticks_remaining);
-      }
+\returns The id of the timer, or TOO_MANY_TIMERS_ERROR.
+ */
+opentimer_id_t opentimers_startWithSlack(uint32_t duration, uint32_t slack, timer_type_t type, time_type_t timetype, opentimers_cbt callback) {
 
-      opentimers_vars.running                         = TRUE;
+   opentimer_id_t id;
+   INTERRUPT_DECLARATION();
 
-   } else {
+   DISABLE_INTERRUPTS();
+
+   // take an unused timer
+   id = opentimers_vars.idleHead;
+   if (id==TOO_MANY_TIMERS_ERROR) {
+      ENABLE_INTERRUPTS();
       return TOO_MANY_TIMERS_ERROR;
    }
+   opentimers_vars.idleHead                     = opentimers_vars.timersBuf[id].index;
+   if (opentimers_vars.idleHead==TOO_MANY_TIMERS_ERROR) {
+      opentimers_vars.idleTail                  = TOO_MANY_TIMERS_ERROR;
+   }
+
+   // register the timer
+   opentimers_vars.timersBuf[id].period_ticks   = opentimers_toTicks(duration,timetype);
+   opentimers_vars.timersBuf[id].slack_ticks    = opentimers_toTicks(slack,timetype);
+   opentimers_vars.timersBuf[id].type           = type;
+   opentimers_vars.timersBuf[id].callback       = callback;
+
+   opentimers_arm(id,opentimers_vars.timersBuf[id].period_ticks);
+
+   ENABLE_INTERRUPTS();
 
    return id;
 }
 
 /**
 \brief Replace the period of a running timer.
+
+A running timer is re-armed to expire <tt>newDuration</tt> after the last
+compare event. The new period also applies to the next reload of a periodic
+timer, including when called from the timer's own callback.
  */
 void  opentimers_setPeriod(opentimer_id_t id,time_type_t timetype,uint32_t newDuration) {
+   INTERRUPT_DECLARATION();
+
+   DISABLE_INTERRUPTS();
+
+   opentimers_vars.timersBuf[id].period_ticks   = opentimers_toTicks(newDuration,timetype);
+
+   if (
+         opentimers_vars.timersBuf[id].isrunning==TRUE &&
+         opentimers_vars.timersBuf[id].index!=OPENTIMERS_NOT_QUEUED
+      ) {
+      opentimers_heapRemove(id);
+      opentimers_arm(id,opentimers_vars.timersBuf[id].period_ticks);
+   }
+
+   ENABLE_INTERRUPTS();
+}
+
+/**
+\brief Stop a running timer.
+
+Sets the timer to "not running". the system recovers even if this was the next
+timer to expire.
+ */
+void opentimers_stop(opentimer_id_t id) {
+   INTERRUPT_DECLARATION();
+
+   DISABLE_INTERRUPTS();
+   if (opentimers_vars.timersBuf[id].isrunning==FALSE) {
+      ENABLE_INTERRUPTS();
+      return;
+   }
+   if (opentimers_vars.timersBuf[id].index!=OPENTIMERS_NOT_QUEUED) {
+      opentimers_heapRemove(id);
+   }
+   opentimers_release(id);
+   ENABLE_INTERRUPTS();
+}
+
+/**
+\brief Restart a stop timer.
+
+Sets the timer to " running", with a full period (see opentimers_setPeriod()).
+ */
+void opentimers_restart(opentimer_id_t id) {
+   opentimer_id_t  prev;
+   opentimer_id_t* pId;
+   INTERRUPT_DECLARATION();
+
+   DISABLE_INTERRUPTS();
+   if (opentimers_vars.timersBuf[id].isrunning==TRUE) {
+      ENABLE_INTERRUPTS();
+      return;
+   }
+
+   // unlink from the idle list
+   prev = TOO_MANY_TIMERS_ERROR;
+   pId  = &opentimers_vars.idleHead;
+   while (*pId!=TOO_MANY_TIMERS_ERROR && *pId!=id) {
+      prev = *pId;
+      pId  = &opentimers_vars.timersBuf[*pId].index;
+   }
+   if (*pId==id) {
+      *pId = opentimers_vars.timersBuf[id].index;
+      if (opentimers_vars.idleTail==id) {
+         opentimers_vars.idleTail = prev;
+      }
+   }
+
+   opentimers_arm(id,opentimers_vars.timersBuf[id].period_ticks);
+   ENABLE_INTERRUPTS();
+}
+
+/**
+\brief Retrieve the statistics of this module.
+ */
+void opentimers_getStats(opentimers_stats_t* stats) {
+   INTERRUPT_DECLARATION();
+
+   DISABLE_INTERRUPTS();
+   memcpy(stats,&opentimers_vars.stats,sizeof(opentimers_stats_t));
+   ENABLE_INTERRUPTS();
+}
+
+//=========================== private =========================================
+
+/**
+\brief Convert a duration into clock ticks.
+ */
+uint32_t opentimers_toTicks(uint32_t duration, time_type_t timetype) {
    if        (timetype==TIME_MS) {
-      opentimers_vars.timersBuf[id].period_ticks      = newDuration*PORT_TICS_PER_MS;
-      opentimers_vars.timersBuf[id].wraps_remaining   = (newDuration*PORT_TICS_PER_MS/MAX_TICKS_IN_SINGLE_CLOCK);//65535=maxValue of uint16_t
+      return duration*PORT_TICS_PER_MS;
    } else if (timetype==TIME_TICS) {
-      opentimers_vars.timersBuf[id].period_ticks      = newDuration;
-      opentimers_vars.timersBuf[id].wraps_remaining   = (newDuration/MAX_TICKS_IN_SINGLE_CLOCK);//65535=maxValue of uint16_t
+      return duration;
    } else {
       // this should never happpen!
-      
+
       // we can not print from within the drivers. Instead:
       // blink the error LED
       leds_error_blink();
       // reset the board
       board_reset();
+      return 0;
    }
-   if(opentimers_vars.timersBuf[id].wraps_remaining==0) {
-      if        (timetype==TIME_MS){
-         opentimers_vars.timersBuf[id].ticks_remaining   = newDuration*PORT_TICS_PER_MS;
-      } else if (timetype==TIME_TICS){
-         opentimers_vars.timersBuf[id].ticks_remaining   = newDuration;
-      }
+}
+
+/**
+\brief Mark a timer as running and insert it in the heap.
+
+\param id    The timer.
+\param ticks Number of ticks, relative to the last compare event, after which
+   the timer expires.
+ */
+void opentimers_arm(opentimer_id_t id, uint32_t ticks) {
+   opentimers_vars.timersBuf[id].deadline       = opentimers_vars.currentTime+ticks;
+   opentimers_vars.timersBuf[id].isrunning      = TRUE;
+   opentimers_heapInsert(id);
+
+   // re-schedule the running timer, if needed
+   if (opentimers_vars.isDispatching==FALSE) {
+      opentimers_reschedule();
+   }
+}
+
+/**
+\brief Mark a timer as not running, and append it to the idle list.
+ */
+void opentimers_release(opentimer_id_t id) {
+   opentimers_vars.timersBuf[id].isrunning      = FALSE;
+   opentimers_vars.timersBuf[id].index          = TOO_MANY_TIMERS_ERROR;
+   if (opentimers_vars.idleTail==TOO_MANY_TIMERS_ERROR) {
+      opentimers_vars.idleHead                  = id;
    } else {
-      opentimers_vars.timersBuf[id].ticks_remaining = MAX_TICKS_IN_SINGLE_CLOCK;
+      opentimers_vars.timersBuf[opentimers_vars.idleTail].index = id;
    }
+   opentimers_vars.idleTail                     = id;
+}
+
+void opentimers_heapInsert(opentimer_id_t id) {
+   uint8_t pos;
+
+   pos = opentimers_vars.heapSize++;
+   opentimers_vars.heap[pos]                    = id;
+   opentimers_vars.timersBuf[id].index          = pos;
+   opentimers_heapSiftUp(pos);
+}
+
+void opentimers_heapRemove(opentimer_id_t id) {
+   uint8_t        pos;
+   opentimer_id_t last;
+
+   pos  = opentimers_vars.timersBuf[id].index;
+   last = opentimers_vars.heap[--opentimers_vars.heapSize];
+   opentimers_vars.timersBuf[id].index          = OPENTIMERS_NOT_QUEUED;
+
+   if (last!=id) {
+      // move the last timer into the hole, then restore the heap order
+      opentimers_vars.heap[pos]                 = last;
+      opentimers_vars.timersBuf[last].index     = pos;
+      opentimers_heapSiftDown(pos);
+      opentimers_heapSiftUp(opentimers_vars.timersBuf[last].index);
+   }
+}
+
+void opentimers_heapSiftUp(uint8_t pos) {
+   opentimer_id_t id;
+   opentimer_id_t parentId;
+
+   id = opentimers_vars.heap[pos];
+   while (pos>0) {
+      parentId = opentimers_vars.heap[(pos-1)/2];
+      if (
+            !OPENTIMERS_IS_BEFORE(
+               opentimers_vars.timersBuf[id].deadline,
+               opentimers_vars.timersBuf[parentId].deadline
+            )
+         ) {
+         break;
+      }
+      opentimers_vars.heap[pos]                 = parentId;
+      opentimers_vars.timersBuf[parentId].index = pos;
+      pos = (pos-1)/2;
+   }
+   opentimers_vars.heap[pos]                    = id;
+   opentimers_vars.timersBuf[id].index          = pos;
+}
+
+void opentimers_heapSiftDown(uint8_t pos) {
+   opentimer_id_t id;
+   opentimer_id_t childId;
+   uint16_t       child;
+
+   id = opentimers_vars.heap[pos];
+   while (1) {
+      child = 2*(uint16_t)pos+1;
+      if (child>=opentimers_vars.heapSize) {
+         break;
+      }
+      // pick the earlier of both children
+      if (
+            child+1<opentimers_vars.heapSize &&
+            OPENTIMERS_IS_BEFORE(
+               opentimers_vars.timersBuf[opentimers_vars.heap[child+1]].deadline,
+               opentimers_vars.timersBuf[opentimers_vars.heap[child]].deadline
+            )
+         ) {
+         child++;
+      }
+      childId = opentimers_vars.heap[child];
+      if (
+            !OPENTIMERS_IS_BEFORE(
+               opentimers_vars.timersBuf[childId].deadline,
+               opentimers_vars.timersBuf[id].deadline
+            )
+         ) {
+         break;
+      }
+      opentimers_vars.heap[pos]                 = childId;
+      opentimers_vars.timersBuf[childId].index  = pos;
+      pos = (uint8_t)child;
+   }
+   opentimers_vars.heap[pos]                    = id;
+   opentimers_vars.timersBuf[id].index          = pos;
 }
 
 /**
-\brief Stop a running timer.
+\brief Find the latest time the next compare event can happen at.
 
-Sets the timer to "not running". the system recovers even if this was the next
-timer to expire.
+That is the earliest <tt>deadline+slack</tt> among the timers which elapse
+by then. Timers elapsing later do not constrain it, and neither do their
+children in the heap, which elapse even later.
+
+\param pos      Root of the sub-heap to search.
+\param fireTime Latest fire time found so far.
+
+\returns The latest fire time allowed by this sub-heap.
  */
-void opentimers_stop(opentimer_id_t id) {
-   opentimers_vars.timersBuf[id].isrunning=FALSE;
+uint32_t opentimers_heapFireTime(uint8_t pos, uint32_t fireTime) {
+   opentimers_t* timer;
+   uint16_t      child;
+
+   timer = &opentimers_vars.timersBuf[opentimers_vars.heap[pos]];
+   if (OPENTIMERS_IS_BEFORE(fireTime,timer->deadline)) {
+      return fireTime;
+   }
+   if (OPENTIMERS_IS_BEFORE(timer->deadline+timer->slack_ticks,fireTime)) {
+      fireTime = timer->deadline+timer->slack_ticks;
+   }
+
+   child = 2*(uint16_t)pos+1;
+   if (child<opentimers_vars.heapSize) {
+      fireTime = opentimers_heapFireTime((uint8_t)child,fireTime);
+   }
+   if (child+1<opentimers_vars.heapSize) {
+      fireTime = opentimers_heapFireTime((uint8_t)(child+1),fireTime);
+   }
+   return fireTime;
 }
 
 /**
-\brief Restart a stop timer.
+\brief Time at which opentimers next needs the CPU.
+
+\pre The heap is not empty.
 
-Sets the timer to " running".
+\returns The latest time the next compare event can happen at, in ticks.
  */
-void opentimers_restart(opentimer_id_t id) {
-   opentimers_vars.timersBuf[id].isrunning=TRUE;
+uint32_t opentimers_fireTime() {
+   opentimers_t* timer;
+
+   timer = &opentimers_vars.timersBuf[opentimers_vars.heap[0]];
+   return opentimers_heapFireTime(0,timer->deadline+timer->slack_ticks);
 }
 
+/**
+\brief Number of ticks between the last compare event and the next one.
+
+\pre The heap is not empty.
+ */
+PORT_TIMER_WIDTH opentimers_nextTimeout() {
+   uint32_t      fireTime;
+   uint32_t      ticks;
 
-//=========================== private =========================================
+   fireTime = opentimers_fireTime();
+
+   if (OPENTIMERS_IS_BEFORE(fireTime,opentimers_vars.currentTime)) {
+      return 0;
+   }
+   ticks = fireTime-opentimers_vars.currentTime;
+   if (ticks>MAX_TICKS_IN_SINGLE_CLOCK) {
+      ticks = MAX_TICKS_IN_SINGLE_CLOCK;
+   }
+   return (PORT_TIMER_WIDTH)ticks;
+}
 
 /**
-\brief Function called when the hardware timer expires.
+\brief Have the hardware timer fire <tt>ticks</tt> after the last compare event.
 
-Executed in interrupt mode.
+bsp_timer_scheduleIn() counts from the compare value it was last given, which
+is the pending compare event (if any), not the last one which happened. The
+delay passed to it is therefore relative to the pending compare event, and
+wraps around when the new compare event is earlier: the bsp then either sets
+that earlier compare value, or fires right away if it is already past.
 
-This function maps the expiration event to possibly multiple timers, calls the
-corresponding callback(s), and restarts the hardware timer with the next timer
-to expire.
+\param ticks Number of ticks after the last compare event.
  */
-void opentimers_timer_callback() {
-   
-   opentimer_id_t   id;
-   PORT_TIMER_WIDTH min_timeout;
-   bool             found;
-    
-   // step 1. Identify expired timers
-   for(id=0; id<MAX_NUM_TIMERS; id++) {
-      if (opentimers_vars.timersBuf[id].isrunning==TRUE) {
-
-         if(opentimers_vars.currentTimeout >= opentimers_vars.timersBuf[id].ticks_remaining) {
-            // this timer has expired
-            //check to see if we have completed the whole timer, or we're just wrapping around the max 16bit value
-            if(opentimers_vars.timersBuf[id].wraps_remaining == 0){
-               // declare as so
-               opentimers_vars.timersBuf[id].hasExpired  = TRUE;
-            }else{
-               opentimers_vars.timersBuf[id].wraps_remaining--;
-               if(opentimers_vars.timersBuf[id].wraps_remaining == 0){
-                  //if we have fully wrapped around, then set the remainring ticks to the modulus of the total ticks and the max clock value
-                  opentimers_vars.timersBuf[id].ticks_remaining = (opentimers_vars.timersBuf[id].period_ticks) % MAX_TICKS_IN_SINGLE_CLOCK;
-               }else{
-                  opentimers_vars.timersBuf[id].ticks_remaining = MAX_TICKS_IN_SINGLE_CLOCK;
-               }
-            }
-         } else {
-            // this timer is not expired
-
-            // update its counter
-            opentimers_vars.timersBuf[id].ticks_remaining -= opentimers_vars.currentTimeout;
-         }   
+void opentimers_scheduleCompare(PORT_TIMER_WIDTH ticks) {
+   bsp_timer_scheduleIn((PORT_TIMER_WIDTH)(ticks-opentimers_vars.currentTimeout));
+   opentimers_vars.currentTimeout               = ticks;
+   opentimers_vars.stats.numArms++;
+}
+
+/**
+\brief Have the hardware timer fire for the earliest timer, if it is earlier
+   than the currently scheduled compare event.
+ */
+void opentimers_reschedule() {
+   PORT_TIMER_WIDTH ticks;
+
+   if (opentimers_vars.heapSize==0) {
+      // the pending compare event (if any) finds no timer and stops
+      return;
+   }
+
+   if (opentimers_vars.running==FALSE) {
+      // restart counting from now
+      bsp_timer_reset();
+      opentimers_vars.currentTimeout            = 0;
+      opentimers_vars.lastCompareValue          = bsp_timer_get_currentValue();
+      opentimers_scheduleCompare(opentimers_nextTimeout());
+   } else {
+      ticks = opentimers_nextTimeout();
+      if (ticks < opentimers_vars.currentTimeout) {
+         opentimers_scheduleCompare(ticks);
+      }
+   }
+
+   opentimers_vars.running                      = TRUE;
+}
+
+/**
+\brief Call the callbacks of the timers which expired by
+   <tt>opentimers_vars.currentTime</tt>, and reload them.
+ */
+void opentimers_expire() {
+   opentimer_id_t expired[MAX_NUM_TIMERS];
+   uint8_t        numExpired;
+   uint8_t        i;
+   opentimer_id_t id;
+   opentimers_t*  timer;
+   uint8_t        numSlack;
+   uint32_t       slackDeadline;
+   bool           onTime;
+   bool           overdue;
+
+   opentimers_vars.isDispatching = TRUE;
+
+   // step 1. pop expired timers, earliest first. A timer which is longer than
+   // what the hardware timer can count is simply not expired yet.
+   numExpired = 0;
+   numSlack   = 0;
+   onTime     = FALSE;
+   overdue    = FALSE;
+   slackDeadline = 0;
+   while (
+         opentimers_vars.heapSize>0 &&
+         !OPENTIMERS_IS_BEFORE(
+            opentimers_vars.currentTime,
+            opentimers_vars.timersBuf[opentimers_vars.heap[0]].deadline
+         )
+      ) {
+      id    = opentimers_vars.heap[0];
+      timer = &opentimers_vars.timersBuf[id];
+      if (timer->deadline==opentimers_vars.currentTime) {
+         onTime = TRUE;
+      } else if (OPENTIMERS_IS_BEFORE(timer->deadline+timer->slack_ticks,opentimers_vars.currentTime)) {
+         // late beyond its slack, e.g. after sleeping
+         overdue = TRUE;
+      } else if (numSlack==0 || timer->deadline!=slackDeadline) {
+         // a deadline reached within its slack, which would otherwise have
+         // needed a compare event of its own
+         slackDeadline = timer->deadline;
+         numSlack++;
       }
+      opentimers_heapRemove(id);
+      expired[numExpired++] = id;
+   }
+   // the compare event was scheduled for one of these deadlines, unless a
+   // timer was on time, and slack played no part if it was late anyway
+   if (overdue==FALSE && numSlack>0) {
+      opentimers_vars.stats.numArmsAvoided += (onTime==TRUE)?numSlack:numSlack-1;
    }
 
    // step 2. call callbacks of expired timers
-   for(id=0; id<MAX_NUM_TIMERS; id++) {
-      if (opentimers_vars.timersBuf[id].hasExpired==TRUE){
-
-         // call the callback
-         opentimers_vars.timersBuf[id].callback(id);
-         opentimers_vars.timersBuf[id].hasExpired     = FALSE;
-
-         // reload the timer, if applicable
-         if (opentimers_vars.timersBuf[id].type==TIMER_PERIODIC) {
-            opentimers_vars.timersBuf[id].wraps_remaining   = (opentimers_vars.timersBuf[id].period_ticks/MAX_TICKS_IN_SINGLE_CLOCK);//65535=maxValue of uint16_t
-            //if the number of ticks falls below a 16bit value, use it, otherwise set to max 16bit value
-            if(opentimers_vars.timersBuf[id].wraps_remaining==0)                                                
-               opentimers_vars.timersBuf[id].ticks_remaining   = opentimers_vars.timersBuf[id].period_ticks;
-            else
-               opentimers_vars.timersBuf[id].ticks_remaining = MAX_TICKS_IN_SINGLE_CLOCK;
-
-         } else {
-            opentimers_vars.timersBuf[id].isrunning   = FALSE;
-         }
+   for (i=0;i<numExpired;i++) {
+      id = expired[i];
+
+      // skip timers stopped or re-armed by an earlier callback
+      if (
+            opentimers_vars.timersBuf[id].isrunning==FALSE ||
+            opentimers_vars.timersBuf[id].index!=OPENTIMERS_NOT_QUEUED
+         ) {
+         continue;
       }
 
-   }
+      // call the callback
+      opentimers_vars.timersBuf[id].callback(id);
+      opentimers_vars.stats.numExpiries++;
 
-   // step 3. find the minimum remaining timeout among running timers
-   found = FALSE;
-   for(id=0;id<MAX_NUM_TIMERS;id++) {
       if (
-            opentimers_vars.timersBuf[id].isrunning==TRUE &&
-            (
-                  found==FALSE
-                  ||
-                  opentimers_vars.timersBuf[id].ticks_remaining < min_timeout
-            )
-      ) {
-         min_timeout    = opentimers_vars.timersBuf[id].ticks_remaining;
-         found          = TRUE;
+            opentimers_vars.timersBuf[id].isrunning==FALSE ||
+            opentimers_vars.timersBuf[id].index!=OPENTIMERS_NOT_QUEUED
+         ) {
+         // stopped or re-armed by its own callback
+         continue;
+      }
+
+      // reload the timer, if applicable
+      if (opentimers_vars.timersBuf[id].type==TIMER_PERIODIC) {
+         // relative to its previous deadline, so that it does not drift
+         opentimers_vars.timersBuf[id].deadline += opentimers_vars.timersBuf[id].period_ticks;
+         opentimers_heapInsert(id);
+      } else {
+         opentimers_release(id);
       }
    }
 
-   // step 4. schedule next timeout
-   if (found==TRUE) {
+   opentimers_vars.isDispatching = FALSE;
+}
+
+/**
+\brief Function called when the hardware timer expires.
+
+Executed in interrupt mode.
+
+This function maps the expiration event to possibly multiple timers, calls the
+corresponding callback(s), and restarts the hardware timer with the next timer
+to expire.
+ */
+void opentimers_timer_callback() {
+   // the compare event which just happened is the new time base
+   opentimers_vars.currentTime      += opentimers_vars.currentTimeout;
+   opentimers_vars.lastCompareValue += opentimers_vars.currentTimeout;
+   opentimers_vars.currentTimeout    = 0;
+
+   opentimers_expire();
+
+   // schedule next timeout
+   if (opentimers_vars.heapSize>0) {
       // at least one timer pending
-      opentimers_vars.currentTimeout = min_timeout;
-      bsp_timer_scheduleIn(opentimers_vars.currentTimeout);
+      opentimers_scheduleCompare(opentimers_nextTimeout());
    } else {
       // no more timers pending
       opentimers_vars.running = FALSE;
    }
 }
 
-void opentimers_sleepTimeCompesation(uint16_t sleepTime)
-{
-   opentimer_id_t   id;
-   PORT_TIMER_WIDTH min_timeout;
-   bool             found;
-   
-   //step 1. reCount the ticks_remain after waking up from sleep
-   for(id=0; id<MAX_NUM_TIMERS; id++)
-   {
-     if (opentimers_vars.timersBuf[id].isrunning==TRUE) 
-     {
-       if(opentimers_vars.timersBuf[id].ticks_remaining > sleepTime)
-       {
-         opentimers_vars.timersBuf[id].ticks_remaining -= sleepTime;
-       }
-       else
-       {
-         if(opentimers_vars.timersBuf[id].wraps_remaining > 0)
-         {
-           opentimers_vars.timersBuf[id].wraps_remaining--;
-           opentimers_vars.timersBuf[id].ticks_remaining += (MAX_TICKS_IN_SINGLE_CLOCK - sleepTime);
-         }
-         else
-         {
-           opentimers_vars.timersBuf[id].hasExpired  = TRUE;
-         }
-       }
-     }
+/**
+\brief Number of ticks before opentimers needs the CPU.
+
+Used by boards which stop the bsp_timer when sleeping, to decide whether they
+can sleep until their next wakeup source.
+
+\returns The number of ticks, from now, before the next timer fires (taking
+   its slack into account), 0 if it is overdue, or OPENTIMERS_NO_TIMEOUT if no
+   timer is running.
+ */
+uint32_t opentimers_getTimeToNextTimeout() {
+   uint32_t         ticks;
+   PORT_TIMER_WIDTH elapsed;
+   INTERRUPT_DECLARATION();
+
+   DISABLE_INTERRUPTS();
+   if (opentimers_vars.heapSize==0) {
+      ENABLE_INTERRUPTS();
+      return OPENTIMERS_NO_TIMEOUT;
    }
-   
-   // step 2. call callbacks of expired timers
-   for(id=0; id<MAX_NUM_TIMERS; id++) {
-      if (opentimers_vars.timersBuf[id].hasExpired==TRUE){
-
-         // call the callback
-         opentimers_vars.timersBuf[id].callback(id);
-         opentimers_vars.timersBuf[id].hasExpired     = FALSE;
-
-         // reload the timer, if applicable
-         if (opentimers_vars.timersBuf[id].type==TIMER_PERIODIC) {
-            opentimers_vars.timersBuf[id].wraps_remaining   = (opentimers_vars.timersBuf[id].period_ticks/MAX_TICKS_IN_SINGLE_CLOCK);//65535=maxValue of uint16_t
-            //if the number of ticks falls below a 16bit value, use it, otherwise set to max 16bit value
-            if(opentimers_vars.timersBuf[id].wraps_remaining==0)                                                
-               opentimers_vars.timersBuf[id].ticks_remaining   = opentimers_vars.timersBuf[id].period_ticks;
-            else
-               opentimers_vars.timersBuf[id].ticks_remaining = MAX_TICKS_IN_SINGLE_CLOCK;
-
-         } else {
-            opentimers_vars.timersBuf[id].isrunning   = FALSE;
-         }
-      }
+   ticks   = opentimers_fireTime()-opentimers_vars.currentTime;
+   elapsed = (PORT_TIMER_WIDTH)(bsp_timer_get_currentValue()-opentimers_vars.lastCompareValue);
+   ENABLE_INTERRUPTS();
 
+   if ((int32_t)ticks<=(int32_t)elapsed) {
+      return 0;
    }
-   
-   // step 3. find the minimum remaining timeout among running timers
-   found = FALSE;
-   for(id=0;id<MAX_NUM_TIMERS;id++) {
-      if (
-            opentimers_vars.timersBuf[id].isrunning==TRUE &&
-            (
-                  found==FALSE
-                  ||
-                  opentimers_vars.timersBuf[id].ticks_remaining < min_timeout
-            )
-      ) {
-         min_timeout    = opentimers_vars.timersBuf[id].ticks_remaining;
-         found          = TRUE;
-      }
+   return ticks-elapsed;
+}
+
+/**
+\brief Correct the running timers after the bsp_timer was stopped.
+
+To be called by boards whose bsp_timer does not count in their deepest sleep
+mode, when waking up. The pending compare event keeps its place relative to
+the bsp_timer counter, so it moves <tt>sleepTime</tt> ticks later relative to
+the timers. The timers which expired while sleeping are called right away, and
+the compare event is moved earlier if needed. This is done with interrupts
+disabled, as from the bsp_timer interrupt.
+
+\param sleepTime Number of ticks the bsp_timer was stopped for.
+ */
+void opentimers_sleepTimeCompesation(uint32_t sleepTime)
+{
+   PORT_TIMER_WIDTH ticks;
+   INTERRUPT_DECLARATION();
+
+   DISABLE_INTERRUPTS();
+   if (opentimers_vars.running==FALSE) {
+      ENABLE_INTERRUPTS();
+      return;
    }
 
-   // step 4. schedule next timeout
-   if (found==TRUE) {
-      // at least one timer pending
-      opentimers_vars.currentTimeout = min_timeout;
-      bsp_timer_scheduleIn(opentimers_vars.currentTimeout);
-   } else {
-      // no more timers pending
-      opentimers_vars.running = FALSE;
+   // reCount the deadlines after waking up from sleep
+   opentimers_vars.currentTime += sleepTime;
+
+   opentimers_expire();
+
+   if (opentimers_vars.heapSize>0) {
+      ticks = opentimers_nextTimeout();
+      if (ticks!=opentimers_vars.currentTimeout) {
+         opentimers_scheduleCompare(ticks);
+      }
    }
+   ENABLE_INTERRUPTS();
 }
@@ -18,13 +18,21 @@
 
 //=========================== define ==========================================
 
-/// Maximum number of timers that can run concurrently
-#define MAX_NUM_TIMERS            10
+/// Maximum number of timers that can run concurrently (at most 254)
+#ifndef MAX_NUM_TIMERS
+#define MAX_NUM_TIMERS            64
+#endif
 
 #define MAX_TICKS_IN_SINGLE_CLOCK ((PORT_TIMER_WIDTH)0xFFFFFFFF)
 
 #define TOO_MANY_TIMERS_ERROR     255
 
+/// value of opentimers_t.index for a running timer which is not in the heap
+#define OPENTIMERS_NOT_QUEUED     0xff
+
+/// returned by opentimers_getTimeToNextTimeout() when no timer is running
+#define OPENTIMERS_NO_TIMEOUT     0xffffffff
+
 #define opentimer_id_t uint8_t
 
 typedef void (*opentimers_cbt)(opentimer_id_t id);
@@ -44,21 +52,37 @@ typedef enum {
 
 typedef struct {
    uint32_t             period_ticks;       // total number of clock ticks
-   PORT_TIMER_WIDTH     ticks_remaining;    // ticks remaining before elapses
-   uint16_t             wraps_remaining;    // the clock register is 16 bit, and can't count beyond 32k...
-                                            // so period_ticks = wraps_remaining*(32k or uint16_t)
+   uint32_t             slack_ticks;        // how late the timer may fire, in clock ticks
+   uint32_t             deadline;           // absolute expiry time, in ticks
    timer_type_t         type;               // periodic or one-shot
    bool                 isrunning;          // is running?
+   uint8_t              index;              // position in the heap when running,
+                                            // next idle timer when not running
    opentimers_cbt       callback;           // function to call when elapses
-   bool                 hasExpired;         // whether the callback has to be called
 } opentimers_t;
 
+BEGIN_PACK
+typedef struct {
+   uint32_t             numArms;            // number of times the bsp_timer was scheduled
+   uint32_t             numExpiries;        // number of timer callbacks called
+   uint32_t             numArmsAvoided;     // expiries which shared a compare event thanks to slack
+} opentimers_stats_t;
+END_PACK
+
 //=========================== module variables ================================
 
 typedef struct {
    opentimers_t         timersBuf[MAX_NUM_TIMERS];
+   opentimer_id_t       heap[MAX_NUM_TIMERS]; // running timers, earliest deadline first
+   uint8_t              heapSize;
+   opentimer_id_t       idleHead;       // first idle timer, TOO_MANY_TIMERS_ERROR if none
+   opentimer_id_t       idleTail;       // last idle timer
    bool                 running;
+   bool                 isDispatching;  // TRUE while calling the callbacks of expired timers
+   uint32_t             currentTime;    // time of the last compare event, in ticks
    PORT_TIMER_WIDTH     currentTimeout; // current timeout, in ticks
+   PORT_TIMER_WIDTH     lastCompareValue; // bsp_timer counter at the last compare event
+   opentimers_stats_t   stats;
 } opentimers_vars_t;
 
 //=========================== prototypes ======================================
@@ -68,11 +92,19 @@ opentimer_id_t opentimers_start(uint32_t       duration,
                                 timer_type_t   type,
                                 time_type_t timetype,
                                 opentimers_cbt callback);
+opentimer_id_t opentimers_startWithSlack(uint32_t       duration,
+                                uint32_t       slack,
+                                timer_type_t   type,
+                                time_type_t    timetype,
+                                opentimers_cbt callback);
 void           opentimers_setPeriod(opentimer_id_t id,time_type_t timetype, uint32_t       newPeriod);
 void           opentimers_stop(opentimer_id_t id);
 void           opentimers_restart(opentimer_id_t id);
 
-void           opentimers_sleepTimeCompesation(uint16_t sleepTime);
+void           opentimers_getStats(opentimers_stats_t* stats);
+
+uint32_t       opentimers_getTimeToNextTimeout(void);
+void           opentimers_sleepTimeCompesation(uint32_t sleepTime);
 
 /**
 \}
@@ -42,6 +42,8 @@ static const uint8_t infoStackName[] = "OpenWSN ";
 #define LENGTH_ADDR64b  8
 #define LENGTH_ADDR128b 16
 
+#define LENGTH_PACKET_BUFFER (1+1+125+2+1) // 1B spi address, 1B length, 125B data, 2B CRC, 1B LQI
+
 
 enum {
    E_SUCCESS                           = 0,
@@ -111,7 +113,12 @@ enum {
    STATUS_QUEUE                        =  8,
    STATUS_NEIGHBORS                    =  9,
    STATUS_KAPERIOD                     = 10,
-   STATUS_MAX                          = 11,
+   STATUS_TASKSTATS                    = 11,
+   STATUS_QUEUEMEM                     = 12,
+   STATUS_QUEUEDROPS                   = 13,
+   STATUS_TIMERSTATS                   = 14,
+   STATUS_SLOTPROFILE                  = 15,
+   STATUS_MAX                          = 16,
 };
 
 //component identifiers
@@ -249,6 +256,8 @@ enum {
    ERR_SIXTOP_COUNT                    = 0x3d, // there are {0} cells to request mote
    ERR_SIXTOP_LIST                     = 0x3e, // the cells reserved to request mote contains slot {0} and slot {1}
    ERR_SCHEDULE_ADDDUPLICATESLOT       = 0x3f, // the slot {0} to be added is already in schedule
+   ERR_SCHEDULE_SLOTOFFSET_OUTOFFRAME  = 0x40, // slot offset {0} does not fit in a slotframe of length {1}
+   ERR_INVALID_TIMESLOT_TEMPLATE       = 0x41, // timeslot template {0} with {1}-tick slots does not fit the timing of this board
 };
 
 //=========================== typedef =========================================
@@ -285,14 +294,16 @@ typedef struct {
    //admin
    uint8_t       creator;                        // the component which called getFreePacketBuffer()
    uint8_t       owner;                          // the component which currently owns the entry
-   uint8_t*      payload;                        // pointer to the start of the payload within 'packet'
    uint8_t       length;                         // length in bytes of the payload
+   uint8_t       packetSize;                     // size of the 'packet' buffer, at most LENGTH_PACKET_BUFFER
+   uint8_t*      packet;                         // frame buffer, from one of the openqueue pools
+   uint8_t*      payload;                        // pointer to the start of the payload within 'packet'
    //l4
    uint8_t       l4_protocol;                    // l4 protocol to be used
    bool          l4_protocol_compressed;         // is the l4 protocol header compressed?
    uint16_t      l4_sourcePortORicmpv6Type;      // l4 source port
    uint16_t      l4_destination_port;            // l4 destination port
-   uint8_t*      l4_payload;                     // pointer to the start of the payload of l4 (used for retransmits)
+   uint8_t       l4_payload;                     // offset in 'packet' of the payload of l4 (used for retransmits)
    uint8_t       l4_length;                      // length of the payload of l4 (used for retransmits)
    //l3
    open_addr_t   l3_destinationAdd;              // 128b IPv6 destination (down stack) 
@@ -305,13 +316,13 @@ typedef struct {
    uint8_t       l2_retriesLeft;                 // number Tx retries left before packet dropped (dropped when hits 0)
    uint8_t       l2_numTxAttempts;               // number Tx attempts
    asn_t         l2_asn;                         // at what ASN the packet was Tx'ed or Rx'ed
-   uint8_t*      l2_payload;                     // pointer to the start of the payload of l2 (used for MAC to fill in ASN in ADV)
-   uint8_t*      l2_sixtop_cellObjects;          // pointer to the start of cell Objects in 6P
+   uint8_t       l2_payload;                     // offset in 'packet' of the payload of l2 (used for MAC to fill in ASN in ADV)
+   uint8_t       l2_sixtop_cellObjects;          // offset in 'packet' of the cell Objects in 6P
    uint8_t       l2_sixtop_numOfCells;           // number of cells were going to be scheduled or removed.
    uint8_t       l2_sixtop_frameID;              // frameID in 6P
    uint8_t       l2_sixtop_requestCommand;       // request Command in 6P
    uint8_t       l2_sixtop_returnCode;           // return code in 6P
-   uint8_t*      l2_ASNpayload;                  // pointer to the ASN in EB
+   uint8_t       l2_ASNpayload;                  // offset in 'packet' of the ASN in EB
    uint8_t       l2_joinPriority;                // the join priority received in EB
    bool          l2_IEListPresent;               //did have IE field?
    bool          l2_payloadIEpresent;            // did I have payload IE field
@@ -321,17 +332,13 @@ typedef struct {
    uint8_t       l2_securityLevel;               //the security level specified for the current frame
    uint8_t       l2_keyIdMode;                   //the key Identifier mode specified for the current frame
    uint8_t       l2_keyIndex;                    //the key Index specified for the current frame
-   open_addr_t   l2_keySource;                   //the key Source specified for the current frame
    uint8_t       l2_authenticationLength;        //the length of the authentication field
    uint8_t       commandFrameIdentifier;         //used in case of Command Frames
-   uint8_t*      l2_FrameCounter;                //pointer to the FrameCounter in the MAC header
+   uint8_t       l2_FrameCounter;                //offset in 'packet' of the FrameCounter in the MAC header
    //l1 (drivers)
-   uint8_t       l1_txPower;                     // power for packet to Tx at
    int8_t        l1_rssi;                        // RSSI of received packet
    uint8_t       l1_lqi;                         // LQI of received packet
    bool          l1_crc;                         // did received packet pass CRC check?
-   //the packet
-   uint8_t       packet[1+1+125+2+1];            // 1B spi address, 1B length, 125B data, 2B CRC, 1B LQI
 } OpenQueueEntry_t;
 
 //=========================== variables =======================================
@@ -31,4 +31,9 @@ void scheduler_start() {
    // TODO: fill in as part of FW-16.
 }
 
+bool scheduler_getPrioStats(uint8_t prio, scheduler_prioStats_t* stats) {
+   // no instrumentation in this kernel
+   return FALSE;
+}
+
 //=========================== private =========================================
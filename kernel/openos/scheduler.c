@@ -9,6 +9,22 @@
 #include "board.h"
 #include "debugpins.h"
 #include "leds.h"
+#ifdef SCHEDULER_STATS
+#include "bsp_timer.h"
+#endif
+
+//=========================== define ==========================================
+
+#if defined(__GNUC__) && defined(__GCC_HAVE_SYNC_COMPARE_AND_SWAP_1)
+// producers claim ring entries with an atomic compare-and-swap
+#define SCHEDULER_RING_LOCKFREE
+#define SCHEDULER_RING_LOAD(x)         __atomic_load_n(&(x),__ATOMIC_ACQUIRE)
+#define SCHEDULER_RING_STORE(x,v)      __atomic_store_n(&(x),(v),__ATOMIC_RELEASE)
+#else
+// producers claim ring entries in a critical section
+#define SCHEDULER_RING_LOAD(x)         (x)
+#define SCHEDULER_RING_STORE(x,v)      (x) = (v)
+#endif
 
 //=========================== variables =======================================
 
@@ -18,88 +34,346 @@ scheduler_dbg_t  scheduler_dbg;
 //=========================== prototypes ======================================
 
 void consumeTask(uint8_t taskId);
+void scheduler_queuePostedTasks(void);
+static uint8_t scheduler_highestReadyPrio(uint16_t readyBitmap);
+#ifdef SCHEDULER_STATS
+void scheduler_recordStats(uint8_t prio, PORT_TIMER_WIDTH queueDelay, PORT_TIMER_WIDTH runTime);
+static uint8_t scheduler_statsBin(PORT_TIMER_WIDTH ticks);
+#endif
 
 //=========================== public ==========================================
 
 void scheduler_init() {   
+   uint8_t i;
    
    // initialization module variables
    memset(&scheduler_vars,0,sizeof(scheduler_vars_t));
    memset(&scheduler_dbg,0,sizeof(scheduler_dbg_t));
    
+   // chain all task containers into the free list
+   for (i=0;i<TASK_LIST_DEPTH-1;i++) {
+      scheduler_vars.taskBuf[i].next = &scheduler_vars.taskBuf[i+1];
+   }
+   scheduler_vars.taskBuf[TASK_LIST_DEPTH-1].next = NULL;
+   scheduler_vars.freeList        = &scheduler_vars.taskBuf[0];
+   
    // enable the scheduler's interrupt so SW can wake up the scheduler
    SCHEDULER_ENABLE_INTERRUPT();
 }
 
 void scheduler_start() {
    taskList_item_t* pThisTask;
+   uint8_t          prio;
+#ifdef SCHEDULER_STATS
+   PORT_TIMER_WIDTH startTime;
+   PORT_TIMER_WIDTH endTime;
+#endif
+   
+   // the priority queues are only accessed from this loop, which is why it
+   // does not need to disable interrupts
    while (1) {
-      while(scheduler_vars.task_list!=NULL) {
-         // there is still at least one task in the linked-list of tasks
-         
-         // the task to execute is the one at the head of the queue
-         pThisTask                = scheduler_vars.task_list;
-         
-         // shift the queue by one task
-         scheduler_vars.task_list = pThisTask->next;
-         
-         // execute the current task
-         pThisTask->cb();
-         
-         // free up this task container
-         pThisTask->cb            = NULL;
-         pThisTask->prio          = TASKPRIO_NONE;
-         pThisTask->next          = NULL;
-         scheduler_dbg.numTasksCur--;
+      // queue the tasks posted since the last pass
+      scheduler_queuePostedTasks();
+      
+      if (scheduler_vars.readyBitmap==0) {
+         // nothing to do
+         debugpins_task_clr();
+         board_sleep();
+         debugpins_task_set();                   // IAR should halt here if nothing to do
+         continue;
+      }
+      
+      // the task to execute is the oldest of the highest priority
+      prio                        = scheduler_highestReadyPrio(scheduler_vars.readyBitmap);
+      pThisTask                   = scheduler_vars.taskHead[prio];
+      
+      // shift that priority's queue by one task
+      scheduler_vars.taskHead[prio] = pThisTask->next;
+      if (scheduler_vars.taskHead[prio]==NULL) {
+         scheduler_vars.taskTail[prio] = NULL;
+         scheduler_vars.readyBitmap   &= ~(0x8000>>prio);
       }
-      debugpins_task_clr();
-      board_sleep();
-      debugpins_task_set();                      // IAR should halt here if nothing to do
+      
+#ifdef SCHEDULER_STATS
+      startTime                   = bsp_timer_get_currentValue();
+#endif
+      
+      // execute the current task
+      pThisTask->cb();
+      
+#ifdef SCHEDULER_STATS
+      endTime                     = bsp_timer_get_currentValue();
+      scheduler_recordStats(
+         prio,
+         (PORT_TIMER_WIDTH)(startTime-pThisTask->pushTime),
+         (PORT_TIMER_WIDTH)(endTime-startTime)
+      );
+#endif
+      
+      // free up this task container
+      pThisTask->cb               = NULL;
+      pThisTask->prio             = TASKPRIO_NONE;
+      pThisTask->next             = scheduler_vars.freeList;
+      scheduler_vars.freeList     = pThisTask;
+      scheduler_dbg.numTasksCur--;
    }
 }
 
+/**
+\brief Post a task, from task or interrupt context.
+
+The task is written into the ring of posted tasks; the scheduler loop later
+moves it into the queue of its priority. Where the compiler provides an atomic
+compare-and-swap (LDREX/STREX on Cortex-M3/M4), the ring entry is claimed
+without disabling interrupts. Elsewhere (MSP430, Cortex-M0, IAR), claiming and
+writing the entry is done in a short critical section.
+
+\param[in] cb   The function to call.
+\param[in] prio The priority of the task.
+*/
  void scheduler_push_task(task_cbt cb, task_prio_t prio) {
-   taskList_item_t*  taskContainer;
-   taskList_item_t** taskListWalker;
+   scheduler_ringEntry_t* entry;
+   uint8_t                idx;
+#ifdef SCHEDULER_RING_LOCKFREE
+   
+   // claim a ring entry
+   idx = __atomic_load_n(&scheduler_vars.ringIdxW,__ATOMIC_RELAXED);
+   do {
+      if ((uint8_t)(idx-SCHEDULER_RING_LOAD(scheduler_vars.ringIdxR))>=SCHEDULER_RING_DEPTH) {
+         // ring has overflown. This should never happpen!
+         
+         // we can not print from within the kernel. Instead:
+         // blink the error LED
+         leds_error_blink();
+         // reset the board
+         board_reset();
+         return;
+      }
+   } while (__atomic_compare_exchange_n(
+               &scheduler_vars.ringIdxW,
+               &idx,
+               (uint8_t)(idx+1),
+               0,
+               __ATOMIC_RELAXED,
+               __ATOMIC_RELAXED
+            )==0);
+   
+   // fill it, and publish it by writing the callback last
+   entry                          = &scheduler_vars.ring[idx&(SCHEDULER_RING_DEPTH-1)];
+   entry->prio                    = prio;
+#ifdef SCHEDULER_STATS
+   entry->pushTime                = bsp_timer_get_currentValue();
+#endif
+   SCHEDULER_RING_STORE(entry->cb,cb);
+#else
    INTERRUPT_DECLARATION();
    
    DISABLE_INTERRUPTS();
    
-   // find an empty task container
-   taskContainer = &scheduler_vars.taskBuf[0];
-   while (taskContainer->cb!=NULL &&
-          taskContainer<=&scheduler_vars.taskBuf[TASK_LIST_DEPTH-1]) {
-      taskContainer++;
-   }
-   if (taskContainer>&scheduler_vars.taskBuf[TASK_LIST_DEPTH-1]) {
-      // task list has overflown. This should never happpen!
-   
+   // claim a ring entry
+   idx                            = scheduler_vars.ringIdxW;
+   if ((uint8_t)(idx-scheduler_vars.ringIdxR)>=SCHEDULER_RING_DEPTH) {
+      // ring has overflown. This should never happpen!
+      
       // we can not print from within the kernel. Instead:
       // blink the error LED
       leds_error_blink();
       // reset the board
       board_reset();
+      
+      ENABLE_INTERRUPTS();
+      return;
    }
-   // fill that task container with this task
-   taskContainer->cb              = cb;
-   taskContainer->prio            = prio;
-   
-   // find position in queue
-   taskListWalker                 = &scheduler_vars.task_list;
-   while (*taskListWalker!=NULL &&
-          (*taskListWalker)->prio < taskContainer->prio) {
-      taskListWalker              = (taskList_item_t**)&((*taskListWalker)->next);
-   }
-   // insert at that position
-   taskContainer->next            = *taskListWalker;
-   *taskListWalker                = taskContainer;
-   // maintain debug stats
-   scheduler_dbg.numTasksCur++;
-   if (scheduler_dbg.numTasksCur>scheduler_dbg.numTasksMax) {
-      scheduler_dbg.numTasksMax   = scheduler_dbg.numTasksCur;
+   scheduler_vars.ringIdxW        = idx+1;
+   
+   // fill it
+   entry                          = &scheduler_vars.ring[idx&(SCHEDULER_RING_DEPTH-1)];
+   entry->prio                    = prio;
+#ifdef SCHEDULER_STATS
+   entry->pushTime                = bsp_timer_get_currentValue();
+#endif
+   entry->cb                      = cb;
+   
+   ENABLE_INTERRUPTS();
+#endif
+}
+
+/**
+\brief Retrieve the instrumentation statistics of one task priority.
+
+Only available when compiled with SCHEDULER_STATS.
+
+\param[in]  prio  The task priority.
+\param[out] stats Where to copy the statistics.
+
+\returns TRUE if statistics were copied, FALSE if instrumentation is disabled
+         or no task of this priority has executed yet.
+*/
+bool scheduler_getPrioStats(uint8_t prio, scheduler_prioStats_t* stats) {
+#ifdef SCHEDULER_STATS
+   INTERRUPT_DECLARATION();
+   
+   if (prio>=TASKPRIO_NUM || scheduler_dbg.prioStats[prio].numRun==0) {
+      return FALSE;
    }
    
+   DISABLE_INTERRUPTS();
+   memcpy(stats,&scheduler_dbg.prioStats[prio],sizeof(scheduler_prioStats_t));
    ENABLE_INTERRUPTS();
+   
+   return TRUE;
+#else
+   return FALSE;
+#endif
 }
 
 //=========================== private =========================================
+
+/**
+\brief Move the posted tasks from the ring to the queues of their priority.
+
+Only called from the scheduler loop, the single consumer of the ring. An
+entry which is claimed but not yet written stops the scan; it is picked up on
+the next pass.
+*/
+void scheduler_queuePostedTasks() {
+   scheduler_ringEntry_t* entry;
+   taskList_item_t*       taskContainer;
+   task_cbt               cb;
+   task_prio_t            prio;
+   
+   while (1) {
+      entry                       = &scheduler_vars.ring[scheduler_vars.ringIdxR&(SCHEDULER_RING_DEPTH-1)];
+      cb                          = SCHEDULER_RING_LOAD(entry->cb);
+      if (cb==NULL) {
+         // no more posted tasks
+         break;
+      }
+      
+      // grab an empty task container
+      taskContainer               = scheduler_vars.freeList;
+      if (taskContainer==NULL) {
+         // task list has overflown. This should never happpen!
+         
+         // we can not print from within the kernel. Instead:
+         // blink the error LED
+         leds_error_blink();
+         // reset the board
+         board_reset();
+         return;
+      }
+      scheduler_vars.freeList     = taskContainer->next;
+      
+      // fill that task container with this task
+      prio                        = entry->prio;
+      taskContainer->cb           = cb;
+      taskContainer->prio         = prio;
+      taskContainer->next         = NULL;
+#ifdef SCHEDULER_STATS
+      taskContainer->pushTime     = entry->pushTime;
+#endif
+      
+      // release the ring entry
+      entry->cb                   = NULL;
+      SCHEDULER_RING_STORE(scheduler_vars.ringIdxR,(uint8_t)(scheduler_vars.ringIdxR+1));
+      
+      // append at the tail of the queue for that priority
+      if (scheduler_vars.taskTail[prio]==NULL) {
+         scheduler_vars.taskHead[prio]     = taskContainer;
+         scheduler_vars.readyBitmap       |= (0x8000>>prio);
+      } else {
+         scheduler_vars.taskTail[prio]->next = taskContainer;
+      }
+      scheduler_vars.taskTail[prio] = taskContainer;
+      
+      // maintain debug stats
+      scheduler_dbg.numTasksCur++;
+      if (scheduler_dbg.numTasksCur>scheduler_dbg.numTasksMax) {
+         scheduler_dbg.numTasksMax = scheduler_dbg.numTasksCur;
+      }
+   }
+}
+
+/**
+\brief Find the highest priority with at least one pending task.
+
+Priority levels are stored MSB-first in the bitmap, so the number of leading
+zeros is the (numerically lowest) priority to serve.
+
+\param[in] readyBitmap Non-zero ready bitmap.
+
+\returns The priority of the task to execute next.
+*/
+static uint8_t scheduler_highestReadyPrio(uint16_t readyBitmap) {
+#if defined(__GNUC__) && !defined(__MSP430__)
+   // single CLZ instruction on the Cortex-M targets
+   return (uint8_t)(__builtin_clz(readyBitmap)-(8*sizeof(unsigned int)-16));
+#else
+   // leading zeros of each 4-bit value
+   static const uint8_t clz4[16] = {4,3,2,2,1,1,1,1,0,0,0,0,0,0,0,0};
+   
+   if (readyBitmap&0xff00) {
+      if (readyBitmap&0xf000) {
+         return  0+clz4[readyBitmap>>12];
+      }
+      return     4+clz4[(readyBitmap>>8)&0x0f];
+   }
+   if (readyBitmap&0x00f0) {
+      return     8+clz4[(readyBitmap>>4)&0x0f];
+   }
+   return       12+clz4[readyBitmap&0x0f];
+#endif
+}
+
+#ifdef SCHEDULER_STATS
+/**
+\brief Account for one executed task in the statistics of its priority.
+
+\param[in] prio       Priority of the task.
+\param[in] queueDelay Ticks between the push and the start of execution.
+\param[in] runTime    Ticks spent executing the task.
+*/
+void scheduler_recordStats(uint8_t prio, PORT_TIMER_WIDTH queueDelay, PORT_TIMER_WIDTH runTime) {
+   scheduler_prioStats_t* stats;
+   uint16_t*              bin;
+   
+   stats = &scheduler_dbg.prioStats[prio];
+   
+   if (stats->numRun<0xffff) {
+      stats->numRun++;
+   }
+   if (queueDelay>stats->maxQueueDelay) {
+      stats->maxQueueDelay = (queueDelay>0xffff)?0xffff:(uint16_t)queueDelay;
+   }
+   if (runTime>stats->maxRunTime) {
+      stats->maxRunTime    = (runTime>0xffff)?0xffff:(uint16_t)runTime;
+   }
+   
+   bin = &stats->queueDelayHist[scheduler_statsBin(queueDelay)];
+   if (*bin<0xffff) {
+      (*bin)++;
+   }
+   bin = &stats->runTimeHist[scheduler_statsBin(runTime)];
+   if (*bin<0xffff) {
+      (*bin)++;
+   }
+}
+
+/**
+\brief Map a duration to its log2 histogram bin.
+
+\param[in] ticks Duration, in bsp_timer ticks.
+
+\returns The bin index, saturated to SCHEDULER_STATS_NUM_BINS-1.
+*/
+static uint8_t scheduler_statsBin(PORT_TIMER_WIDTH ticks) {
+   uint8_t bin;
+   
+   bin = 0;
+   while (ticks!=0 && bin<SCHEDULER_STATS_NUM_BINS-1) {
+      ticks >>= 1;
+      bin++;
+   }
+   return bin;
+}
+#endif
@@ -32,6 +32,12 @@ typedef enum {
 } task_prio_t;
 
 #define TASK_LIST_DEPTH           10
+#define TASKPRIO_NUM              (TASKPRIO_MAX+1) // one FIFO per priority level
+#define SCHEDULER_RING_DEPTH      16               // power of 2, at least TASK_LIST_DEPTH
+
+// number of log2 bins in the queueing delay and run time histograms
+// bin 0: 0 ticks, bin 1: 1 tick, bin 2: 2-3 ticks, ..., last bin: everything above
+#define SCHEDULER_STATS_NUM_BINS  8
 
 //=========================== typedef =========================================
 
@@ -41,13 +47,47 @@ typedef struct task_llist_t {
    task_cbt                       cb;
    task_prio_t                    prio;
    void*                          next;
+#ifdef SCHEDULER_STATS
+   PORT_TIMER_WIDTH               pushTime;               // bsp_timer value when pushed
+#endif
 } taskList_item_t;
 
+typedef struct {
+   volatile task_cbt              cb;                     // NULL until the entry is fully written
+   task_prio_t                    prio;
+#ifdef SCHEDULER_STATS
+   PORT_TIMER_WIDTH               pushTime;               // bsp_timer value when pushed
+#endif
+} scheduler_ringEntry_t;
+
+BEGIN_PACK
+typedef struct {
+   uint16_t                       numRun;                 // number of tasks executed (saturates)
+   uint16_t                       maxQueueDelay;          // worst-case push-to-start delay, in bsp_timer ticks
+   uint16_t                       maxRunTime;             // worst-case execution time, in bsp_timer ticks
+   uint16_t                       queueDelayHist[SCHEDULER_STATS_NUM_BINS];
+   uint16_t                       runTimeHist[SCHEDULER_STATS_NUM_BINS];
+} scheduler_prioStats_t;
+END_PACK
+
+BEGIN_PACK
+typedef struct {
+   uint8_t                        prio;
+   scheduler_prioStats_t          stats;
+} debugTaskStatsEntry_t;
+END_PACK
+
 //=========================== module variables ================================
 
 typedef struct {
    taskList_item_t                taskBuf[TASK_LIST_DEPTH];
-   taskList_item_t*               task_list;
+   taskList_item_t*               freeList;               // unused task containers
+   taskList_item_t*               taskHead[TASKPRIO_NUM]; // oldest task of each priority
+   taskList_item_t*               taskTail[TASKPRIO_NUM]; // newest task of each priority
+   uint16_t                       readyBitmap;            // bit (15-prio) set if that FIFO is not empty
+   scheduler_ringEntry_t          ring[SCHEDULER_RING_DEPTH]; // posted tasks, not yet in a FIFO
+   volatile uint8_t               ringIdxW;               // next entry to claim, advanced by scheduler_push_task()
+   volatile uint8_t               ringIdxR;               // next entry to read, advanced by the scheduler loop
    uint8_t                        numTasksCur;
    uint8_t                        numTasksMax;
 } scheduler_vars_t;
@@ -55,6 +95,9 @@ typedef struct {
 typedef struct {
    uint8_t                        numTasksCur;
    uint8_t                        numTasksMax;
+#ifdef SCHEDULER_STATS
+   scheduler_prioStats_t          prioStats[TASKPRIO_NUM];
+#endif
 } scheduler_dbg_t;
 
 //=========================== prototypes ======================================
@@ -62,6 +105,7 @@ typedef struct {
 void scheduler_init(void);
 void scheduler_start(void);
 void scheduler_push_task(task_cbt task_cb, task_prio_t prio);
+bool scheduler_getPrioStats(uint8_t prio, scheduler_prioStats_t* stats);
 
 /**
 \}
@@ -19,6 +19,8 @@
 
 /// inter-packet period (in ms)
 #define CEXAMPLEPERIOD  10000
+/// how late a packet may be sent (in ms)
+#define CEXAMPLESLACK   1000
 #define PAYLOADLEN      40
 
 const uint8_t cexample_path0[] = "ex";
@@ -53,7 +55,8 @@ void cexample_init() {
    
    
    opencoap_register(&cexample_vars.desc);
-   cexample_vars.timerId    = opentimers_start(CEXAMPLEPERIOD,
+   cexample_vars.timerId    = opentimers_startWithSlack(CEXAMPLEPERIOD,
+                                                CEXAMPLESLACK,
                                                 TIMER_PERIODIC,TIME_MS,
                                                 cexample_timer_cb);
 }
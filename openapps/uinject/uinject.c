@@ -31,8 +31,9 @@ void uinject_init() {
    memset(&uinject_vars,0,sizeof(uinject_vars_t));
    
    // start periodic timer
-   uinject_vars.timerId                    = opentimers_start(
+   uinject_vars.timerId                    = opentimers_startWithSlack(
       UINJECT_PERIOD_MS,
+      UINJECT_SLACK_MS,
       TIMER_PERIODIC,TIME_MS,
       uinject_timer_cb
    );
@@ -121,6 +121,7 @@ class moteProbe(threading.Thread):
     CMD_SET_DAGROOT = '7e5259bbbb0000000000000c347e'
     CMD_SEND_DATA   = '7e44141592000012e63b78001180bbbb0000000000000000000000000001bbbb000000000000141592000012e63b07d007d0000ea30d706f69706f697a837e'
     SLOT_DURATION    = 0.015
+    LATENCYTRACE_TYPE = 0x30 # elective 6LoRH added by motes built with latencytrace=1
     
     def __init__(self,serialport=None):
         
@@ -145,7 +146,7 @@ class moteProbe(threading.Thread):
         
         # give this thread a name
         self.name                 = 'moteProbe@'+self.serialport
-        print "counter latency(second)"
+        print "counter latency(second) per-hop(slots)"
         
         # start myself
         self.start()
@@ -204,7 +205,9 @@ class moteProbe(threading.Thread):
                                             #print ''.join(['{0:02x}'.format(ord(b)) for b in outputToWrite])
                                             self.serial.write(outputToWrite)
                                 elif self.inputBuf[0]==ord('D'):
-                                    if len(self.inputBuf)==62:
+                                    # the 6LoWPAN packet follows the ASN and the next and previous hops
+                                    (hopDelays,traceLen) = self._parseLatencyTrace(self.inputBuf[24:])
+                                    if len(self.inputBuf)==62+traceLen:
                                         asn_inital  = struct.unpack('<HHB',''.join([chr(c) for c in self.inputBuf[3:8]]))
                                         asn_arrive  = struct.unpack('<HHB',''.join([chr(c) for c in self.inputBuf[-7:-2]]))
                                         counter  = struct.unpack('<h',''.join([chr(b) for b in self.inputBuf[-2:]]))[0]
@@ -213,7 +216,7 @@ class moteProbe(threading.Thread):
                                             if counter-self.last_counter!=1:
                                                 print 'MISSING {0} packets!!'.format(counter-self.last_counter-1)
                                         self.last_counter = counter
-                                        print "{0:^7} {1:^15}".format(counter, self.SLOT_DURATION*((asn_inital[0]-asn_arrive[0])+(asn_inital[1]-asn_arrive[1])*256+(asn_inital[2]-asn_arrive[2])*65536))
+                                        print "{0:^7} {1:^15} {2}".format(counter, self.SLOT_DURATION*((asn_inital[0]-asn_arrive[0])+(asn_inital[1]-asn_arrive[1])*256+(asn_inital[2]-asn_arrive[2])*65536), ' '.join([str(d) for d in hopDelays]))
                                         
                                         with self.outputBufLock:
                                             self.outputBuf += [binascii.unhexlify(self.CMD_SEND_DATA)]
@@ -231,6 +234,37 @@ class moteProbe(threading.Thread):
         self.goOn = False
     
     #======================== private =========================================
+    
+    def _parseLatencyTrace(self,pkt):
+        '''
+        Find the latency trace 6LoRH in a 6LoWPAN packet.
+        
+        :returns: a tuple with the delay spent at each hop (in slots, first
+            hop is the source) and the length of the trace, ([],0) if the
+            packet carries none.
+        '''
+        if not pkt or pkt[0]!=0xf1:
+            # no page 1 dispatch, no 6LoRH
+            return ([],0)
+        i = 1
+        while i<len(pkt)-1 and (pkt[i] & 0xe0) in [0x80,0xa0]:
+            if (pkt[i] & 0xe0)==0x80:
+                if pkt[i+1]<=4:
+                    # RH3 6LoRH, addresses of 2^type bytes
+                    i += 2+(1<<pkt[i+1])*((pkt[i] & 0x1f)+1)
+                else:
+                    # RPI 6LoRH, the I and K flags elide part of the option
+                    i += 2+[3,2,2,1][pkt[i] & 0x03]
+            else:
+                length = pkt[i] & 0x1f
+                if pkt[i+1]==self.LATENCYTRACE_TYPE and i+2+length<=len(pkt):
+                    numHops = min(pkt[i+2],(length-5)/2)
+                    return (
+                        [(pkt[i+7+2*h]<<8)+pkt[i+8+2*h] for h in range(numHops)],
+                        2+length,
+                    )
+                i += 2+length
+        return ([],0)
 
 def main():
     print 'poipoi'
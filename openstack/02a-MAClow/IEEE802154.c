@@ -27,6 +27,8 @@
 
 //=========================== prototypes ======================================
 
+void ieee802154_writeTimeCorrection(uint8_t* buf);
+
 //=========================== public ==========================================
 
 /**
@@ -49,13 +51,12 @@ void ieee802154_prependHeader(OpenQueueEntry_t* msg,
    uint8_t temp_8b;
    uint8_t ielistpresent = IEEE154_IELIST_NO;
    bool    securityEnabled;
-   int16_t timeCorrection;
    header_IE_ht header_desc;
    bool    headerIEPresent = FALSE;
    
    securityEnabled = msg->l2_securityLevel == IEEE154_ASH_SLF_TYPE_NOSEC ? 0 : 1;
 
-   msg->l2_payload = msg->payload; // save the position where to start encrypting if security is enabled 
+   msg->l2_payload = (uint8_t)(msg->payload-msg->packet); // save the position where to start encrypting if security is enabled 
  
    // General IEs here (those that are carried in all packets)
    // add termination IE accordingly 
@@ -93,12 +94,9 @@ void ieee802154_prependHeader(OpenQueueEntry_t* msg,
   }
 
    if (frameType == IEEE154_TYPE_ACK) {
-       timeCorrection = (int16_t)(ieee154e_getTimeCorrection());
        // add the payload to the ACK (i.e. the timeCorrection)
        packetfunctions_reserveHeaderSize(msg,sizeof(timecorrection_IE_ht));
-       timeCorrection *= US_PER_TICK;
-       msg->payload[0] = (uint8_t)((((uint16_t)timeCorrection)   ) & 0xff);
-       msg->payload[1] = (uint8_t)((((uint16_t)timeCorrection)>>8) & 0xff);
+       ieee802154_writeTimeCorrection(msg->payload);
 
        // add header IE header -- xv poipoi -- pkt is filled in reverse order..
        packetfunctions_reserveHeaderSize(msg,sizeof(header_IE_ht));
@@ -182,6 +180,41 @@ void ieee802154_prependHeader(OpenQueueEntry_t* msg,
    *((uint8_t*)(msg->payload)) = temp_8b;
 }
 
+/**
+\brief Set or clear the frame pending bit of an already prepended header.
+
+The header is expected to start at msg->payload, i.e. this is called after
+ieee802154_prependHeader() and before anything is prepended in front of it.
+
+\param[in,out] msg        The message whose header to modify.
+\param[in] framePending   Whether more frames follow for the same neighbor.
+*/
+void ieee802154_setFramePending(OpenQueueEntry_t* msg, bool framePending) {
+   if (framePending==TRUE) {
+      msg->payload[0] |=  (IEEE154_PENDING_YES_FRAMEPENDING << IEEE154_FCF_FRAME_PENDING);
+   } else {
+      msg->payload[0] &= ~(IEEE154_PENDING_YES_FRAMEPENDING << IEEE154_FCF_FRAME_PENDING);
+   }
+}
+
+/**
+\brief Update an ACK header copied from a template for the frame being ACKed.
+
+Only the fields which change from one ACK to the next one for the same
+neighbor are written: the sequence number and the time correction. The header
+is expected to start at msg->payload, and msg->l2_payload to be the position
+right after it, as left by ieee802154_prependHeader().
+
+\param[in,out] msg          The ACK.
+\param[in] sequenceNumber   Sequence number of the frame being ACKed.
+*/
+void ieee802154_updateAckHeader(OpenQueueEntry_t* msg, uint8_t sequenceNumber) {
+   // dsn, after the 2-byte fcf
+   msg->payload[2] = sequenceNumber;
+   // timeCorrection, last field of the header
+   ieee802154_writeTimeCorrection(&(msg->packet[msg->l2_payload])-sizeof(timecorrection_IE_ht));
+}
+
 /**
 \brief Retreieve the IEEE802.15.4 MAC header from a (just received) packet.
 
@@ -371,7 +404,7 @@ void ieee802154_retrieveHeader(OpenQueueEntry_t*      msg,
                        ieee802514_header->headerLength  += len;
 
                        // Record the position where we should start decrypting the ACK, if security is enabled
-                       msg->l2_payload = &msg->payload[ieee802514_header->headerLength];
+                       msg->l2_payload = (uint8_t)(msg->payload-msg->packet)+ieee802514_header->headerLength;
                        break;
                    default:
                        break;
@@ -388,7 +421,7 @@ void ieee802154_retrieveHeader(OpenQueueEntry_t*      msg,
    }
 
    // Record the position where we should start decrypting if security is enabled
-   msg->l2_payload = &msg->payload[ieee802514_header->headerLength];
+   msg->l2_payload = (uint8_t)(msg->payload-msg->packet)+ieee802514_header->headerLength;
 
    // apply topology filter
    if (topology_isAcceptablePacket(ieee802514_header)==FALSE) {
@@ -400,3 +433,12 @@ void ieee802154_retrieveHeader(OpenQueueEntry_t*      msg,
 }
 
 //=========================== private =========================================
+
+void ieee802154_writeTimeCorrection(uint8_t* buf) {
+   int16_t timeCorrection;
+   
+   timeCorrection  = (int16_t)(ieee154e_getTimeCorrection());
+   timeCorrection *= US_PER_TICK;
+   buf[0] = (uint8_t)((((uint16_t)timeCorrection)   ) & 0xff);
+   buf[1] = (uint8_t)((((uint16_t)timeCorrection)>>8) & 0xff);
+}
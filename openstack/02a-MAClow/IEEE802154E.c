@@ -22,6 +22,57 @@
 ieee154e_vars_t    ieee154e_vars;
 ieee154e_stats_t   ieee154e_stats;
 ieee154e_dbg_t     ieee154e_dbg;
+ieee154e_profile_t ieee154e_profile;
+ieee154e_chStats_t ieee154e_chStats;
+
+// timeslot templates, indexed by ID
+const ieee154e_timeslotTemplate_t ieee154e_timeslotTemplates[TIMESLOT_TEMPLATE_NUM] = {
+   // TIMESLOT_TEMPLATE_ID (10ms)
+   {
+      328,                          // TsSlotDuration  10000us
+       70,                          // TsTxOffset       2120us
+       36,                          // TsLongGT         1100us
+       33,                          // TsTxAckDelay     1000us
+        9,                          // TsShortGT         275us
+       33,                          // wdRadioTx        1000us
+      164,                          // wdDataDuration   5000us
+       80,                          // wdAckDuration    2400us
+   },
+   // TIMESLOT_TEMPLATE_ID_CUSTOM (this board's timing)
+   {
+      TsSlotDuration,
+      TsTxOffset,
+      TsLongGT,
+      TsTxAckDelay,
+      TsShortGT,
+      wdRadioTx,
+      wdDataDuration,
+      wdAckDuration,
+   },
+   // TIMESLOT_TEMPLATE_ID_15MS (telosb, gina, wsn430v14, ...: same as their
+   // compiled timing, so that they advertise a standard template)
+   {
+      492,                          // TsSlotDuration  15000us
+      131,                          // TsTxOffset       4000us
+       43,                          // TsLongGT         1300us
+      151,                          // TsTxAckDelay     4606us
+       16,                          // TsShortGT         500us
+       33,                          // wdRadioTx        1000us
+      164,                          // wdDataDuration   5000us
+       98,                          // wdAckDuration    3000us
+   },
+   // TIMESLOT_TEMPLATE_ID_7500US (a 127-byte frame and its ACK end at 7.4ms)
+   {
+      245,                          // TsSlotDuration   7500us
+       44,                          // TsTxOffset       1340us
+       20,                          // TsLongGT          610us
+       23,                          // TsTxAckDelay      700us
+        9,                          // TsShortGT         275us
+       33,                          // wdRadioTx        1000us
+      147,                          // wdDataDuration   4490us
+       40,                          // wdAckDuration    1220us
+   },
+};
 
 //=========================== prototypes ======================================
 
@@ -70,18 +121,39 @@ bool     isValidJoin(OpenQueueEntry_t* eb, ieee802154_header_iht *parsedHeader);
 bool     ieee154e_processIEs(OpenQueueEntry_t* pkt, uint16_t* lenIE);
 // ASN handling
 void     incrementAsnOffset(void);
+void     incrementAsnOffsetBy(PORT_RADIOTIMER_WIDTH numSlots);
+void     ieee154e_asnAdd(asn_t* asn, uint32_t numSlots);
+bool     ieee154e_asnReached(asn_t* someASN);
 void     ieee154e_syncSlotOffset(void);
+void     ieee154e_syncAsnOffset(void);
 void     asnStoreFromEB(uint8_t* asn);
 void     joinPriorityStoreFromEB(uint8_t jp);
 
 // timeslot template handling
-void     timeslotTemplateIDStoreFromEB(uint8_t id);
+uint8_t  timeslotTemplateStoreFromEB(uint8_t* ie, uint16_t len);
+bool     ieee154e_changeTimeslotTemplate(uint8_t id, uint16_t slotDuration);
+bool     ieee154e_scheduleTimeslotTemplate(uint8_t id, uint16_t slotDuration, asn_t* switchAsn);
+uint32_t ieee154e_slotsToTimeslotTemplateSwitch(void);
+bool     ieee154e_applyTimeslotTemplate(uint8_t id, uint16_t slotDuration);
+bool     ieee154e_buildTimeslotTemplate(uint8_t id, uint16_t slotDuration, ieee154e_timeslotTemplate_t* ts);
+bool     ieee154e_isValidTimeslotTemplate(const ieee154e_timeslotTemplate_t* ts);
 // channelhopping template handling
-void     channelhoppingTemplateIDStoreFromEB(uint8_t id);
+uint8_t  channelhoppingTemplateStoreFromEB(uint8_t* ie, uint16_t len);
+bool     ieee154e_isValidChannelHoppingSequence(uint8_t* sequence, uint8_t length);
+bool     ieee154e_isNewerChannelHoppingTemplate(uint8_t id);
+// per-channel statistics
+void     ieee154e_countTx(bool acked);
+void     ieee154e_countRx(bool failed);
+bool     ieee154e_isBadChannel(ieee154e_channelStats_t* stats);
 // synchronization
 void     synchronizePacket(PORT_RADIOTIMER_WIDTH timeReceived);
 void     synchronizeAck(PORT_SIGNED_INT_WIDTH timeCorrection);
 void     changeIsSync(bool newIsSync);
+// skipping idle slots
+PORT_RADIOTIMER_WIDTH ieee154e_slotsToNextActive(void);
+void     ieee154e_sleepSlots(PORT_RADIOTIMER_WIDTH numOfSleepSlots);
+bool     ieee154e_isBurstPossible(void);
+void     ieee154e_prepareAck(void);
 // notifying upper layer
 void     notif_sendDone(OpenQueueEntry_t* packetSent, owerror_t error);
 void     notif_receive(OpenQueueEntry_t* packetReceived);
@@ -92,6 +164,7 @@ void     updateStats(PORT_SIGNED_INT_WIDTH timeCorrection);
 uint8_t  calculateFrequency(uint8_t channelOffset);
 void     changeState(ieee154e_state_t newstate);
 void     endSlot(void);
+void     ieee154e_profileStep(uint8_t step, PORT_RADIOTIMER_WIDTH time, PORT_RADIOTIMER_WIDTH deadline);
 bool     debugPrint_asn(void);
 bool     debugPrint_isSync(void);
 // interrupts
@@ -107,25 +180,51 @@ Call this function once before any other function in this module, possibly
 during boot-up.
 */
 void ieee154e_init() {
+   uint8_t i;
    
    // initialize variables
    memset(&ieee154e_vars,0,sizeof(ieee154e_vars_t));
    memset(&ieee154e_dbg,0,sizeof(ieee154e_dbg_t));
+   memset(&ieee154e_profile,0,sizeof(ieee154e_profile_t));
+   memset(&ieee154e_chStats,0,sizeof(ieee154e_chStats_t));
    
    // to easy debug, by default we use signle channel to communication
    // set singleChannel to 0 to enable channel hopping.
    ieee154e_vars.singleChannel     = SYNCHRONIZING_CHANNEL;
    ieee154e_vars.isAckEnabled      = TRUE;
    ieee154e_vars.isSecurityEnabled = FALSE;
-   ieee154e_vars.slotDuration      = TsSlotDuration;
    ieee154e_vars.numOfSleepSlots   = 1;
+   ieee154e_vars.localCopyForTransmission.packet     = &(ieee154e_vars.localCopyPacket[0]);
+   ieee154e_vars.localCopyForTransmission.packetSize = LENGTH_PACKET_BUFFER;
+   ieee154e_vars.ackCopy.packet                      = &(ieee154e_vars.ackCopyPacket[0]);
+   ieee154e_vars.ackCopy.packetSize                  = OPENQUEUE_SMALL_PACKET_SIZE;
    
    // default hopping template
-   memcpy(
-       &(ieee154e_vars.chTemplate[0]),
-       chTemplate_default,
-       sizeof(ieee154e_vars.chTemplate)
-   );
+   ieee154e_setChannelHoppingTemplate(CHANNELHOPPING_TEMPLATE_ID,NULL,0);
+   
+   // this board's timing, advertised as a standard template if it is one
+   ieee154e_vars.tsTemplateId = TIMESLOT_TEMPLATE_ID_CUSTOM;
+   for (i=0;i<TIMESLOT_TEMPLATE_NUM;i++) {
+      if (
+            i!=TIMESLOT_TEMPLATE_ID_CUSTOM &&
+            memcmp(
+               &ieee154e_timeslotTemplates[i],
+               &ieee154e_timeslotTemplates[TIMESLOT_TEMPLATE_ID_CUSTOM],
+               sizeof(ieee154e_timeslotTemplate_t)
+            )==0
+         ) {
+         ieee154e_vars.tsTemplateId = i;
+         break;
+      }
+   }
+   memcpy(&ieee154e_vars.ts,&ieee154e_timeslotTemplates[ieee154e_vars.tsTemplateId],sizeof(ieee154e_timeslotTemplate_t));
+   ieee154e_vars.slotDuration = ieee154e_vars.ts.slotDuration;
+   if (ieee154e_isValidTimeslotTemplate(&ieee154e_vars.ts)==FALSE) {
+      // the board's timing is kept, but is not expected to work
+      openserial_printError(COMPONENT_IEEE802154E,ERR_INVALID_TIMESLOT_TEMPLATE,
+                            (errorparameter_t)ieee154e_vars.tsTemplateId,
+                            (errorparameter_t)ieee154e_vars.slotDuration);
+   }
    
    if (idmanager_getIsDAGroot()==TRUE) {
       changeIsSync(TRUE);
@@ -195,6 +294,7 @@ void isr_ieee154e_newSlot() {
          changeIsSync(TRUE);
          incrementAsnOffset();
          ieee154e_syncSlotOffset();
+         schedule_syncSlotOffset(ieee154e_vars.slotOffset);
          ieee154e_vars.nextActiveSlotOffset = schedule_getNextActiveSlotOffset();
       } else {
          activity_synchronize_newSlot();
@@ -419,6 +519,39 @@ bool debugPrint_macStats() {
    return TRUE;
 }
 
+/**
+\brief Print the margin left to the deadline of one profiled step of the slot.
+
+Each call prints the next step which has been profiled at least once, so all
+steps are covered over successive calls. Margins are in 32kHz ticks, a
+negative margin is a missed deadline. Nothing is printed unless compiled with
+SLOT_PROFILER.
+
+\returns TRUE if this function printed something, FALSE otherwise.
+*/
+bool debugPrint_slotProfile() {
+#ifdef SLOT_PROFILER
+   ieee154e_profileStatus_t output;
+   ieee154e_profileStats_t* stats;
+   uint8_t                  i;
+   
+   for (i=0;i<PROFILE_MAX;i++) {
+      ieee154e_profile.printStep = (ieee154e_profile.printStep+1)%PROFILE_MAX;
+      stats = &ieee154e_profile.steps[ieee154e_profile.printStep];
+      if (stats->numSamples>0) {
+         output.step       = ieee154e_profile.printStep;
+         output.numSamples = stats->numSamples;
+         output.minMargin  = stats->minMargin;
+         output.meanMargin = (int16_t)(stats->sumMargin/(int32_t)stats->numSamples);
+         output.maxMargin  = stats->maxMargin;
+         openserial_printStatus(STATUS_SLOTPROFILE,(uint8_t*)&output,sizeof(ieee154e_profileStatus_t));
+         return TRUE;
+      }
+   }
+#endif
+   return FALSE;
+}
+
 //=========================== private =========================================
 
 //======= SYNCHRONIZING
@@ -555,7 +688,7 @@ port_INLINE void activity_synchronize_endOfFrame(PORT_RADIOTIMER_WIDTH capturedT
       ieee154e_vars.dataReceived->payload = &(ieee154e_vars.dataReceived->packet[FIRST_FRAME_BYTE]);
       radio_getReceivedFrame(       ieee154e_vars.dataReceived->payload,
                                    &ieee154e_vars.dataReceived->length,
-                             sizeof(ieee154e_vars.dataReceived->packet),
+                             ieee154e_vars.dataReceived->packetSize,
                                    &ieee154e_vars.dataReceived->l1_rssi,
                                    &ieee154e_vars.dataReceived->l1_lqi,
                                    &ieee154e_vars.dataReceived->l1_crc);
@@ -679,7 +812,6 @@ port_INLINE bool ieee154e_processIEs(OpenQueueEntry_t* pkt, uint16_t* lenIE) {
    uint16_t              sublen;
    // flag used for understanding if the slotoffset should be inferred from both ASN and slotframe length
    bool                  f_asn2slotoffset;
-   uint8_t               i; // used for find the index in channel hopping template
    
    ptr=0;
    
@@ -763,23 +895,23 @@ port_INLINE bool ieee154e_processIEs(OpenQueueEntry_t* pkt, uint16_t* lenIE) {
                
                case IEEE802154E_MLME_TIMESLOT_IE_SUBID:
                   if (idmanager_getIsDAGroot()==FALSE) {
-                      // timelsot template ID
-                      timeslotTemplateIDStoreFromEB(*((uint8_t*)(pkt->payload)+ptr));
-                      ptr = ptr + 1;
-                      if (ieee154e_vars.tsTemplateId != TIMESLOT_TEMPLATE_ID){
-                          ieee154e_vars.slotDuration = *((uint8_t*)(pkt->payload)+ptr);
-                          ptr = ptr + 1;
-                          ieee154e_vars.slotDuration |= ((*((uint8_t*)(pkt->payload)+ptr))<<8) & 0xff00;
-                          ptr = ptr + 1;
+                      // timeslot template, and slot duration
+                      temp_8b = timeslotTemplateStoreFromEB((uint8_t*)(pkt->payload)+ptr,sublen);
+                      if (temp_8b==0){
+                          return FALSE;
                       }
+                      ptr = ptr + temp_8b;
                   }
                   break;
                   
                case IEEE802154E_MLME_CHANNELHOPPING_IE_SUBID:
                   if (idmanager_getIsDAGroot()==FALSE) {
-                      // timelsot template ID
-                      channelhoppingTemplateIDStoreFromEB(*((uint8_t*)(pkt->payload)+ptr));
-                      ptr = ptr + 1;
+                      // channel hopping template(s)
+                      temp_8b = channelhoppingTemplateStoreFromEB((uint8_t*)(pkt->payload)+ptr,sublen);
+                      if (temp_8b==0){
+                          return FALSE;
+                      }
+                      ptr = ptr + temp_8b;
                   }
                   break;
                default:
@@ -795,16 +927,8 @@ port_INLINE bool ieee154e_processIEs(OpenQueueEntry_t* pkt, uint16_t* lenIE) {
             ieee154e_syncSlotOffset();
             schedule_syncSlotOffset(ieee154e_vars.slotOffset);
             ieee154e_vars.nextActiveSlotOffset = schedule_getNextActiveSlotOffset();
-            /* 
-            infer the asnOffset based on the fact that
-            ieee154e_vars.freq = 11 + (asnOffset + channelOffset)%16 
-            */
-            for (i=0;i<16;i++){
-                if ((ieee154e_vars.freq - 11)==ieee154e_vars.chTemplate[i]){
-                    break;
-                }
-            }
-            ieee154e_vars.asnOffset = i - schedule_getChannelOffset();
+            // the offset in the hopping sequence also follows from the ASN
+            ieee154e_syncAsnOffset();
          }
          break;
          
@@ -834,10 +958,57 @@ port_INLINE void activity_ti1ORri1() {
    sync_IE_ht  sync_IE;
    bool        changeToRX=FALSE;
    bool        couldSendEB=FALSE;
+   uint8_t     burstType;
+   uint8_t     numSerialSlots;
+   uint32_t    slotsToSwitch;
+   uint16_t    oldSlotDuration;
 
    // increment ASN (do this first so debug pins are in sync)
    incrementAsnOffset();
    
+   // whether this slot continues the burst of the previous one
+   burstType                     = ieee154e_vars.burstType;
+   ieee154e_vars.burstType       = CELLTYPE_OFF;
+   ieee154e_vars.framePending    = FALSE;
+   
+   // realign on the slotframe length if it changed, e.g. from the serial port
+   if (ieee154e_vars.frameLength!=schedule_getFrameLength()) {
+      ieee154e_syncSlotOffset();
+      schedule_syncSlotOffset(ieee154e_vars.slotOffset);
+      ieee154e_vars.nextActiveSlotOffset = schedule_getNextActiveSlotOffset();
+   }
+   
+   // switch hopping sequence at the same ASN as the rest of the network
+   if (
+         ieee154e_vars.chTemplateIsPending==TRUE &&
+         ieee154e_asnReached(&ieee154e_vars.chTemplatePendingAsn)==TRUE
+      ) {
+      ieee154e_vars.chTemplateIsPending = FALSE;
+      ieee154e_setChannelHoppingTemplate(
+         ieee154e_vars.chTemplatePendingId,
+         ieee154e_vars.chTemplatePending,
+         ieee154e_vars.chTemplatePendingLength
+      );
+   }
+   
+   // switch timeslot template at the same ASN as the rest of the network
+   if (
+         ieee154e_vars.tsTemplateIsPending==TRUE &&
+         ieee154e_asnReached(&ieee154e_vars.tsTemplatePendingAsn)==TRUE
+      ) {
+      ieee154e_vars.tsTemplateIsPending = FALSE;
+      oldSlotDuration = ieee154e_vars.slotDuration;
+      if (
+            ieee154e_applyTimeslotTemplate(
+               ieee154e_vars.tsTemplatePendingId,
+               ieee154e_vars.tsTemplatePendingDuration
+            )==TRUE
+         ) {
+         // this slot already started with the previous duration
+         radio_setTimerPeriod(radio_getTimerPeriod()-oldSlotDuration+ieee154e_vars.slotDuration);
+      }
+   }
+   
    // wiggle debug pins
    debugpins_slot_toggle();
    if (ieee154e_vars.slotOffset==0) {
@@ -893,21 +1064,27 @@ port_INLINE void activity_ti1ORri1() {
       // find the next one
       ieee154e_vars.nextActiveSlotOffset = schedule_getNextActiveSlotOffset();
       if (idmanager_getIsSlotSkip() && idmanager_getIsDAGroot()==FALSE) {
-          if (ieee154e_vars.nextActiveSlotOffset>ieee154e_vars.slotOffset) {
-               ieee154e_vars.numOfSleepSlots = ieee154e_vars.nextActiveSlotOffset-ieee154e_vars.slotOffset;
-          } else {
-               ieee154e_vars.numOfSleepSlots = schedule_getFrameLength()+ieee154e_vars.nextActiveSlotOffset-ieee154e_vars.slotOffset; 
-          }
+          // wake up next at the next active slot
+          ieee154e_sleepSlots(ieee154e_slotsToNextActive());
           
-          radio_setTimerPeriod(TsSlotDuration*(ieee154e_vars.numOfSleepSlots));
-           
           //increase ASN by numOfSleepSlots-1 slots as at this slot is already incremented by 1
-          for (i=0;i<ieee154e_vars.numOfSleepSlots-1;i++){
-             incrementAsnOffset();
-          }
+          incrementAsnOffsetBy(ieee154e_vars.numOfSleepSlots-1);
       }       
+   } else if (burstType!=CELLTYPE_OFF) {
+      // this slot continues the burst of the previous one, on the same cell:
+      // the schedule is not advanced, so the channel offset and the cell
+      // statistics remain those of that cell
+      if (idmanager_getIsSlotSkip() && idmanager_getIsDAGroot()==FALSE) {
+          ieee154e_sleepSlots(ieee154e_slotsToNextActive());
+          incrementAsnOffsetBy(ieee154e_vars.numOfSleepSlots-1);
+      }
    } else {
       // this is NOT the next active slot, abort
+      if (idmanager_getIsSlotSkip() && idmanager_getIsDAGroot()==FALSE) {
+          // the next active slot was too far for the slot timer, sleep again
+          ieee154e_sleepSlots(ieee154e_slotsToNextActive());
+          incrementAsnOffsetBy(ieee154e_vars.numOfSleepSlots-1);
+      }
       // stop using serial
       openserial_stop();
       // abort the slot
@@ -918,7 +1095,11 @@ port_INLINE void activity_ti1ORri1() {
    }
    
    // check the schedule to see what type of slot this is
-   cellType = schedule_getType();
+   if (burstType!=CELLTYPE_OFF) {
+      cellType = burstType;
+   } else {
+      cellType = schedule_getType();
+   }
    switch (cellType) {
       case CELLTYPE_TXRX:
       case CELLTYPE_TX:
@@ -927,7 +1108,10 @@ port_INLINE void activity_ti1ORri1() {
          // assuming that there is nothing to send
          ieee154e_vars.dataToSend = NULL;
          // check whether we can send
-         if (schedule_getOkToSend()) {
+         if (burstType==CELLTYPE_TX) {
+            // the neighbor is expecting the next frame of the burst
+            ieee154e_vars.dataToSend = openqueue_macGetDataPacket(&ieee154e_vars.burstNeighbor);
+         } else if (schedule_getOkToSend()) {
             schedule_getNeighbor(&neighbor);
             ieee154e_vars.dataToSend = openqueue_macGetDataPacket(&neighbor);
             if ((ieee154e_vars.dataToSend==NULL) && (cellType==CELLTYPE_TXRX)) {
@@ -954,7 +1138,7 @@ port_INLINE void activity_ti1ORri1() {
                // fill in the ASN field of the EB
                ieee154e_getAsn(sync_IE.asn);
                sync_IE.join_priority = (neighbors_getMyDAGrank()/MINHOPRANKINCREASE)-1; //poipoi -- use dagrank(rank)-1
-               memcpy(ieee154e_vars.dataToSend->l2_ASNpayload,&sync_IE,sizeof(sync_IE_ht));
+               memcpy(&(ieee154e_vars.dataToSend->packet[ieee154e_vars.dataToSend->l2_ASNpayload]),&sync_IE,sizeof(sync_IE_ht));
             }
             // record that I attempt to transmit this packet
             ieee154e_vars.dataToSend->l2_numTxAttempts++;
@@ -981,11 +1165,18 @@ port_INLINE void activity_ti1ORri1() {
          openserial_startInput();
          //this is to emulate a set of serial input slots without having the slotted structure.
 
+         // the serial rx slots stop at a switch of timeslot template, the
+         // slots after it have another duration: the remaining ones are then
+         // woken up for, and keep the serial input going
+         numSerialSlots = NUMSERIALRX;
+         slotsToSwitch  = ieee154e_slotsToTimeslotTemplateSwitch();
+         if (slotsToSwitch>0 && slotsToSwitch<NUMSERIALRX) {
+            numSerialSlots = (uint8_t)slotsToSwitch;
+         }
+
          //skip the serial rx slots
-         ieee154e_vars.numOfSleepSlots = NUMSERIALRX;
-         
-         //increase ASN by NUMSERIALRX-1 slots as at this slot is already incremented by 1
-         for (i=0;i<NUMSERIALRX-1;i++){
+         //increase ASN by numSerialSlots-1 slots as at this slot is already incremented by 1
+         for (i=0;i<numSerialSlots-1;i++){
             incrementAsnOffset();
             // advance the schedule
             schedule_advanceSlot();
@@ -994,24 +1185,13 @@ port_INLINE void activity_ti1ORri1() {
          }
          // possibly skip additional slots if enabled
          if (idmanager_getIsSlotSkip() && idmanager_getIsDAGroot()==FALSE) {
-             if (ieee154e_vars.nextActiveSlotOffset>ieee154e_vars.slotOffset) {
-                 ieee154e_vars.numOfSleepSlots = ieee154e_vars.nextActiveSlotOffset-ieee154e_vars.slotOffset+NUMSERIALRX-1;
-             } else {
-                 ieee154e_vars.numOfSleepSlots = schedule_getFrameLength()+ieee154e_vars.nextActiveSlotOffset-ieee154e_vars.slotOffset+NUMSERIALRX-1; 
-             }
+             ieee154e_sleepSlots(ieee154e_slotsToNextActive()+numSerialSlots-1);
               
-             //only increase ASN by numOfSleepSlots-NUMSERIALRX
-             for (i=0;i<ieee154e_vars.numOfSleepSlots-NUMSERIALRX;i++){
-                incrementAsnOffset();
-             }
+             //only increase ASN by numOfSleepSlots-numSerialSlots
+             incrementAsnOffsetBy(ieee154e_vars.numOfSleepSlots-numSerialSlots);
+         } else {
+             ieee154e_sleepSlots(numSerialSlots);
          }
-         // set the timer based on calcualted number of slots to skip
-         radio_setTimerPeriod(TsSlotDuration*(ieee154e_vars.numOfSleepSlots));
-         
-#ifdef ADAPTIVE_SYNC
-         // deal with the case when schedule multi slots
-         adaptive_sync_countCompensationTimeout_compoundSlots(NUMSERIALRX-1);
-#endif
          break;
       case CELLTYPE_MORESERIALRX:
          // do nothing (not even endSlot())
@@ -1036,6 +1216,15 @@ port_INLINE void activity_ti2() {
 
    // make a local copy of the frame
    packetfunctions_duplicatePacket(&ieee154e_vars.localCopyForTransmission, ieee154e_vars.dataToSend);
+   
+   // announce a burst if more frames wait for the same neighbor
+   if (
+         openqueue_macIsDataPending(ieee154e_vars.dataToSend)==TRUE &&
+         ieee154e_isBurstPossible()==TRUE
+      ) {
+      ieee154e_vars.framePending = TRUE;
+      ieee802154_setFramePending(&ieee154e_vars.localCopyForTransmission,TRUE);
+   }
 
    // check if packet needs to be encrypted/authenticated before transmission 
    if (ieee154e_vars.localCopyForTransmission.l2_securityLevel != IEEE154_ASH_SLF_TYPE_NOSEC) { // security enabled
@@ -1211,6 +1400,7 @@ port_INLINE void activity_ti7() {
 port_INLINE void activity_tie5() {
    // indicate transmit failed to schedule to keep stats
    schedule_indicateTx(&ieee154e_vars.asn,FALSE);
+   ieee154e_countTx(FALSE);
    
    // decrement transmits left counter
    ieee154e_vars.dataToSend->l2_retriesLeft--;
@@ -1220,7 +1410,7 @@ port_INLINE void activity_tie5() {
       notif_sendDone(ieee154e_vars.dataToSend,E_FAIL);
    } else {
       // return packet to the virtual COMPONENT_SIXTOP_TO_IEEE802154E component
-      ieee154e_vars.dataToSend->owner = COMPONENT_SIXTOP_TO_IEEE802154E;
+      openqueue_setOwner(ieee154e_vars.dataToSend,COMPONENT_SIXTOP_TO_IEEE802154E);
    }
    
    // reset local variable
@@ -1297,7 +1487,7 @@ port_INLINE void activity_ti9(PORT_RADIOTIMER_WIDTH capturedTime) {
       ieee154e_vars.ackReceived->payload = &(ieee154e_vars.ackReceived->packet[FIRST_FRAME_BYTE]);
       radio_getReceivedFrame(       ieee154e_vars.ackReceived->payload,
                                    &ieee154e_vars.ackReceived->length,
-                             sizeof(ieee154e_vars.ackReceived->packet),
+                             ieee154e_vars.ackReceived->packetSize,
                                    &ieee154e_vars.ackReceived->l1_rssi,
                                    &ieee154e_vars.ackReceived->l1_lqi,
                                    &ieee154e_vars.ackReceived->l1_crc);
@@ -1360,6 +1550,13 @@ port_INLINE void activity_ti9(PORT_RADIOTIMER_WIDTH capturedTime) {
       
       // inform schedule of successful transmission
       schedule_indicateTx(&ieee154e_vars.asn,TRUE);
+      ieee154e_countTx(TRUE);
+      
+      // continue the burst in the next slot if the neighbor agreed to listen
+      if (ieee154e_vars.framePending==TRUE && ieee802514_header.framePending==TRUE) {
+         ieee154e_vars.burstType = CELLTYPE_TX;
+         memcpy(&ieee154e_vars.burstNeighbor,&(ieee154e_vars.dataToSend->l2_nextORpreviousHop),sizeof(open_addr_t));
+      }
       
       // inform upper layer
       notif_sendDone(ieee154e_vars.dataToSend,E_SUCCESS);
@@ -1368,6 +1565,11 @@ port_INLINE void activity_ti9(PORT_RADIOTIMER_WIDTH capturedTime) {
       // in any case, execute the clean-up code below (processing of ACK done)
    } while (0);
    
+   // no valid ACK, the transmission failed
+   if (ieee154e_vars.dataToSend!=NULL) {
+      ieee154e_countTx(FALSE);
+   }
+   
    // free the received ack so corresponding RAM memory can be recycled
    openqueue_freePacketBuffer(ieee154e_vars.ackReceived);
    
@@ -1501,11 +1703,18 @@ port_INLINE void activity_ri5(PORT_RADIOTIMER_WIDTH capturedTime) {
       ieee154e_vars.dataReceived->payload = &(ieee154e_vars.dataReceived->packet[FIRST_FRAME_BYTE]);
       radio_getReceivedFrame(       ieee154e_vars.dataReceived->payload,
                                    &ieee154e_vars.dataReceived->length,
-                             sizeof(ieee154e_vars.dataReceived->packet),
+                             ieee154e_vars.dataReceived->packetSize,
                                    &ieee154e_vars.dataReceived->l1_rssi,
                                    &ieee154e_vars.dataReceived->l1_lqi,
                                    &ieee154e_vars.dataReceived->l1_crc);
       
+      // keep per-channel statistics
+      ieee154e_countRx(
+         ieee154e_vars.dataReceived->l1_crc==FALSE           ||
+         ieee154e_vars.dataReceived->length<LENGTH_CRC       ||
+         ieee154e_vars.dataReceived->length>LENGTH_IEEE154_MAX
+      );
+      
       // break if wrong length
       if (ieee154e_vars.dataReceived->length<LENGTH_CRC || ieee154e_vars.dataReceived->length>LENGTH_IEEE154_MAX ) {
          // jump to the error code below this do-while loop
@@ -1573,10 +1782,12 @@ port_INLINE void activity_ri5(PORT_RADIOTIMER_WIDTH capturedTime) {
       }
       
       // record the timeCorrection and print out at end of slot
-      ieee154e_vars.dataReceived->l2_timeCorrection = (PORT_SIGNED_INT_WIDTH)((PORT_SIGNED_INT_WIDTH)TsTxOffset-(PORT_SIGNED_INT_WIDTH)ieee154e_vars.syncCapturedTime);
+      ieee154e_vars.dataReceived->l2_timeCorrection = (PORT_SIGNED_INT_WIDTH)((PORT_SIGNED_INT_WIDTH)ieee154e_vars.ts.txOffset-(PORT_SIGNED_INT_WIDTH)ieee154e_vars.syncCapturedTime);
       
       // check if ack requested
       if (ieee802514_header.ackRequested==1 && ieee154e_vars.isAckEnabled == TRUE) {
+         // listen in the next slot if the sender announces a burst and I can
+         ieee154e_vars.framePending = (ieee802514_header.framePending==TRUE && ieee154e_isBurstPossible()==TRUE);
          // arm rt5
          radiotimer_schedule(DURATION_rt5);
       } else {
@@ -1612,51 +1823,25 @@ port_INLINE void activity_ri6() {
    // change state
    changeState(S_TXACKPREPARE);
    
-   // get a buffer to put the ack to send in
-   ieee154e_vars.ackToSend = openqueue_getFreePacketBuffer(COMPONENT_IEEE802154E);
-   if (ieee154e_vars.ackToSend==NULL) {
-      // log the error
-      openserial_printError(COMPONENT_IEEE802154E,ERR_NO_FREE_PACKET_BUFFER,
-                            (errorparameter_t)0,
-                            (errorparameter_t)0);
-      // indicate we received a packet anyway (we don't want to loose any)
-      notif_receive(ieee154e_vars.dataReceived);
-      // free local variable
-      ieee154e_vars.dataReceived = NULL;
-      // abort
-      endSlot();
-      return;
-   }
-   
-   // declare ownership over that packet
-   ieee154e_vars.ackToSend->creator = COMPONENT_IEEE802154E;
-   ieee154e_vars.ackToSend->owner   = COMPONENT_IEEE802154E;
+   // the ack is built in its own buffer, no need to get one from the queue
+   ieee154e_vars.ackToSend = &ieee154e_vars.ackCopy;
    
    // calculate the time timeCorrection (this is the time the sender is off w.r.t to this node. A negative number means
    // the sender is too late.
-   ieee154e_vars.timeCorrection = (PORT_SIGNED_INT_WIDTH)((PORT_SIGNED_INT_WIDTH)TsTxOffset-(PORT_SIGNED_INT_WIDTH)ieee154e_vars.syncCapturedTime);
+   ieee154e_vars.timeCorrection = (PORT_SIGNED_INT_WIDTH)((PORT_SIGNED_INT_WIDTH)ieee154e_vars.ts.txOffset-(PORT_SIGNED_INT_WIDTH)ieee154e_vars.syncCapturedTime);
    
    // prepend the IEEE802.15.4 header to the ACK
-   ieee154e_vars.ackToSend->l2_frameType = IEEE154_TYPE_ACK;
-   ieee154e_vars.ackToSend->l2_dsn       = ieee154e_vars.dataReceived->l2_dsn;
-
-   // To send ACK, we use the same security level (including NOSEC) and keys
-   // that were present in the DATA packet.
-   ieee154e_vars.ackToSend->l2_securityLevel = ieee154e_vars.dataReceived->l2_securityLevel;
-   ieee154e_vars.ackToSend->l2_keyIdMode     = ieee154e_vars.dataReceived->l2_keyIdMode;
-   ieee154e_vars.ackToSend->l2_keyIndex      = ieee154e_vars.dataReceived->l2_keyIndex;
-
-   ieee802154_prependHeader(ieee154e_vars.ackToSend,
-                            ieee154e_vars.ackToSend->l2_frameType,
-                            FALSE,//no payloadIE in ack
-                            ieee154e_vars.dataReceived->l2_dsn,
-                            &(ieee154e_vars.dataReceived->l2_nextORpreviousHop)
-                            );
+   ieee154e_prepareAck();
+   
+   // accept the burst announced by the sender
+   if (ieee154e_vars.framePending==TRUE) {
+      ieee802154_setFramePending(ieee154e_vars.ackToSend,TRUE);
+      ieee154e_vars.burstType = CELLTYPE_RX;
+   }
    
    // if security is enabled, encrypt directly in OpenQueue as there are no retransmissions for ACKs
    if (ieee154e_vars.ackToSend->l2_securityLevel != IEEE154_ASH_SLF_TYPE_NOSEC) {
       if (IEEE802154_SECURITY.outgoingFrame(ieee154e_vars.ackToSend) != E_SUCCESS) {
-     	   openqueue_freePacketBuffer(ieee154e_vars.ackToSend);
      	   endSlot();
      	   return;
       }
@@ -1750,10 +1935,7 @@ port_INLINE void activity_ri9(PORT_RADIOTIMER_WIDTH capturedTime) {
    // record the captured time
    ieee154e_vars.lastCapturedTime = capturedTime;
    
-   // free the ack we just sent so corresponding RAM memory can be recycled
-   openqueue_freePacketBuffer(ieee154e_vars.ackToSend);
-   
-   // clear local variable
+   // clear local variable, the ack buffer is reused for the next ack
    ieee154e_vars.ackToSend = NULL;
    
    // synchronize to the received packet
@@ -1853,7 +2035,61 @@ port_INLINE void incrementAsnOffset() {
    } else {
       ieee154e_vars.slotOffset  = (ieee154e_vars.slotOffset+1)%frameLength;
    }
-   ieee154e_vars.asnOffset   = (ieee154e_vars.asnOffset+1)%16;
+   ieee154e_vars.asnOffset++;
+   if (ieee154e_vars.asnOffset==ieee154e_vars.chTemplateLength) {
+      ieee154e_vars.asnOffset = 0;
+   }
+}
+
+/**
+\brief Advance the ASN, and the offsets derived from it, by several slots at once.
+
+\param[in] numSlots The number of slots to advance by.
+*/
+port_INLINE void incrementAsnOffsetBy(PORT_RADIOTIMER_WIDTH numSlots) {
+   frameLength_t frameLength;
+   
+   // increment the asn
+   ieee154e_asnAdd(&ieee154e_vars.asn,numSlots);
+   
+   // increment the offsets
+   frameLength = schedule_getFrameLength();
+   if (frameLength == 0) {
+      ieee154e_vars.slotOffset   += numSlots;
+   } else {
+      ieee154e_vars.slotOffset    = (slotOffset_t)(((uint32_t)ieee154e_vars.slotOffset+numSlots)%frameLength);
+   }
+   ieee154e_vars.asnOffset        = (uint8_t)((ieee154e_vars.asnOffset+numSlots)%ieee154e_vars.chTemplateLength);
+}
+
+/**
+\brief Add a number of slots to an ASN.
+
+\param[in,out] asn   The ASN to add to.
+\param[in]     numSlots The number of slots to add.
+*/
+port_INLINE void ieee154e_asnAdd(asn_t* asn, uint32_t numSlots) {
+   uint32_t sum;
+   
+   // 16 bits at a time
+   sum                 = (uint32_t)asn->bytes0and1+(numSlots&0xffff);
+   asn->bytes0and1     = (uint16_t)sum;
+   sum                 = (uint32_t)asn->bytes2and3+(numSlots>>16)+(sum>>16);
+   asn->bytes2and3     = (uint16_t)sum;
+   asn->byte4         += (uint8_t)(sum>>16);
+}
+
+/**
+\brief Whether the current ASN is at or past some ASN.
+*/
+port_INLINE bool ieee154e_asnReached(asn_t* someASN) {
+   if (ieee154e_vars.asn.byte4!=someASN->byte4) {
+      return ieee154e_vars.asn.byte4>someASN->byte4;
+   }
+   if (ieee154e_vars.asn.bytes2and3!=someASN->bytes2and3) {
+      return ieee154e_vars.asn.bytes2and3>someASN->bytes2and3;
+   }
+   return ieee154e_vars.asn.bytes0and1>=someASN->bytes0and1;
 }
 
 //from upper layer that want to send the ASN to compute timing or latency
@@ -1940,6 +2176,189 @@ port_INLINE void ieee154e_syncSlotOffset() {
    slotOffset = slotOffset % frameLength;
    
    ieee154e_vars.slotOffset       = (slotOffset_t) slotOffset;
+   ieee154e_vars.frameLength      = frameLength;
+}
+
+/**
+\brief Determine the offset in the hopping sequence from the ASN.
+*/
+port_INLINE void ieee154e_syncAsnOffset() {
+   uint32_t asnOffset;
+   
+   asnOffset = ieee154e_vars.asn.byte4;
+   asnOffset = asnOffset % ieee154e_vars.chTemplateLength;
+   asnOffset = asnOffset << 16;
+   asnOffset = asnOffset + ieee154e_vars.asn.bytes2and3;
+   asnOffset = asnOffset % ieee154e_vars.chTemplateLength;
+   asnOffset = asnOffset << 16;
+   asnOffset = asnOffset + ieee154e_vars.asn.bytes0and1;
+   asnOffset = asnOffset % ieee154e_vars.chTemplateLength;
+   
+   ieee154e_vars.asnOffset        = (uint8_t) asnOffset;
+}
+
+//======= skipping idle slots
+
+/**
+\brief Number of slots from the current slot to the next active one.
+
+This is capped to what the slot timer can count, keeping some margin for the
+serial RX slots and the adaptive synchronization. The mote then wakes up
+before the next active slot, and goes back to sleep. It also wakes up at a
+pending switch of timeslot template, since the sleep is timed with the slot
+duration in use.
+*/
+port_INLINE PORT_RADIOTIMER_WIDTH ieee154e_slotsToNextActive() {
+   PORT_RADIOTIMER_WIDTH numSlots;
+   PORT_RADIOTIMER_WIDTH maxSlots;
+   uint32_t              slotsToSwitch;
+   
+   if (ieee154e_vars.nextActiveSlotOffset>ieee154e_vars.slotOffset) {
+      numSlots = ieee154e_vars.nextActiveSlotOffset-ieee154e_vars.slotOffset;
+   } else {
+      numSlots = schedule_getFrameLength()+ieee154e_vars.nextActiveSlotOffset-ieee154e_vars.slotOffset;
+   }
+   
+   // wake up at a switch of timeslot template, the slots after it have another duration
+   slotsToSwitch = ieee154e_slotsToTimeslotTemplateSwitch();
+   if (slotsToSwitch>0 && numSlots>slotsToSwitch) {
+      numSlots = (PORT_RADIOTIMER_WIDTH)slotsToSwitch;
+   }
+   
+   maxSlots    = ((PORT_RADIOTIMER_WIDTH)0xFFFFFFFF)/ieee154e_vars.slotDuration-NUMSERIALRX;
+   if (numSlots>maxSlots) {
+      numSlots = maxSlots;
+   }
+   return numSlots;
+}
+
+/**
+\brief Start the next slot a number of slots after the start of the current one.
+
+The slots in between are not woken up for. The caller advances the ASN over
+them. They are still counted by the adaptive synchronization.
+
+\param[in] numOfSleepSlots The number of slots, 1 to wake up at the next slot.
+*/
+port_INLINE void ieee154e_sleepSlots(PORT_RADIOTIMER_WIDTH numOfSleepSlots) {
+   ieee154e_vars.numOfSleepSlots = numOfSleepSlots;
+#ifdef ADAPTIVE_SYNC
+   // also applies the compensation due over these slots
+   adaptive_sync_countCompensationTimeout_compoundSlots(numOfSleepSlots-1);
+#else
+   radio_setTimerPeriod(ieee154e_vars.slotDuration*numOfSleepSlots);
+#endif
+}
+
+//======= frame pending
+
+/**
+\brief Whether a burst may continue in the slot following the current one.
+
+The next slot must be an idle one, so the burst does not take over another
+cell, and this mote must wake up for it, i.e. not be skipping slots.
+*/
+port_INLINE bool ieee154e_isBurstPossible() {
+   slotOffset_t nextSlotOffset;
+   
+   if (ieee154e_vars.numOfSleepSlots!=1) {
+      return FALSE;
+   }
+   nextSlotOffset = ieee154e_vars.slotOffset+1;
+   if (nextSlotOffset>=schedule_getFrameLength()) {
+      nextSlotOffset = 0;
+   }
+   return nextSlotOffset!=ieee154e_vars.nextActiveSlotOffset;
+}
+
+//======= ACK templates
+
+/**
+\brief Build the ACK to the frame just received into ackCopy.
+
+The header of an ACK only depends on the neighbor ACKed and on the security
+configuration, except for the sequence number and the time correction. It is
+built by ieee802154_prependHeader() the first time, kept as a template, and
+copied and patched for the next ACKs to that neighbor. The template also keeps
+the security metadata the auxiliary security header sets (MIC length, frame
+counter location), as the MIC, if any, is computed afterwards by the caller.
+*/
+port_INLINE void ieee154e_prepareAck() {
+   OpenQueueEntry_t*         ack;
+   OpenQueueEntry_t*         data;
+   ieee154e_ackTemplate_t*   ackTemplate;
+   uint8_t                   i;
+   
+   ack  = &ieee154e_vars.ackCopy;
+   data = ieee154e_vars.dataReceived;
+   
+   // reset the metadata, keeping the frame buffer
+   memset(ack,0,sizeof(OpenQueueEntry_t));
+   ack->packet                 = &(ieee154e_vars.ackCopyPacket[0]);
+   ack->packetSize             = OPENQUEUE_SMALL_PACKET_SIZE;
+   ack->payload                = &(ack->packet[ack->packetSize-3-IEEE802154_SECURITY_TAG_LEN]);
+   ack->creator                = COMPONENT_IEEE802154E;
+   ack->owner                  = COMPONENT_IEEE802154E;
+   ack->l2_frameType           = IEEE154_TYPE_ACK;
+   ack->l2_dsn                 = data->l2_dsn;
+   
+   // To send ACK, we use the same security level (including NOSEC) and keys
+   // that were present in the DATA packet.
+   ack->l2_securityLevel       = data->l2_securityLevel;
+   ack->l2_keyIdMode           = data->l2_keyIdMode;
+   ack->l2_keyIndex            = data->l2_keyIndex;
+   
+   // look for the template of the ACKs to that neighbor
+   ackTemplate = NULL;
+   for (i=0;i<ACKTEMPLATE_NUM;i++) {
+      if (
+            ieee154e_vars.ackTemplates[i].securityLevel==ack->l2_securityLevel &&
+            ieee154e_vars.ackTemplates[i].keyIdMode    ==ack->l2_keyIdMode     &&
+            ieee154e_vars.ackTemplates[i].keyIndex     ==ack->l2_keyIndex      &&
+            packetfunctions_sameAddress(&ieee154e_vars.ackTemplates[i].neighbor,&data->l2_nextORpreviousHop)
+         ) {
+         ackTemplate = &ieee154e_vars.ackTemplates[i];
+         break;
+      }
+   }
+   
+   if (ackTemplate!=NULL) {
+      // copy the template, patch what changes
+      packetfunctions_reserveHeaderSize(ack,ackTemplate->length);
+      memcpy(ack->payload,ackTemplate->header,ackTemplate->length);
+      ack->l2_payload              = (uint8_t)(ack->payload-ack->packet)+ackTemplate->length;
+      // restore what the auxiliary security header sets, the MIC needs it
+      ack->l2_authenticationLength = ackTemplate->authenticationLength;
+      if (ackTemplate->frameCounterOffset!=ACKTEMPLATE_NOFRAMECOUNTER) {
+         ack->l2_FrameCounter      = (uint8_t)(ack->payload-ack->packet)+ackTemplate->frameCounterOffset;
+      }
+      ieee802154_updateAckHeader(ack,data->l2_dsn);
+   } else {
+      // build the header from scratch
+      ieee802154_prependHeader(ack,
+                               ack->l2_frameType,
+                               FALSE,//no payloadIE in ack
+                               data->l2_dsn,
+                               &(data->l2_nextORpreviousHop)
+                               );
+      // keep it as template, replacing the oldest one
+      if (ack->length<=ACKTEMPLATE_MAXLENGTH) {
+         ackTemplate = &ieee154e_vars.ackTemplates[ieee154e_vars.ackTemplateNext];
+         ieee154e_vars.ackTemplateNext = (ieee154e_vars.ackTemplateNext+1)%ACKTEMPLATE_NUM;
+         memcpy(&ackTemplate->neighbor,&data->l2_nextORpreviousHop,sizeof(open_addr_t));
+         ackTemplate->securityLevel        = ack->l2_securityLevel;
+         ackTemplate->keyIdMode            = ack->l2_keyIdMode;
+         ackTemplate->keyIndex             = ack->l2_keyIndex;
+         ackTemplate->authenticationLength = ack->l2_authenticationLength;
+         if (ack->l2_FrameCounter!=0) {
+            ackTemplate->frameCounterOffset = (uint8_t)(ack->l2_FrameCounter-(ack->payload-ack->packet));
+         } else {
+            ackTemplate->frameCounterOffset = ACKTEMPLATE_NOFRAMECOUNTER;
+         }
+         ackTemplate->length               = ack->length;
+         memcpy(ackTemplate->header,ack->payload,ack->length);
+      }
+   }
 }
 
 void ieee154e_setIsAckEnabled(bool isEnabled){
@@ -1962,22 +2381,712 @@ void ieee154e_setIsSecurityEnabled(bool isEnabled){
     ieee154e_vars.isSecurityEnabled = isEnabled;
 }
 
+/**
+\brief Run this board's timing over slots of another duration.
+
+The slot duration is then advertised in the EBs, with the
+TIMESLOT_TEMPLATE_ID_CUSTOM template. The duration is refused if that timing
+does not fit in it. Once synchronized, the network switches to it at the same
+ASN, see ieee154e_changeTimeslotTemplate().
+
+\param[in] duration The slot duration, in 32kHz ticks.
+*/
 void ieee154e_setSlotDuration(uint16_t duration){
-    ieee154e_vars.slotDuration = duration;
+    ieee154e_changeTimeslotTemplate(TIMESLOT_TEMPLATE_ID_CUSTOM,duration);
 }
 
 uint16_t ieee154e_getSlotDuration(){
     return ieee154e_vars.slotDuration;
 }
 
+/**
+\brief Switch to one of the standard timeslot templates.
+
+Meant for the DAG root, through the COMMAND_SET_TIMESLOT_TEMPLATE serial
+command. The other motes follow the template advertised in its EBs, see
+ieee154e_changeTimeslotTemplate().
+
+\param[in] id The ID of the template.
+
+\returns E_SUCCESS if the template is known and fits the timing of this board,
+   E_FAIL otherwise, or if the previous switch did not happen yet.
+*/
+owerror_t ieee154e_setTimeslotTemplate(uint8_t id){
+    if (id>=TIMESLOT_TEMPLATE_NUM) {
+        return E_FAIL;
+    }
+    if (ieee154e_changeTimeslotTemplate(id,ieee154e_timeslotTemplates[id].slotDuration)==FALSE) {
+        return E_FAIL;
+    }
+    return E_SUCCESS;
+}
+
+uint8_t ieee154e_getTimeslotTemplateId(){
+    return ieee154e_vars.tsTemplateId;
+}
+
+/**
+\brief Get the timeslot template the network switches to, if any.
+
+\param[out] id           The ID of the template.
+\param[out] slotDuration The slot duration, in 32kHz ticks.
+\param[out] switchAsn    The ASN of the switch.
+
+\returns TRUE if a switch is scheduled, FALSE otherwise.
+*/
+bool ieee154e_getPendingTimeslotTemplate(uint8_t* id, uint16_t* slotDuration, asn_t* switchAsn){
+    bool isPending;
+    INTERRUPT_DECLARATION();
+    
+    DISABLE_INTERRUPTS();
+    isPending = ieee154e_vars.tsTemplateIsPending;
+    if (isPending==TRUE) {
+        *id           = ieee154e_vars.tsTemplatePendingId;
+        *slotDuration = ieee154e_vars.tsTemplatePendingDuration;
+        memcpy(switchAsn,&(ieee154e_vars.tsTemplatePendingAsn),sizeof(asn_t));
+    }
+    ENABLE_INTERRUPTS();
+    return isPending;
+}
+
 // timeslot template handling
-port_INLINE void timeslotTemplateIDStoreFromEB(uint8_t id){
+
+/**
+\brief Store the timeslot templates advertised in an EB.
+
+The Timeslot IE holds the template in use: its ID, followed by the slot
+duration (2 bytes, little endian) unless it is the default template. It may be
+followed by a template the network switches to: its ID, its slot duration, and
+the ASN of the switch.
+
+A mote does not synchronize to a network whose template it does not know or
+cannot keep up with. Once synchronized, it only changes template at the ASN of
+a switch, together with the rest of the network: switching on hearing an EB
+would start its slots out of step with the neighbors which did not switch
+yet. A mote which missed a switch desynchronizes, and takes the template in
+use when it synchronizes again.
+
+\param[in] ie  The content of the IE.
+\param[in] len The length of the content of the IE.
+
+\returns The number of bytes parsed, 0 if a template cannot be used.
+*/
+port_INLINE uint8_t timeslotTemplateStoreFromEB(uint8_t* ie, uint16_t len){
+    uint8_t  id;
+    uint16_t slotDuration;
+    asn_t    switchAsn;
+    uint8_t  ptr;
+    
+    ptr = 0;
+    
+    // template in use
+    if (len<1) {
+        return 0;
+    }
+    id = ie[ptr++];
+    if (id>=TIMESLOT_TEMPLATE_NUM) {
+        return 0;
+    }
+    slotDuration = ieee154e_timeslotTemplates[id].slotDuration;
+    if (id!=TIMESLOT_TEMPLATE_ID) {
+        if (len<3) {
+            return 0;
+        }
+        // the duration only matters with the custom template
+        if (id==TIMESLOT_TEMPLATE_ID_CUSTOM) {
+            slotDuration  = ie[ptr];
+            slotDuration |= (ie[ptr+1]<<8) & 0xff00;
+        }
+        ptr += 2;
+    }
+    
+    // only taken before synchronizing, if that is not already the template in use
+    if (
+          ieee154e_vars.isSync==FALSE &&
+          (id!=ieee154e_vars.tsTemplateId || slotDuration!=ieee154e_vars.slotDuration)
+       ) {
+        if (ieee154e_applyTimeslotTemplate(id,slotDuration)==FALSE) {
+            return 0;
+        }
+    }
+    
+    // template the network switches to
+    if (ptr<len) {
+        if (ptr+8>len) {
+            return 0;
+        }
+        id                   = ie[ptr];
+        slotDuration         = ie[ptr+1];
+        slotDuration        |= (ie[ptr+2]<<8) & 0xff00;
+        switchAsn.bytes0and1 = ie[ptr+3]+256*ie[ptr+4];
+        switchAsn.bytes2and3 = ie[ptr+5]+256*ie[ptr+6];
+        switchAsn.byte4      = ie[ptr+7];
+        ptr                  = ptr + 8;
+        if (id>=TIMESLOT_TEMPLATE_NUM) {
+            return 0;
+        }
+        // the duration only matters with the custom template
+        if (id!=TIMESLOT_TEMPLATE_ID_CUSTOM) {
+            slotDuration     = ieee154e_timeslotTemplates[id].slotDuration;
+        }
+        if (
+              ieee154e_asnReached(&switchAsn)==FALSE &&
+              (
+                 ieee154e_vars.tsTemplateIsPending==FALSE                            ||
+                 id!=ieee154e_vars.tsTemplatePendingId                               ||
+                 slotDuration!=ieee154e_vars.tsTemplatePendingDuration               ||
+                 switchAsn.bytes0and1!=ieee154e_vars.tsTemplatePendingAsn.bytes0and1 ||
+                 switchAsn.bytes2and3!=ieee154e_vars.tsTemplatePendingAsn.bytes2and3 ||
+                 switchAsn.byte4!=ieee154e_vars.tsTemplatePendingAsn.byte4
+              )
+           ) {
+            if (ieee154e_scheduleTimeslotTemplate(id,slotDuration,&switchAsn)==FALSE) {
+                return 0;
+            }
+        }
+    }
+    return ptr;
+}
+
+/**
+\brief Change the timeslot template of the network.
+
+Until this mote is synchronized, the template is used at once. Once it is, the
+whole network switches TSTEMPLATE_SWITCHDELAY slots later, at the same ASN,
+so neighbors never run slots of different durations. Until then, the template
+is advertised in EBs together with the one in use, so it spreads through the
+network.
+
+\param[in] id           The ID of the template.
+\param[in] slotDuration The slot duration, in 32kHz ticks.
+
+\returns TRUE if the template is used or the switch scheduled, FALSE if its
+   timing does not fit this board, or if the previous switch did not happen yet.
+*/
+port_INLINE bool ieee154e_changeTimeslotTemplate(uint8_t id, uint16_t slotDuration){
+    asn_t switchAsn;
+    INTERRUPT_DECLARATION();
+    
+    if (ieee154e_vars.isSync==FALSE) {
+        return ieee154e_applyTimeslotTemplate(id,slotDuration);
+    }
+    if (ieee154e_vars.tsTemplateIsPending==TRUE) {
+        return FALSE;
+    }
+    
+    DISABLE_INTERRUPTS();
+    memcpy(&switchAsn,&ieee154e_vars.asn,sizeof(asn_t));
+    ENABLE_INTERRUPTS();
+    ieee154e_asnAdd(&switchAsn,TSTEMPLATE_SWITCHDELAY);
+    return ieee154e_scheduleTimeslotTemplate(id,slotDuration,&switchAsn);
+}
+
+/**
+\brief Switch to another timeslot template at a given ASN.
+
+The switch happens at the start of that slot, in activity_ti1ORri1(). Until
+then, the mote does not sleep over it.
+
+\param[in] id           The ID of the template.
+\param[in] slotDuration The slot duration, in 32kHz ticks.
+\param[in] switchAsn    The ASN of the switch.
+
+\returns TRUE if the switch is scheduled, FALSE if the timing does not fit this
+   board.
+*/
+port_INLINE bool ieee154e_scheduleTimeslotTemplate(uint8_t id, uint16_t slotDuration, asn_t* switchAsn){
+    ieee154e_timeslotTemplate_t ts;
+    INTERRUPT_DECLARATION();
+    
+    if (ieee154e_buildTimeslotTemplate(id,slotDuration,&ts)==FALSE) {
+        return FALSE;
+    }
+    
+    DISABLE_INTERRUPTS();
+    ieee154e_vars.tsTemplatePendingId       = id;
+    ieee154e_vars.tsTemplatePendingDuration = ts.slotDuration;
+    memcpy(&(ieee154e_vars.tsTemplatePendingAsn),switchAsn,sizeof(asn_t));
+    ieee154e_vars.tsTemplateIsPending       = TRUE;
+    ENABLE_INTERRUPTS();
+    return TRUE;
+}
+
+/**
+\brief Number of slots from the current slot to a pending switch of timeslot
+   template.
+
+\returns The number of slots, 0 if no switch is pending.
+*/
+port_INLINE uint32_t ieee154e_slotsToTimeslotTemplateSwitch(){
+    uint32_t numSlots;
+    
+    if (
+          ieee154e_vars.tsTemplateIsPending==FALSE ||
+          ieee154e_asnReached(&ieee154e_vars.tsTemplatePendingAsn)==TRUE
+       ) {
+        return 0;
+    }
+    
+    // the switch is less than 2^32 slots ahead, the difference is taken modulo 2^32
+    numSlots  = (uint32_t)(uint16_t)(ieee154e_vars.tsTemplatePendingAsn.bytes2and3-ieee154e_vars.asn.bytes2and3)<<16;
+    numSlots += ieee154e_vars.tsTemplatePendingAsn.bytes0and1;
+    numSlots -= ieee154e_vars.asn.bytes0and1;
+    return numSlots;
+}
+
+/**
+\brief Use the timing of a timeslot template, over slots of the given duration.
+
+\returns TRUE if the timing fits this board and is used, FALSE otherwise.
+*/
+port_INLINE bool ieee154e_applyTimeslotTemplate(uint8_t id, uint16_t slotDuration){
+    ieee154e_timeslotTemplate_t ts;
+    
+    if (ieee154e_buildTimeslotTemplate(id,slotDuration,&ts)==FALSE) {
+        return FALSE;
+    }
+    
+    memcpy(&ieee154e_vars.ts,&ts,sizeof(ieee154e_timeslotTemplate_t));
+    ieee154e_vars.slotDuration = slotDuration;
     ieee154e_vars.tsTemplateId = id;
+    return TRUE;
+}
+
+/**
+\brief The timing of a timeslot template, over slots of the given duration.
+
+\param[out] ts Where to write the timing.
+
+\returns TRUE if the timing fits this board, FALSE otherwise.
+*/
+port_INLINE bool ieee154e_buildTimeslotTemplate(uint8_t id, uint16_t slotDuration, ieee154e_timeslotTemplate_t* ts){
+    memcpy(ts,&ieee154e_timeslotTemplates[id],sizeof(ieee154e_timeslotTemplate_t));
+    ts->slotDuration = slotDuration;
+    
+    if (ieee154e_isValidTimeslotTemplate(ts)==FALSE) {
+        openserial_printError(COMPONENT_IEEE802154E,ERR_INVALID_TIMESLOT_TEMPLATE,
+                              (errorparameter_t)id,
+                              (errorparameter_t)slotDuration);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+/**
+\brief Check that this board can keep up with the timing of a timeslot template.
+
+Each deadline of the slot has to leave room for this board's preparation time
+(maxTxDataPrepare, etc.) and radio turnaround (delayTx, delayRx), the radio
+watchdogs have to cover the longest frames, and the longest exchange (a
+127-byte frame and its ACK) has to end within the slot.
+*/
+port_INLINE bool ieee154e_isValidTimeslotTemplate(const ieee154e_timeslotTemplate_t* ts){
+    // the data is ready to be sent at TsTxOffset
+    if (ts->txOffset<maxTxDataPrepare+delayTx) {
+        return FALSE;
+    }
+    // the receiver listens TsLongGT before TsTxOffset
+    if (ts->txOffset<ts->longGT+maxRxDataPrepare+delayRx) {
+        return FALSE;
+    }
+    // the ACK is ready to be sent at TsTxAckDelay
+    if (ts->txAckDelay<maxTxAckPrepare+delayTx) {
+        return FALSE;
+    }
+    // the transmitter listens TsShortGT before TsTxAckDelay
+    if (ts->txAckDelay<ts->shortGT+maxRxAckPrepare+delayRx) {
+        return FALSE;
+    }
+    // radio watchdogs
+    if (
+          ts->wdRadioTx<=delayTx                                                          ||
+          ts->wdDataDuration<AIRTIME_TICKS(LENGTH_IEEE154_MAX+LENGTH_IEEE154_PHYHEADER)   ||
+          ts->wdAckDuration<AIRTIME_TICKS(LENGTH_IEEE154_ACK+LENGTH_IEEE154_PHYHEADER)
+       ) {
+        return FALSE;
+    }
+    // the longest exchange ends within the slot
+    if (
+          (uint32_t)ts->txOffset                                                     +
+          AIRTIME_TICKS(LENGTH_IEEE154_MAX+LENGTH_IEEE154_PHYHEADER)                 +
+          ts->txAckDelay                                                             +
+          AIRTIME_TICKS(LENGTH_IEEE154_ACK+LENGTH_IEEE154_PHYHEADER)
+          > ts->slotDuration
+       ) {
+        return FALSE;
+    }
+    return TRUE;
 }
 
 // channelhopping template handling
-port_INLINE void channelhoppingTemplateIDStoreFromEB(uint8_t id){
-    ieee154e_vars.chTemplateId = id;
+
+/**
+\brief Store the channel hopping templates advertised in an EB.
+
+The Channel Hopping IE holds the template in use: its ID, followed by the
+length and channels of the sequence unless it is the default one. It may be
+followed by a template the network switches to: its ID, the length and
+channels of its sequence, and the ASN of the switch.
+
+A synchronized mote only takes templates newer than the one it uses, so EBs
+from neighbors which did not switch yet do not revert it.
+
+\param[in] ie  The content of the IE.
+\param[in] len The length of the content of the IE.
+
+\returns The number of bytes parsed, 0 if the IE is not valid.
+*/
+port_INLINE uint8_t channelhoppingTemplateStoreFromEB(uint8_t* ie, uint16_t len){
+    uint8_t   ptr;
+    uint8_t   id;
+    uint8_t   length;
+    uint8_t*  sequence;
+    asn_t     switchAsn;
+    
+    ptr = 0;
+    
+    // template in use
+    id       = ie[ptr];
+    ptr      = ptr + 1;
+    length   = 0;
+    sequence = NULL;
+    if (id!=CHANNELHOPPING_TEMPLATE_ID) {
+        length   = ie[ptr];
+        ptr      = ptr + 1;
+        sequence = &ie[ptr];
+        ptr      = ptr + length;
+    }
+    if (ptr>len) {
+        return 0;
+    }
+    if (ieee154e_vars.isSync==FALSE || ieee154e_isNewerChannelHoppingTemplate(id)==TRUE) {
+        if (ieee154e_setChannelHoppingTemplate(id,sequence,length)!=E_SUCCESS) {
+            return 0;
+        }
+        if (
+              ieee154e_vars.chTemplateIsPending==TRUE &&
+              ieee154e_isNewerChannelHoppingTemplate(ieee154e_vars.chTemplatePendingId)==FALSE
+           ) {
+            // the switch already happened
+            ieee154e_vars.chTemplateIsPending = FALSE;
+        }
+    }
+    
+    // template the network switches to
+    if (ptr<len) {
+        id       = ie[ptr];
+        ptr      = ptr + 1;
+        length   = ie[ptr];
+        ptr      = ptr + 1;
+        sequence = &ie[ptr];
+        ptr      = ptr + length;
+        if (ptr+5>len) {
+            return 0;
+        }
+        switchAsn.bytes0and1 = ie[ptr+0]+256*ie[ptr+1];
+        switchAsn.bytes2and3 = ie[ptr+2]+256*ie[ptr+3];
+        switchAsn.byte4      = ie[ptr+4];
+        ptr      = ptr + 5;
+        if (
+              ieee154e_isNewerChannelHoppingTemplate(id)==TRUE &&
+              (
+                 ieee154e_vars.chTemplateIsPending==FALSE ||
+                 (int8_t)(id-ieee154e_vars.chTemplatePendingId)>0
+              )
+           ) {
+            if (ieee154e_scheduleChannelHoppingTemplate(id,sequence,length,&switchAsn)!=E_SUCCESS) {
+                return 0;
+            }
+        }
+    }
+    
+    return ptr;
+}
+
+/**
+\brief Whether a hopping sequence is valid.
+*/
+port_INLINE bool ieee154e_isValidChannelHoppingSequence(uint8_t* sequence, uint8_t length){
+    uint8_t i;
+    
+    if (length==0 || length>CHTEMPLATE_MAXLENGTH) {
+        return FALSE;
+    }
+    for (i=0;i<length;i++) {
+        if (sequence[i]>=NUM_CHANNELS) {
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+/**
+\brief Whether a template ID is newer than the template in use.
+
+Template IDs are compared as sequence numbers, so they can wrap around.
+*/
+port_INLINE bool ieee154e_isNewerChannelHoppingTemplate(uint8_t id){
+    return (int8_t)(id-ieee154e_vars.chTemplateId)>0;
+}
+
+/**
+\brief Set the channel hopping sequence.
+
+The frequencies are precomputed into a table holding the sequence twice, so
+calculateFrequency() indexes it directly with the offset in the sequence plus
+the channel offset, without wrapping around.
+
+\param[in] id       The template ID, CHANNELHOPPING_TEMPLATE_ID for the default
+   sequence, in which case sequence and length are ignored.
+\param[in] sequence The channels of the sequence, each between 0 (channel 11)
+   and 15 (channel 26).
+\param[in] length   The number of channels in the sequence.
+
+\returns E_SUCCESS if the sequence is used, E_FAIL if it is not valid.
+*/
+owerror_t ieee154e_setChannelHoppingTemplate(uint8_t id, uint8_t* sequence, uint8_t length){
+    uint8_t i;
+    
+    if (id==CHANNELHOPPING_TEMPLATE_ID) {
+        sequence = (uint8_t*)chTemplate_default;
+        length   = sizeof(chTemplate_default);
+    }
+    if (ieee154e_isValidChannelHoppingSequence(sequence,length)==FALSE) {
+        return E_FAIL;
+    }
+    
+    ieee154e_vars.chTemplateId     = id;
+    ieee154e_vars.chTemplateLength = length;
+    memcpy(&(ieee154e_vars.chTemplate[0]),sequence,length);
+    for (i=0;i<sizeof(ieee154e_vars.chTable);i++) {
+        ieee154e_vars.chTable[i]   = 11+sequence[i%length];
+    }
+    
+    // the offset in the sequence depends on its length
+    ieee154e_syncAsnOffset();
+    return E_SUCCESS;
+}
+
+uint8_t ieee154e_getChannelHoppingTemplateId(){
+    return ieee154e_vars.chTemplateId;
+}
+
+/**
+\brief Get the channel hopping sequence in use.
+
+\param[out] sequence Where to copy the sequence, CHTEMPLATE_MAXLENGTH bytes.
+
+\returns The number of channels in the sequence.
+*/
+uint8_t ieee154e_getChannelHoppingSequence(uint8_t* sequence){
+    memcpy(sequence,&(ieee154e_vars.chTemplate[0]),ieee154e_vars.chTemplateLength);
+    return ieee154e_vars.chTemplateLength;
+}
+
+/**
+\brief Switch to another channel hopping sequence at a given ASN.
+
+All the motes switch at the same ASN. Until then, the new sequence is
+advertised in EBs together with the one in use, so it spreads through the
+network.
+
+\param[in] id        The template ID of the sequence, newer than the one in use.
+\param[in] sequence  The channels of the sequence.
+\param[in] length    The number of channels in the sequence.
+\param[in] switchAsn The ASN of the switch.
+
+\returns E_SUCCESS if the switch is scheduled, E_FAIL if the sequence is not valid.
+*/
+owerror_t ieee154e_scheduleChannelHoppingTemplate(uint8_t id, uint8_t* sequence, uint8_t length, asn_t* switchAsn){
+    INTERRUPT_DECLARATION();
+    
+    if (ieee154e_isValidChannelHoppingSequence(sequence,length)==FALSE) {
+        return E_FAIL;
+    }
+    
+    DISABLE_INTERRUPTS();
+    ieee154e_vars.chTemplatePendingId     = id;
+    ieee154e_vars.chTemplatePendingLength = length;
+    memcpy(&(ieee154e_vars.chTemplatePending[0]),sequence,length);
+    memcpy(&(ieee154e_vars.chTemplatePendingAsn),switchAsn,sizeof(asn_t));
+    ieee154e_vars.chTemplateIsPending     = TRUE;
+    ENABLE_INTERRUPTS();
+    return E_SUCCESS;
+}
+
+/**
+\brief Get the channel hopping sequence the network switches to, if any.
+
+\param[out] id        The template ID of the sequence.
+\param[out] sequence  Where to copy the sequence, CHTEMPLATE_MAXLENGTH bytes.
+\param[out] length    The number of channels in the sequence.
+\param[out] switchAsn The ASN of the switch.
+
+\returns TRUE if a switch is scheduled, FALSE otherwise.
+*/
+bool ieee154e_getPendingChannelHoppingTemplate(uint8_t* id, uint8_t* sequence, uint8_t* length, asn_t* switchAsn){
+    bool isPending;
+    INTERRUPT_DECLARATION();
+    
+    DISABLE_INTERRUPTS();
+    isPending = ieee154e_vars.chTemplateIsPending;
+    if (isPending==TRUE) {
+        *id     = ieee154e_vars.chTemplatePendingId;
+        *length = ieee154e_vars.chTemplatePendingLength;
+        memcpy(sequence,&(ieee154e_vars.chTemplatePending[0]),ieee154e_vars.chTemplatePendingLength);
+        memcpy(switchAsn,&(ieee154e_vars.chTemplatePendingAsn),sizeof(asn_t));
+    }
+    ENABLE_INTERRUPTS();
+    return isPending;
+}
+
+//======= channel blacklisting
+
+/**
+\brief Blacklist the channels with poor link statistics.
+
+This is called periodically on the DAG root, which decides of the hopping
+sequence of the network. A channel is blacklisted when, over enough frames,
+too few of the frames sent on it were acknowledged, or too many of the
+frames received on it were corrupted. It is tried again after
+CHBLACKLIST_TIMEOUT calls. At least CHBLACKLIST_MINCHANNELS channels are
+always kept.
+
+When the set of blacklisted channels changes, the network switches to the
+default hopping sequence without the blacklisted channels, under a new
+template ID, CHTEMPLATE_SWITCHDELAY slots later.
+
+The statistics are halved at each call, so recent frames weigh most.
+*/
+void ieee154e_updateChannelBlacklist(){
+    ieee154e_channelStats_t* stats;
+    uint8_t                  sequence[CHTEMPLATE_MAXLENGTH];
+    uint8_t                  length;
+    uint8_t                  numBlacklisted;
+    uint8_t                  id;
+    asn_t                    switchAsn;
+    bool                     changed;
+    uint8_t                  i;
+    INTERRUPT_DECLARATION();
+    
+    if (
+          ieee154e_vars.singleChannel!=0 ||
+          ieee154e_vars.chTemplateIsPending==TRUE
+       ) {
+        // not hopping, or the previous switch did not happen yet
+        return;
+    }
+    
+    numBlacklisted = 0;
+    for (i=0;i<NUM_CHANNELS;i++) {
+        if (ieee154e_chStats.channels[i].blacklistTimeout>0) {
+            numBlacklisted++;
+        }
+    }
+    
+    changed = FALSE;
+    DISABLE_INTERRUPTS();
+    for (i=0;i<NUM_CHANNELS;i++) {
+        stats = &ieee154e_chStats.channels[i];
+        if (stats->blacklistTimeout>0) {
+            // blacklisted, try it again once the timeout expires
+            stats->blacklistTimeout--;
+            if (stats->blacklistTimeout==0) {
+                changed = TRUE;
+            }
+        } else if (
+              ieee154e_isBadChannel(stats)==TRUE &&
+              NUM_CHANNELS-numBlacklisted>CHBLACKLIST_MINCHANNELS
+           ) {
+            memset(stats,0,sizeof(ieee154e_channelStats_t));
+            stats->blacklistTimeout = CHBLACKLIST_TIMEOUT;
+            numBlacklisted++;
+            changed = TRUE;
+        }
+        stats->numTx     = stats->numTx>>1;
+        stats->numTxAck  = stats->numTxAck>>1;
+        stats->numRx     = stats->numRx>>1;
+        stats->numRxFail = stats->numRxFail>>1;
+    }
+    memcpy(&switchAsn,&ieee154e_vars.asn,sizeof(asn_t));
+    ENABLE_INTERRUPTS();
+    
+    if (changed==FALSE) {
+        return;
+    }
+    
+    // the default sequence, without the blacklisted channels
+    length = 0;
+    for (i=0;i<sizeof(chTemplate_default);i++) {
+        if (ieee154e_chStats.channels[chTemplate_default[i]].blacklistTimeout==0) {
+            sequence[length++] = chTemplate_default[i];
+        }
+    }
+    
+    // a new template, the default one's ID is never reused
+    id = ieee154e_vars.chTemplateId+1;
+    if (id==CHANNELHOPPING_TEMPLATE_ID) {
+        id++;
+    }
+    ieee154e_asnAdd(&switchAsn,CHTEMPLATE_SWITCHDELAY);
+    ieee154e_scheduleChannelHoppingTemplate(id,sequence,length,&switchAsn);
+}
+
+/**
+\brief Whether the statistics of a channel are poor enough to blacklist it.
+*/
+port_INLINE bool ieee154e_isBadChannel(ieee154e_channelStats_t* stats){
+    if (
+          stats->numTx>=CHBLACKLIST_MINSAMPLES &&
+          (uint32_t)stats->numTxAck*100<(uint32_t)stats->numTx*CHBLACKLIST_MINPDR
+       ) {
+        return TRUE;
+    }
+    if (
+          stats->numRx>=CHBLACKLIST_MINSAMPLES &&
+          (uint32_t)(stats->numRx-stats->numRxFail)*100<(uint32_t)stats->numRx*CHBLACKLIST_MINPDR
+       ) {
+        return TRUE;
+    }
+    return FALSE;
+}
+
+/**
+\brief Count a unicast transmission on the channel of the current slot.
+
+\param[in] acked Whether it was acknowledged.
+*/
+port_INLINE void ieee154e_countTx(bool acked){
+    ieee154e_channelStats_t* stats;
+    
+    stats = &ieee154e_chStats.channels[ieee154e_vars.freq-11];
+    if (stats->numTx==0xffff) {
+        stats->numTx     = stats->numTx>>1;
+        stats->numTxAck  = stats->numTxAck>>1;
+    }
+    stats->numTx++;
+    if (acked==TRUE) {
+        stats->numTxAck++;
+    }
+}
+
+/**
+\brief Count a reception on the channel of the current slot.
+
+\param[in] failed Whether the frame was received with a wrong length or CRC.
+*/
+port_INLINE void ieee154e_countRx(bool failed){
+    ieee154e_channelStats_t* stats;
+    
+    stats = &ieee154e_chStats.channels[ieee154e_vars.freq-11];
+    if (stats->numRx==0xffff) {
+        stats->numRx     = stats->numRx>>1;
+        stats->numRxFail = stats->numRxFail>>1;
+    }
+    stats->numRx++;
+    if (failed==TRUE) {
+        stats->numRxFail++;
+    }
 }
 //======= synchronization
 
@@ -1992,7 +3101,7 @@ void synchronizePacket(PORT_RADIOTIMER_WIDTH timeReceived) {
    currentPeriod                  =  radio_getTimerPeriod();
    
    // calculate new period
-   timeCorrection                 =  (PORT_SIGNED_INT_WIDTH)((PORT_SIGNED_INT_WIDTH)timeReceived-(PORT_SIGNED_INT_WIDTH)TsTxOffset);
+   timeCorrection                 =  (PORT_SIGNED_INT_WIDTH)((PORT_SIGNED_INT_WIDTH)timeReceived-(PORT_SIGNED_INT_WIDTH)ieee154e_vars.ts.txOffset);
 
    newPeriod                      =  ieee154e_vars.slotDuration;
    
@@ -2085,6 +3194,9 @@ void changeIsSync(bool newIsSync) {
    } else {
       leds_sync_off();
       schedule_resetBackoff();
+      ieee154e_vars.burstType = CELLTYPE_OFF;
+      // the template in use is taken again from the EBs
+      ieee154e_vars.tsTemplateIsPending = FALSE;
    }
 }
 
@@ -2097,7 +3209,7 @@ void notif_sendDone(OpenQueueEntry_t* packetSent, owerror_t error) {
    memcpy(&packetSent->l2_asn,&ieee154e_vars.asn,sizeof(asn_t));
    // associate this packet with the virtual component
    // COMPONENT_IEEE802154E_TO_RES so RES can knows it's for it
-   packetSent->owner              = COMPONENT_IEEE802154E_TO_SIXTOP;
+   openqueue_setOwner(packetSent,COMPONENT_IEEE802154E_TO_SIXTOP);
    // post RES's sendDone task
    scheduler_push_task(task_sixtopNotifSendDone,TASKPRIO_SIXTOP_NOTIF_TXDONE);
    // wake up the scheduler
@@ -2111,7 +3223,7 @@ void notif_receive(OpenQueueEntry_t* packetReceived) {
    schedule_indicateRx(&packetReceived->l2_asn);
    // associate this packet with the virtual component
    // COMPONENT_IEEE802154E_TO_SIXTOP so sixtop can knows it's for it
-   packetReceived->owner          = COMPONENT_IEEE802154E_TO_SIXTOP;
+   openqueue_setOwner(packetReceived,COMPONENT_IEEE802154E_TO_SIXTOP);
 #ifdef GOLDEN_IMAGE_ROOT
 //   openserial_printInfo(COMPONENT_IEEE802154E,ERR_PACKET_SYNC,
 //                   (errorparameter_t)packetReceived->l2_asn.bytes0and1,
@@ -2171,9 +3283,12 @@ port_INLINE uint8_t calculateFrequency(uint8_t channelOffset) {
         return ieee154e_vars.singleChannel; // single channel
     } else {
         // channel hopping enabled, use the channel depending on hopping template
-        return 11 + ieee154e_vars.chTemplate[(ieee154e_vars.asnOffset+channelOffset)%16];
+        if (channelOffset>=CHTEMPLATE_MAXLENGTH) {
+            // beyond the table
+            channelOffset = channelOffset%ieee154e_vars.chTemplateLength;
+        }
+        return ieee154e_vars.chTable[ieee154e_vars.asnOffset+channelOffset];
     }
-    //return 11+(ieee154e_vars.asnOffset+channelOffset)%16; //channel hopping
 }
 
 /**
@@ -2185,6 +3300,27 @@ this function toggles the FSM debug pin.
 \param[in] newstate The state the IEEE802.15.4e FSM is now in.
 */
 void changeState(ieee154e_state_t newstate) {
+#ifdef SLOT_PROFILER
+   // record when the state is entered and, when entering a ready state, the
+   // margin left by the preparation to its deadline
+   ieee154e_profile.stateTime[newstate] = radio_getTimerValue();
+   switch (newstate) {
+      case S_TXDATAREADY:
+         ieee154e_profileStep(PROFILE_TXDATAPREPARE,ieee154e_profile.stateTime[newstate],DURATION_tt2);
+         break;
+      case S_RXACKREADY:
+         ieee154e_profileStep(PROFILE_RXACKPREPARE,ieee154e_profile.stateTime[newstate],DURATION_tt6);
+         break;
+      case S_RXDATAREADY:
+         ieee154e_profileStep(PROFILE_RXDATAPREPARE,ieee154e_profile.stateTime[newstate],DURATION_rt2);
+         break;
+      case S_TXACKREADY:
+         ieee154e_profileStep(PROFILE_TXACKPREPARE,ieee154e_profile.stateTime[newstate],DURATION_rt6);
+         break;
+      default:
+         break;
+   }
+#endif
    // update the state
    ieee154e_vars.state = newstate;
    // wiggle the FSM debug pin
@@ -2238,6 +3374,13 @@ will do that for you, but assume that something went wrong.
 */
 void endSlot() {
   
+#ifdef SLOT_PROFILER
+   // margin left before the next slot starts
+   if (ieee154e_vars.isSync==TRUE && ieee154e_vars.state!=S_SLEEP) {
+      ieee154e_profileStep(PROFILE_ENDSLOT,radio_getTimerValue(),radio_getTimerPeriod());
+   }
+#endif
+   
    // turn off the radio
    radio_rfOff();
    // compute the duty cycle if radio has been turned on
@@ -2280,7 +3423,7 @@ void endSlot() {
          notif_sendDone(ieee154e_vars.dataToSend,E_FAIL);
       } else {
          // return packet to the virtual COMPONENT_SIXTOP_TO_IEEE802154E component
-         ieee154e_vars.dataToSend->owner = COMPONENT_SIXTOP_TO_IEEE802154E;
+         openqueue_setOwner(ieee154e_vars.dataToSend,COMPONENT_SIXTOP_TO_IEEE802154E);
       }
       
       // reset local variable
@@ -2297,13 +3440,8 @@ void endSlot() {
       ieee154e_vars.dataReceived = NULL;
    }
    
-   // clean up ackToSend
-   if (ieee154e_vars.ackToSend!=NULL) {
-      // free ackToSend so corresponding RAM memory can be recycled
-      openqueue_freePacketBuffer(ieee154e_vars.ackToSend);
-      // reset local variable
-      ieee154e_vars.ackToSend = NULL;
-   }
+   // clean up ackToSend (not in the queue, nothing to free)
+   ieee154e_vars.ackToSend = NULL;
    
    // clean up ackReceived
    if (ieee154e_vars.ackReceived!=NULL) {
@@ -2318,6 +3456,43 @@ void endSlot() {
    changeState(S_SLEEP);
 }
 
+/**
+\brief Record the margin left to the deadline of a step of the slot.
+
+\param[in] step     The profiled step, see ieee154e_profileStep_enum.
+\param[in] time     When the step completed, in ticks since the slot started.
+\param[in] deadline When the step had to complete, in ticks since the slot started.
+*/
+void ieee154e_profileStep(uint8_t step, PORT_RADIOTIMER_WIDTH time, PORT_RADIOTIMER_WIDTH deadline) {
+   ieee154e_profileStats_t* stats;
+   int32_t                  margin;
+   
+   stats  = &ieee154e_profile.steps[step];
+   margin = (int32_t)deadline-(int32_t)time;
+   if (margin>INT16_MAX) {
+      margin = INT16_MAX;
+   } else if (margin<INT16_MIN) {
+      margin = INT16_MIN;
+   }
+   
+   if (stats->numSamples==0) {
+      stats->minMargin = (int16_t)margin;
+      stats->maxMargin = (int16_t)margin;
+   } else if (stats->numSamples==0xffff) {
+      // keep the mean over a sliding window
+      stats->numSamples  = stats->numSamples>>1;
+      stats->sumMargin   = stats->sumMargin/2;
+   }
+   if (margin<stats->minMargin) {
+      stats->minMargin   = (int16_t)margin;
+   }
+   if (margin>stats->maxMargin) {
+      stats->maxMargin   = (int16_t)margin;
+   }
+   stats->numSamples++;
+   stats->sumMargin     += margin;
+}
+
 bool ieee154e_isSynch(){
    return ieee154e_vars.isSync;
 }
@@ -12,6 +12,7 @@
 #include "board.h"
 #include "schedule.h"
 #include "processIE.h"
+#include "openqueue.h"
 
 //=========================== debug define ====================================
 
@@ -33,6 +34,20 @@ static const uint8_t chTemplate_default[] = {
 #define LIMITLARGETIMECORRECTION     5 // threshold number of ticks to declare a timeCorrection "large"
 #define LENGTH_IEEE154_MAX         128 // max length of a valid radio packet  
 #define DUTY_CYCLE_WINDOW_LIMIT    (0xFFFFFFFF>>1) // limit of the dutycycle window
+#define CHTEMPLATE_MAXLENGTH        16 // max number of channels in a hopping sequence, also the number of channel offsets served from the table
+#define CHTEMPLATE_SWITCHDELAY    9000 // in slots: @10ms per slot -> 90 seconds, 3 EB periods for a new hopping sequence to reach the network
+#define TSTEMPLATE_SWITCHDELAY    9000 // in slots: @10ms per slot -> 90 seconds, 3 EB periods for a new timeslot template to reach the network
+#define NUM_CHANNELS                16 // number of channels, 11 to 26
+#define CHBLACKLIST_MINSAMPLES      20 // min number of frames on a channel to judge it
+#define CHBLACKLIST_MINPDR          50 // in percent: channels with a lower success ratio are blacklisted
+#define CHBLACKLIST_MINCHANNELS      4 // never hop on fewer channels
+#define CHBLACKLIST_TIMEOUT         20 // in blacklist evaluations (@30s each -> 10 minutes) before a blacklisted channel is tried again
+#define ACKTEMPLATE_NUM              4 // number of neighbor/security configurations an ACK header is kept for
+#define ACKTEMPLATE_MAXLENGTH       40 // max length of an ACK header, auxiliary security header included
+#define ACKTEMPLATE_NOFRAMECOUNTER 0xff // the ACK header carries no frame counter
+#define LENGTH_IEEE154_PHYHEADER     6 // preamble, SFD and PHY header, in bytes
+#define LENGTH_IEEE154_ACK          27 // ACK without security: MAC header, time correction IE and CRC, in bytes
+#define AIRTIME_TICKS(numBytes)     ((((uint32_t)(numBytes))*32*32768+999999)/1000000) // in 32kHz ticks, at 32us per byte (250kbps)
 
 //15.4e information elements related
 #define IEEE802154E_PAYLOAD_DESC_LEN_SHIFT                 0x04
@@ -132,10 +147,17 @@ typedef enum {
    S_RXPROC                  = 0x19,   // processing received data
 } ieee154e_state_t;
 
-#define  TIMESLOT_TEMPLATE_ID         0x00
+#define  TIMESLOT_TEMPLATE_ID         0x00 // 10ms, the default timeslot template of IEEE802.15.4
+#define  TIMESLOT_TEMPLATE_ID_CUSTOM  0x01 // this board's timing, with the slot duration carried in the Timeslot IE
+#define  TIMESLOT_TEMPLATE_ID_15MS    0x02 // 15ms, the timing the boards with a 492-tick slot are compiled with
+#define  TIMESLOT_TEMPLATE_ID_7500US  0x03 // 7.5ms, for boards which prepare a slot in less than about 1.3ms
+#define  TIMESLOT_TEMPLATE_NUM        4
 #define  CHANNELHOPPING_TEMPLATE_ID   0x00
 
 // Atomic durations
+// The time-slot related durations and the radio watchdogs are this board's
+// default timing. The timing in use is that of the current timeslot template,
+// in ieee154e_vars.ts.
 // expressed in 32kHz ticks:
 //    - ticks = duration_in_seconds * 32768
 //    - duration_in_seconds = ticks / 32768
@@ -173,6 +195,16 @@ enum ieee154e_atomicdurations_enum {
 #endif
 };
 
+// steps of the slot which have a deadline, profiled when compiled with SLOT_PROFILER
+enum ieee154e_profileStep_enum {
+   PROFILE_TXDATAPREPARE     = 0,   // Tx data ready, before TsTxOffset
+   PROFILE_RXACKPREPARE      = 1,   // ready to Rx ACK, before TsTxAckDelay
+   PROFILE_RXDATAPREPARE     = 2,   // ready to Rx data, before TsTxOffset-TsLongGT
+   PROFILE_TXACKPREPARE      = 3,   // Tx ACK ready, before TsTxAckDelay
+   PROFILE_ENDSLOT           = 4,   // end of the slot's processing, before the next slot
+   PROFILE_MAX               = 5,
+};
+
 //shift of bytes in the linkOption bitmap: draft-ietf-6tisch-minimal-10.txt: page 6
 enum ieee154e_linkOption_enum {
    FLAG_TX_S                 = 0,
@@ -183,23 +215,23 @@ enum ieee154e_linkOption_enum {
 
 // FSM timer durations (combinations of atomic durations)
 // TX
-#define DURATION_tt1 ieee154e_vars.lastCapturedTime+TsTxOffset-delayTx-maxTxDataPrepare
-#define DURATION_tt2 ieee154e_vars.lastCapturedTime+TsTxOffset-delayTx
-#define DURATION_tt3 ieee154e_vars.lastCapturedTime+TsTxOffset-delayTx+wdRadioTx
-#define DURATION_tt4 ieee154e_vars.lastCapturedTime+wdDataDuration
-#define DURATION_tt5 ieee154e_vars.lastCapturedTime+TsTxAckDelay-TsShortGT-delayRx-maxRxAckPrepare
-#define DURATION_tt6 ieee154e_vars.lastCapturedTime+TsTxAckDelay-TsShortGT-delayRx
-#define DURATION_tt7 ieee154e_vars.lastCapturedTime+TsTxAckDelay+TsShortGT
-#define DURATION_tt8 ieee154e_vars.lastCapturedTime+wdAckDuration
+#define DURATION_tt1 ieee154e_vars.lastCapturedTime+ieee154e_vars.ts.txOffset-delayTx-maxTxDataPrepare
+#define DURATION_tt2 ieee154e_vars.lastCapturedTime+ieee154e_vars.ts.txOffset-delayTx
+#define DURATION_tt3 ieee154e_vars.lastCapturedTime+ieee154e_vars.ts.txOffset-delayTx+ieee154e_vars.ts.wdRadioTx
+#define DURATION_tt4 ieee154e_vars.lastCapturedTime+ieee154e_vars.ts.wdDataDuration
+#define DURATION_tt5 ieee154e_vars.lastCapturedTime+ieee154e_vars.ts.txAckDelay-ieee154e_vars.ts.shortGT-delayRx-maxRxAckPrepare
+#define DURATION_tt6 ieee154e_vars.lastCapturedTime+ieee154e_vars.ts.txAckDelay-ieee154e_vars.ts.shortGT-delayRx
+#define DURATION_tt7 ieee154e_vars.lastCapturedTime+ieee154e_vars.ts.txAckDelay+ieee154e_vars.ts.shortGT
+#define DURATION_tt8 ieee154e_vars.lastCapturedTime+ieee154e_vars.ts.wdAckDuration
 // RX
-#define DURATION_rt1 ieee154e_vars.lastCapturedTime+TsTxOffset-TsLongGT-delayRx-maxRxDataPrepare
-#define DURATION_rt2 ieee154e_vars.lastCapturedTime+TsTxOffset-TsLongGT-delayRx
-#define DURATION_rt3 ieee154e_vars.lastCapturedTime+TsTxOffset+TsLongGT
-#define DURATION_rt4 ieee154e_vars.lastCapturedTime+wdDataDuration
-#define DURATION_rt5 ieee154e_vars.lastCapturedTime+TsTxAckDelay-delayTx-maxTxAckPrepare
-#define DURATION_rt6 ieee154e_vars.lastCapturedTime+TsTxAckDelay-delayTx
-#define DURATION_rt7 ieee154e_vars.lastCapturedTime+TsTxAckDelay-delayTx+wdRadioTx
-#define DURATION_rt8 ieee154e_vars.lastCapturedTime+wdAckDuration
+#define DURATION_rt1 ieee154e_vars.lastCapturedTime+ieee154e_vars.ts.txOffset-ieee154e_vars.ts.longGT-delayRx-maxRxDataPrepare
+#define DURATION_rt2 ieee154e_vars.lastCapturedTime+ieee154e_vars.ts.txOffset-ieee154e_vars.ts.longGT-delayRx
+#define DURATION_rt3 ieee154e_vars.lastCapturedTime+ieee154e_vars.ts.txOffset+ieee154e_vars.ts.longGT
+#define DURATION_rt4 ieee154e_vars.lastCapturedTime+ieee154e_vars.ts.wdDataDuration
+#define DURATION_rt5 ieee154e_vars.lastCapturedTime+ieee154e_vars.ts.txAckDelay-delayTx-maxTxAckPrepare
+#define DURATION_rt6 ieee154e_vars.lastCapturedTime+ieee154e_vars.ts.txAckDelay-delayTx
+#define DURATION_rt7 ieee154e_vars.lastCapturedTime+ieee154e_vars.ts.txAckDelay-delayTx+ieee154e_vars.ts.wdRadioTx
+#define DURATION_rt8 ieee154e_vars.lastCapturedTime+ieee154e_vars.ts.wdAckDuration
 
 //=========================== typedef =========================================
 
@@ -208,6 +240,30 @@ typedef struct {
    PORT_SIGNED_INT_WIDTH timeCorrection;
 } IEEE802154E_ACK_ht;
 
+// timing of the slot, in 32kHz ticks
+typedef struct {
+   uint16_t                  slotDuration;            // TsSlotDuration
+   uint16_t                  txOffset;                // TsTxOffset
+   uint16_t                  longGT;                  // TsLongGT
+   uint16_t                  txAckDelay;              // TsTxAckDelay
+   uint16_t                  shortGT;                 // TsShortGT
+   uint16_t                  wdRadioTx;               // wdRadioTx
+   uint16_t                  wdDataDuration;          // wdDataDuration
+   uint16_t                  wdAckDuration;           // wdAckDuration
+} ieee154e_timeslotTemplate_t;
+
+// precomputed header of the ACKs to a neighbor
+typedef struct {
+   open_addr_t               neighbor;                // the neighbor ACKed, ADDR_NONE if unused
+   uint8_t                   securityLevel;           // security configuration of the ACK
+   uint8_t                   keyIdMode;
+   uint8_t                   keyIndex;
+   uint8_t                   authenticationLength;    // length of the MIC
+   uint8_t                   frameCounterOffset;      // offset of the frame counter in the header
+   uint8_t                   length;                  // length of the header
+   uint8_t                   header[ACKTEMPLATE_MAXLENGTH];
+} ieee154e_ackTemplate_t;
+
 // includes payload header IE short + MLME short Header + Sync IE
 #define EB_PAYLOAD_LENGTH sizeof(payload_IE_ht) + \
                            sizeof(mlme_IE_ht)     + \
@@ -220,9 +276,11 @@ typedef struct {
    asn_t                     asn;                     // current absolute slot number
    slotOffset_t              slotOffset;              // current slot offset
    slotOffset_t              nextActiveSlotOffset;    // next active slot offset
+   frameLength_t             frameLength;             // slotframe length slotOffset was synchronized on
    PORT_RADIOTIMER_WIDTH     deSyncTimeout;           // how many slots left before looses sync
    bool                      isSync;                  // TRUE iff mote is synchronized to network
    OpenQueueEntry_t          localCopyForTransmission;// copy of the frame used for current TX
+   uint8_t                   localCopyPacket[LENGTH_PACKET_BUFFER];// frame buffer of localCopyForTransmission
    PORT_RADIOTIMER_WIDTH     numOfSleepSlots;         // number of slots to sleep between active slots
    // as shown on the chronogram
    ieee154e_state_t          state;                   // state of the FSM
@@ -230,16 +288,36 @@ typedef struct {
    OpenQueueEntry_t*         dataReceived;            // pointer to the data received
    OpenQueueEntry_t*         ackToSend;               // pointer to the ack to send
    OpenQueueEntry_t*         ackReceived;             // pointer to the ack received
+   OpenQueueEntry_t          ackCopy;                 // the ack sent in the current slot, ackToSend points to it
+   uint8_t                   ackCopyPacket[OPENQUEUE_SMALL_PACKET_SIZE];// frame buffer of ackCopy
+   ieee154e_ackTemplate_t    ackTemplates[ACKTEMPLATE_NUM];// headers of the last ACKs sent
+   uint8_t                   ackTemplateNext;         // index of the template to replace next
+   // frame pending
+   bool                      framePending;            // TRUE iff the frame exchanged in this slot announces a follow-up frame
+   uint8_t                   burstType;               // CELLTYPE_TX/CELLTYPE_RX iff the next slot continues a burst, CELLTYPE_OFF otherwise
+   open_addr_t               burstNeighbor;           // neighbor the burst is transmitted to
    PORT_RADIOTIMER_WIDTH     lastCapturedTime;        // last captured time
    PORT_RADIOTIMER_WIDTH     syncCapturedTime;        // captured time used to sync
    // channel hopping
    uint8_t                   freq;                    // frequency of the current slot
-   uint8_t                   asnOffset;               // offset inside the frame
+   uint8_t                   asnOffset;               // offset inside the hopping sequence, i.e. ASN modulo its length
    uint8_t                   singleChannel;           // the single channel used for transmission
    bool                      singleChannelChanged;    // detect id singleChannelChanged
-   uint8_t                   chTemplate[16];          // storing the template of hopping sequence
+   uint8_t                   chTemplate[CHTEMPLATE_MAXLENGTH];// storing the template of hopping sequence
+   uint8_t                   chTemplateLength;        // number of channels in the hopping sequence
+   uint8_t                   chTable[2*CHTEMPLATE_MAXLENGTH];// frequencies of the hopping sequence, repeated to avoid wrapping around
+   bool                      chTemplateIsPending;     // TRUE iff the network switches to another hopping sequence at chTemplatePendingAsn
+   uint8_t                   chTemplatePendingId;     // template ID of the sequence to switch to
+   uint8_t                   chTemplatePending[CHTEMPLATE_MAXLENGTH];// the sequence to switch to
+   uint8_t                   chTemplatePendingLength; // number of channels in the sequence to switch to
+   asn_t                     chTemplatePendingAsn;    // ASN at which the whole network switches
    // template ID
    uint8_t                   tsTemplateId;            // timeslot template id
+   ieee154e_timeslotTemplate_t ts;                    // timing of the timeslot template in use
+   bool                      tsTemplateIsPending;     // TRUE iff the network switches to another timeslot template at tsTemplatePendingAsn
+   uint8_t                   tsTemplatePendingId;     // ID of the template to switch to
+   uint16_t                  tsTemplatePendingDuration;// slot duration of the template to switch to
+   asn_t                     tsTemplatePendingAsn;    // ASN at which the whole network switches
    uint8_t                   chTemplateId;            // channel hopping tempalte id
    
    PORT_RADIOTIMER_WIDTH     radioOnInit;             // when within the slot the radio turns on
@@ -274,6 +352,41 @@ typedef struct {
    PORT_RADIOTIMER_WIDTH     num_endOfFrame;
 } ieee154e_dbg_t;
 
+typedef struct {
+   uint16_t                  numTx;                   // unicast frames sent, expecting an ACK
+   uint16_t                  numTxAck;                // unicast frames sent which were acknowledged
+   uint16_t                  numRx;                   // frames received
+   uint16_t                  numRxFail;               // frames received with a wrong length or CRC
+   uint8_t                   blacklistTimeout;        // evaluations left before the channel is used again, 0 if not blacklisted
+} ieee154e_channelStats_t;
+
+typedef struct {
+   ieee154e_channelStats_t   channels[NUM_CHANNELS];  // indexed by channel-11
+} ieee154e_chStats_t;
+
+typedef struct {
+   uint16_t                  numSamples;              // number of margins recorded
+   int16_t                   minMargin;               // smallest margin to the deadline, in ticks
+   int16_t                   maxMargin;               // largest margin to the deadline, in ticks
+   int32_t                   sumMargin;               // sum of the margins recorded, for the mean
+} ieee154e_profileStats_t;
+
+BEGIN_PACK
+typedef struct {
+   uint8_t                   step;                    // the profiled step, see ieee154e_profileStep_enum
+   uint16_t                  numSamples;
+   int16_t                   minMargin;
+   int16_t                   meanMargin;
+   int16_t                   maxMargin;
+} ieee154e_profileStatus_t;
+END_PACK
+
+typedef struct {
+   PORT_RADIOTIMER_WIDTH     stateTime[S_RXPROC+1];   // when each state was last entered, in ticks since the slot started
+   ieee154e_profileStats_t   steps[PROFILE_MAX];      // margins, per profiled step
+   uint8_t                   printStep;               // the step printed last over serial
+} ieee154e_profile_t;
+
 //=========================== prototypes ======================================
 
 // admin
@@ -287,6 +400,15 @@ void               ieee154e_setSingleChannel(uint8_t channel);
 void               ieee154e_setIsSecurityEnabled(bool isEnabled);
 void               ieee154e_setSlotDuration(uint16_t duration);
 uint16_t           ieee154e_getSlotDuration(void);
+owerror_t          ieee154e_setTimeslotTemplate(uint8_t id);
+uint8_t            ieee154e_getTimeslotTemplateId(void);
+bool               ieee154e_getPendingTimeslotTemplate(uint8_t* id, uint16_t* slotDuration, asn_t* switchAsn);
+owerror_t          ieee154e_setChannelHoppingTemplate(uint8_t id, uint8_t* sequence, uint8_t length);
+uint8_t            ieee154e_getChannelHoppingTemplateId(void);
+uint8_t            ieee154e_getChannelHoppingSequence(uint8_t* sequence);
+owerror_t          ieee154e_scheduleChannelHoppingTemplate(uint8_t id, uint8_t* sequence, uint8_t length, asn_t* switchAsn);
+bool               ieee154e_getPendingChannelHoppingTemplate(uint8_t* id, uint8_t* sequence, uint8_t* length, asn_t* switchAsn);
+void               ieee154e_updateChannelBlacklist(void);
 
 uint16_t           ieee154e_getTimeCorrection(void);
 // events
@@ -296,6 +418,7 @@ void               ieee154e_endOfFrame(PORT_RADIOTIMER_WIDTH capturedTime);
 bool               debugPrint_asn(void);
 bool               debugPrint_isSync(void);
 bool               debugPrint_macStats(void);
+bool               debugPrint_slotProfile(void);
 
 /**
 \}
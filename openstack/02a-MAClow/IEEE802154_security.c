@@ -194,6 +194,9 @@ void IEEE802154_security_prependAuxiliarySecurityHeader(OpenQueueEntry_t* msg){
    open_addr_t* temp_keySource;
    uint8_t auxiliaryLength;
 
+   // the frames are sent with the only key source of this mote
+   temp_keySource = &ieee802154_security_vars.m_macDefaultKeySource;
+
    frameCounterSuppression = IEEE154_ASH_FRAMECOUNTER_SUPPRESSED; //the frame counter is carried in the frame
 
    //max length of MAC frames
@@ -220,21 +223,16 @@ void IEEE802154_security_prependAuxiliarySecurityHeader(OpenQueueEntry_t* msg){
    //insert the keyIdMode field
    switch (msg->l2_keyIdMode){
       case IEEE154_ASH_KEYIDMODE_IMPLICIT: //no KeyIDMode field - implicit
-    	 temp_keySource = &ieee802154_security_vars.m_macDefaultKeySource;
-         memcpy(&(msg->l2_keySource), temp_keySource, sizeof(open_addr_t));
          break;
       case IEEE154_ASH_KEYIDMODE_DEFAULTKEYSOURCE:// macDefaultKeySource
-         msg->l2_keySource = ieee802154_security_vars.m_macDefaultKeySource;
          break;
       case IEEE154_ASH_KEYIDMODE_EXPLICIT_16: //keySource with 16b address
-         temp_keySource = &msg->l2_keySource;
          packetfunctions_reserveHeaderSize(msg, sizeof(uint8_t));
          *((uint8_t*)(msg->payload)) = temp_keySource->addr_64b[6];
          packetfunctions_reserveHeaderSize(msg, sizeof(uint8_t));
          *((uint8_t*)(msg->payload)) = temp_keySource->addr_64b[7];
          break;
       case IEEE154_ASH_KEYIDMODE_EXPLICIT_64: //keySource with 64b address
-         temp_keySource = &msg->l2_keySource;
          packetfunctions_writeAddress(msg,temp_keySource,OW_LITTLE_ENDIAN);
          break;
       default://error
@@ -252,10 +250,10 @@ void IEEE802154_security_prependAuxiliarySecurityHeader(OpenQueueEntry_t* msg){
       // reserve space
       packetfunctions_reserveHeaderSize(msg,sizeof(macFrameCounter_t));
 
-      // Keep a pointer to where the ASN will be
+      // Keep the position where the ASN will be
       // Note: the actual value of the current ASN will be written by the
       //    IEEE802.15.4e when transmitting
-      msg->l2_FrameCounter = msg->payload;
+      msg->l2_FrameCounter = (uint8_t)(msg->payload-msg->packet);
    }
 
    //security control field
@@ -297,9 +295,9 @@ owerror_t IEEE802154_security_outgoingFrameSecurity(OpenQueueEntry_t*   msg){
 
    //search for a key
    keyDescriptor = IEEE802154_security_keyDescriptorLookup(msg->l2_keyIdMode,
-                                                           &msg->l2_keySource,
+                                                           &ieee802154_security_vars.m_macDefaultKeySource,
                                                            msg->l2_keyIndex,
-                                                           &msg->l2_keySource,
+                                                           &ieee802154_security_vars.m_macDefaultKeySource,
                                                            (idmanager_getMyID(ADDR_PANID)),
                                                            msg->l2_frameType);
 
@@ -324,7 +322,7 @@ owerror_t IEEE802154_security_outgoingFrameSecurity(OpenQueueEntry_t*   msg){
       l2_frameCounter.byte4 = vectASN[4];
 
       IEEE802154_security_getFrameCounter(l2_frameCounter,
-                                         msg->l2_FrameCounter);
+                                         &(msg->packet[msg->l2_FrameCounter]));
    } //otherwise the frame counter is not in the frame
 
    //nonce creation
@@ -351,7 +349,7 @@ owerror_t IEEE802154_security_outgoingFrameSecurity(OpenQueueEntry_t*   msg){
       case IEEE154_ASH_SLF_TYPE_ENC_MIC_64:
       case IEEE154_ASH_SLF_TYPE_ENC_MIC_128:
          a = msg->payload;             // first byte of the frame
-         m = msg->l2_payload;          // first byte where we should start encrypting (see 15.4 std)
+         m = &(msg->packet[msg->l2_payload]); // first byte where we should start encrypting (see 15.4 std)
          len_a = m - a;                // part that is only authenticated is the difference of two pointers
          len_m = msg->length - len_a;  // part that is encrypted+authenticated is the rest of the frame
          break;
@@ -458,27 +456,27 @@ void IEEE802154_security_retrieveAuxiliarySecurityHeader(OpenQueueEntry_t*
 
    }
 
-   //retrieve the Key Identifier field
+   //retrieve the Key Identifier field, kept until IEEE802154_security_incomingFrame()
    switch (msg->l2_keyIdMode){
       case IEEE154_ASH_KEYIDMODE_IMPLICIT:
          //key is derived implicitly
          temp_addr = &ieee802154_security_vars.m_macDefaultKeySource;
-         memcpy(&(msg->l2_keySource), temp_addr, sizeof(open_addr_t));
+         memcpy(&(ieee802154_security_vars.rxKeySource), temp_addr, sizeof(open_addr_t));
          break;
       case IEEE154_ASH_KEYIDMODE_DEFAULTKEYSOURCE:
-         msg->l2_keySource = ieee802154_security_vars.m_macDefaultKeySource;
+         ieee802154_security_vars.rxKeySource = ieee802154_security_vars.m_macDefaultKeySource;
          break;
       case IEEE154_ASH_KEYIDMODE_EXPLICIT_16:
          packetfunctions_readAddress(((uint8_t*)(msg->payload)+tempheader->headerLength),
                                      ADDR_16B,
-                                     &msg->l2_keySource,
+                                     &ieee802154_security_vars.rxKeySource,
                                      OW_LITTLE_ENDIAN);
          tempheader->headerLength+=2;
          break;
       case IEEE154_ASH_KEYIDMODE_EXPLICIT_64:
          packetfunctions_readAddress(((uint8_t*)(msg->payload)+tempheader->headerLength),
                                      ADDR_64B,
-                                     &msg->l2_keySource,
+                                     &ieee802154_security_vars.rxKeySource,
                                      OW_LITTLE_ENDIAN);
          tempheader->headerLength+=8;
          break;
@@ -520,9 +518,9 @@ owerror_t IEEE802154_security_incomingFrame(OpenQueueEntry_t* msg){
 
    //key descriptor lookup procedure
    keyDescriptor = IEEE802154_security_keyDescriptorLookup(msg->l2_keyIdMode,
-                                                          &msg->l2_keySource,
+                                                          &ieee802154_security_vars.rxKeySource,
                                                           msg->l2_keyIndex,
-                                                          &msg->l2_keySource,
+                                                          &ieee802154_security_vars.rxKeySource,
                                                           idmanager_getMyID(ADDR_PANID),
                                                           msg->l2_frameType);
 
@@ -534,7 +532,7 @@ owerror_t IEEE802154_security_incomingFrame(OpenQueueEntry_t* msg){
    }
 
    //device descriptor lookup
-   deviceDescriptor = IEEE802154_security_deviceDescriptorLookup(&msg->l2_keySource,
+   deviceDescriptor = IEEE802154_security_deviceDescriptorLookup(&ieee802154_security_vars.rxKeySource,
                                                                 idmanager_getMyID(ADDR_PANID),
                                                                 keyDescriptor);
 
@@ -604,7 +602,7 @@ owerror_t IEEE802154_security_incomingFrame(OpenQueueEntry_t* msg){
       case IEEE154_ASH_SLF_TYPE_ENC_MIC_64:
       case IEEE154_ASH_SLF_TYPE_ENC_MIC_128:
          a = msg->payload;             // first byte of the frame
-         c = msg->l2_payload;          // first byte where we should start decrypting 
+         c = &(msg->packet[msg->l2_payload]); // first byte where we should start decrypting 
          len_a = c - a;                // part that is only authenticated is the difference of two pointers
          len_c = msg->length - len_a;  // part that is decrypted+authenticated is the rest of the frame
          break;
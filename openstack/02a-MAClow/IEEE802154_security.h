@@ -84,6 +84,7 @@ typedef struct{
    uint8_t                 m_macAutoRequestSecurityLevel;
    uint8_t                 m_macAutoReququestKeyIndex;
    open_addr_t             m_macDefaultKeySource;
+   open_addr_t             rxKeySource;              // key source of the frame being received
    m_macKeyTable           MacKeyTable;
    m_macDeviceTable        MacDeviceTable;
    m_macSecurityLevelTable MacSecurityLevelTable;
@@ -206,40 +206,46 @@ void adaptive_sync_countCompensationTimeout() {
 }
 
 /**
-\brief update compensationTimeout when compound slots are scheduled and adjust the slot when the elapsed slots rearch to compensation interval(e.g. SERIALRX slots)
+\brief update compensationTimeout when compound slots are scheduled and adjust the slot when the elapsed slots rearch to compensation interval(e.g. SERIALRX slots, idle slots skipped)
+
+The current slot is extended by the compound slots, on top of any compensation
+already applied to it.
 
 \param[in] compoundSlots how many slots will be elapsed before wakeup next time.
+   With 32-bit radiotimers, that can be more than 65535 idle slots.
 */
-void adaptive_sync_countCompensationTimeout_compoundSlots(uint16_t compoundSlots) {
-   uint16_t counter;
-   uint8_t  compensateTicks;
-   uint16_t newSlotDuration;
-   
-   newSlotDuration  = ieee154e_getSlotDuration()*(compoundSlots+1);
+void adaptive_sync_countCompensationTimeout_compoundSlots(PORT_RADIOTIMER_WIDTH compoundSlots) {
+   PORT_RADIOTIMER_WIDTH counter;
+   PORT_RADIOTIMER_WIDTH compensateTicks;
+   PORT_RADIOTIMER_WIDTH newSlotDuration;
    
-   // if clockState is not set yet, don't compensate.
-   if(adaptive_sync_vars.clockState == S_NONE) {
+   if(compoundSlots < 1) {
+      // return, if this is not a compoundSlot
       return;
    }
    
-   if(adaptive_sync_vars.compensationTimeout == 0) {
-      return; // should not happen
-   }
+   newSlotDuration  = radio_getTimerPeriod()+ieee154e_getSlotDuration()*compoundSlots;
    
-   if(compoundSlots < 1) {
-      // return, if this is not a compoundSlot
+   // if clockState is not set yet, don't compensate.
+   if(
+         adaptive_sync_vars.clockState == S_NONE ||
+         adaptive_sync_vars.compensationTimeout == 0 || // should not happen
+         adaptive_sync_vars.compensationInfo_vars.compensationSlots == 0
+      ) {
+      radio_setTimerPeriod(newSlotDuration);
       return;
    }
    
-   counter          = compoundSlots; 
-   compensateTicks  = 0;
-   while(counter > 0) {
-      adaptive_sync_vars.compensationTimeout--;
-      if (adaptive_sync_vars.compensationTimeout == 0) {
-         compensateTicks += 1;
-         adaptive_sync_vars.compensationTimeout = adaptive_sync_vars.compensationInfo_vars.compensationSlots;
-      }
-      counter--;
+   // count the compensations due over the compound slots, without iterating
+   // over them since many idle slots may be skipped at once
+   if (compoundSlots < adaptive_sync_vars.compensationTimeout) {
+      compensateTicks  = 0;
+      adaptive_sync_vars.compensationTimeout -= compoundSlots;
+   } else {
+      counter          = compoundSlots-adaptive_sync_vars.compensationTimeout;
+      compensateTicks  = 1+counter/adaptive_sync_vars.compensationInfo_vars.compensationSlots;
+      adaptive_sync_vars.compensationTimeout  = adaptive_sync_vars.compensationInfo_vars.compensationSlots;
+      adaptive_sync_vars.compensationTimeout -= counter%adaptive_sync_vars.compensationInfo_vars.compensationSlots;
    }
    
    // when compensateTicks > 0, I need to do compensation by adjusting current slot length
@@ -251,12 +257,12 @@ void adaptive_sync_countCompensationTimeout_compoundSlots(uint16_t compoundSlots
          newSlotDuration                    += compensateTicks*SYNC_ACCURACY;
          adaptive_sync_vars.compensateTicks += compensateTicks * SYNC_ACCURACY;
       }
-      radio_setTimerPeriod(newSlotDuration);
 #ifdef OPENSIM
       debugpins_debug_set();
       debugpins_debug_clr();
 #endif
    }
+   radio_setTimerPeriod(newSlotDuration);
 }
 
 /**
@@ -51,7 +51,7 @@ void adaptive_sync_indicateTimeCorrection(int16_t timeCorrection, open_addr_t ti
 void adaptive_sync_calculateCompensatedSlots(int16_t timeCorrection);
 
 void adaptive_sync_countCompensationTimeout(void);
-void adaptive_sync_countCompensationTimeout_compoundSlots(uint16_t compoundSlots);
+void adaptive_sync_countCompensationTimeout_compoundSlots(PORT_RADIOTIMER_WIDTH compoundSlots);
 void adaptive_sync_driftChanged(void);
 
 /**
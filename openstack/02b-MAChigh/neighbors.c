@@ -5,6 +5,9 @@
 #include "idmanager.h"
 #include "openserial.h"
 #include "IEEE802154E.h"
+#include "otf.h"
+#include "schedule.h"
+#include "openqueue.h"
 
 //=========================== variables =======================================
 
@@ -21,10 +24,10 @@ void registerNewNeighbor(
      );
 bool isNeighbor(open_addr_t* neighbor);
 void removeNeighbor(uint8_t neighborIndex);
-bool isThisRowMatching(
-        open_addr_t* address,
-        uint8_t      rowNumber
-     );
+uint8_t evictNeighbor(void);
+uint8_t getNeighborRow(open_addr_t* address);
+uint8_t hashNeighbor(uint8_t* addr_64b);
+bool getParentByCellLoad(open_addr_t* addressToWrite, bool mostLoaded);
 
 //=========================== public ==========================================
 
@@ -35,6 +38,7 @@ void neighbors_init() {
    
    // clear module variables
    memset(&neighbors_vars,0,sizeof(neighbors_vars_t));
+   memset(&neighbors_vars.hashTable[0],NEIGHBORS_HASHEMPTY,NEIGHBORS_HASHSIZE);
    
    // set myDAGrank
    if (idmanager_getIsDAGroot()==TRUE) {
@@ -124,6 +128,97 @@ bool neighbors_getPreferredParentEui64(open_addr_t* addressToWrite) {
    return foundPreferred;
 }
 
+/**
+\brief Pick the parent to send the next upstream packet to.
+
+Upstream traffic is spread over the parent set: the packet goes to the parent
+with the fewest packets already queued for it per TX cell, ties going to the
+preferred parent. Parents I have no TX cell to are skipped.
+
+\param[out] addressToWrite Where to write the parent's address to.
+
+\returns TRUE if a parent was found, FALSE otherwise.
+*/
+bool neighbors_getUpstreamNextHopEui64(open_addr_t* addressToWrite) {
+   uint8_t   i;
+   uint16_t  numTxCells;
+   uint16_t  queueDepth;
+   uint16_t  bestNumTxCells;
+   uint16_t  bestQueueDepth;
+   uint8_t   bestIdx;
+   uint32_t  load;             // queueDepth/numTxCells, cross-multiplied with the best one
+   uint32_t  bestLoad;
+   
+   // default to the preferred parent, promotes one if needed
+   if (neighbors_getPreferredParentEui64(addressToWrite)==FALSE) {
+      return FALSE;
+   }
+   
+   bestIdx        = MAXNUMNEIGHBORS;
+   bestNumTxCells = 0;
+   bestQueueDepth = 0;
+   for (i=0;i<MAXNUMNEIGHBORS;i++) {
+      if (neighbors_isParent(i)==FALSE) {
+         continue;
+      }
+      numTxCells = schedule_getCellsCounts(schedule_getFrameHandle(),CELLTYPE_TX,&(neighbors_vars.neighbors[i].addr_64b));
+      if (numTxCells==0) {
+         continue;
+      }
+      queueDepth = openqueue_getNumDataPackets(&(neighbors_vars.neighbors[i].addr_64b));
+      load       = (uint32_t)queueDepth*bestNumTxCells;
+      bestLoad   = (uint32_t)bestQueueDepth*numTxCells;
+      if (
+            bestIdx==MAXNUMNEIGHBORS ||
+            load<bestLoad            ||
+            (
+               load==bestLoad &&
+               neighbors_vars.neighbors[i].parentPreference>neighbors_vars.neighbors[bestIdx].parentPreference
+            )
+         ) {
+         bestIdx        = i;
+         bestNumTxCells = numTxCells;
+         bestQueueDepth = queueDepth;
+      }
+   }
+   
+   if (bestIdx<MAXNUMNEIGHBORS) {
+      memcpy(addressToWrite,&(neighbors_vars.neighbors[bestIdx].addr_64b),sizeof(open_addr_t));
+      addressToWrite->type=ADDR_64B;
+   }
+   return TRUE;
+}
+
+/**
+\brief Pick the parent to ask for one more TX cell.
+
+Cells are spread over the parent set in proportion to the packets queued for
+each parent: this is the parent with the most packets queued per TX cell.
+Parents without TX cell count as having one packet queued, so that the backup
+parents get cells too.
+
+\param[out] addressToWrite Where to write the parent's address to.
+
+\returns TRUE if a parent was found, FALSE otherwise.
+*/
+bool neighbors_getParentToAddCellEui64(open_addr_t* addressToWrite) {
+   return getParentByCellLoad(addressToWrite,TRUE);
+}
+
+/**
+\brief Pick the parent to release a TX cell to.
+
+This is the parent with TX cells with the fewest packets queued per TX cell,
+the backup parents before the preferred parent.
+
+\param[out] addressToWrite Where to write the parent's address to.
+
+\returns TRUE if a parent was found, FALSE otherwise.
+*/
+bool neighbors_getParentToRemoveCellEui64(open_addr_t* addressToWrite) {
+   return getParentByCellLoad(addressToWrite,FALSE);
+}
+
 /**
 \brief Find neighbor to which to send KA.
 
@@ -208,12 +303,10 @@ bool neighbors_isStableNeighbor(open_addr_t* address) {
          return returnVal;
    }
    
-   // iterate through neighbor table
-   for (i=0;i<MAXNUMNEIGHBORS;i++) {
-      if (isThisRowMatching(&temp_addr_64b,i) && neighbors_vars.neighbors[i].stableNeighbor==TRUE) {
-         returnVal  = TRUE;
-         break;
-      }
+   // look up neighbor table
+   i = getNeighborRow(&temp_addr_64b);
+   if (i<MAXNUMNEIGHBORS && neighbors_vars.neighbors[i].stableNeighbor==TRUE) {
+      returnVal  = TRUE;
    }
    
    return returnVal;
@@ -236,12 +329,10 @@ bool neighbors_isPreferredParent(open_addr_t* address) {
    // by default, not preferred
    returnVal = FALSE;
    
-   // iterate through neighbor table
-   for (i=0;i<MAXNUMNEIGHBORS;i++) {
-      if (isThisRowMatching(address,i) && neighbors_vars.neighbors[i].parentPreference==MAXPREFERENCE) {
-         returnVal  = TRUE;
-         break;
-      }
+   // look up neighbor table
+   i = getNeighborRow(address);
+   if (i<MAXNUMNEIGHBORS && neighbors_vars.neighbors[i].parentPreference==MAXPREFERENCE) {
+      returnVal  = TRUE;
    }
    
    ENABLE_INTERRUPTS();
@@ -289,6 +380,47 @@ bool neighbors_isNeighborWithHigherDAGrank(uint8_t index) {
    return returnVal;
 }
 
+/**
+\brief Indicate whether some neighbor is in my parent set.
+
+\param[in] index The index of that neighbor in the neighbor table.
+
+\returns TRUE if that neighbor is my preferred parent or a backup parent,
+   FALSE otherwise.
+*/
+bool neighbors_isParent(uint8_t index) {
+   return neighbors_vars.neighbors[index].used==TRUE &&
+          neighbors_vars.neighbors[index].parentPreference>0;
+}
+
+/**
+\brief Indicate whether some neighbor is in my parent set.
+
+\param[in] address The EUI64 address of the neighbor.
+
+\returns TRUE if that neighbor is my preferred parent or a backup parent,
+   FALSE otherwise.
+*/
+bool neighbors_isInParentSet(open_addr_t* address) {
+   uint8_t i;
+   bool    returnVal;
+   
+   INTERRUPT_DECLARATION();
+   DISABLE_INTERRUPTS();
+   
+   // by default, not a parent
+   returnVal = FALSE;
+   
+   // look up neighbor table
+   i = getNeighborRow(address);
+   if (i<MAXNUMNEIGHBORS && neighbors_isParent(i)==TRUE) {
+      returnVal  = TRUE;
+   }
+   
+   ENABLE_INTERRUPTS();
+   return returnVal;
+}
+
 //===== updating neighbor information
 
 /**
@@ -318,55 +450,44 @@ void neighbors_indicateRx(open_addr_t* l2_src,
                           bool         joinPrioPresent,
                           uint8_t      joinPrio) {
    uint8_t i;
-   bool    newNeighbor;
    
    // update existing neighbor
-   newNeighbor = TRUE;
-   for (i=0;i<MAXNUMNEIGHBORS;i++) {
-      if (isThisRowMatching(l2_src,i)) {
-         
-         // this is not a new neighbor
-         newNeighbor = FALSE;
-         
-         // update numRx, rssi, asn
-         neighbors_vars.neighbors[i].numRx++;
-         neighbors_vars.neighbors[i].rssi=rssi;
-         memcpy(&neighbors_vars.neighbors[i].asn,asnTs,sizeof(asn_t));
-         //update jp
-         if (joinPrioPresent==TRUE){
-            neighbors_vars.neighbors[i].joinPrio=joinPrio;
-         }
-         
-         // update stableNeighbor, switchStabilityCounter
-         if (neighbors_vars.neighbors[i].stableNeighbor==FALSE) {
-            if (neighbors_vars.neighbors[i].rssi>BADNEIGHBORMAXRSSI) {
-               neighbors_vars.neighbors[i].switchStabilityCounter++;
-               if (neighbors_vars.neighbors[i].switchStabilityCounter>=SWITCHSTABILITYTHRESHOLD) {
-                  neighbors_vars.neighbors[i].switchStabilityCounter=0;
-                  neighbors_vars.neighbors[i].stableNeighbor=TRUE;
-               }
-            } else {
+   i = getNeighborRow(l2_src);
+   if (i<MAXNUMNEIGHBORS) {
+      
+      // update numRx, rssi, asn
+      neighbors_vars.neighbors[i].numRx++;
+      neighbors_vars.neighbors[i].rssi=rssi;
+      memcpy(&neighbors_vars.neighbors[i].asn,asnTs,sizeof(asn_t));
+      //update jp
+      if (joinPrioPresent==TRUE){
+         neighbors_vars.neighbors[i].joinPrio=joinPrio;
+      }
+      
+      // update stableNeighbor, switchStabilityCounter
+      if (neighbors_vars.neighbors[i].stableNeighbor==FALSE) {
+         if (neighbors_vars.neighbors[i].rssi>BADNEIGHBORMAXRSSI) {
+            neighbors_vars.neighbors[i].switchStabilityCounter++;
+            if (neighbors_vars.neighbors[i].switchStabilityCounter>=SWITCHSTABILITYTHRESHOLD) {
                neighbors_vars.neighbors[i].switchStabilityCounter=0;
+               neighbors_vars.neighbors[i].stableNeighbor=TRUE;
             }
-         } else if (neighbors_vars.neighbors[i].stableNeighbor==TRUE) {
-            if (neighbors_vars.neighbors[i].rssi<GOODNEIGHBORMINRSSI) {
-               neighbors_vars.neighbors[i].switchStabilityCounter++;
-               if (neighbors_vars.neighbors[i].switchStabilityCounter>=SWITCHSTABILITYTHRESHOLD) {
-                  neighbors_vars.neighbors[i].switchStabilityCounter=0;
-                   neighbors_vars.neighbors[i].stableNeighbor=FALSE;
-               }
-            } else {
+         } else {
+            neighbors_vars.neighbors[i].switchStabilityCounter=0;
+         }
+      } else if (neighbors_vars.neighbors[i].stableNeighbor==TRUE) {
+         if (neighbors_vars.neighbors[i].rssi<GOODNEIGHBORMINRSSI) {
+            neighbors_vars.neighbors[i].switchStabilityCounter++;
+            if (neighbors_vars.neighbors[i].switchStabilityCounter>=SWITCHSTABILITYTHRESHOLD) {
                neighbors_vars.neighbors[i].switchStabilityCounter=0;
+                neighbors_vars.neighbors[i].stableNeighbor=FALSE;
             }
+         } else {
+            neighbors_vars.neighbors[i].switchStabilityCounter=0;
          }
-         
-         // stop looping
-         break;
       }
-   }
-   
-   // register new neighbor
-   if (newNeighbor==TRUE) {
+   } else {
+      // register new neighbor
       registerNewNeighbor(l2_src, rssi, asnTs, joinPrioPresent,joinPrio);
    }
 }
@@ -381,6 +502,12 @@ The fields which are updated are:
 - numTx
 - numTxACK
 - asn
+- etx
+
+The ETX is an exponentially weighted moving average of the number of attempts
+each packet needed, a packet which was never acknowledged counting as
+ETX_NOACK attempts. Unlike the numTx/numTxACK ratio, it does not jump when
+these counters wrap.
 
 \param[in] l2_dest MAC destination address of the packet, i.e. the neighbor
    who I just sent the packet to.
@@ -393,30 +520,44 @@ void neighbors_indicateTx(open_addr_t* l2_dest,
                           uint8_t      numTxAttempts,
                           bool         was_finally_acked,
                           asn_t*       asnTs) {
-   uint8_t i;
+   uint8_t  i;
+   uint16_t etxSample;
    // don't run through this function if packet was sent to broadcast address
    if (packetfunctions_isBroadcastMulticast(l2_dest)==TRUE) {
       return;
    }
    
-   // loop through neighbor table
-   for (i=0;i<MAXNUMNEIGHBORS;i++) {
-      if (isThisRowMatching(l2_dest,i)) {
-         // handle roll-over case
-        
-          if (neighbors_vars.neighbors[i].numTx>(0xff-numTxAttempts)) {
-              neighbors_vars.neighbors[i].numWraps++; //counting the number of times that tx wraps.
-              neighbors_vars.neighbors[i].numTx/=2;
-              neighbors_vars.neighbors[i].numTxACK/=2;
-           }
-         // update statistics
-        neighbors_vars.neighbors[i].numTx += numTxAttempts; 
-        
-        if (was_finally_acked==TRUE) {
-            neighbors_vars.neighbors[i].numTxACK++;
-            memcpy(&neighbors_vars.neighbors[i].asn,asnTs,sizeof(asn_t));
-        }
-        break;
+   // look up neighbor table
+   i = getNeighborRow(l2_dest);
+   if (i<MAXNUMNEIGHBORS) {
+      // update the link quality estimate
+      if (was_finally_acked==TRUE) {
+         etxSample = numTxAttempts*ETX_SCALE;
+      } else {
+         etxSample = ETX_NOACK*ETX_SCALE;
+      }
+      if (neighbors_vars.neighbors[i].numTx==0) {
+         // first sample
+         neighbors_vars.neighbors[i].etx = etxSample;
+      } else {
+         neighbors_vars.neighbors[i].etx = (uint16_t)((
+            (uint32_t)neighbors_vars.neighbors[i].etx*(ETX_SCALE-ETX_ALPHA) +
+            (uint32_t)etxSample*ETX_ALPHA
+         )/ETX_SCALE);
+      }
+      
+      // handle roll-over case
+      if (neighbors_vars.neighbors[i].numTx>(0xff-numTxAttempts)) {
+         neighbors_vars.neighbors[i].numWraps++; //counting the number of times that tx wraps.
+         neighbors_vars.neighbors[i].numTx/=2;
+         neighbors_vars.neighbors[i].numTxACK/=2;
+      }
+      // update statistics
+      neighbors_vars.neighbors[i].numTx += numTxAttempts; 
+      
+      if (was_finally_acked==TRUE) {
+         neighbors_vars.neighbors[i].numTxACK++;
+         memcpy(&neighbors_vars.neighbors[i].asn,asnTs,sizeof(asn_t));
       }
    }
 }
@@ -445,23 +586,19 @@ void neighbors_indicateRxDIO(OpenQueueEntry_t* msg) {
    // retrieve rank
    temp_8b            = *(msg->payload+2);
    neighbors_vars.dio->rank = (temp_8b << 8) + *(msg->payload+3);
-   if (isNeighbor(&(msg->l2_nextORpreviousHop))==TRUE) {
-      for (i=0;i<MAXNUMNEIGHBORS;i++) {
-         if (isThisRowMatching(&(msg->l2_nextORpreviousHop),i)) {
-            if (
-                  neighbors_vars.dio->rank > neighbors_vars.neighbors[i].DAGrank &&
-                  neighbors_vars.dio->rank - neighbors_vars.neighbors[i].DAGrank >(DEFAULTLINKCOST*2*MINHOPRANKINCREASE)
-               ) {
-                // the new DAGrank looks suspiciously high, only increment a bit
-                neighbors_vars.neighbors[i].DAGrank += (DEFAULTLINKCOST*2*MINHOPRANKINCREASE);
-                openserial_printError(COMPONENT_NEIGHBORS,ERR_LARGE_DAGRANK,
-                               (errorparameter_t)neighbors_vars.dio->rank,
-                               (errorparameter_t)neighbors_vars.neighbors[i].DAGrank);
-            } else {
-               neighbors_vars.neighbors[i].DAGrank = neighbors_vars.dio->rank;
-            }
-            break;
-         }
+   i = getNeighborRow(&(msg->l2_nextORpreviousHop));
+   if (i<MAXNUMNEIGHBORS) {
+      if (
+            neighbors_vars.dio->rank > neighbors_vars.neighbors[i].DAGrank &&
+            neighbors_vars.dio->rank - neighbors_vars.neighbors[i].DAGrank >(DEFAULTLINKCOST*2*MINHOPRANKINCREASE)
+         ) {
+          // the new DAGrank looks suspiciously high, only increment a bit
+          neighbors_vars.neighbors[i].DAGrank += (DEFAULTLINKCOST*2*MINHOPRANKINCREASE);
+          openserial_printError(COMPONENT_NEIGHBORS,ERR_LARGE_DAGRANK,
+                         (errorparameter_t)neighbors_vars.dio->rank,
+                         (errorparameter_t)neighbors_vars.neighbors[i].DAGrank);
+      } else {
+         neighbors_vars.neighbors[i].DAGrank = neighbors_vars.dio->rank;
       }
    } 
    // update my routing information
@@ -503,6 +640,11 @@ routing decisions to change. Examples are:
 - I received a DIO which updated by neighbor table. If this DIO indicated a
   very low DAGrank, I may want to change by routing parent.
 - I became a DAGroot, so my DAGrank should be 0.
+
+The link cost is derived from the ETX estimated in neighbors_indicateTx(). As
+in MRHOF, I only switch to a new parent if it lowers my DAGrank by at least
+PARENT_SWITCH_THRESHOLD, and the scheduling function is told to move its cells
+to the new parent.
 */
 void neighbors_updateMyDAGrankAndNeighborPreference() {
    uint8_t   i;
@@ -510,13 +652,19 @@ void neighbors_updateMyDAGrankAndNeighborPreference() {
    uint32_t  tentativeDAGrank; // 32-bit since is used to sum
    uint8_t   prefParentIdx;
    bool      prefParentFound;
-   uint32_t  rankIncreaseIntermediary; // stores intermediary results of rankIncrease calculation
+   uint8_t   oldParentIdx;
+   bool      oldParentFound;
+   uint32_t  oldParentDAGrank;
+   uint8_t   numParents;
+   uint8_t   backupIdx;
+   bool      backupFound;
+   uint32_t  backupDAGrank;
    
    // if I'm a DAGroot, my DAGrank is always MINHOPRANKINCREASE
    if ((idmanager_getIsDAGroot())==TRUE) {
        // the dagrank is not set through setting command, set rank to MINHOPRANKINCREASE here 
        neighbors_vars.myDAGrank=MINHOPRANKINCREASE;
-       return;
+       return;
    }
    
    // reset my DAG rank to max value. May be lowered below.
@@ -525,26 +673,28 @@ void neighbors_updateMyDAGrankAndNeighborPreference() {
    // by default, I haven't found a preferred parent
    prefParentFound           = FALSE;
    prefParentIdx             = 0;
+   oldParentFound            = FALSE;
+   oldParentIdx              = 0;
+   oldParentDAGrank          = MAXDAGRANK;
    
    // loop through neighbor table, update myDAGrank
    for (i=0;i<MAXNUMNEIGHBORS;i++) {
       if (neighbors_vars.neighbors[i].used==TRUE) {
          
-         // reset parent preference
-         neighbors_vars.neighbors[i].parentPreference=0;
-         
-         // calculate link cost to this neighbor
-         if (neighbors_vars.neighbors[i].numTxACK==0) {
-            rankIncrease = DEFAULTLINKCOST*2*MINHOPRANKINCREASE;
-         } else {
-            //6TiSCH minimal draft using OF0 for rank computation
-            rankIncreaseIntermediary = (((uint32_t)neighbors_vars.neighbors[i].numTx) << 10);
-            rankIncreaseIntermediary = (rankIncreaseIntermediary * 2 * MINHOPRANKINCREASE) / ((uint32_t)neighbors_vars.neighbors[i].numTxACK);
-            rankIncrease = (uint16_t)(rankIncreaseIntermediary >> 10);
-         }
+         // calculate link cost to this neighbor, 6TiSCH minimal draft using OF0 with the ETX
+         rankIncrease = (uint16_t)(((uint32_t)neighbors_vars.neighbors[i].etx*2*MINHOPRANKINCREASE)/ETX_SCALE);
          
          // cast the uint16_t summands to avoid an overflow if DAGrank == 0xFFFF (MAXDAGRANK)
          tentativeDAGrank = (uint32_t)neighbors_vars.neighbors[i].DAGrank + (uint32_t)rankIncrease;
+         
+         // remember my current parent, and reset parent preference
+         if (neighbors_vars.neighbors[i].parentPreference==MAXPREFERENCE) {
+            oldParentFound   = TRUE;
+            oldParentIdx     = i;
+            oldParentDAGrank = tentativeDAGrank;
+         }
+         neighbors_vars.neighbors[i].parentPreference=0;
+         
          if ( tentativeDAGrank<neighbors_vars.myDAGrank &&
               tentativeDAGrank<MAXDAGRANK) {
             // found better parent, lower my DAGrank
@@ -555,11 +705,55 @@ void neighbors_updateMyDAGrankAndNeighborPreference() {
       }
    } 
    
+   // hysteresis: stick to my current parent unless the new one is clearly better
+   if (
+         prefParentFound && oldParentFound               &&
+         prefParentIdx!=oldParentIdx                     &&
+         oldParentDAGrank<MAXDAGRANK                     &&
+         neighbors_vars.myDAGrank+PARENT_SWITCH_THRESHOLD>oldParentDAGrank
+      ) {
+      neighbors_vars.myDAGrank   = oldParentDAGrank;
+      prefParentIdx              = oldParentIdx;
+   }
+   
    // update preferred parent
    if (prefParentFound) {
       neighbors_vars.neighbors[prefParentIdx].parentPreference       = MAXPREFERENCE;
       neighbors_vars.neighbors[prefParentIdx].stableNeighbor         = TRUE;
       neighbors_vars.neighbors[prefParentIdx].switchStabilityCounter = 0;
+      
+      if (oldParentFound && prefParentIdx!=oldParentIdx) {
+         // move the cells from my former parent to the new one
+         otf_notif_parentChanged(&(neighbors_vars.neighbors[oldParentIdx].addr_64b));
+      }
+      
+      // complete the parent set with the best neighbors of lower rank than
+      // mine, as long as going through them costs at most PARENT_SET_TOLERANCE
+      for (numParents=1;numParents<MAXNUMPARENTS;numParents++) {
+         backupFound      = FALSE;
+         backupIdx        = 0;
+         backupDAGrank    = (uint32_t)neighbors_vars.myDAGrank+PARENT_SET_TOLERANCE;
+         for (i=0;i<MAXNUMNEIGHBORS;i++) {
+            if (
+                  neighbors_vars.neighbors[i].used==FALSE                  ||
+                  neighbors_vars.neighbors[i].parentPreference>0           ||
+                  neighbors_vars.neighbors[i].DAGrank>=neighbors_vars.myDAGrank
+               ) {
+               continue;
+            }
+            rankIncrease     = (uint16_t)(((uint32_t)neighbors_vars.neighbors[i].etx*2*MINHOPRANKINCREASE)/ETX_SCALE);
+            tentativeDAGrank = (uint32_t)neighbors_vars.neighbors[i].DAGrank + (uint32_t)rankIncrease;
+            if (tentativeDAGrank<=backupDAGrank) {
+               backupFound   = TRUE;
+               backupIdx     = i;
+               backupDAGrank = tentativeDAGrank;
+            }
+         }
+         if (backupFound==FALSE) {
+            break;
+         }
+         neighbors_vars.neighbors[backupIdx].parentPreference = BACKUPPREFERENCE;
+      }
    }
 }
 
@@ -606,6 +800,7 @@ void registerNewNeighbor(open_addr_t* address,
                          bool         joinPrioPresent,
                          uint8_t      joinPrio) {
    uint8_t  i,j;
+   uint8_t  pos;
    bool     iHaveAPreferedParent;
    // filter errors
    if (address->type!=ADDR_64B) {
@@ -619,60 +814,96 @@ void registerNewNeighbor(open_addr_t* address,
       i=0;
       while(i<MAXNUMNEIGHBORS) {
          if (neighbors_vars.neighbors[i].used==FALSE) {
-            // add this neighbor
-            neighbors_vars.neighbors[i].used                   = TRUE;
-            neighbors_vars.neighbors[i].parentPreference       = 0;
-            // neighbors_vars.neighbors[i].stableNeighbor         = FALSE;
-            // Note: all new neighbors are consider stable
-            neighbors_vars.neighbors[i].stableNeighbor         = TRUE;
-            neighbors_vars.neighbors[i].switchStabilityCounter = 0;
-            memcpy(&neighbors_vars.neighbors[i].addr_64b,address,sizeof(open_addr_t));
-            neighbors_vars.neighbors[i].DAGrank                = DEFAULTDAGRANK;
-            neighbors_vars.neighbors[i].rssi                   = rssi;
-            neighbors_vars.neighbors[i].numRx                  = 1;
-            neighbors_vars.neighbors[i].numTx                  = 0;
-            neighbors_vars.neighbors[i].numTxACK               = 0;
-            memcpy(&neighbors_vars.neighbors[i].asn,asnTimestamp,sizeof(asn_t));
-            //update jp
-            if (joinPrioPresent==TRUE){
-               neighbors_vars.neighbors[i].joinPrio=joinPrio;
-            }
-            
-            // do I already have a preferred parent ? -- TODO change to use JP
-            iHaveAPreferedParent = FALSE;
-            for (j=0;j<MAXNUMNEIGHBORS;j++) {
-               if (neighbors_vars.neighbors[j].parentPreference==MAXPREFERENCE) {
-                  iHaveAPreferedParent = TRUE;
-               }
-            }
-            // if I have none, and I'm not DAGroot, the new neighbor is my preferred
-            if (iHaveAPreferedParent==FALSE && idmanager_getIsDAGroot()==FALSE) {      
-               neighbors_vars.neighbors[i].parentPreference     = MAXPREFERENCE;
-            }
             break;
          }
          i++;
       }
+      if (i==MAXNUMNEIGHBORS) {
+         // table full, make room by evicting a neighbor I can do without
+         i = evictNeighbor();
+      }
       if (i==MAXNUMNEIGHBORS) {
          openserial_printError(COMPONENT_NEIGHBORS,ERR_NEIGHBORS_FULL,
                                (errorparameter_t)MAXNUMNEIGHBORS,
                                (errorparameter_t)0);
          return;
       }
+      
+      // add this neighbor
+      neighbors_vars.neighbors[i].used                   = TRUE;
+      neighbors_vars.neighbors[i].parentPreference       = 0;
+      // neighbors_vars.neighbors[i].stableNeighbor         = FALSE;
+      // Note: all new neighbors are consider stable
+      neighbors_vars.neighbors[i].stableNeighbor         = TRUE;
+      neighbors_vars.neighbors[i].switchStabilityCounter = 0;
+      memcpy(&neighbors_vars.neighbors[i].addr_64b,address,sizeof(open_addr_t));
+      neighbors_vars.neighbors[i].DAGrank                = DEFAULTDAGRANK;
+      neighbors_vars.neighbors[i].rssi                   = rssi;
+      neighbors_vars.neighbors[i].numRx                  = 1;
+      neighbors_vars.neighbors[i].numTx                  = 0;
+      neighbors_vars.neighbors[i].numTxACK               = 0;
+      neighbors_vars.neighbors[i].etx                    = DEFAULTLINKCOST*ETX_SCALE;
+      memcpy(&neighbors_vars.neighbors[i].asn,asnTimestamp,sizeof(asn_t));
+      //update jp
+      if (joinPrioPresent==TRUE){
+         neighbors_vars.neighbors[i].joinPrio=joinPrio;
+      }
+      
+      // index it in the first free entry of the hash, starting at its hash
+      pos = hashNeighbor(address->addr_64b);
+      while (neighbors_vars.hashTable[pos]!=NEIGHBORS_HASHEMPTY) {
+         pos = (pos+1)%NEIGHBORS_HASHSIZE;
+      }
+      neighbors_vars.hashTable[pos] = i;
+      
+      // do I already have a preferred parent ? -- TODO change to use JP
+      iHaveAPreferedParent = FALSE;
+      for (j=0;j<MAXNUMNEIGHBORS;j++) {
+         if (neighbors_vars.neighbors[j].parentPreference==MAXPREFERENCE) {
+            iHaveAPreferedParent = TRUE;
+         }
+      }
+      // if I have none, and I'm not DAGroot, the new neighbor is my preferred
+      if (iHaveAPreferedParent==FALSE && idmanager_getIsDAGroot()==FALSE) {      
+         neighbors_vars.neighbors[i].parentPreference     = MAXPREFERENCE;
+      }
    }
 }
 
 bool isNeighbor(open_addr_t* neighbor) {
-   uint8_t i=0;
-   for (i=0;i<MAXNUMNEIGHBORS;i++) {
-      if (isThisRowMatching(neighbor,i)) {
-         return TRUE;
-      }
-   }
-   return FALSE;
+   return getNeighborRow(neighbor)<MAXNUMNEIGHBORS;
 }
 
 void removeNeighbor(uint8_t neighborIndex) {
+   uint8_t pos;
+   uint8_t next;
+   uint8_t home;
+   
+   // remove it from the hash
+   pos = hashNeighbor(neighbors_vars.neighbors[neighborIndex].addr_64b.addr_64b);
+   while (neighbors_vars.hashTable[pos]!=neighborIndex) {
+      pos = (pos+1)%NEIGHBORS_HASHSIZE;
+   }
+   neighbors_vars.hashTable[pos] = NEIGHBORS_HASHEMPTY;
+   // shift back the entries of the same probe sequence, so lookups do not stop at the hole
+   next = pos;
+   while (1) {
+      next = (next+1)%NEIGHBORS_HASHSIZE;
+      if (neighbors_vars.hashTable[next]==NEIGHBORS_HASHEMPTY) {
+         break;
+      }
+      home = hashNeighbor(neighbors_vars.neighbors[neighbors_vars.hashTable[next]].addr_64b.addr_64b);
+      if (
+            (pos<next && (home<=pos || home>next)) ||
+            (pos>next && (home<=pos && home>next))
+         ) {
+         // its home is at or before the hole, move it there
+         neighbors_vars.hashTable[pos]  = neighbors_vars.hashTable[next];
+         neighbors_vars.hashTable[next] = NEIGHBORS_HASHEMPTY;
+         pos = next;
+      }
+   }
+   
    neighbors_vars.neighbors[neighborIndex].used                      = FALSE;
    neighbors_vars.neighbors[neighborIndex].parentPreference          = 0;
    neighbors_vars.neighbors[neighborIndex].stableNeighbor            = FALSE;
@@ -685,22 +916,171 @@ void removeNeighbor(uint8_t neighborIndex) {
    neighbors_vars.neighbors[neighborIndex].numRx                     = 0;
    neighbors_vars.neighbors[neighborIndex].numTx                     = 0;
    neighbors_vars.neighbors[neighborIndex].numTxACK                  = 0;
+   neighbors_vars.neighbors[neighborIndex].etx                       = DEFAULTLINKCOST*ETX_SCALE;
    neighbors_vars.neighbors[neighborIndex].asn.bytes0and1            = 0;
    neighbors_vars.neighbors[neighborIndex].asn.bytes2and3            = 0;
    neighbors_vars.neighbors[neighborIndex].asn.byte4                 = 0;
 }
 
+/**
+\brief Free a row of the full neighbor table.
+
+My preferred parent and the neighbors I have dedicated cells with (parents and
+children) are kept. Among the others, the one I haven't heard for the longest
+time is removed.
+
+\returns The freed row, MAXNUMNEIGHBORS if none could be freed.
+*/
+uint8_t evictNeighbor() {
+   uint8_t    i;
+   uint8_t    victim;
+   uint16_t   timeSinceHeard;
+   uint16_t   maxTimeSinceHeard;
+   
+   victim            = MAXNUMNEIGHBORS;
+   maxTimeSinceHeard = 0;
+   for (i=0;i<MAXNUMNEIGHBORS;i++) {
+      if (
+            neighbors_vars.neighbors[i].used==FALSE ||
+            neighbors_vars.neighbors[i].parentPreference>0
+         ) {
+         continue;
+      }
+      if (
+            schedule_getCellsCounts(schedule_getFrameHandle(),CELLTYPE_TX,&(neighbors_vars.neighbors[i].addr_64b))>0 ||
+            schedule_getCellsCounts(schedule_getFrameHandle(),CELLTYPE_RX,&(neighbors_vars.neighbors[i].addr_64b))>0
+         ) {
+         continue;
+      }
+      timeSinceHeard = ieee154e_asnDiff(&neighbors_vars.neighbors[i].asn);
+      if (victim==MAXNUMNEIGHBORS || timeSinceHeard>=maxTimeSinceHeard) {
+         victim            = i;
+         maxTimeSinceHeard = timeSinceHeard;
+      }
+   }
+   if (victim<MAXNUMNEIGHBORS) {
+      removeNeighbor(victim);
+   }
+   return victim;
+}
+
+/**
+\brief Pick a parent by the number of packets queued for it per TX cell.
+
+The load of a parent is (queueDepth+1)/(numTxCells+1), so that parents without
+cells or without queued packets still compare.
+
+\param[out] addressToWrite Where to write the parent's address to.
+\param[in]  mostLoaded     TRUE for the most loaded parent, ties going to the
+   preferred parent. FALSE for the least loaded parent with TX cells, ties
+   going to the backup parents.
+
+\returns TRUE if a parent was found, FALSE otherwise.
+*/
+bool getParentByCellLoad(open_addr_t* addressToWrite, bool mostLoaded) {
+   uint8_t   i;
+   uint16_t  numTxCells;
+   uint16_t  queueDepth;
+   uint16_t  bestNumTxCells;
+   uint16_t  bestQueueDepth;
+   uint8_t   bestIdx;
+   uint32_t  load;             // (queueDepth+1)/(numTxCells+1), cross-multiplied with the best one
+   uint32_t  bestLoad;
+   bool      isBetter;
+   
+   bestIdx        = MAXNUMNEIGHBORS;
+   bestNumTxCells = 0;
+   bestQueueDepth = 0;
+   for (i=0;i<MAXNUMNEIGHBORS;i++) {
+      if (neighbors_isParent(i)==FALSE) {
+         continue;
+      }
+      numTxCells = schedule_getCellsCounts(schedule_getFrameHandle(),CELLTYPE_TX,&(neighbors_vars.neighbors[i].addr_64b));
+      if (mostLoaded==FALSE && numTxCells==0) {
+         // no cell to release
+         continue;
+      }
+      queueDepth = openqueue_getNumDataPackets(&(neighbors_vars.neighbors[i].addr_64b));
+      if (bestIdx==MAXNUMNEIGHBORS) {
+         isBetter = TRUE;
+      } else {
+         load     = ((uint32_t)queueDepth+1)*((uint32_t)bestNumTxCells+1);
+         bestLoad = ((uint32_t)bestQueueDepth+1)*((uint32_t)numTxCells+1);
+         if (mostLoaded==TRUE) {
+            isBetter = load>bestLoad || (
+                          load==bestLoad &&
+                          neighbors_vars.neighbors[i].parentPreference>neighbors_vars.neighbors[bestIdx].parentPreference
+                       );
+         } else {
+            isBetter = load<bestLoad || (
+                          load==bestLoad &&
+                          neighbors_vars.neighbors[i].parentPreference<neighbors_vars.neighbors[bestIdx].parentPreference
+                       );
+         }
+      }
+      if (isBetter==TRUE) {
+         bestIdx        = i;
+         bestNumTxCells = numTxCells;
+         bestQueueDepth = queueDepth;
+      }
+   }
+   
+   if (bestIdx==MAXNUMNEIGHBORS) {
+      addressToWrite->type = ADDR_NONE;
+      return FALSE;
+   }
+   memcpy(addressToWrite,&(neighbors_vars.neighbors[bestIdx].addr_64b),sizeof(open_addr_t));
+   addressToWrite->type=ADDR_64B;
+   return TRUE;
+}
+
 //=========================== helpers =========================================
 
-bool isThisRowMatching(open_addr_t* address, uint8_t rowNumber) {
-   switch (address->type) {
-      case ADDR_64B:
-         return neighbors_vars.neighbors[rowNumber].used &&
-                packetfunctions_sameAddress(address,&neighbors_vars.neighbors[rowNumber].addr_64b);
-      default:
-         openserial_printCritical(COMPONENT_NEIGHBORS,ERR_WRONG_ADDR_TYPE,
-                               (errorparameter_t)address->type,
-                               (errorparameter_t)3);
-         return FALSE;
+/**
+\brief Find the row of a neighbor in the neighbor table.
+
+The row is found through the hash of its EUI64, with linear probing.
+
+\param[in] address The EUI64 address of the neighbor.
+
+\returns The row of that neighbor, MAXNUMNEIGHBORS if it is not in the table.
+*/
+uint8_t getNeighborRow(open_addr_t* address) {
+   uint8_t pos;
+   uint8_t row;
+   uint8_t numProbes;
+   
+   if (address->type!=ADDR_64B) {
+      openserial_printCritical(COMPONENT_NEIGHBORS,ERR_WRONG_ADDR_TYPE,
+                            (errorparameter_t)address->type,
+                            (errorparameter_t)3);
+      return MAXNUMNEIGHBORS;
+   }
+   
+   pos = hashNeighbor(address->addr_64b);
+   for (numProbes=0;numProbes<NEIGHBORS_HASHSIZE;numProbes++) {
+      row = neighbors_vars.hashTable[pos];
+      if (row==NEIGHBORS_HASHEMPTY) {
+         break;
+      }
+      if (memcmp(neighbors_vars.neighbors[row].addr_64b.addr_64b,address->addr_64b,LENGTH_ADDR64b)==0) {
+         return row;
+      }
+      pos = (pos+1)%NEIGHBORS_HASHSIZE;
+   }
+   return MAXNUMNEIGHBORS;
+}
+
+/**
+\brief Hash an EUI64 into the neighbor hash.
+*/
+uint8_t hashNeighbor(uint8_t* addr_64b) {
+   uint8_t  i;
+   uint16_t hash;
+   
+   hash = 0;
+   for (i=0;i<LENGTH_ADDR64b;i++) {
+      hash = (hash*31)^addr_64b[i];
    }
+   return (uint8_t)(hash%NEIGHBORS_HASHSIZE);
 }
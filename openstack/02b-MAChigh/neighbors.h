@@ -12,13 +12,31 @@
 
 //=========================== define ==========================================
 
-#define MAXNUMNEIGHBORS           10
-#define MAXPREFERENCE             2
+#ifndef MAXNUMNEIGHBORS
+#define MAXNUMNEIGHBORS           10   // boards with more RAM raise it in board_info.h
+#endif
+#define NEIGHBORS_HASHSIZE        (2*MAXNUMNEIGHBORS) // entries in the EUI64 hash, at most half full
+#define NEIGHBORS_HASHEMPTY       0xff
+#if NEIGHBORS_HASHSIZE>=NEIGHBORS_HASHEMPTY
+#error "slots of the neighbor hash are indexed on 8 bits, 2*MAXNUMNEIGHBORS must be below NEIGHBORS_HASHEMPTY"
+#endif
+#define MAXPREFERENCE             2    // preferred parent
+#define BACKUPPREFERENCE          1    // other parents of the parent set
 #define BADNEIGHBORMAXRSSI        -80 //dBm
 #define GOODNEIGHBORMINRSSI       -90 //dBm
 #define SWITCHSTABILITYTHRESHOLD  3
 #define DEFAULTLINKCOST           15
 
+#define ETX_SCALE                 128  // fixed-point ETX, ETX_SCALE stands for an ETX of 1
+#define ETX_ALPHA                 32   // weight of a new sample in the ETX average, out of ETX_SCALE
+#define ETX_NOACK                 DEFAULTLINKCOST // ETX sample of a packet which was never acknowledged
+#define PARENT_SWITCH_THRESHOLD   (3*MINHOPRANKINCREASE) // rank improvement needed to switch parent (ETX of 1.5, as in RFC6719)
+
+#define MAXNUMPARENTS             3    // size of the parent set, including the preferred parent
+#ifndef PARENT_SET_TOLERANCE
+#define PARENT_SET_TOLERANCE      (2*MINHOPRANKINCREASE) // max rank through a backup parent, above the one through the preferred parent
+#endif
+
 #define MAXDAGRANK                0xffff
 #define DEFAULTDAGRANK            MAXDAGRANK
 #define MINHOPRANKINCREASE        256  //default value in RPL and Minimal 6TiSCH draft
@@ -40,6 +58,7 @@ typedef struct {
    uint8_t          numWraps;//number of times the tx counter wraps. can be removed if memory is a restriction. also check openvisualizer then.
    asn_t            asn;
    uint8_t          joinPrio;
+   uint16_t         etx;           ///< moving average of the ETX to this neighbor, in ETX_SCALE units
 } neighborRow_t;
 END_PACK
 
@@ -64,6 +83,7 @@ END_PACK
    
 typedef struct {
    neighborRow_t        neighbors[MAXNUMNEIGHBORS];
+   uint8_t              hashTable[NEIGHBORS_HASHSIZE]; ///< row of each neighbor, indexed by hash of its EUI64
    dagrank_t            myDAGrank;
    uint8_t              debugRow;
    icmpv6rpl_dio_ht*    dio; //keep it global to be able to debug correctly.
@@ -77,6 +97,9 @@ void          neighbors_init(void);
 dagrank_t     neighbors_getMyDAGrank(void);
 uint8_t       neighbors_getNumNeighbors(void);
 bool          neighbors_getPreferredParentEui64(open_addr_t* addressToWrite);
+bool          neighbors_getUpstreamNextHopEui64(open_addr_t* addressToWrite);
+bool          neighbors_getParentToAddCellEui64(open_addr_t* addressToWrite);
+bool          neighbors_getParentToRemoveCellEui64(open_addr_t* addressToWrite);
 open_addr_t*  neighbors_getKANeighbor(uint16_t kaPeriod);
 // setters
 void          neighbors_setMyDAGrank(dagrank_t rank);
@@ -84,8 +107,10 @@ void          neighbors_setMyDAGrank(dagrank_t rank);
 // interrogators
 bool          neighbors_isStableNeighbor(open_addr_t* address);
 bool          neighbors_isPreferredParent(open_addr_t* address);
+bool          neighbors_isInParentSet(open_addr_t* address);
 bool          neighbors_isNeighborWithLowerDAGrank(uint8_t index);
 bool          neighbors_isNeighborWithHigherDAGrank(uint8_t index);
+bool          neighbors_isParent(uint8_t index);
 
 // updating neighbor information
 void          neighbors_indicateRx(
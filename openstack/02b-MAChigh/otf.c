@@ -3,17 +3,26 @@
 #include "neighbors.h"
 #include "sixtop.h"
 #include "scheduler.h"
+#include "schedule.h"
+#include "packetfunctions.h"
 
 //=========================== variables =======================================
 
+otf_vars_t otf_vars;
+
 //=========================== prototypes ======================================
 
 void otf_addCell_task(void);
 void otf_removeCell_task(void);
+void otf_relocateCells_task(void);
+void otf_clearFormerParent_task(void);
 
 //=========================== public ==========================================
 
 void otf_init(void) {
+   memset(&otf_vars,0,sizeof(otf_vars_t));
+   otf_vars.formerParent.type = ADDR_NONE;
+   otf_vars.newParent.type    = ADDR_NONE;
 }
 
 void otf_notif_addedCell(void) {
@@ -24,14 +33,60 @@ void otf_notif_removedCell(void) {
    scheduler_push_task(otf_removeCell_task,TASKPRIO_OTF);
 }
 
+/**
+\brief Indicates a 6P transaction this module started is over.
+
+If it is the request for the cells moved to the new parent, the cells with the
+former parent are released once the new parent granted them. If it did not,
+the cells stay with the former parent.
+
+\param[in] command    The 6P command of the transaction.
+\param[in] neighbor   The neighbor the transaction was with.
+\param[in] returnCode The 6P return code, IANA_6TOP_RC_ERR if no response came.
+*/
+void otf_notif_transactionDone(uint8_t command, open_addr_t* neighbor, uint8_t returnCode) {
+   if (
+         otf_vars.newParent.type==ADDR_NONE ||
+         command!=IANA_6TOP_CMD_ADD         ||
+         packetfunctions_sameAddress(neighbor,&(otf_vars.newParent))==FALSE
+      ) {
+      // not the request for the moved cells
+      return;
+   }
+   
+   if (returnCode==IANA_6TOP_RC_SUCCESS) {
+      scheduler_push_task(otf_clearFormerParent_task,TASKPRIO_OTF);
+   } else {
+      otf_vars.formerParent.type = ADDR_NONE;
+      otf_vars.newParent.type    = ADDR_NONE;
+   }
+}
+
+/**
+\brief Indicates my preferred parent changed.
+
+The dedicated cells I have with my former parent are moved to my new parent:
+the same number of cells is first requested from the new parent, then the
+cells with the former parent are cleared, once the new parent granted them.
+A former parent still in the parent set keeps its cells, and the new parent is
+only asked for one cell.
+
+\param[in] formerParent The preferred parent I just left.
+*/
+void otf_notif_parentChanged(open_addr_t* formerParent) {
+   memcpy(&(otf_vars.formerParent),formerParent,sizeof(open_addr_t));
+   otf_vars.newParent.type = ADDR_NONE;
+   scheduler_push_task(otf_relocateCells_task,TASKPRIO_OTF);
+}
+
 //=========================== private =========================================
 
 void otf_addCell_task(void) {
    open_addr_t          neighbor;
    bool                 foundNeighbor;
    
-   // get preferred parent
-   foundNeighbor = neighbors_getPreferredParentEui64(&neighbor);
+   // get the parent the shortest of cells
+   foundNeighbor = neighbors_getParentToAddCellEui64(&neighbor);
    if (foundNeighbor==FALSE) {
       return;
    }
@@ -49,8 +104,8 @@ void otf_removeCell_task(void) {
    open_addr_t          neighbor;
    bool                 foundNeighbor;
    
-   // get preferred parent
-   foundNeighbor = neighbors_getPreferredParentEui64(&neighbor);
+   // get the parent the least short of cells
+   foundNeighbor = neighbors_getParentToRemoveCellEui64(&neighbor);
    if (foundNeighbor==FALSE) {
       return;
    }
@@ -62,4 +117,75 @@ void otf_removeCell_task(void) {
       &neighbor,
       1
    );
+}
+
+void otf_relocateCells_task(void) {
+   open_addr_t          neighbor;
+   bool                 foundNeighbor;
+   uint16_t             numCells;
+   
+   if (neighbors_isInParentSet(&(otf_vars.formerParent))==TRUE) {
+      // still a backup parent, its cells keep carrying upstream packets
+      otf_vars.formerParent.type = ADDR_NONE;
+      // the new preferred parent is likely the shortest of cells
+      scheduler_push_task(otf_addCell_task,TASKPRIO_OTF);
+      return;
+   }
+   
+   numCells = schedule_getCellsCounts(
+      schedule_getFrameHandle(),
+      CELLTYPE_TX,
+      &(otf_vars.formerParent)
+   );
+   if (numCells==0) {
+      // nothing to move
+      otf_vars.formerParent.type = ADDR_NONE;
+      return;
+   }
+   if (numCells>SCHEDULEIEMAXNUMCELLS) {
+      numCells = SCHEDULEIEMAXNUMCELLS;
+   }
+   
+   // get preferred parent
+   foundNeighbor = neighbors_getPreferredParentEui64(&neighbor);
+   if (foundNeighbor==FALSE) {
+      otf_vars.formerParent.type = ADDR_NONE;
+      return;
+   }
+   
+   sixtop_setHandler(SIX_HANDLER_OTF);
+   // call sixtop
+   if (
+         sixtop_request(
+            IANA_6TOP_CMD_ADD,
+            &neighbor,
+            (uint8_t)numCells
+         )==E_SUCCESS
+      ) {
+      memcpy(&(otf_vars.newParent),&neighbor,sizeof(open_addr_t));
+   } else {
+      // no request sent (sixtop busy, no free cell or buffer), keep the cells
+      otf_vars.formerParent.type = ADDR_NONE;
+   }
+}
+
+void otf_clearFormerParent_task(void) {
+   open_addr_t          formerParent;
+   
+   memcpy(&formerParent,&(otf_vars.formerParent),sizeof(open_addr_t));
+   otf_vars.formerParent.type = ADDR_NONE;
+   otf_vars.newParent.type    = ADDR_NONE;
+   
+   if (neighbors_isInParentSet(&formerParent)==TRUE) {
+      // it joined the parent set again, keep its cells
+      return;
+   }
+   
+   sixtop_setHandler(SIX_HANDLER_OTF);
+   // call sixtop
+   sixtop_request(
+      IANA_6TOP_CMD_CLEAR,
+      &formerParent,
+      0
+   );
 }
\ No newline at end of file
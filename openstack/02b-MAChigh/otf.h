@@ -16,6 +16,11 @@
 
 //=========================== module variables ================================
 
+typedef struct {
+   open_addr_t          formerParent;  ///< parent whose cells are being moved, ADDR_NONE if none
+   open_addr_t          newParent;     ///< parent asked for the moved cells, ADDR_NONE until asked
+} otf_vars_t;
+
 //=========================== prototypes ======================================
 
 // admin
@@ -23,6 +28,9 @@ void      otf_init(void);
 // notification from sixtop
 void      otf_notif_addedCell(void);
 void      otf_notif_removedCell(void);
+void      otf_notif_transactionDone(uint8_t command, open_addr_t* neighbor, uint8_t returnCode);
+// notification from neighbors
+void      otf_notif_parentChanged(open_addr_t* formerParent);
 
 /**
 \}
@@ -75,10 +75,10 @@ port_INLINE uint8_t processIE_prependSyncIE(OpenQueueEntry_t* pkt){
       sizeof(sync_IE_ht)
    );
    
-   // Keep a pointer to where the ASN will be
+   // Keep the position where the ASN will be
    // Note: the actual value of the current ASN and JP will be written by the
    //    IEEE802.15.4e when transmitting
-   pkt->l2_ASNpayload               = pkt->payload; 
+   pkt->l2_ASNpayload               = (uint8_t)(pkt->payload-pkt->packet);
    
    len += sizeof(sync_IE_ht);
   
@@ -182,11 +182,29 @@ port_INLINE uint8_t processIE_prependTSCHTimeslotIE(OpenQueueEntry_t* pkt){
    mlme_IE_ht mlme_subHeader;
    
    uint16_t    duration;
+   uint8_t     id;
+   asn_t       switchAsn;
    
    len = 0;
+   
+   if (ieee154e_getPendingTimeslotTemplate(&id,&duration,&switchAsn)==TRUE){
+       // the template the network switches to, and when
+       packetfunctions_reserveHeaderSize(pkt,5);
+       pkt->payload[0] = (uint8_t)(switchAsn.bytes0and1 & 0x00ff);
+       pkt->payload[1] = (uint8_t)((switchAsn.bytes0and1>>8) & 0x00ff);
+       pkt->payload[2] = (uint8_t)(switchAsn.bytes2and3 & 0x00ff);
+       pkt->payload[3] = (uint8_t)((switchAsn.bytes2and3>>8) & 0x00ff);
+       pkt->payload[4] = switchAsn.byte4;
+       packetfunctions_reserveHeaderSize(pkt,3*sizeof(uint8_t));
+       pkt->payload[0] = id;
+       pkt->payload[1] = (uint8_t)(duration & 0x00ff);
+       pkt->payload[2] = (uint8_t)((duration>>8) & 0x00ff);
+       len+=8;
+   }
+   
    duration = ieee154e_getSlotDuration();
    
-   if (duration==328){
+   if (ieee154e_getTimeslotTemplateId()==TIMESLOT_TEMPLATE_ID){
        // reserve space for timeslot template ID
        packetfunctions_reserveHeaderSize(pkt,sizeof(uint8_t));
        // write header
@@ -201,7 +219,7 @@ port_INLINE uint8_t processIE_prependTSCHTimeslotIE(OpenQueueEntry_t* pkt){
        // reserve space for timeslot template ID
        packetfunctions_reserveHeaderSize(pkt,sizeof(uint8_t));
        // write header
-       *((uint8_t*)(pkt->payload)) = 1;
+       *((uint8_t*)(pkt->payload)) = ieee154e_getTimeslotTemplateId();
        len+=3;
    }
    
@@ -227,13 +245,46 @@ port_INLINE uint8_t processIE_prependTSCHTimeslotIE(OpenQueueEntry_t* pkt){
 port_INLINE uint8_t processIE_prependChannelHoppingIE(OpenQueueEntry_t* pkt){
    uint8_t    len;
    mlme_IE_ht mlme_subHeader;
+   uint8_t    id;
+   uint8_t    sequence[CHTEMPLATE_MAXLENGTH];
+   uint8_t    length;
+   asn_t      switchAsn;
    
    len = 0;
-
-   // reserve space for timeslot template ID
+   
+   if (ieee154e_getPendingChannelHoppingTemplate(&id,sequence,&length,&switchAsn)==TRUE){
+       // the template the network switches to, and when
+       packetfunctions_reserveHeaderSize(pkt,5);
+       pkt->payload[0] = (uint8_t)(switchAsn.bytes0and1 & 0x00ff);
+       pkt->payload[1] = (uint8_t)((switchAsn.bytes0and1>>8) & 0x00ff);
+       pkt->payload[2] = (uint8_t)(switchAsn.bytes2and3 & 0x00ff);
+       pkt->payload[3] = (uint8_t)((switchAsn.bytes2and3>>8) & 0x00ff);
+       pkt->payload[4] = switchAsn.byte4;
+       packetfunctions_reserveHeaderSize(pkt,length);
+       memcpy(pkt->payload,sequence,length);
+       packetfunctions_reserveHeaderSize(pkt,2*sizeof(uint8_t));
+       pkt->payload[0] = id;
+       pkt->payload[1] = length;
+       len+=2+length+5;
+   }
+   
+   id  = ieee154e_getChannelHoppingTemplateId();
+   
+   if (id!=CHANNELHOPPING_TEMPLATE_ID){
+       // reserve space for the hopping sequence
+       length = ieee154e_getChannelHoppingSequence(sequence);
+       packetfunctions_reserveHeaderSize(pkt,length);
+       memcpy(pkt->payload,sequence,length);
+       // reserve space for its length
+       packetfunctions_reserveHeaderSize(pkt,sizeof(uint8_t));
+       *((uint8_t*)(pkt->payload)) = length;
+       len+=1+length;
+   }
+   
+   // reserve space for channel hopping template ID
    packetfunctions_reserveHeaderSize(pkt,sizeof(uint8_t));
    // write header
-   *((uint8_t*)(pkt->payload)) = CHANNELHOPPING_TEMPLATE_ID;
+   *((uint8_t*)(pkt->payload)) = id;
    
    len+=1;
    
@@ -345,7 +396,7 @@ port_INLINE uint8_t processIE_prepend_sixCelllist(
    
     // record the position of cellObjects
     pkt->l2_sixtop_numOfCells  = numOfCells;
-    pkt->l2_sixtop_cellObjects = pkt->payload;
+    pkt->l2_sixtop_cellObjects = (uint8_t)(pkt->payload-pkt->packet);
    
     return len;
 }
@@ -419,6 +470,7 @@ port_INLINE void processIE_retrieveSlotframeLinkIE(
             memset(&temp_neighbor,0,sizeof(temp_neighbor));
             temp_neighbor.type             = ADDR_ANYCAST;
             schedule_addActiveSlot(
+               sfInfo.slotframehandle,             // slotframe handle
                linkInfo.tsNum,                     // slot offset
                CELLTYPE_TXRX,                      // type of slot
                TRUE,                               // shared?
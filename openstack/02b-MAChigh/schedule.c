@@ -5,6 +5,7 @@
 #include "packetfunctions.h"
 #include "sixtop.h"
 #include "idmanager.h"
+#include "IEEE802154E.h"
 
 //=========================== variables =======================================
 
@@ -13,6 +14,17 @@ schedule_vars_t schedule_vars;
 //=========================== prototypes ======================================
 
 void schedule_resetEntry(scheduleEntry_t* pScheduleEntry);
+uint8_t schedule_getSlotframeIndex(uint8_t frameHandle);
+uint8_t schedule_findPosition(uint8_t slotframe, slotOffset_t slotOffset);
+scheduleEntry_t* schedule_getEntry(uint8_t slotframe, slotOffset_t slotOffset);
+scheduleEntry_t* schedule_getEntryAtOrBefore(uint8_t slotframe, slotOffset_t slotOffset);
+void schedule_setBusy(uint8_t slotframe, slotOffset_t slotOffset, bool busy);
+void schedule_removeEntry(scheduleEntry_t* slotContainer);
+slotOffset_t schedule_asnToSlotOffset(frameLength_t frameLength);
+frameLength_t schedule_slotsToNext(slotframe_t* slotframe);
+frameLength_t schedule_slotsToNextActive(void);
+void schedule_updateCurrent(void);
+uint8_t schedule_getUnreservedRows(void);
 
 //=========================== public ==========================================
 
@@ -32,9 +44,17 @@ void schedule_init() {
    memset(&schedule_vars,0,sizeof(schedule_vars_t));
    for (running_slotOffset=0;running_slotOffset<MAXACTIVESLOTS;running_slotOffset++) {
       schedule_resetEntry(&schedule_vars.scheduleBuf[running_slotOffset]);
+      // all rows are free, the first ones are used first
+      schedule_vars.freeRows[running_slotOffset] = MAXACTIVESLOTS-1-running_slotOffset;
    }
+   schedule_vars.numFreeRows = MAXACTIVESLOTS;
    schedule_vars.backoffExponent = MINBE-1;
-   schedule_vars.maxActiveSlots = MAXACTIVESLOTS;
+   
+   // the minimal slotframe is always there, its length is known when joining
+   // it gets all rows, until some are given to another slotframe
+   schedule_vars.slotframes[0].inUse          = TRUE;
+   schedule_vars.slotframes[0].handle         = SCHEDULE_MINIMAL_6TISCH_DEFAULT_SLOTFRAME_HANDLE;
+   schedule_vars.slotframes[0].maxActiveSlots = MAXACTIVESLOTS;
    
    start_slotOffset = SCHEDULE_MINIMAL_6TISCH_SLOTOFFSET;
    if (idmanager_getIsDAGroot()==TRUE) {
@@ -46,6 +66,7 @@ void schedule_init() {
    memset(&temp_neighbor,0,sizeof(temp_neighbor));
    for (running_slotOffset=start_slotOffset;running_slotOffset<start_slotOffset+NUMSERIALRX;running_slotOffset++) {
       schedule_addActiveSlot(
+         schedule_vars.slotframes[0].handle,    // slotframe
          running_slotOffset,                    // slot offset
          CELLTYPE_SERIALRX,                     // type of slot
          FALSE,                                 // shared?
@@ -65,7 +86,7 @@ void schedule_startDAGroot() {
    
    start_slotOffset = SCHEDULE_MINIMAL_6TISCH_SLOTOFFSET;
    // set frame length, handle and number (default 1 by now)
-   if (schedule_vars.frameLength == 0) {
+   if (schedule_vars.slotframes[0].length == 0) {
        // slotframe length is not set, set it to default length
        schedule_setFrameLength(SLOTFRAME_LENGTH);
    } else {
@@ -79,6 +100,7 @@ void schedule_startDAGroot() {
    temp_neighbor.type             = ADDR_ANYCAST;
    for (running_slotOffset=start_slotOffset;running_slotOffset<start_slotOffset+SCHEDULE_MINIMAL_6TISCH_ACTIVE_CELLS;running_slotOffset++) {
       schedule_addActiveSlot(
+         SCHEDULE_MINIMAL_6TISCH_DEFAULT_SLOTFRAME_HANDLE, // slotframe
          running_slotOffset,                 // slot offset
          CELLTYPE_TXRX,                      // type of slot
          TRUE,                               // shared?
@@ -100,7 +122,7 @@ bool debugPrint_schedule() {
    debugScheduleEntry_t temp;
    
    // increment the row just printed
-   schedule_vars.debugPrintRow         = (schedule_vars.debugPrintRow+1)%schedule_vars.maxActiveSlots;
+   schedule_vars.debugPrintRow         = (schedule_vars.debugPrintRow+1)%MAXACTIVESLOTS;
    
    // gather status data
    temp.row                            = schedule_vars.debugPrintRow;
@@ -167,24 +189,59 @@ bool debugPrint_backoff() {
 //=== from 6top (writing the schedule)
 
 /**
-\brief Set frame length.
+\brief Set the length of the minimal slotframe.
+
+This can be done at any time. Active slots which do not fit in the new length
+are removed. Once synchronized, IEEE802154E realigns on the new length at the
+start of the next slot.
 
 \param newFrameLength The new frame length.
 */
 void schedule_setFrameLength(frameLength_t newFrameLength) {
+   slotframe_t*     slotframe;
+   scheduleEntry_t* slotContainer;
+   uint8_t          pos;
    
    INTERRUPT_DECLARATION();
    DISABLE_INTERRUPTS();
    
-   schedule_vars.frameLength = newFrameLength;
-   if (newFrameLength <= MAXACTIVESLOTS) {
-      schedule_vars.maxActiveSlots = newFrameLength;
+   if (newFrameLength==0) {
+      ENABLE_INTERRUPTS();
+      openserial_printError(
+         COMPONENT_SCHEDULE,ERR_SCHEDULE_SLOTOFFSET_OUTOFFRAME,
+         (errorparameter_t)0,
+         (errorparameter_t)newFrameLength
+      );
+      return;
+   }
+   
+   // remove the active slots past the end of the slotframe
+   pos = schedule_findPosition(0,newFrameLength);
+   while (
+         pos<schedule_vars.numActiveSlots &&
+         schedule_vars.scheduleBuf[schedule_vars.activeRows[pos]].slotframe==0
+      ) {
+      slotContainer = &schedule_vars.scheduleBuf[schedule_vars.activeRows[pos]];
+      openserial_printError(
+         COMPONENT_SCHEDULE,ERR_SCHEDULE_SLOTOFFSET_OUTOFFRAME,
+         (errorparameter_t)slotContainer->slotOffset,
+         (errorparameter_t)newFrameLength
+      );
+      schedule_removeEntry(slotContainer);
    }
+   
+   slotframe                   = &schedule_vars.slotframes[0];
+   slotframe->length           = newFrameLength;
+   slotframe->slotOffset       = slotframe->slotOffset%newFrameLength;
+   slotframe->currentEntry     = schedule_getEntryAtOrBefore(0,slotframe->slotOffset);
+   schedule_vars.slotsToNextActive = 0;
+   schedule_updateCurrent();
+   
    ENABLE_INTERRUPTS();
 }
 
 /**
-\brief Set frame handle.
+\brief Set the handle of the minimal slotframe.
 
 \param frameHandle The new frame handle.
 */
@@ -193,7 +250,7 @@ void schedule_setFrameHandle(uint8_t frameHandle) {
    INTERRUPT_DECLARATION();
    DISABLE_INTERRUPTS();
    
-   schedule_vars.frameHandle = frameHandle;
+   schedule_vars.slotframes[0].handle = frameHandle;
    
    ENABLE_INTERRUPTS();
 }
@@ -213,34 +270,212 @@ void schedule_setFrameNumber(uint8_t frameNumber) {
    ENABLE_INTERRUPTS();
 }
 
+/**
+\brief Add a slotframe to the schedule.
+
+Its slot offsets are counted from ASN 0, as the ones of the minimal slotframe.
+
+The rows of the schedule reserved for the new slotframe are taken from the ones
+not reserved by any slotframe, then from the ones reserved, but not used, by
+the minimal slotframe.
+
+\param frameHandle    The handle of the new slotframe. The lower the handle,
+   the higher the priority of its cells.
+\param frameLength    The length of the new slotframe, in slots.
+\param maxActiveSlots The number of active slots it can hold.
+*/
+owerror_t schedule_addSlotframe(
+      uint8_t       frameHandle,
+      frameLength_t frameLength,
+      uint8_t       maxActiveSlots
+   ) {
+   slotframe_t* slotframe;
+   slotframe_t* minimal;
+   uint8_t      unreserved;
+   uint8_t      i;
+   
+   INTERRUPT_DECLARATION();
+   DISABLE_INTERRUPTS();
+   
+   if (frameLength==0 || schedule_getSlotframeIndex(frameHandle)<MAXSLOTFRAMES) {
+      ENABLE_INTERRUPTS();
+      return E_FAIL;
+   }
+   
+   // find a free slotframe
+   for (i=0;i<MAXSLOTFRAMES;i++) {
+      if (schedule_vars.slotframes[i].inUse==FALSE) {
+         break;
+      }
+   }
+   if (i==MAXSLOTFRAMES) {
+      ENABLE_INTERRUPTS();
+      openserial_printError(
+         COMPONENT_SCHEDULE,ERR_SCHEDULE_OVERFLOWN,
+         (errorparameter_t)frameHandle,
+         (errorparameter_t)1
+      );
+      return E_FAIL;
+   }
+   
+   // reserve its rows
+   minimal    = &schedule_vars.slotframes[0];
+   unreserved = schedule_getUnreservedRows();
+   if (maxActiveSlots>unreserved) {
+      if (maxActiveSlots-unreserved>minimal->maxActiveSlots-minimal->numActiveSlots) {
+         ENABLE_INTERRUPTS();
+         openserial_printError(
+            COMPONENT_SCHEDULE,ERR_SCHEDULE_OVERFLOWN,
+            (errorparameter_t)frameHandle,
+            (errorparameter_t)maxActiveSlots
+         );
+         return E_FAIL;
+      }
+      minimal->maxActiveSlots -= maxActiveSlots-unreserved;
+   }
+   
+   slotframe                 = &schedule_vars.slotframes[i];
+   memset(slotframe,0,sizeof(slotframe_t));
+   slotframe->inUse          = TRUE;
+   slotframe->handle         = frameHandle;
+   slotframe->length         = frameLength;
+   slotframe->slotOffset     = schedule_asnToSlotOffset(frameLength);
+   slotframe->currentEntry   = NULL;
+   slotframe->maxActiveSlots = maxActiveSlots;
+   
+   ENABLE_INTERRUPTS();
+   return E_SUCCESS;
+}
+
+/**
+\brief Remove a slotframe, and all its cells, from the schedule.
+
+The minimal slotframe cannot be removed. It gets the rows of the schedule
+reserved for the slotframe removed.
+
+\param frameHandle The handle of the slotframe to remove.
+*/
+owerror_t schedule_removeSlotframe(uint8_t frameHandle) {
+   uint8_t i;
+   uint8_t pos;
+   
+   INTERRUPT_DECLARATION();
+   DISABLE_INTERRUPTS();
+   
+   i = schedule_getSlotframeIndex(frameHandle);
+   if (i==0 || i==MAXSLOTFRAMES) {
+      ENABLE_INTERRUPTS();
+      return E_FAIL;
+   }
+   
+   // remove its cells, they are contiguous in the table of active slots
+   pos = schedule_findPosition(i,0);
+   while (
+         pos<schedule_vars.numActiveSlots &&
+         schedule_vars.scheduleBuf[schedule_vars.activeRows[pos]].slotframe==i
+      ) {
+      schedule_removeEntry(&schedule_vars.scheduleBuf[schedule_vars.activeRows[pos]]);
+   }
+   
+   schedule_vars.slotframes[i].inUse           = FALSE;
+   schedule_vars.slotframes[0].maxActiveSlots += schedule_vars.slotframes[i].maxActiveSlots;
+   
+   ENABLE_INTERRUPTS();
+   return E_SUCCESS;
+}
+
+/**
+\brief Get the length of a slotframe.
+
+\param frameHandle The handle of the slotframe.
+
+\returns The length of the slotframe, 0 if there is no such slotframe.
+*/
+frameLength_t schedule_getSlotframeLength(uint8_t frameHandle) {
+   frameLength_t returnVal;
+   uint8_t       i;
+   
+   INTERRUPT_DECLARATION();
+   DISABLE_INTERRUPTS();
+   
+   i = schedule_getSlotframeIndex(frameHandle);
+   if (i==MAXSLOTFRAMES) {
+      returnVal = 0;
+   } else {
+      returnVal = schedule_vars.slotframes[i].length;
+   }
+   
+   ENABLE_INTERRUPTS();
+   
+   return returnVal;
+}
+
+/**
+\brief Get an active slot of a slotframe.
+
+The active slots of a slotframe form a circular list, through their
+<tt>next</tt> field, which can be walked from the entry returned.
+
+\param frameHandle The handle of the slotframe.
+
+\returns An active slot of the slotframe, NULL if it has none.
+*/
+scheduleEntry_t* schedule_getSlotframeEntry(uint8_t frameHandle) {
+   scheduleEntry_t* returnVal;
+   uint8_t          i;
+   
+   INTERRUPT_DECLARATION();
+   DISABLE_INTERRUPTS();
+   
+   i = schedule_getSlotframeIndex(frameHandle);
+   if (i==MAXSLOTFRAMES) {
+      returnVal = NULL;
+   } else {
+      returnVal = schedule_vars.slotframes[i].currentEntry;
+   }
+   
+   ENABLE_INTERRUPTS();
+   
+   return returnVal;
+}
+
 /**
 \brief Get the information of a specific slot.
 
+\param frameHandle
 \param slotOffset
 \param neighbor
 \param info
 */
 void  schedule_getSlotInfo(
+   uint8_t              frameHandle,
    slotOffset_t         slotOffset,
    open_addr_t*         neighbor,
    slotinfo_element_t*  info
 ){
    
    scheduleEntry_t* slotContainer;
-  
-   // find an empty schedule entry container
-   slotContainer = &schedule_vars.scheduleBuf[0];
-   while (slotContainer<=&schedule_vars.scheduleBuf[schedule_vars.maxActiveSlots-1]) {
-       //check that this entry for that neighbour and timeslot is not already scheduled.
-       if (packetfunctions_sameAddress(neighbor,&(slotContainer->neighbor))&& (slotContainer->slotOffset==slotOffset)){
-               //it exists so this is an update.
-               info->link_type                 = slotContainer->type;
-               info->shared                    =slotContainer->shared;
-               info->channelOffset             = slotContainer->channelOffset;
-               return; //as this is an update. No need to re-insert as it is in the same position on the list.
-        }
-        slotContainer++;
+   uint8_t          i;
+   
+   INTERRUPT_DECLARATION();
+   DISABLE_INTERRUPTS();
+   
+   // find the schedule entry at that slot offset
+   i = schedule_getSlotframeIndex(frameHandle);
+   if (i==MAXSLOTFRAMES) {
+      slotContainer = NULL;
+   } else {
+      slotContainer = schedule_getEntry(i,slotOffset);
+   }
+   //check that this entry is for that neighbour
+   if (slotContainer!=NULL && packetfunctions_sameAddress(neighbor,&(slotContainer->neighbor))){
+      info->link_type                 = slotContainer->type;
+      info->shared                    = slotContainer->shared;
+      info->channelOffset             = slotContainer->channelOffset;
+      ENABLE_INTERRUPTS();
+      return;
    }
+   ENABLE_INTERRUPTS();
    //return cell type off.
    info->link_type                 = CELLTYPE_OFF;
    info->shared                    = FALSE;
@@ -248,17 +483,62 @@ void  schedule_getSlotInfo(
 }
 
 /**
-\brief Get the maximum number of active slots.
+\brief Get the maximum number of active slots of the minimal slotframe.
 
 \param[out] maximum number of active slots
 */
 uint16_t  schedule_getMaxActiveSlots() {
-   return schedule_vars.maxActiveSlots;
+   return schedule_vars.slotframes[0].maxActiveSlots;
+}
+
+/**
+\brief Change the number of rows of the schedule reserved for a slotframe.
+
+The rows are taken from, or given back to, the ones no slotframe reserves.
+
+\param frameHandle    The handle of the slotframe.
+\param maxActiveSlots The number of active slots it can hold, at least the
+   number it currently has.
+*/
+owerror_t schedule_setMaxActiveSlots(uint8_t frameHandle, uint8_t maxActiveSlots) {
+   slotframe_t* slotframe;
+   uint8_t      i;
+   
+   INTERRUPT_DECLARATION();
+   DISABLE_INTERRUPTS();
+   
+   i = schedule_getSlotframeIndex(frameHandle);
+   if (i==MAXSLOTFRAMES) {
+      ENABLE_INTERRUPTS();
+      return E_FAIL;
+   }
+   slotframe = &schedule_vars.slotframes[i];
+   
+   if (
+         maxActiveSlots<slotframe->numActiveSlots ||
+         (
+            maxActiveSlots>slotframe->maxActiveSlots &&
+            maxActiveSlots-slotframe->maxActiveSlots>schedule_getUnreservedRows()
+         )
+      ) {
+      ENABLE_INTERRUPTS();
+      openserial_printError(
+         COMPONENT_SCHEDULE,ERR_SCHEDULE_OVERFLOWN,
+         (errorparameter_t)frameHandle,
+         (errorparameter_t)maxActiveSlots
+      );
+      return E_FAIL;
+   }
+   slotframe->maxActiveSlots = maxActiveSlots;
+   
+   ENABLE_INTERRUPTS();
+   return E_SUCCESS;
 }
 
 /**
 \brief Add a new active slot into the schedule.
 
+\param frameHandle      The handle of the slotframe of the new slot
 \param slotOffset       The slotoffset of the new slot
 \param type             The type of the cell
 \param shared           Whether this cell is shared (TRUE) or not (FALSE).
@@ -267,6 +547,7 @@ uint16_t  schedule_getMaxActiveSlots() {
    none)
 */
 owerror_t schedule_addActiveSlot(
+      uint8_t         frameHandle,
       slotOffset_t    slotOffset,
       cellType_t      type,
       bool            shared,
@@ -276,21 +557,45 @@ owerror_t schedule_addActiveSlot(
    scheduleEntry_t* slotContainer;
    scheduleEntry_t* previousSlotWalker;
    scheduleEntry_t* nextSlotWalker;
+   slotframe_t*     slotframe;
+   uint8_t          i;
+   uint8_t          row;
+   uint8_t          pos;
+   uint8_t          first;
+   uint8_t          last;
    
    INTERRUPT_DECLARATION();
    DISABLE_INTERRUPTS();
    
-   // find an empty schedule entry container
-   slotContainer = &schedule_vars.scheduleBuf[0];
-   while (
-         slotContainer->type!=CELLTYPE_OFF &&
-         slotContainer<=&schedule_vars.scheduleBuf[schedule_vars.maxActiveSlots-1]
-      ) {
-      slotContainer++;
+   // abort if no such slotframe
+   i = schedule_getSlotframeIndex(frameHandle);
+   if (i==MAXSLOTFRAMES) {
+      ENABLE_INTERRUPTS();
+      openserial_printError(
+         COMPONENT_SCHEDULE,ERR_UNSUPPORTED_COMMAND,
+         (errorparameter_t)frameHandle,
+         (errorparameter_t)slotOffset
+      );
+      return E_FAIL;
+   }
+   slotframe = &schedule_vars.slotframes[i];
+   
+   // abort if the slot offset is past the end of the slotframe
+   if (slotframe->length!=0 && slotOffset>=slotframe->length) {
+      ENABLE_INTERRUPTS();
+      openserial_printError(
+         COMPONENT_SCHEDULE,ERR_SCHEDULE_SLOTOFFSET_OUTOFFRAME,
+         (errorparameter_t)slotOffset,
+         (errorparameter_t)slotframe->length
+      );
+      return E_FAIL;
    }
    
    // abort it schedule overflow
-   if (slotContainer>&schedule_vars.scheduleBuf[schedule_vars.maxActiveSlots-1]) {
+   if (
+         slotframe->numActiveSlots>=slotframe->maxActiveSlots ||
+         schedule_vars.numFreeRows==0
+      ) {
       ENABLE_INTERRUPTS();
       openserial_printCritical(
          COMPONENT_SCHEDULE,ERR_SCHEDULE_OVERFLOWN,
@@ -300,64 +605,67 @@ owerror_t schedule_addActiveSlot(
       return E_FAIL;
    }
    
+   // abort if slot is already in schedule
+   if (schedule_getEntry(i,slotOffset)!=NULL) {
+      ENABLE_INTERRUPTS();
+      openserial_printError(
+         COMPONENT_SCHEDULE,ERR_SCHEDULE_ADDDUPLICATESLOT,
+         (errorparameter_t)slotOffset,
+         (errorparameter_t)0
+      );
+      return E_FAIL;
+   }
+   
+   // take an empty schedule entry container
+   schedule_vars.numFreeRows--;
+   row                                      = schedule_vars.freeRows[schedule_vars.numFreeRows];
+   slotContainer                            = &schedule_vars.scheduleBuf[row];
+   
    // fill that schedule entry with parameters passed
    slotContainer->slotOffset                = slotOffset;
    slotContainer->type                      = type;
    slotContainer->shared                    = shared;
    slotContainer->channelOffset             = channelOffset;
    memcpy(&slotContainer->neighbor,neighbor,sizeof(open_addr_t));
-   
-   // insert in circular list
-   if (schedule_vars.currentScheduleEntry==NULL) {
-      // this is the first active slot added
+   slotContainer->slotframe                 = i;
+   
+   // insert in the table of active slots, which stays sorted
+   pos                                      = schedule_findPosition(i,slotOffset);
+   memmove(
+      &schedule_vars.activeRows[pos+1],
+      &schedule_vars.activeRows[pos],
+      schedule_vars.numActiveSlots-pos
+   );
+   schedule_vars.activeRows[pos]            = row;
+   schedule_vars.numActiveSlots++;
+   slotframe->numActiveSlots++;
+   schedule_setBusy(i,slotOffset,TRUE);
+   
+   // insert in the circular list of the slotframe
+   if (slotframe->currentEntry==NULL) {
+      // this is the first active slot added to the slotframe
       
       // the next slot of this slot is this slot
       slotContainer->next                   = slotContainer;
-      
-      // current slot points to this slot
-      schedule_vars.currentScheduleEntry    = slotContainer;
    } else  {
-      // this is NOT the first active slot added
+      // this is NOT the first active slot added to the slotframe
       
-      // find position in schedule
-      previousSlotWalker                    = schedule_vars.currentScheduleEntry;
-      while (1) {
-         nextSlotWalker                     = previousSlotWalker->next;
-         if (
-               (
-                     (previousSlotWalker->slotOffset <  slotContainer->slotOffset) &&
-                     (slotContainer->slotOffset <  nextSlotWalker->slotOffset)
-               )
-               ||
-               (
-                     (previousSlotWalker->slotOffset <  slotContainer->slotOffset) &&
-                     (nextSlotWalker->slotOffset <= previousSlotWalker->slotOffset)
-               )
-               ||
-               (
-                     (slotContainer->slotOffset <  nextSlotWalker->slotOffset) &&
-                     (nextSlotWalker->slotOffset <= previousSlotWalker->slotOffset)
-               )
-         ) {
-            break;
-         }
-         if (previousSlotWalker->slotOffset == slotContainer->slotOffset) {
-            // slot is already in schedule
-            openserial_printError(
-               COMPONENT_SCHEDULE,ERR_SCHEDULE_ADDDUPLICATESLOT,
-               (errorparameter_t)slotContainer->slotOffset,
-               (errorparameter_t)0
-            );
-            ENABLE_INTERRUPTS();
-            return E_FAIL;
-         }
-         previousSlotWalker                 = nextSlotWalker;
-      }
-      // insert between previousSlotWalker and nextSlotWalker
+      // insert between its neighbors in the table of active slots
+      first                                 = schedule_findPosition(i,0);
+      last                                  = schedule_findPosition(i+1,0)-1;
+      previousSlotWalker                    = &schedule_vars.scheduleBuf[schedule_vars.activeRows[(pos==first) ? last : pos-1]];
+      nextSlotWalker                        = &schedule_vars.scheduleBuf[schedule_vars.activeRows[(pos==last) ? first : pos+1]];
       previousSlotWalker->next              = slotContainer;
       slotContainer->next                   = nextSlotWalker;
    }
    
+   // the new slot may be the last one before the current slot
+   slotframe->currentEntry                  = schedule_getEntryAtOrBefore(i,slotframe->slotOffset);
+   if (schedule_vars.currentScheduleEntry==NULL) {
+      // this is the first active slot added
+      schedule_updateCurrent();
+   }
+   
    ENABLE_INTERRUPTS();
    return E_SUCCESS;
 }
@@ -365,32 +673,32 @@ owerror_t schedule_addActiveSlot(
 /**
 \brief Remove an active slot from the schedule.
 
+\param frameHandle      The handle of the slotframe of the slot to remove.
 \param slotOffset       The slotoffset of the slot to remove.
 \param neighbor         The neighbor associated with this cell (all 0's if
    none)
 */
-owerror_t schedule_removeActiveSlot(slotOffset_t slotOffset, open_addr_t* neighbor) {
+owerror_t schedule_removeActiveSlot(uint8_t frameHandle, slotOffset_t slotOffset, open_addr_t* neighbor) {
    scheduleEntry_t* slotContainer;
-   scheduleEntry_t* previousSlotWalker;
+   uint8_t          i;
    
    INTERRUPT_DECLARATION();
    DISABLE_INTERRUPTS();
    
    // find the schedule entry
-   slotContainer = &schedule_vars.scheduleBuf[0];
-   while (slotContainer<=&schedule_vars.scheduleBuf[schedule_vars.maxActiveSlots-1]) {
-      if (
-            slotContainer->slotOffset==slotOffset
-            &&
-            packetfunctions_sameAddress(neighbor,&(slotContainer->neighbor))
-            ){
-         break;
-      }
-      slotContainer++;
+   i = schedule_getSlotframeIndex(frameHandle);
+   if (i==MAXSLOTFRAMES) {
+      slotContainer = NULL;
+   } else {
+      slotContainer = schedule_getEntry(i,slotOffset);
    }
    
    // abort it could not find
-   if (slotContainer>&schedule_vars.scheduleBuf[schedule_vars.maxActiveSlots-1]) {
+   if (
+         slotContainer==NULL
+         ||
+         packetfunctions_sameAddress(neighbor,&(slotContainer->neighbor))==FALSE
+      ) {
       ENABLE_INTERRUPTS();
       openserial_printCritical(
          COMPONENT_SCHEDULE,ERR_FREEING_ERROR,
@@ -400,65 +708,31 @@ owerror_t schedule_removeActiveSlot(slotOffset_t slotOffset, open_addr_t* neighb
       return E_FAIL;
    }
    
-   // remove from linked list
-   if (slotContainer->next==slotContainer) {
-      // this is the last active slot
-      
-      // the next slot of this slot is NULL
-      slotContainer->next                   = NULL;
-      
-      // current slot points to this slot
-      schedule_vars.currentScheduleEntry    = NULL;
-   } else  {
-      // this is NOT the last active slot
-      
-      // find the previous in the schedule
-      previousSlotWalker                    = schedule_vars.currentScheduleEntry;
-      
-      while (1) {
-         if (previousSlotWalker->next==slotContainer){
-            break;
-         }
-         previousSlotWalker                 = previousSlotWalker->next;
-      }
-      
-      // remove this element from the linked list, i.e. have the previous slot
-      // "jump" to slotContainer's next
-      previousSlotWalker->next              = slotContainer->next;
-      
-      // update current slot if points to slot I just removed
-      if (schedule_vars.currentScheduleEntry==slotContainer) {
-         schedule_vars.currentScheduleEntry = slotContainer->next;
-      }
-   }
-   
-   // reset removed schedule entry
-   schedule_resetEntry(slotContainer);
+   schedule_removeEntry(slotContainer);
    
    ENABLE_INTERRUPTS();
    
    return E_SUCCESS;
 }
 
-bool schedule_isSlotOffsetAvailable(uint16_t slotOffset){
+bool schedule_isSlotOffsetAvailable(uint8_t frameHandle, uint16_t slotOffset){
    
-   scheduleEntry_t* scheduleWalker;
+   bool    returnVal;
+   uint8_t i;
    
    INTERRUPT_DECLARATION();
    DISABLE_INTERRUPTS();
    
-   scheduleWalker = schedule_vars.currentScheduleEntry;
-   do {
-      if(slotOffset == scheduleWalker->slotOffset){
-          ENABLE_INTERRUPTS();
-          return FALSE;
-      }
-      scheduleWalker = scheduleWalker->next;
-   }while(scheduleWalker!=schedule_vars.currentScheduleEntry);
+   i = schedule_getSlotframeIndex(frameHandle);
+   if (i==MAXSLOTFRAMES) {
+      returnVal = FALSE;
+   } else {
+      returnVal = (schedule_getEntry(i,slotOffset)==NULL);
+   }
    
    ENABLE_INTERRUPTS();
    
-   return TRUE;
+   return returnVal;
 }
 
 scheduleEntry_t* schedule_statistic_poorLinkQuality(){
@@ -467,7 +741,12 @@ scheduleEntry_t* schedule_statistic_poorLinkQuality(){
    INTERRUPT_DECLARATION();
    DISABLE_INTERRUPTS();
    
-   scheduleWalker = schedule_vars.currentScheduleEntry;
+   // only the cells of the minimal slotframe are maintained
+   scheduleWalker = schedule_vars.slotframes[0].currentEntry;
+   if (scheduleWalker==NULL) {
+       ENABLE_INTERRUPTS();
+       return NULL;
+   }
    do {
       if(
          scheduleWalker->numTx > MIN_NUMTX_FOR_PDR                     &&\
@@ -476,9 +755,9 @@ scheduleEntry_t* schedule_statistic_poorLinkQuality(){
          break;
       }
       scheduleWalker = scheduleWalker->next;
-   }while(scheduleWalker!=schedule_vars.currentScheduleEntry);
+   }while(scheduleWalker!=schedule_vars.slotframes[0].currentEntry);
    
-   if (scheduleWalker == schedule_vars.currentScheduleEntry){
+   if (scheduleWalker == schedule_vars.slotframes[0].currentEntry){
        ENABLE_INTERRUPTS();
        return NULL;
    } else {
@@ -489,26 +768,32 @@ scheduleEntry_t* schedule_statistic_poorLinkQuality(){
 
 uint16_t  schedule_getCellsCounts(uint8_t frameID,cellType_t type, open_addr_t* neighbor){
     uint16_t         count = 0;
+    uint8_t          i;
+    uint8_t          pos;
     scheduleEntry_t* scheduleWalker;
    
     INTERRUPT_DECLARATION();
     DISABLE_INTERRUPTS();
     
-    if (frameID != SCHEDULE_MINIMAL_6TISCH_DEFAULT_SLOTFRAME_HANDLE){
+    i = schedule_getSlotframeIndex(frameID);
+    if (i==MAXSLOTFRAMES){
         ENABLE_INTERRUPTS();
         return 0;
     }
    
-    scheduleWalker = schedule_vars.currentScheduleEntry;
-    do {
+    // the cells of a slotframe are contiguous in the table of active slots
+    for (pos=schedule_findPosition(i,0);pos<schedule_vars.numActiveSlots;pos++) {
+       scheduleWalker = &schedule_vars.scheduleBuf[schedule_vars.activeRows[pos]];
+       if (scheduleWalker->slotframe!=i) {
+          break;
+       }
        if(
           packetfunctions_sameAddress(&(scheduleWalker->neighbor),neighbor) &&
           type == scheduleWalker->type
        ){
            count++;
        }
-       scheduleWalker = scheduleWalker->next;
-    }while(scheduleWalker!=schedule_vars.currentScheduleEntry);
+    }
    
     ENABLE_INTERRUPTS();
     return count;
@@ -518,11 +803,22 @@ void schedule_removeAllCells(
     open_addr_t*   previousHop
     ){
     uint8_t i;
+    uint8_t slotframe;
+    
+    slotframe = schedule_getSlotframeIndex(slotframeID);
+    if (slotframe==MAXSLOTFRAMES) {
+        return;
+    }
     
     // remove all entries in schedule with previousHop address
     for(i=0;i<MAXACTIVESLOTS;i++){
-        if (packetfunctions_sameAddress(&(schedule_vars.scheduleBuf[i].neighbor),previousHop)){
+        if (
+            schedule_vars.scheduleBuf[i].type!=CELLTYPE_OFF &&
+            schedule_vars.scheduleBuf[i].slotframe==slotframe &&
+            packetfunctions_sameAddress(&(schedule_vars.scheduleBuf[i].neighbor),previousHop)
+        ){
            schedule_removeActiveSlot(
+              slotframeID,
               schedule_vars.scheduleBuf[i].slotOffset,
               previousHop
            );
@@ -536,41 +832,103 @@ scheduleEntry_t* schedule_getCurrentScheduleEntry(){
 
 //=== from IEEE802154E: reading the schedule and updating statistics
 
+/**
+\brief Synchronize the schedule to the current ASN.
+
+In each slotframe, the active slot at or last before the current slot becomes
+the current one.
+
+\param targetSlotOffset The slot offset of the current slot in the minimal
+   slotframe.
+*/
 void schedule_syncSlotOffset(slotOffset_t targetSlotOffset) {
+   slotframe_t* slotframe;
+   uint8_t      i;
    
    INTERRUPT_DECLARATION();
    DISABLE_INTERRUPTS();
    
-   while (schedule_vars.currentScheduleEntry->slotOffset!=targetSlotOffset) {
-      schedule_advanceSlot();
+   for (i=0;i<MAXSLOTFRAMES;i++) {
+      slotframe = &schedule_vars.slotframes[i];
+      if (slotframe->inUse==FALSE) {
+         continue;
+      }
+      if (i==0) {
+         slotframe->slotOffset = targetSlotOffset;
+      } else {
+         slotframe->slotOffset = schedule_asnToSlotOffset(slotframe->length);
+      }
+      slotframe->currentEntry  = schedule_getEntryAtOrBefore(i,slotframe->slotOffset);
    }
+   schedule_vars.slotsToNextActive = 0;
+   
+   schedule_updateCurrent();
    
    ENABLE_INTERRUPTS();
 }
 
 /**
 \brief advance to next active slot
+
+The next active slot is the one last returned by
+schedule_getNextActiveSlotOffset(), even if the schedule changed since.
 */
 void schedule_advanceSlot() {
+   slotframe_t*  slotframe;
+   frameLength_t slotsToNextActive;
+   frameLength_t slotsToNext;
+   uint8_t       i;
    
    INTERRUPT_DECLARATION();
    DISABLE_INTERRUPTS();
    
-   schedule_vars.currentScheduleEntry = schedule_vars.currentScheduleEntry->next;
+   slotsToNextActive = schedule_vars.slotsToNextActive;
+   if (slotsToNextActive==0) {
+      slotsToNextActive = schedule_slotsToNextActive();
+   }
+   
+   // move each slotframe forward, usually by exactly one active slot
+   for (i=0;i<MAXSLOTFRAMES;i++) {
+      slotframe = &schedule_vars.slotframes[i];
+      if (slotframe->inUse==FALSE || slotframe->length==0) {
+         continue;
+      }
+      slotsToNext = schedule_slotsToNext(slotframe);
+      slotframe->slotOffset = (slotframe->slotOffset+slotsToNextActive)%slotframe->length;
+      if (slotsToNext==slotsToNextActive) {
+         slotframe->currentEntry = slotframe->currentEntry->next;
+      } else if (slotsToNext!=0 && slotsToNext<slotsToNextActive) {
+         // active slots were added in between
+         slotframe->currentEntry = schedule_getEntryAtOrBefore(i,slotframe->slotOffset);
+      }
+   }
+   schedule_vars.slotsToNextActive = 0;
+   
+   schedule_updateCurrent();
    
    ENABLE_INTERRUPTS();
 }
 
 /**
 \brief return slotOffset of next active slot
+
+\returns The slot offset, in the minimal slotframe, of the next slot at which
+   any slotframe has an active slot.
 */
 slotOffset_t schedule_getNextActiveSlotOffset() {
    slotOffset_t res;   
+   slotframe_t* slotframe;
    
    INTERRUPT_DECLARATION();
    DISABLE_INTERRUPTS();
    
-   res = ((scheduleEntry_t*)(schedule_vars.currentScheduleEntry->next))->slotOffset;
+   schedule_vars.slotsToNextActive = schedule_slotsToNextActive();
+   
+   slotframe = &schedule_vars.slotframes[0];
+   res       = slotframe->slotOffset+schedule_vars.slotsToNextActive;
+   if (slotframe->length!=0) {
+      res    = res%slotframe->length;
+   }
    
    ENABLE_INTERRUPTS();
    
@@ -578,7 +936,7 @@ slotOffset_t schedule_getNextActiveSlotOffset() {
 }
 
 /**
-\brief Get the frame length.
+\brief Get the length of the minimal slotframe.
 
 \returns The frame length.
 */
@@ -588,7 +946,7 @@ frameLength_t schedule_getFrameLength() {
    INTERRUPT_DECLARATION();
    DISABLE_INTERRUPTS();
    
-   returnVal = schedule_vars.frameLength;
+   returnVal = schedule_vars.slotframes[0].length;
    
    ENABLE_INTERRUPTS();
    
@@ -596,7 +954,7 @@ frameLength_t schedule_getFrameLength() {
 }
 
 /**
-\brief Get the frame handle.
+\brief Get the handle of the minimal slotframe.
 
 \returns The frame handle.
 */
@@ -606,7 +964,7 @@ uint8_t schedule_getFrameHandle() {
    INTERRUPT_DECLARATION();
    DISABLE_INTERRUPTS();
    
-   returnVal = schedule_vars.frameHandle;
+   returnVal = schedule_vars.slotframes[0].handle;
    
    ENABLE_INTERRUPTS();
    
@@ -818,5 +1176,353 @@ void schedule_resetEntry(scheduleEntry_t* e) {
    e->lastUsedAsn.bytes0and1 = 0;
    e->lastUsedAsn.bytes2and3 = 0;
    e->lastUsedAsn.byte4      = 0;
+   e->slotframe              = 0;
    e->next                   = NULL;
 }
+
+/**
+\brief Get the index of a slotframe in schedule_vars.slotframes.
+
+\pre This function assumes interrupts are already disabled.
+
+\returns The index, MAXSLOTFRAMES if there is no such slotframe.
+*/
+uint8_t schedule_getSlotframeIndex(uint8_t frameHandle) {
+   uint8_t i;
+   
+   for (i=0;i<MAXSLOTFRAMES;i++) {
+      if (
+            schedule_vars.slotframes[i].inUse==TRUE &&
+            schedule_vars.slotframes[i].handle==frameHandle
+         ) {
+         break;
+      }
+   }
+   return i;
+}
+
+/**
+\brief Find where a slot offset is, or would be, in the table of active slots.
+
+The table is sorted by slotframe, then by slot offset.
+
+\pre This function assumes interrupts are already disabled.
+
+\returns The position of the first active slot at or after
+   <tt>slotOffset</tt> in <tt>slotframe</tt> (or in a later slotframe),
+   <tt>numActiveSlots</tt> if there is none.
+*/
+uint8_t schedule_findPosition(uint8_t slotframe, slotOffset_t slotOffset) {
+   scheduleEntry_t* entry;
+   uint8_t          low;
+   uint8_t          high;
+   uint8_t          middle;
+   
+   low  = 0;
+   high = schedule_vars.numActiveSlots;
+   while (low<high) {
+      middle = (low+high)/2;
+      entry  = &schedule_vars.scheduleBuf[schedule_vars.activeRows[middle]];
+      if (
+            entry->slotframe<slotframe ||
+            (entry->slotframe==slotframe && entry->slotOffset<slotOffset)
+         ) {
+         low  = middle+1;
+      } else {
+         high = middle;
+      }
+   }
+   return low;
+}
+
+/**
+\brief Get the schedule entry at a slot offset.
+
+\pre This function assumes interrupts are already disabled.
+
+\returns The schedule entry, NULL if that slot offset is not in use.
+*/
+scheduleEntry_t* schedule_getEntry(uint8_t slotframe, slotOffset_t slotOffset) {
+   uint8_t          pos;
+   scheduleEntry_t* entry;
+   uint8_t*         busyMap;
+   
+   // most slot offsets are in the bitmap
+   busyMap = schedule_vars.slotframes[slotframe].busyMap;
+   if (
+         slotOffset<SCHEDULE_BUSYMAP_SLOTS &&
+         (busyMap[slotOffset/8] & (1<<(slotOffset%8)))==0
+      ) {
+      return NULL;
+   }
+   
+   pos = schedule_findPosition(slotframe,slotOffset);
+   if (pos==schedule_vars.numActiveSlots) {
+      return NULL;
+   }
+   entry = &schedule_vars.scheduleBuf[schedule_vars.activeRows[pos]];
+   if (entry->slotframe!=slotframe || entry->slotOffset!=slotOffset) {
+      return NULL;
+   }
+   return entry;
+}
+
+/**
+\brief Get the active slot at, or last before, a slot offset.
+
+\pre This function assumes interrupts are already disabled.
+
+\returns The schedule entry, possibly the last one of the slotframe if
+   <tt>slotOffset</tt> is before its first one, NULL if the slotframe has no
+   active slot.
+*/
+scheduleEntry_t* schedule_getEntryAtOrBefore(uint8_t slotframe, slotOffset_t slotOffset) {
+   uint8_t          first;
+   uint8_t          end;
+   uint8_t          pos;
+   scheduleEntry_t* entry;
+   
+   first = schedule_findPosition(slotframe,0);
+   end   = schedule_findPosition(slotframe+1,0);
+   if (first==end) {
+      return NULL;
+   }
+   
+   pos = schedule_findPosition(slotframe,slotOffset);
+   if (pos<end) {
+      entry = &schedule_vars.scheduleBuf[schedule_vars.activeRows[pos]];
+      if (entry->slotOffset==slotOffset) {
+         return entry;
+      }
+   }
+   if (pos==first) {
+      // before the first one, this is the last one of the previous slotframe cycle
+      pos = end;
+   }
+   return &schedule_vars.scheduleBuf[schedule_vars.activeRows[pos-1]];
+}
+
+/**
+\brief Mark a slot offset as in use or not in the busy-slot bitmap.
+
+\pre This function assumes interrupts are already disabled.
+*/
+void schedule_setBusy(uint8_t slotframe, slotOffset_t slotOffset, bool busy) {
+   uint8_t* busyMap;
+   
+   if (slotOffset>=SCHEDULE_BUSYMAP_SLOTS) {
+      return;
+   }
+   busyMap = schedule_vars.slotframes[slotframe].busyMap;
+   if (busy==TRUE) {
+      busyMap[slotOffset/8] |=  (1<<(slotOffset%8));
+   } else {
+      busyMap[slotOffset/8] &= ~(1<<(slotOffset%8));
+   }
+}
+
+/**
+\brief Remove a schedule entry from the schedule.
+
+\pre This function assumes interrupts are already disabled.
+*/
+void schedule_removeEntry(scheduleEntry_t* slotContainer) {
+   scheduleEntry_t* previousSlotWalker;
+   slotframe_t*     slotframe;
+   uint8_t          i;
+   uint8_t          pos;
+   uint8_t          first;
+   uint8_t          last;
+   
+   i                                        = slotContainer->slotframe;
+   slotframe                                = &schedule_vars.slotframes[i];
+   pos                                      = schedule_findPosition(i,slotContainer->slotOffset);
+   
+   // remove from linked list
+   if (slotContainer->next==slotContainer) {
+      // this is the last active slot of the slotframe
+      
+      // the next slot of this slot is NULL
+      slotContainer->next                   = NULL;
+      
+      // current slot of the slotframe points to this slot
+      slotframe->currentEntry               = NULL;
+   } else  {
+      // this is NOT the last active slot of the slotframe
+      
+      // the previous in the schedule is the previous in the table of active slots
+      first                                 = schedule_findPosition(i,0);
+      last                                  = schedule_findPosition(i+1,0)-1;
+      previousSlotWalker                    = &schedule_vars.scheduleBuf[schedule_vars.activeRows[(pos==first) ? last : pos-1]];
+      
+      // remove this element from the linked list, i.e. have the previous slot
+      // "jump" to slotContainer's next
+      previousSlotWalker->next              = slotContainer->next;
+      
+      // update current slot of the slotframe if points to slot I just removed
+      if (slotframe->currentEntry==slotContainer) {
+         slotframe->currentEntry            = previousSlotWalker;
+      }
+   }
+   
+   // remove from the table of active slots
+   memmove(
+      &schedule_vars.activeRows[pos],
+      &schedule_vars.activeRows[pos+1],
+      schedule_vars.numActiveSlots-pos-1
+   );
+   schedule_vars.numActiveSlots--;
+   slotframe->numActiveSlots--;
+   schedule_setBusy(i,slotContainer->slotOffset,FALSE);
+   
+   // update current slot if points to slot I just removed
+   if (schedule_vars.currentScheduleEntry==slotContainer) {
+      schedule_updateCurrent();
+   }
+   
+   // reset removed schedule entry, and give its container back
+   schedule_resetEntry(slotContainer);
+   schedule_vars.freeRows[schedule_vars.numFreeRows] = (uint8_t)(slotContainer-&schedule_vars.scheduleBuf[0]);
+   schedule_vars.numFreeRows++;
+}
+
+/**
+\brief Slot offset of the current ASN in a slotframe.
+
+\pre This function assumes interrupts are already disabled.
+*/
+slotOffset_t schedule_asnToSlotOffset(frameLength_t frameLength) {
+   uint8_t  asn[5];
+   uint32_t slotOffset;
+   
+   if (frameLength==0) {
+      return 0;
+   }
+   
+   ieee154e_getAsn(asn);
+   
+   // ASN modulo frameLength, 16 bits at a time
+   slotOffset = asn[4];
+   slotOffset = slotOffset % frameLength;
+   slotOffset = (slotOffset << 16) + (asn[2] | (asn[3]<<8));
+   slotOffset = slotOffset % frameLength;
+   slotOffset = (slotOffset << 16) + (asn[0] | (asn[1]<<8));
+   slotOffset = slotOffset % frameLength;
+   
+   return (slotOffset_t)slotOffset;
+}
+
+/**
+\brief Number of slots from the current slot of a slotframe to its next active
+   slot.
+
+\pre This function assumes interrupts are already disabled.
+
+\returns The number of slots, the slotframe length if its only active slot is
+   the current one, 0 if it has no active slot.
+*/
+frameLength_t schedule_slotsToNext(slotframe_t* slotframe) {
+   scheduleEntry_t* next;
+   frameLength_t    slots;
+   
+   if (slotframe->currentEntry==NULL || slotframe->length==0) {
+      return 0;
+   }
+   
+   next  = slotframe->currentEntry->next;
+   slots = (next->slotOffset+slotframe->length-slotframe->slotOffset)%slotframe->length;
+   if (slots==0) {
+      slots = slotframe->length;
+   }
+   return slots;
+}
+
+/**
+\brief Number of slots from the current slot to the next one at which any
+   slotframe has an active slot.
+
+\pre This function assumes interrupts are already disabled.
+
+\returns The number of slots, 0 if no slotframe has an active slot.
+*/
+frameLength_t schedule_slotsToNextActive() {
+   frameLength_t slotsToNextActive;
+   frameLength_t slotsToNext;
+   uint8_t       i;
+   
+   slotsToNextActive = 0;
+   for (i=0;i<MAXSLOTFRAMES;i++) {
+      if (schedule_vars.slotframes[i].inUse==FALSE) {
+         continue;
+      }
+      slotsToNext = schedule_slotsToNext(&schedule_vars.slotframes[i]);
+      if (slotsToNext!=0 && (slotsToNextActive==0 || slotsToNext<slotsToNextActive)) {
+         slotsToNextActive = slotsToNext;
+      }
+   }
+   return slotsToNextActive;
+}
+
+/**
+\brief Select the schedule entry used in the current slot.
+
+When several slotframes have an active slot at the current ASN, the one of the
+slotframe with the lowest handle wins.
+
+\pre This function assumes interrupts are already disabled.
+*/
+void schedule_updateCurrent() {
+   slotframe_t*     slotframe;
+   scheduleEntry_t* atCurrent;
+   scheduleEntry_t* beforeCurrent;
+   uint8_t          atHandle;
+   uint8_t          beforeHandle;
+   uint8_t          i;
+   
+   atCurrent     = NULL;
+   beforeCurrent = NULL;
+   atHandle      = 0;
+   beforeHandle  = 0;
+   for (i=0;i<MAXSLOTFRAMES;i++) {
+      slotframe = &schedule_vars.slotframes[i];
+      if (slotframe->inUse==FALSE || slotframe->currentEntry==NULL) {
+         continue;
+      }
+      if (slotframe->currentEntry->slotOffset==slotframe->slotOffset) {
+         if (atCurrent==NULL || slotframe->handle<atHandle) {
+            atCurrent     = slotframe->currentEntry;
+            atHandle      = slotframe->handle;
+         }
+      } else {
+         if (beforeCurrent==NULL || slotframe->handle<beforeHandle) {
+            beforeCurrent = slotframe->currentEntry;
+            beforeHandle  = slotframe->handle;
+         }
+      }
+   }
+   
+   if (atCurrent!=NULL) {
+      schedule_vars.currentScheduleEntry = atCurrent;
+   } else {
+      // not an active slot
+      schedule_vars.currentScheduleEntry = beforeCurrent;
+   }
+}
+
+/**
+\brief Number of rows of the schedule no slotframe reserves.
+
+\pre This function assumes interrupts are already disabled.
+*/
+uint8_t schedule_getUnreservedRows() {
+   uint8_t reserved;
+   uint8_t i;
+   
+   reserved = 0;
+   for (i=0;i<MAXSLOTFRAMES;i++) {
+      if (schedule_vars.slotframes[i].inUse==TRUE) {
+         reserved += schedule_vars.slotframes[i].maxActiveSlots;
+      }
+   }
+   return MAXACTIVESLOTS-reserved;
+}
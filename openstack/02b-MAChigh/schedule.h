@@ -13,11 +13,16 @@
 //=========================== define ==========================================
 
 /**
-\brief The length of the superframe, in slots.
+\brief The default length of the superframe, in slots.
 
-The superframe repears over time and can be arbitrarly long.
+The superframe repears over time and can be arbitrarly long. This is only the
+length the DAGroot starts with: the length is changed at run time with
+schedule_setFrameLength(), from the serial port on the DAGroot, and motes learn
+it from the Slotframe and Link IE of the EBs they join with.
 */
-#define SLOTFRAME_LENGTH    11 //should be 101
+#ifndef SLOTFRAME_LENGTH
+#define SLOTFRAME_LENGTH    11
+#endif
 
 //draft-ietf-6tisch-minimal-06
 #define SCHEDULE_MINIMAL_6TISCH_ACTIVE_CELLS                      1
@@ -26,32 +31,74 @@ The superframe repears over time and can be arbitrarly long.
 #define SCHEDULE_MINIMAL_6TISCH_DEFAULT_SLOTFRAME_HANDLE          1 //id of slotframe
 #define SCHEDULE_MINIMAL_6TISCH_DEFAULT_SLOTFRAME_NUMBER          1 //1 slotframe by default.
 
+/**
+\brief Maximum number of slotframes in the schedule at the same time.
+
+The first one is the minimal 6TiSCH slotframe, which is announced in EBs and
+in which IEEE802154E counts slot offsets. The others are added with
+schedule_addSlotframe(), e.g. a short slotframe for latency-critical flows.
+When active slots of several slotframes fall on the same ASN, the one of the
+slotframe with the lowest handle is used.
+*/
+#define MAXSLOTFRAMES        2
+
+/**
+\brief The slotframe bursts of traffic are given cells in, besides the minimal
+   slotframe.
+
+All motes know it: it is added to the schedule when the first cell is
+requested in it, by this mote or by a neighbor, and removed again when its
+last cell is. Shorter than the minimal slotframe, its cells come back more
+often, and carry a burst with a lower latency. When they fall on the same ASN
+as an active slot of the minimal slotframe, the latter is used.
+*/
+#define SCHEDULE_BURST_SLOTFRAME_HANDLE           2
+#define SCHEDULE_BURST_SLOTFRAME_LENGTH           7
+#define SCHEDULE_BURST_SLOTFRAME_MAXACTIVESLOTS   2
+
 #define NUMSERIALRX          3
 
 /*
   NUMSLOTSOFF is the max number of cells that the mote can add into schedule, 
   besides 6TISCH_ACTIVE_CELLS and NUMSERIALRX Cell. Initially those cells are 
-  off. The value of NUMSLOTSOFF can be changed but the value should satisfy:
+  off. It only sizes the default MAXACTIVESLOTS.
  
-        MAXACTIVESLOTS < SLOTFRAME_LENGTH 
-        
-  This would make sure number of slots are available (SLOTFRAME_LENGTH-MAXACTIVESLOTS) 
-  for seiral port to tranmit data to dagroot. 
+  The slot offsets which are not active are used by the serial port to transmit
+  data to the dagroot. A slotframe can not have more active slots than the
+  rows it reserves (see schedule_setMaxActiveSlots()), so keep those below its
+  length, which is SLOTFRAME_LENGTH by default but can be changed at run time
+  (see schedule_setFrameLength()):
+ 
+        maxActiveSlots < frame length 
 */
 
 #define NUMSLOTSOFF          3
 
 /**
-\brief Maximum number of active slots in a superframe.
+\brief Maximum number of active slots in the schedule, over all slotframes.
 
 Note that this is merely used to allocate RAM memory for the schedule. The
 schedule is represented, in RAM, by a table. There is one row per active slot
 in that table; a slot is "active" when it is not of type CELLTYPE_OFF.
 
-Set this number to the exact number of active slots you are planning on having
-in your schedule, so not to waste RAM.
+This pool of rows is partitioned between the slotframes at run time, see
+schedule_setMaxActiveSlots(). Set this number to the largest number of active
+slots any deployment of the image needs, so not to waste RAM.
 */
+#ifndef MAXACTIVESLOTS
 #define MAXACTIVESLOTS       (SCHEDULE_MINIMAL_6TISCH_ACTIVE_CELLS+NUMSERIALRX+NUMSLOTSOFF)
+#endif
+#if MAXACTIVESLOTS>255
+#error "rows of the schedule are indexed on 8 bits, MAXACTIVESLOTS must be at most 255"
+#endif
+
+/**
+\brief Number of slot offsets covered by the busy-slot bitmap.
+
+Whether a slot offset below this value is in use is a single bit test. Slot
+offsets above it are looked up in the sorted table of active slots.
+*/
+#define SCHEDULE_BUSYMAP_SLOTS    128
 
 /**
 \brief Minimum backoff exponent.
@@ -100,7 +147,8 @@ typedef struct {
    uint8_t         numTx;
    uint8_t         numTxACK;
    asn_t           lastUsedAsn;
-   void*           next;
+   uint8_t         slotframe;         // index in schedule_vars.slotframes
+   void*           next;              // next active slot in the same slotframe
 } scheduleEntry_t;
 
 BEGIN_PACK
@@ -126,14 +174,28 @@ typedef struct {
   channelOffset_t  channelOffset;
 }slotinfo_element_t;
 
+typedef struct {
+   bool             inUse;
+   uint8_t          handle;
+   frameLength_t    length;
+   slotOffset_t     slotOffset;        // slot offset of the current slot in this slotframe
+   scheduleEntry_t* currentEntry;      // active slot at or last before slotOffset, NULL if none
+   uint8_t          maxActiveSlots;    // rows of the schedule reserved for this slotframe
+   uint8_t          numActiveSlots;    // rows of the schedule used by this slotframe
+   uint8_t          busyMap[SCHEDULE_BUSYMAP_SLOTS/8]; // one bit per slot offset in use
+} slotframe_t;
+
 //=========================== variables =======================================
 
 typedef struct {
    scheduleEntry_t  scheduleBuf[MAXACTIVESLOTS];
-   scheduleEntry_t* currentScheduleEntry;
-   frameLength_t    frameLength;
-   frameLength_t    maxActiveSlots;
-   uint8_t          frameHandle;
+   uint8_t          activeRows[MAXACTIVESLOTS];     // rows of scheduleBuf in use, by slotframe then slotOffset
+   uint8_t          numActiveSlots;
+   uint8_t          freeRows[MAXACTIVESLOTS];       // stack of the rows of scheduleBuf not in use
+   uint8_t          numFreeRows;
+   slotframe_t      slotframes[MAXSLOTFRAMES];      // the first one is the minimal slotframe
+   scheduleEntry_t* currentScheduleEntry;           // entry used in the current slot
+   frameLength_t    slotsToNextActive;              // computed by schedule_getNextActiveSlotOffset()
    uint8_t          frameNumber;
    uint8_t          backoffExponent;
    uint8_t          backoff;
@@ -152,7 +214,16 @@ bool               debugPrint_backoff(void);
 void               schedule_setFrameLength(frameLength_t newFrameLength);
 void               schedule_setFrameHandle(uint8_t frameHandle);
 void               schedule_setFrameNumber(uint8_t frameNumber);
+owerror_t          schedule_addSlotframe(
+   uint8_t              frameHandle,
+   frameLength_t        frameLength,
+   uint8_t              maxActiveSlots
+);
+owerror_t          schedule_removeSlotframe(uint8_t frameHandle);
+frameLength_t      schedule_getSlotframeLength(uint8_t frameHandle);
+scheduleEntry_t*   schedule_getSlotframeEntry(uint8_t frameHandle);
 owerror_t          schedule_addActiveSlot(
+   uint8_t              frameHandle,
    slotOffset_t         slotOffset,
    cellType_t           type,
    bool                 shared,
@@ -161,18 +232,27 @@ owerror_t          schedule_addActiveSlot(
 );
 
 void               schedule_getSlotInfo(
+   uint8_t              frameHandle,
    slotOffset_t         slotOffset,                      
    open_addr_t*         neighbor,
    slotinfo_element_t*  info
 );
 
 uint16_t           schedule_getMaxActiveSlots(void);
+owerror_t          schedule_setMaxActiveSlots(
+   uint8_t              frameHandle,
+   uint8_t              maxActiveSlots
+);
 
 owerror_t          schedule_removeActiveSlot(
+   uint8_t              frameHandle,
    slotOffset_t         slotOffset,
    open_addr_t*         neighbor
 );
-bool               schedule_isSlotOffsetAvailable(uint16_t slotOffset);
+bool               schedule_isSlotOffsetAvailable(
+   uint8_t              frameHandle,
+   uint16_t             slotOffset
+);
 // return the slot info which has a poor quality
 scheduleEntry_t*  schedule_statistic_poorLinkQuality(void);
 uint16_t          schedule_getCellsCounts(
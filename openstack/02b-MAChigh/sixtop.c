@@ -43,6 +43,7 @@ void          sixtop_sendKA(void);
 //=== six2six task
 
 void          timer_sixtop_six2six_timeout_fired(void);
+void          sixtop_six2six_transactionDone(uint8_t returnCode);
 void          sixtop_six2six_sendDone(
    OpenQueueEntry_t*    msg,
    owerror_t            error
@@ -69,12 +70,12 @@ uint8_t sixtop_getCelllist(
 //=== helper functions
 
 bool          sixtop_candidateAddCellList(
-   uint8_t*             frameID,
+   uint8_t              frameID,
    cellInfo_ht*         cellList,
    uint8_t              requiredCells
 );
 bool          sixtop_candidateRemoveCellList(
-   uint8_t*             frameID,
+   uint8_t              frameID,
    cellInfo_ht*         cellList,
    open_addr_t*         neighbor,
    uint8_t              requiredCells
@@ -101,6 +102,8 @@ bool sixtop_areAvailableCellsToBeRemoved(
     cellInfo_ht* cellList,
     open_addr_t* neighbor
 );
+bool          sixtop_addBurstSlotframe(void);
+void          sixtop_releaseBurstSlotframe(uint8_t frameID);
 
 //=========================== public ==========================================
 
@@ -115,8 +118,9 @@ void sixtop_init() {
    sixtop_vars.ebPeriod           = EBPERIOD;
    sixtop_vars.isResponseEnabled  = TRUE;
    
-   sixtop_vars.maintenanceTimerId = opentimers_start(
+   sixtop_vars.maintenanceTimerId = opentimers_startWithSlack(
       sixtop_vars.periodMaintenance,
+      SIXTOP_MAINTENANCE_SLACK_MS,
       TIMER_PERIODIC,
       TIME_MS,
       sixtop_maintenance_timer_cb
@@ -152,43 +156,96 @@ void sixtop_setHandler(six2six_handler_t handler) {
 
 //======= scheduling
 
-void sixtop_request(uint8_t code, open_addr_t* neighbor, uint8_t numCells){
+/**
+\brief Issue a 6P request for cells in the slotframe the minimal cells are in.
+
+\returns E_SUCCESS if the request was sent, E_FAIL otherwise.
+*/
+owerror_t sixtop_request(uint8_t code, open_addr_t* neighbor, uint8_t numCells){
+    return sixtop_requestInSlotframe(schedule_getFrameHandle(),code,neighbor,numCells);
+}
+
+/**
+\brief Issue a 6P request for cells in the burst slotframe.
+
+The burst slotframe is added to the schedule first, if it is not in it yet. It
+is removed again once it has no cells left, either because the request could
+not be sent, or at the end of the transaction.
+
+\param[in] code     The 6P command.
+\param[in] neighbor The neighbor to negotiate the cells with.
+\param[in] numCells The number of cells to add or delete.
+
+\returns E_SUCCESS if the request was sent, E_FAIL otherwise.
+*/
+owerror_t sixtop_requestInBurstSlotframe(uint8_t code, open_addr_t* neighbor, uint8_t numCells){
+    if (sixtop_addBurstSlotframe()==FALSE){
+        return E_FAIL;
+    }
+    if (
+        sixtop_requestInSlotframe(
+            SCHEDULE_BURST_SLOTFRAME_HANDLE,
+            code,
+            neighbor,
+            numCells
+        )==E_SUCCESS
+    ){
+        return E_SUCCESS;
+    }
+    sixtop_releaseBurstSlotframe(SCHEDULE_BURST_SLOTFRAME_HANDLE);
+    return E_FAIL;
+}
+
+/**
+\brief Issue a 6P request for cells in a given slotframe.
+
+\param[in] frameID  The handle of the slotframe, also used as 6P container.
+\param[in] code     The 6P command.
+\param[in] neighbor The neighbor to negotiate the cells with.
+\param[in] numCells The number of cells to add or delete.
+
+\returns E_SUCCESS if the request was sent, E_FAIL if it was not: a
+   transaction is ongoing, no handler is set, no candidate cell was found or
+   no packet buffer is free. The handler is only notified of the end of the
+   transactions which were sent.
+*/
+owerror_t sixtop_requestInSlotframe(uint8_t frameID, uint8_t code, open_addr_t* neighbor, uint8_t numCells){
     OpenQueueEntry_t* pkt;
     uint8_t           len;
     uint8_t           container;
-    uint8_t           frameID;
     cellInfo_ht       cellList[SCHEDULEIEMAXNUMCELLS];
    
     memset(cellList,0,sizeof(cellList));
    
     // filter parameters
     if(sixtop_vars.six2six_state!=SIX_IDLE){
-        return;
+        return E_FAIL;
     }
     if (neighbor==NULL){
-        return;
+        return E_FAIL;
     }
    
     if (sixtop_vars.handler == SIX_HANDLER_NONE) {
         // sxitop handler must not be NONE
-        return;
+        return E_FAIL;
+    }
+    if (schedule_getSlotframeLength(frameID)==0){
+        // no such slotframe
+        return E_FAIL;
     }
+    
+    // container to be define by SF, currently equals to frameID
+    container = frameID;
    
     // generate candidate cell list
     if (code == IANA_6TOP_CMD_ADD){
-        if (sixtop_candidateAddCellList(&frameID,cellList,numCells)==FALSE){
-              return;
-        } else{
-            // container to be define by SF, currently equals to frameID
-            container  = frameID;
+        if (sixtop_candidateAddCellList(frameID,cellList,numCells)==FALSE){
+              return E_FAIL;
         }
     }
     if (code == IANA_6TOP_CMD_DELETE){
-        if (sixtop_candidateRemoveCellList(&frameID,cellList,neighbor,numCells)==FALSE){
-              return;
-        } else{
-            // container to be define by SF, currently equals to frameID
-            container  = frameID;
+        if (sixtop_candidateRemoveCellList(frameID,cellList,neighbor,numCells)==FALSE){
+              return E_FAIL;
         }
     }
     
@@ -201,11 +258,14 @@ void sixtop_request(uint8_t code, open_addr_t* neighbor, uint8_t numCells){
             (errorparameter_t)0,
             (errorparameter_t)0
         );
-        return;
+        return E_FAIL;
     }
    
     // update state
     sixtop_vars.six2six_state  = SIX_SENDING_REQUEST;
+    sixtop_vars.frameID        = frameID;
+    sixtop_vars.commandID      = code;
+    memcpy(&(sixtop_vars.neighbor),neighbor,sizeof(open_addr_t));
    
     // take ownership
     pkt->creator = COMPONENT_SIXTOP_RES;
@@ -215,7 +275,7 @@ void sixtop_request(uint8_t code, open_addr_t* neighbor, uint8_t numCells){
    
     // create packet
     len  = 0;
-    if (code == IANA_6TOP_CMD_ADD || IANA_6TOP_CMD_DELETE){
+    if (code == IANA_6TOP_CMD_ADD || code == IANA_6TOP_CMD_DELETE){
         len += processIE_prepend_sixCelllist(pkt,cellList);
         // reserve space for container
         packetfunctions_reserveHeaderSize(pkt,sizeof(uint8_t));
@@ -271,6 +331,8 @@ void sixtop_request(uint8_t code, open_addr_t* neighbor, uint8_t numCells){
         SIX2SIX_TIMEOUT_MS
     );
     opentimers_restart(sixtop_vars.timeoutTimerId);
+    
+    return E_SUCCESS;
 }
 
 void sixtop_addORremoveCellByInfo(uint8_t code,open_addr_t* neighbor,cellInfo_ht* cellInfo){
@@ -314,6 +376,9 @@ void sixtop_addORremoveCellByInfo(uint8_t code,open_addr_t* neighbor,cellInfo_ht
    
     // update state
     sixtop_vars.six2six_state = SIX_SENDING_REQUEST;
+    sixtop_vars.frameID       = frameID;
+    sixtop_vars.commandID     = code;
+    memcpy(&(sixtop_vars.neighbor),neighbor,sizeof(open_addr_t));
    
     // declare ownership over that packet
     pkt->creator = COMPONENT_SIXTOP_RES;
@@ -367,7 +432,7 @@ void sixtop_addORremoveCellByInfo(uint8_t code,open_addr_t* neighbor,cellInfo_ht
 void sixtop_maintaining(uint16_t slotOffset,open_addr_t* neighbor){
     slotinfo_element_t info;
     cellInfo_ht linkInfo;
-    schedule_getSlotInfo(slotOffset,neighbor,&info);
+    schedule_getSlotInfo(schedule_getFrameHandle(),slotOffset,neighbor,&info);
     if(info.link_type != CELLTYPE_OFF){
         linkInfo.tsNum       = slotOffset;
         linkInfo.choffset    = info.channelOffset;
@@ -635,8 +700,6 @@ owerror_t sixtop_send_internal(
    msg->l2_dsn = sixtop_vars.dsn++;
    // this is a new packet which I never attempted to send
    msg->l2_numTxAttempts = 0;
-   // transmit with the default TX power
-   msg->l1_txPower = TX_POWER;
    // add a IEEE802.15.4 header
    ieee802154_prependHeader(msg,
                             msg->l2_frameType,
@@ -645,7 +708,7 @@ owerror_t sixtop_send_internal(
                             &(msg->l2_nextORpreviousHop)
                             );
    // change owner to IEEE802154E fetches it from queue
-   msg->owner  = COMPONENT_SIXTOP_TO_IEEE802154E;
+   openqueue_setOwner(msg,COMPONENT_SIXTOP_TO_IEEE802154E);
    return E_SUCCESS;
 }
 
@@ -745,6 +808,11 @@ port_INLINE void sixtop_sendEB() {
    eb->creator = COMPONENT_SIXTOP;
    eb->owner   = COMPONENT_SIXTOP;
    
+   // the DAG root decides of the hopping sequence, advertised in EBs
+   if (idmanager_getIsDAGroot()==TRUE) {
+      ieee154e_updateChannelBlacklist();
+   }
+   
    // reserve space for EB-specific header
    // reserving for IEs.
    len += processIE_prependSlotframeLinkIE(eb);
@@ -814,7 +882,7 @@ port_INLINE void sixtop_sendKA() {
    // if I get here, I will send a KA
    
    // get a free packet buffer
-   kaPkt = openqueue_getFreePacketBuffer(COMPONENT_SIXTOP);
+   kaPkt = openqueue_getFreeSmallPacketBuffer(COMPONENT_SIXTOP);
    if (kaPkt==NULL) {
       openserial_printError(COMPONENT_SIXTOP,ERR_NO_FREE_PACKET_BUFFER,
                             (errorparameter_t)1,
@@ -851,9 +919,27 @@ port_INLINE void sixtop_sendKA() {
 
 void timer_sixtop_six2six_timeout_fired(void) {
    // timeout timer fired, reset the state of sixtop to idle
+   sixtop_six2six_transactionDone(IANA_6TOP_RC_ERR);
+}
+
+/**
+\brief End the ongoing 6P transaction, and tell the handler how it went.
+
+\param[in] returnCode The return code of the response, IANA_6TOP_RC_ERR if
+   the request could not be sent or no response came.
+*/
+void sixtop_six2six_transactionDone(uint8_t returnCode){
    sixtop_vars.six2six_state = SIX_IDLE;
+   if (sixtop_vars.handler == SIX_HANDLER_OTF){
+       otf_notif_transactionDone(
+           sixtop_vars.commandID,
+           &(sixtop_vars.neighbor),
+           returnCode
+       );
+   }
    sixtop_vars.handler = SIX_HANDLER_NONE;
    opentimers_stop(sixtop_vars.timeoutTimerId);
+   sixtop_releaseBurstSlotframe(sixtop_vars.frameID);
 }
 
 void sixtop_six2six_sendDone(OpenQueueEntry_t* msg, owerror_t error){
@@ -863,12 +949,18 @@ void sixtop_six2six_sendDone(OpenQueueEntry_t* msg, owerror_t error){
    
    memset(cellList,0,SCHEDULEIEMAXNUMCELLS*sizeof(cellInfo_ht));
   
-   ptr = msg->l2_sixtop_cellObjects;
+   ptr = &(msg->packet[msg->l2_sixtop_cellObjects]);
    numOfCells = msg->l2_sixtop_numOfCells;
    msg->owner = COMPONENT_SIXTOP_RES;
   
    if(error == E_FAIL) {
-      sixtop_vars.six2six_state = SIX_IDLE;
+      if (sixtop_vars.six2six_state == SIX_WAIT_RESPONSE_SENDDONE) {
+         sixtop_vars.six2six_state = SIX_IDLE;
+         sixtop_releaseBurstSlotframe(msg->l2_sixtop_frameID);
+      } else {
+         // my request was not sent, no response will come
+         sixtop_six2six_transactionDone(IANA_6TOP_RC_ERR);
+      }
       openqueue_freePacketBuffer(msg);
       return;
    }
@@ -928,6 +1020,7 @@ void sixtop_six2six_sendDone(OpenQueueEntry_t* msg, owerror_t error){
                 }
             }
         }
+        sixtop_releaseBurstSlotframe(msg->l2_sixtop_frameID);
         
         sixtop_vars.six2six_state = SIX_IDLE;
         sixtop_vars.handler = SIX_HANDLER_NONE;
@@ -1134,6 +1227,13 @@ void sixtop_notifyReceiveCommand(
                     numOfCells = *((uint8_t*)(pkt->payload)+ptr);
                     container  = *((uint8_t*)(pkt->payload)+ptr+1);
                     frameID = container;
+                    if (
+                        commandIdORcode == IANA_6TOP_CMD_ADD &&
+                        frameID == SCHEDULE_BURST_SLOTFRAME_HANDLE
+                    ){
+                        // the first cell asked in it, removed again at sendDone if none is granted
+                        sixtop_addBurstSlotframe();
+                    }
                     processIE_retrieve_sixCelllist(pkt,ptr+2,length-2,cellList);
                     if (
                         (
@@ -1206,14 +1306,15 @@ void sixtop_notifyReceiveCommand(
             opentimers_restart(sixtop_vars.timeoutTimerId);
         } else {
             //------ if this is a return code
+            code = commandIdORcode;
             // if the code is SUCCESS
             if (commandIdORcode==IANA_6TOP_RC_SUCCESS){
                 switch(sixtop_vars.six2six_state){
                 case SIX_WAIT_ADDRESPONSE:
                 case SIX_WAIT_DELETERESPONSE:
                     processIE_retrieve_sixCelllist(pkt,ptr,length,cellList);
-                    // always default frameID
-                    frameID = SCHEDULE_MINIMAL_6TISCH_DEFAULT_SLOTFRAME_HANDLE;
+                    // cells are in the slotframe of the request
+                    frameID = sixtop_vars.frameID;
                     if (sixtop_vars.six2six_state == SIX_WAIT_ADDRESPONSE){
                         sixtop_addCellsByState(frameID,
                                               cellList,
@@ -1247,7 +1348,10 @@ void sixtop_notifyReceiveCommand(
 #endif
                     break;
                 case SIX_WAIT_CLEARRESPONSE:
-                  
+                    // the neighbor removed all our cells, do the same
+                    schedule_removeAllCells(
+                          sixtop_vars.frameID,
+                          &(pkt->l2_nextORpreviousHop));
                     break;
                 default:
                     code = IANA_6TOP_RC_ERR;
@@ -1260,9 +1364,7 @@ void sixtop_notifyReceiveCommand(
                            (errorparameter_t)commandIdORcode,
                            (errorparameter_t)sixtop_vars.six2six_state);
 #endif
-            sixtop_vars.six2six_state = SIX_IDLE;
-            sixtop_vars.handler = SIX_HANDLER_NONE;
-            opentimers_stop(sixtop_vars.timeoutTimerId);
+            sixtop_six2six_transactionDone(code);
         }
     }
 }
@@ -1279,14 +1381,14 @@ uint8_t sixtop_getCelllist(
     INTERRUPT_DECLARATION();
     DISABLE_INTERRUPTS();
     
-    if (frameID != SCHEDULE_MINIMAL_6TISCH_DEFAULT_SLOTFRAME_HANDLE){
+    memset(cellList,0,SCHEDULEIEMAXNUMCELLS*sizeof(cellInfo_ht));
+    
+    scheduleWalker = schedule_getSlotframeEntry(frameID);
+    if (scheduleWalker==NULL){
+        // no such slotframe, or no cell in it
         ENABLE_INTERRUPTS();
         return 0;
     }
-    
-    memset(cellList,0,SCHEDULEIEMAXNUMCELLS*sizeof(cellInfo_ht));
-   
-    scheduleWalker = schedule_getCurrentScheduleEntry();
     currentEntry   = scheduleWalker;
     do {
        if(packetfunctions_sameAddress(&(scheduleWalker->neighbor),neighbor)){
@@ -1305,20 +1407,21 @@ uint8_t sixtop_getCelllist(
 //======= helper functions
 
 bool sixtop_candidateAddCellList(
-      uint8_t*     frameID,
+      uint8_t      frameID,
       cellInfo_ht* cellList,
       uint8_t      requiredCells
    ){
    frameLength_t i;
+   frameLength_t frameLength;
    uint8_t counter;
    uint8_t numCandCells;
    
-   *frameID = schedule_getFrameHandle();
+   frameLength = schedule_getSlotframeLength(frameID);
    
    numCandCells=0;
    for(counter=0;counter<SCHEDULEIEMAXNUMCELLS;counter++){
-      i = openrandom_get16b()%schedule_getFrameLength();
-      if(schedule_isSlotOffsetAvailable(i)==TRUE){
+      i = openrandom_get16b()%frameLength;
+      if(schedule_isSlotOffsetAvailable(frameID,i)==TRUE){
          cellList[numCandCells].tsNum       = i;
          cellList[numCandCells].choffset    = 0;
          cellList[numCandCells].linkoptions = CELLTYPE_TX;
@@ -1334,20 +1437,21 @@ bool sixtop_candidateAddCellList(
 }
 
 bool sixtop_candidateRemoveCellList(
-      uint8_t*     frameID,
+      uint8_t      frameID,
       cellInfo_ht* cellList,
       open_addr_t* neighbor,
       uint8_t      requiredCells
    ){
-   uint8_t              i;
+   frameLength_t        i;
+   frameLength_t        frameLength;
    uint8_t              numCandCells;
    slotinfo_element_t   info;
    
-   *frameID        = schedule_getFrameHandle();
+   frameLength     = schedule_getSlotframeLength(frameID);
   
    numCandCells    = 0;
-   for(i=0;i<schedule_getFrameLength();i++){
-      schedule_getSlotInfo(i,neighbor,&info);
+   for(i=0;i<frameLength;i++){
+      schedule_getSlotInfo(frameID,i,neighbor,&info);
       if(info.link_type == CELLTYPE_TX){
          cellList[numCandCells].tsNum       = i;
          cellList[numCandCells].choffset    = info.channelOffset;
@@ -1385,6 +1489,7 @@ void sixtop_addCellsByState(
                memcpy(&temp_neighbor,previousHop,sizeof(open_addr_t));
                //add a RX link
                schedule_addActiveSlot(
+                  slotframeID,
                   cellList[i].tsNum,
                   CELLTYPE_RX,
                   FALSE,
@@ -1397,6 +1502,7 @@ void sixtop_addCellsByState(
                memcpy(&temp_neighbor,previousHop,sizeof(open_addr_t));
                //add a TX link
                schedule_addActiveSlot(
+                  slotframeID,
                   cellList[i].tsNum,
                   CELLTYPE_TX,
                   FALSE,
@@ -1422,6 +1528,7 @@ void sixtop_removeCellsByState(
    for(i=0;i<SCHEDULEIEMAXNUMCELLS;i++){   
       if(cellList[i].linkoptions != CELLTYPE_OFF){
          schedule_removeActiveSlot(
+            slotframeID,
             cellList[i].tsNum,
             previousHop
          );
@@ -1448,7 +1555,7 @@ bool sixtop_areAvailableCellsToBeScheduled(
       available = FALSE;
    } else {
       do {
-         if(schedule_isSlotOffsetAvailable(cellList[i].tsNum) == TRUE){
+         if(schedule_isSlotOffsetAvailable(frameID,cellList[i].tsNum) == TRUE){
             bw--;
          } else {
             cellList[i].linkoptions = CELLTYPE_OFF;
@@ -1493,7 +1600,7 @@ bool sixtop_areAvailableCellsToBeRemoved(
       available = FALSE;
    } else {
       do {
-          schedule_getSlotInfo(cellList[i].tsNum,neighbor,&info);
+          schedule_getSlotInfo(frameID,cellList[i].tsNum,neighbor,&info);
           if(info.link_type == CELLTYPE_RX){
               bw--;
           } else {
@@ -1518,3 +1625,36 @@ bool sixtop_areAvailableCellsToBeRemoved(
    
    return available;
 }
+
+/**
+\brief Add the burst slotframe to the schedule, if it is not in it yet.
+
+\returns TRUE if the burst slotframe is in the schedule.
+*/
+bool sixtop_addBurstSlotframe(void){
+   if (schedule_getSlotframeLength(SCHEDULE_BURST_SLOTFRAME_HANDLE)!=0){
+      return TRUE;
+   }
+   return schedule_addSlotframe(
+      SCHEDULE_BURST_SLOTFRAME_HANDLE,
+      SCHEDULE_BURST_SLOTFRAME_LENGTH,
+      SCHEDULE_BURST_SLOTFRAME_MAXACTIVESLOTS
+   )==E_SUCCESS;
+}
+
+/**
+\brief Remove the burst slotframe from the schedule, once it has no cells left.
+
+Its rows of the schedule go back to the minimal slotframe.
+
+\param[in] frameID The slotframe cells were just negotiated in.
+*/
+void sixtop_releaseBurstSlotframe(uint8_t frameID){
+   if (
+      frameID == SCHEDULE_BURST_SLOTFRAME_HANDLE &&
+      schedule_getSlotframeLength(frameID)!=0    &&
+      schedule_getSlotframeEntry(frameID)==NULL
+   ){
+      schedule_removeSlotframe(frameID);
+   }
+}
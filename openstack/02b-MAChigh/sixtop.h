@@ -72,6 +72,7 @@ typedef enum {
 //=========================== typedef =========================================
 
 #define SIX2SIX_TIMEOUT_MS 4000
+#define SIXTOP_MAINTENANCE_SLACK_MS 100 // how late the maintenance timer may fire
 #define SIXTOP_MINIMAL_EBPERIOD 5 // minist period of sending EB
 
 //=========================== module variables ================================
@@ -87,9 +88,11 @@ typedef struct {
    uint16_t             kaPeriod;                // period of sending KA
    uint16_t             ebPeriod;                // period of sending EB
    six2six_state_t      six2six_state;
-   uint8_t              commandID;
+   uint8_t              commandID;               // command of the ongoing transaction
+   open_addr_t          neighbor;                // neighbor of the ongoing transaction
    six2six_handler_t    handler;
    bool                 isResponseEnabled;
+   uint8_t              frameID;                 // slotframe of the ongoing transaction
 } sixtop_vars_t;
 
 //=========================== prototypes ======================================
@@ -100,7 +103,9 @@ void      sixtop_setKaPeriod(uint16_t kaPeriod);
 void      sixtop_setEBPeriod(uint8_t ebPeriod);
 void      sixtop_setHandler(six2six_handler_t handler);
 // scheduling
-void      sixtop_request(uint8_t code, open_addr_t* neighbor, uint8_t numCells);
+owerror_t sixtop_request(uint8_t code, open_addr_t* neighbor, uint8_t numCells);
+owerror_t sixtop_requestInSlotframe(uint8_t frameID, uint8_t code, open_addr_t* neighbor, uint8_t numCells);
+owerror_t sixtop_requestInBurstSlotframe(uint8_t code, open_addr_t* neighbor, uint8_t numCells);
 void      sixtop_addORremoveCellByInfo(uint8_t code,open_addr_t*  neighbor,cellInfo_ht* cellInfo);
 // maintaining
 void      sixtop_maintaining(uint16_t slotOffset,open_addr_t* neighbor);
@@ -8,6 +8,7 @@
 #include "neighbors.h"
 #include "openbridge.h"
 #include "icmpv6rpl.h"
+#include "IEEE802154E.h"
 
 //=========================== variables =======================================
 
@@ -56,8 +57,6 @@ owerror_t iphc_sendFromForwarding(
     ipv6_header_iht*  ipv6_inner_header,
     rpl_option_ht*    rpl_option,
     uint32_t*         flow_label,
-    uint8_t*          rh3_copy,
-    uint8_t           rh3_length,
     uint8_t           fw_SendOrfw_Rcv
     ) {
     open_addr_t  temp_dest_prefix;
@@ -176,12 +175,6 @@ owerror_t iphc_sendFromForwarding(
         iphc_prependIPv6HopByHopHeader(msg, msg->l4_protocol, rpl_option);
     }
     
-    // copy RH3s back if length > 0
-    if (rh3_length > 0){
-        packetfunctions_reserveHeaderSize(msg,rh3_length);
-        memcpy(&msg->payload[0],&rh3_copy[0],rh3_length);
-    }
-    
     // if there are 6LoRH in the packet, add page dispatch no.1
     if (
         (*((uint8_t*)(msg->payload)) & FORMAT_6LORH_MASK) == CRITICAL_6LORH ||
@@ -194,6 +187,67 @@ owerror_t iphc_sendFromForwarding(
     return sixtop_send(msg);
 }
 
+/**
+\brief Send a packet being forwarded, whose 6LoRHs were updated in place.
+
+Used for source-routed packets: the RH3-6LoRHs, RPI-6LoRH and IP-in-IP 6LoRH
+are already in the packet, only the hop limit is left to update.
+
+\param[in,out] msg               The packet to send.
+\param[in]     ipv6_outer_header The packet's outer IPv6 header.
+\param[in]     ipv6_inner_header The packet's inner IPv6 header.
+\param[in,out] hopLimit          The hop limit of the IP-in-IP 6LoRH in the
+   packet, NULL if there is none.
+*/
+owerror_t iphc_sendFromForwardingInPlace(
+    OpenQueueEntry_t* msg,
+    ipv6_header_iht*  ipv6_outer_header,
+    ipv6_header_iht*  ipv6_inner_header,
+    uint8_t*          hopLimit
+    ) {
+    // take ownership over the packet
+    msg->owner = COMPONENT_IPHC;
+    
+    // error checking
+    if (idmanager_getIsDAGroot()==TRUE) {
+        openserial_printCritical(COMPONENT_IPHC,ERR_BRIDGE_MISMATCH,
+                            (errorparameter_t)2,
+                            (errorparameter_t)0);
+        return E_FAIL;
+    }
+    
+    //discard the packet.. hop limit reached.
+    if (hopLimit!=NULL){
+        // there is IPinIP check hop limit in ip in ip encapsulation
+        if (*hopLimit==0){
+            openserial_printError(COMPONENT_IPHC,ERR_HOP_LIMIT_REACHED,
+                                (errorparameter_t)0,
+                                (errorparameter_t)0);
+            return E_FAIL;
+        } else {
+            // decrement the packet's hop limit
+            (*hopLimit)--;
+            ipv6_outer_header->hop_limit = *hopLimit;
+        }
+    } else {
+        if (ipv6_inner_header->hop_limit==0) {
+            openserial_printError(COMPONENT_IPHC,ERR_HOP_LIMIT_REACHED,
+                                (errorparameter_t)0,
+                                (errorparameter_t)0);
+            return E_FAIL;
+        } else {
+            // decrement the packet's hop limit
+            ipv6_inner_header->hop_limit--;
+        }
+    }
+    
+    // the packet starts with a 6LoRH, add page dispatch no.1
+    packetfunctions_reserveHeaderSize(msg,sizeof(uint8_t));
+    *((uint8_t*)(msg->payload)) = PAGE_DISPATCH_NO_1;
+    
+    return sixtop_send(msg);
+}
+
 //send from bridge: 6LoWPAN header already added by OpenLBR, send as is
 owerror_t iphc_sendFromBridge(OpenQueueEntry_t *msg) {
    msg->owner = COMPONENT_IPHC;
@@ -244,7 +298,7 @@ void iphc_receive(OpenQueueEntry_t* msg) {
         ) {
             // retrieve hop-by-hop header (includes RPL option)
             rpi_length = iphc_retrieveIPv6HopByHopHeader(
-                              msg,
+                              msg->payload,
                               &rpl_option
                          );
          
@@ -263,6 +317,10 @@ void iphc_receive(OpenQueueEntry_t* msg) {
             &rpl_option
         );
    } else {
+#ifdef LATENCY_TRACE
+      // account for the last hop before handing the trace to the OpenVisualizer
+      iphc_updateLatencyTrace(msg,&ipv6_outer_header);
+#endif
       openbridge_receive(msg);                   //out to the OpenVisualizer
    }
 }
@@ -685,13 +743,21 @@ void iphc_retrieveIPv6Header(OpenQueueEntry_t* msg, ipv6_header_iht* ipv6_outer_
     					}
     				}
     			} else {
-    				//unknown elective packet, print error and skip it
-    				openserial_printError(
-    						COMPONENT_IPHC,
-    				        ERR_6LOWPAN_UNSUPPORTED,
-    				        (errorparameter_t)13,
-    				        (errorparameter_t)(rh3_index)
-    				);
+    				if (lorh_type == LATENCY_6LOTH_TYPE && lorh_length == LATENCYTRACE_LEN){
+    					// latency trace, left in place and updated by the relays
+    					ipv6_outer_header->latencyTrace = (uint8_t*)(msg->payload) + \
+    							ipv6_outer_header->header_length + \
+    							*page_length + \
+								extention_header_length;
+    				} else {
+    					//unknown elective packet, print error and skip it
+    					openserial_printError(
+    							COMPONENT_IPHC,
+    					        ERR_6LOWPAN_UNSUPPORTED,
+    					        (errorparameter_t)13,
+    					        (errorparameter_t)(rh3_index)
+    					);
+    				}
     				extention_header_length += 2 + lorh_length;
     				ipv6_outer_header->rhe_length += 2 + lorh_length;
     			}
@@ -1050,14 +1116,14 @@ void iphc_prependIPv6HopByHopHeader(
 /**
 \brief Retrieve an IPv6 hop-by-hop header from a message.
 
-\param[in,out] msg             The message to retrieve the header from.
-\param[out]    hopbyhop_header Pointer to the structure to hold the retrieved
-   hop-by-hop option.
+\param[in]     rpi             The RPI-6LoRH in the message.
 \param[out]    rpl_option      Pointer to the structure to hold the retrieved
    RPL option.
+
+\returns The length of the RPI-6LoRH.
 */
 uint8_t iphc_retrieveIPv6HopByHopHeader(
-      OpenQueueEntry_t*      msg,
+      uint8_t*               rpi,
       rpl_option_ht*         rpl_option
    ){
    uint8_t temp_8b;
@@ -1067,8 +1133,8 @@ uint8_t iphc_retrieveIPv6HopByHopHeader(
    // initialize the header length (will increment at each field)
    length = 0;
    
-   temp_8b = *((uint8_t*)(msg->payload)+length);
-   type    = *((uint8_t*)(msg->payload)+length+1);
+   temp_8b = *(rpi+length);
+   type    = *(rpi+length+1);
    
    if (
        (temp_8b & FORMAT_6LORH_MASK) == CRITICAL_6LORH &&
@@ -1080,7 +1146,7 @@ uint8_t iphc_retrieveIPv6HopByHopHeader(
        rpl_option->flags = (uint8_t)(temp_8b & FLAG_MASK);
        // check FLAG I to get rplinstance ID
        if ((temp_8b & I_FLAG)==0){
-           rpl_option->rplInstanceID = *((uint8_t*)(msg->payload)+length);
+           rpl_option->rplInstanceID = *(rpi+length);
            length += sizeof(uint8_t);
        } else {
            // Global RPLInstanceID
@@ -1088,11 +1154,11 @@ uint8_t iphc_retrieveIPv6HopByHopHeader(
        }
        // check FLAG K to get senderRannk
        if ((temp_8b & K_FLAG)==0){
-           rpl_option->senderRank = *((uint8_t*)(msg->payload)+length);
-           rpl_option->senderRank = ((rpl_option->senderRank)<<8)+*((uint8_t*)(msg->payload)+length+1);
+           rpl_option->senderRank = *(rpi+length);
+           rpl_option->senderRank = ((rpl_option->senderRank)<<8)+*(rpi+length+1);
            length += sizeof(uint16_t);
        } else{
-           rpl_option->senderRank = *((uint8_t*)(msg->payload)+length);
+           rpl_option->senderRank = *(rpi+length);
            rpl_option->senderRank = rpl_option->senderRank*256;
            length  += sizeof(uint8_t);
        }
@@ -1106,3 +1172,109 @@ uint8_t iphc_retrieveIPv6HopByHopHeader(
    }
    return length;
 }
+
+/**
+\brief Rewrite the RPI-6LoRH of a message being forwarded, in place.
+
+The new RPI ends where the old one did. If its length changes, the 6LoRHs
+before it slide by the difference, so the headers stay contiguous.
+
+\param[in,out] msg        The message.
+\param[in]     rpi_offset Offset of the RPI-6LoRH, from msg->payload.
+\param[in]     rpi_length Length of the RPI-6LoRH in the message.
+\param[in]     rpl_option The RPL option to write.
+*/
+void iphc_rewriteIPv6HopByHopHeader(
+      OpenQueueEntry_t*      msg,
+      uint8_t                rpi_offset,
+      uint8_t                rpi_length,
+      rpl_option_ht*         rpl_option
+   ){
+   uint8_t new_length;
+   
+   new_length  = 2;
+   new_length += ((rpl_option->flags & I_FLAG)==0)?sizeof(uint8_t):0;
+   new_length += ((rpl_option->flags & K_FLAG)==0)?sizeof(uint16_t):sizeof(uint8_t);
+   
+   // slide the 6LoRHs before the RPI, then write the RPI behind them
+   if (new_length>rpi_length) {
+      packetfunctions_reserveHeaderSize(msg,new_length-rpi_length);
+      memmove(msg->payload,msg->payload+new_length-rpi_length,rpi_offset);
+   } else if (new_length<rpi_length) {
+      memmove(msg->payload+rpi_length-new_length,msg->payload,rpi_offset);
+      packetfunctions_tossHeader(msg,rpi_length-new_length);
+   }
+   packetfunctions_tossHeader(msg,rpi_offset+new_length);
+   iphc_prependIPv6HopByHopHeader(msg,msg->l4_protocol,rpl_option);
+   packetfunctions_reserveHeaderSize(msg,rpi_offset);
+}
+
+//===== latency trace
+
+/**
+\brief Prepend a latency trace 6LoRH to a message originating at this mote.
+
+The trace is an elective 6LoRH placed right before the IPHC inner header. It
+holds the number of hops the packet went through, the ASN at which the packet
+entered the current hop (32 least significant bits) and, for each hop, the
+number of slots the packet spent there (queueing and retransmissions). Each
+relay closes the entry of the previous hop when receiving the packet, see
+iphc_updateLatencyTrace().
+
+\param[in,out] msg The message to prepend the trace to.
+*/
+void iphc_prependLatencyTrace(OpenQueueEntry_t* msg) {
+   uint8_t asnArray[5];
+   
+   ieee154e_getAsn(asnArray);
+   
+   packetfunctions_reserveHeaderSize(msg,2+LATENCYTRACE_LEN);
+   memset(&msg->payload[0],0,2+LATENCYTRACE_LEN);
+   msg->payload[0] = ELECTIVE_6LoRH | LATENCYTRACE_LEN;
+   msg->payload[1] = LATENCY_6LOTH_TYPE;
+   // numHops is 0, entry ASN is now
+   msg->payload[3] = asnArray[3];
+   msg->payload[4] = asnArray[2];
+   msg->payload[5] = asnArray[1];
+   msg->payload[6] = asnArray[0];
+}
+
+/**
+\brief Record in the latency trace the time the packet spent at the previous hop.
+
+The trace is updated in place, using the ASN at which the packet was received.
+Delays are in slots and saturate at 0xffff. Hops past LATENCYTRACE_MAXHOPS are
+counted but their delay is not recorded.
+
+\param[in,out] msg               The received message.
+\param[in]     ipv6_outer_header The outer header, pointing to the trace.
+*/
+void iphc_updateLatencyTrace(
+      OpenQueueEntry_t*      msg,
+      ipv6_header_iht*       ipv6_outer_header
+   ){
+   uint8_t*  trace;
+   uint32_t  rxAsn;
+   uint32_t  delay;
+   
+   if (ipv6_outer_header->latencyTrace==NULL) {
+      return;
+   }
+   
+   // skip the length and type
+   trace = ipv6_outer_header->latencyTrace+2;
+   
+   rxAsn = ((uint32_t)msg->l2_asn.bytes2and3<<16) | msg->l2_asn.bytes0and1;
+   delay = rxAsn-packetfunctions_ntohl(&trace[1]);
+   if (delay>0xffff) {
+      delay = 0xffff;
+   }
+   
+   if (trace[0]<LATENCYTRACE_MAXHOPS) {
+      packetfunctions_htons((uint16_t)delay,&trace[5+2*trace[0]]);
+   }
+   if (trace[0]<0xff) {
+      trace[0]++;
+   }
+   packetfunctions_htonl(rxAsn,&trace[1]);
+}
@@ -16,6 +16,9 @@
 #define IPv6HOP_HDR_LEN           2  // tengfei: should be 2
 #define MAXNUM_RH3                3
 
+#define LATENCYTRACE_MAXHOPS      8  // hops recorded in the latency trace
+#define LATENCYTRACE_LEN          (1+4+2*LATENCYTRACE_MAXHOPS) // numHops, entry ASN, per-hop delays
+
 enum IPHC_enums {
    IPHC_DISPATCH             = 5,
    IPHC_TF                   = 3,
@@ -144,12 +147,16 @@ enum TYPE_6LORH_enums{
     RH3_6LOTH_TYPE_4         = 0x04,
     RPI_6LOTH_TYPE           = 0x05,
     IPECAP_6LOTH_TYPE        = 0x06,
+    LATENCY_6LOTH_TYPE       = 0x30,        // locally assigned, elective latency trace
 };
 
 enum SIZE_6LORH_RH3_enums{
     RH3_6LOTH_SIZE_MASK      = 0x1F,
 };
 
+// bytes per address of a RH3-6LoRH of a given type: 1, 2, 4, 8 or 16
+#define RH3_6LOTH_ADDRLEN(type)  (1<<(type))
+
 enum PAGE_DISPATCH_enums{
     PAGE_DISPATCH_NO_1       = 0xF1,
     PAGE_DISPATCH_TAG        = 0xF0,
@@ -165,6 +172,7 @@ typedef struct {
    uint8_t     next_header;
    uint8_t*    routing_header[MAXNUM_RH3];
    uint8_t*    hopByhop_option;
+   uint8_t*    latencyTrace;           ///< latency trace 6LoRH, NULL if absent
    uint8_t     hop_limit;
    uint8_t	   rhe_length;
    open_addr_t src;
@@ -225,10 +233,14 @@ owerror_t     iphc_sendFromForwarding(
    ipv6_header_iht*     ipv6_inner_header, 
    rpl_option_ht*       rpl_option, 
    uint32_t*            flow_label,
-   uint8_t*             rh3_copy,
-   uint8_t              rh3_length,
    uint8_t              fw_SendOrfw_Rcv
 );
+owerror_t     iphc_sendFromForwardingInPlace(
+   OpenQueueEntry_t*    msg,
+   ipv6_header_iht*     ipv6_outer_header,
+   ipv6_header_iht*     ipv6_inner_header,
+   uint8_t*             hopLimit
+);
 owerror_t     iphc_sendFromBridge(OpenQueueEntry_t *msg);
 void          iphc_sendDone(OpenQueueEntry_t *msg, owerror_t error);
 void          iphc_receive(OpenQueueEntry_t *msg);
@@ -252,9 +264,21 @@ owerror_t iphc_prependIPv6Header(
    uint8_t              fw_SendOrfw_Rcv
 );
 uint8_t iphc_retrieveIPv6HopByHopHeader(
+   uint8_t*             rpi,
+   rpl_option_ht*       rpl_option
+);
+void    iphc_rewriteIPv6HopByHopHeader(
    OpenQueueEntry_t*    msg,
+   uint8_t              rpi_offset,
+   uint8_t              rpi_length,
    rpl_option_ht*       rpl_option
 );
+// latency trace
+void    iphc_prependLatencyTrace(OpenQueueEntry_t* msg);
+void    iphc_updateLatencyTrace(
+   OpenQueueEntry_t*    msg,
+   ipv6_header_iht*     ipv6_outer_header
+);
 
 /**
 \}
@@ -17,7 +17,7 @@
 
 //=========================== prototypes ======================================
 
-void      forwarding_getNextHop(
+uint8_t   forwarding_getNextHop(
    open_addr_t*         destination,
    open_addr_t*         addressToWrite
 );
@@ -35,6 +35,11 @@ owerror_t forwarding_send_internal_SourceRouting(
    ipv6_header_iht*     ipv6_inner_header,
    rpl_option_ht*       rpl_option
 );
+void      forwarding_compactHeader(
+   OpenQueueEntry_t*    msg,
+   uint8_t              offset,
+   uint8_t              len
+);
 void      forwarding_createRplOption(
    rpl_option_ht*       rpl_option,
    uint8_t              flags
@@ -158,6 +163,16 @@ owerror_t forwarding_send(OpenQueueEntry_t* msg) {
     // both of them are compressed
     ipv6_outer_header.next_header_compressed = TRUE;
 
+#ifdef LATENCY_TRACE
+    // start tracing the per-hop latency of data packets
+    if (
+        msg->l4_protocol==IANA_UDP &&
+        packetfunctions_isBroadcastMulticast(&(msg->l3_destinationAdd))==FALSE
+    ) {
+        iphc_prependLatencyTrace(msg);
+    }
+#endif
+
     return forwarding_send_internal_RoutingTable(
         msg,
         &ipv6_outer_header,
@@ -230,6 +245,10 @@ void forwarding_receive(
     ) {
     uint8_t flags;
     uint16_t senderRank;
+    bool downward;
+#ifdef RPL_STORING_MODE
+    uint8_t hlen;
+#endif
    
     // take ownership
     msg->owner                     = COMPONENT_FORWARDING;
@@ -282,13 +301,55 @@ void forwarding_receive(
     } else {
         // this packet is not for me: relay
       
+#ifdef RPL_STORING_MODE
+        // learn the route to the motes whose DAO I relay
+        if (
+            msg->l4_protocol==IANA_ICMPv6 &&
+            msg->l4_protocol_compressed==FALSE
+        ) {
+            hlen = ipv6_inner_header->header_length;
+            if (ipv6_outer_header->src.type != ADDR_NONE || ipv6_outer_header->rhe_length){
+                hlen += ipv6_outer_header->header_length + ipv6_outer_header->rhe_length;
+            }
+            if (
+                msg->length>=hlen+sizeof(ICMPv6_ht) &&
+                ((ICMPv6_ht*)(msg->payload+hlen))->type==IANA_ICMPv6_RPL &&
+                ((ICMPv6_ht*)(msg->payload+hlen))->code==IANA_ICMPv6_RPL_DAO
+            ) {
+                icmpv6rpl_indicateRelayedDAO(&(msg->l3_sourceAdd),&(msg->l2_nextORpreviousHop));
+            }
+        }
+#endif
+      
         // change the creator of the packet
         msg->creator = COMPONENT_FORWARDING;
+        
+        // respect the share of the queue for relayed packets
+        if (openqueue_admitForwarded(msg)==E_FAIL) {
+            openserial_printError(
+                COMPONENT_FORWARDING,
+                ERR_NO_FREE_PACKET_BUFFER,
+                (errorparameter_t)0,
+                (errorparameter_t)0
+            );
+            openqueue_freePacketBuffer(msg);
+            return;
+        }
+        
+#ifdef LATENCY_TRACE
+        // record the time the packet spent at the previous hop
+        iphc_updateLatencyTrace(msg,ipv6_outer_header);
+#endif
       
         if (ipv6_outer_header->next_header!=IANA_IPv6ROUTE) {
             flags = rpl_option->flags;
             senderRank = rpl_option->senderRank;
+            downward = FALSE;
             if ((flags & O_FLAG)!=0){
+#ifdef RPL_STORING_MODE
+                // sent down by a storing-mode parent
+                downward = TRUE;
+#else
                 // wrong direction
                 // log error
                 openserial_printError(
@@ -297,8 +358,12 @@ void forwarding_receive(
                     (errorparameter_t)flags,
                     (errorparameter_t)senderRank
                 );
+#endif
             }
-            if (senderRank < neighbors_getMyDAGrank()){
+            if (
+                (downward==FALSE && senderRank < neighbors_getMyDAGrank()) ||
+                (downward==TRUE  && senderRank > neighbors_getMyDAGrank())
+            ){
                 // loop detected
                 // set flag
                 rpl_option->flags |= R_FLAG;
@@ -341,6 +406,7 @@ void forwarding_receive(
                     (errorparameter_t)0,
                     (errorparameter_t)0
                 );
+                openqueue_freePacketBuffer(msg);
             }
         }
     }
@@ -353,8 +419,10 @@ void forwarding_receive(
 
 \param[in]  destination128b  Final IPv6 destination address.
 \param[out] addressToWrite64b Location to write the EUI64 of next hop to.
+
+\returns How the next hop was found, ROUTE_DIRECT, ROUTE_DOWN or ROUTE_UP.
 */
-void forwarding_getNextHop(open_addr_t* destination128b, open_addr_t* addressToWrite64b) {
+uint8_t forwarding_getNextHop(open_addr_t* destination128b, open_addr_t* addressToWrite64b) {
    uint8_t         i;
    open_addr_t     temp_prefix64btoWrite;
    
@@ -364,12 +432,20 @@ void forwarding_getNextHop(open_addr_t* destination128b, open_addr_t* addressToW
       for (i=0;i<8;i++) {
          addressToWrite64b->addr_64b[i] = 0xff;
       }
+      return ROUTE_DIRECT;
    } else if (neighbors_isStableNeighbor(destination128b)) {
       // IP destination is 1-hop neighbor, send directly
       packetfunctions_ip128bToMac64b(destination128b,&temp_prefix64btoWrite,addressToWrite64b);
+      return ROUTE_DIRECT;
+#ifdef RPL_STORING_MODE
+   } else if (icmpv6rpl_getRouteNextHop(destination128b,addressToWrite64b)==TRUE) {
+      // IP destination is in my sub-DODAG, send down towards it
+      return ROUTE_DOWN;
+#endif
    } else {
-      // destination is remote, send to preferred parent
-      neighbors_getPreferredParentEui64(addressToWrite64b);
+      // destination is remote, send to one of my parents
+      neighbors_getUpstreamNextHopEui64(addressToWrite64b);
+      return ROUTE_UP;
    }
 }
 
@@ -391,9 +467,15 @@ owerror_t forwarding_send_internal_RoutingTable(
       uint32_t*              flow_label,
       uint8_t                fw_SendOrfw_Rcv
    ) {
+#ifdef RPL_STORING_MODE
+   uint8_t route;
    
+   // retrieve the next hop from the routing table
+   route = forwarding_getNextHop(&(msg->l3_destinationAdd),&(msg->l2_nextORpreviousHop));
+#else
    // retrieve the next hop from the routing table
    forwarding_getNextHop(&(msg->l3_destinationAdd),&(msg->l2_nextORpreviousHop));
+#endif
    if (msg->l2_nextORpreviousHop.type==ADDR_NONE) {
       openserial_printError(
          COMPONENT_FORWARDING,
@@ -404,6 +486,23 @@ owerror_t forwarding_send_internal_RoutingTable(
       return E_FAIL;
    }
    
+#ifdef RPL_STORING_MODE
+   if (route==ROUTE_DOWN) {
+      // tell the next hop the packet is going down the DODAG
+      rpl_option->flags |= O_FLAG;
+   } else if (route==ROUTE_UP && (rpl_option->flags & O_FLAG)!=0) {
+      // the packet was sent down to me, but my route towards its destination
+      // expired: sending it back up would loop (forwarding error, RFC6550 11.2.2.3)
+      openserial_printError(
+         COMPONENT_FORWARDING,
+         ERR_NO_NEXTHOP,
+         (errorparameter_t)1,
+         (errorparameter_t)0
+      );
+      return E_FAIL;
+   }
+#endif
+   
    if (ipv6_outer_header->src.type != ADDR_NONE){
       packetfunctions_tossHeader(msg,ipv6_outer_header->header_length);
    }
@@ -415,8 +514,6 @@ owerror_t forwarding_send_internal_RoutingTable(
       ipv6_inner_header,
       rpl_option,
       flow_label,
-      NULL,  // no rh3
-      0,
       fw_SendOrfw_Rcv
    );
 }
@@ -426,8 +523,8 @@ owerror_t forwarding_send_internal_RoutingTable(
 
 \note This is always called for packets being forwarded.
 
-How to process the routing header is detailed in
-http://tools.ietf.org/html/rfc6554#page-9.
+The headers are updated in place by forwarding_consumeSourceRoute(), then
+the packet is handed to IPHC as is.
 
 \param[in,out] msg             The packet to send.
 \param[in]     ipv6_header     The packet's IPv6 header.
@@ -438,31 +535,77 @@ owerror_t forwarding_send_internal_SourceRouting(
     ipv6_header_iht*  ipv6_inner_header,
     rpl_option_ht*    rpl_option
     ) {
-    uint8_t              temp_8b;
+    uint8_t*             hopLimit;
+    
+    if (
+        forwarding_consumeSourceRoute(
+            msg,
+            ipv6_outer_header,
+            ipv6_inner_header,
+            rpl_option,
+            &hopLimit
+        )==E_FAIL
+    ) {
+        return E_FAIL;
+    }
+    
+    // send to next lower layer
+    return iphc_sendFromForwardingInPlace(
+        msg,
+        ipv6_outer_header,
+        ipv6_inner_header,
+        hopLimit
+    );
+}
+
+/**
+\brief Consume this mote's entry in the RH3-6LoRHs of a packet, in place.
+
+How to process the routing header is detailed in
+http://tools.ietf.org/html/rfc6554#page-9.
+
+The packet starts with the elective 6LoRHs this mote does not know, followed by
+the RH3-6LoRHs, the RPI-6LoRH and the IP-in-IP 6LoRH. The bytes of the
+consumed address are removed by sliding the headers which precede them
+forward within msg->packet; the rest of the packet does not move. The RPI is
+rewritten where it is, for the next hop.
+
+\param[in,out] msg               The packet to forward.
+\param[in]     ipv6_outer_header The packet's outer IPv6 header.
+\param[in]     ipv6_inner_header The packet's inner IPv6 header.
+\param[in,out] rpl_option        The packet's RPL option.
+\param[out]    hopLimit          Where to write the location of the hop limit
+   of the IP-in-IP 6LoRH in the packet to, NULL if the packet has none.
+
+\returns E_SUCCESS if this mote is the first address of the source route, and
+   the next hop was written to msg->l2_nextORpreviousHop, E_FAIL otherwise.
+*/
+owerror_t forwarding_consumeSourceRoute(
+    OpenQueueEntry_t* msg,
+    ipv6_header_iht*  ipv6_outer_header,
+    ipv6_header_iht*  ipv6_inner_header,
+    rpl_option_ht*    rpl_option,
+    uint8_t**         hopLimit
+    ) {
+    uint8_t              hlen;
+    uint8_t*             rh3;
+    uint8_t*             next_rh3;
     uint8_t              type;
     uint8_t              next_type;
     uint8_t              size;
     uint8_t              next_size;
-    uint8_t              hlen;
+    uint8_t              addrLen;
+    uint8_t              next_addrLen;
     open_addr_t          firstAddr;
-    open_addr_t          nextAddr;
     open_addr_t          temp_prefix;
     open_addr_t          temp_addr64;
     
+    uint8_t              rpi_offset;
     uint8_t              rpi_length;
     uint8_t              flags;
     uint16_t             senderRank;
     
-    uint8_t              RH_copy[127];
-    uint8_t              RH_length;
-    
-    uint8_t				 RH3_length;
-
-    uint8_t sizeRH=0;
-
-    memset(&RH_copy[0],0,127);
-    RH3_length = 0;
-    RH_length = 0;
+    *hopLimit = NULL;
     memcpy(&msg->l3_destinationAdd,&ipv6_inner_header->dest,sizeof(open_addr_t));
     memcpy(&msg->l3_sourceAdd,&ipv6_inner_header->src,sizeof(open_addr_t));
     
@@ -476,190 +619,32 @@ owerror_t forwarding_send_internal_SourceRouting(
         memcpy(&firstAddr,&ipv6_inner_header->src,sizeof(open_addr_t));
     }
     
+    // skip the unknown 6LoRHE, they stay in place
     hlen = 0;
-    
-    temp_8b = *((uint8_t*)(msg->payload)+hlen);
-    type    = *((uint8_t*)(msg->payload)+hlen+1);
-    
-    //copy and toss any unknown 6LoRHE
-    while((temp_8b&FORMAT_6LORH_MASK) == ELECTIVE_6LoRH){
-        sizeRH = temp_8b & IPINIP_LEN_6LORH_MASK;
-    	memcpy(&RH_copy[RH_length], msg->payload, sizeRH+2);
-    	packetfunctions_tossHeader(msg, sizeRH+2);
-    	RH_length += 2 + sizeRH;
-        temp_8b = *((uint8_t*)(msg->payload)+hlen);
-        type    = *((uint8_t*)(msg->payload)+hlen+1);
+    while ((msg->payload[hlen]&FORMAT_6LORH_MASK) == ELECTIVE_6LoRH){
+        hlen += 2 + (msg->payload[hlen] & IPINIP_LEN_6LORH_MASK);
     }
-
-    hlen += 2;
-
+    
     // get the first address
-    switch(type){
-    case RH3_6LOTH_TYPE_0:
-        memcpy(&firstAddr.addr_128b[15],msg->payload+hlen,1);
-        hlen += 1;
-        break;
-    case RH3_6LOTH_TYPE_1:
-        memcpy(&firstAddr.addr_128b[14],msg->payload+hlen,2);
-        hlen += 2;
-        break;
-    case RH3_6LOTH_TYPE_2:
-        memcpy(&firstAddr.addr_128b[12],msg->payload+hlen,4);
-        hlen += 4;
-        break;
-    case RH3_6LOTH_TYPE_3:
-        memcpy(&firstAddr.addr_128b[8],msg->payload+hlen,8);
-        hlen += 8;
-        break;
-    case RH3_6LOTH_TYPE_4:
-        memcpy(&firstAddr.addr_128b[0],msg->payload+hlen,16);
-        hlen += 16;
-        break;
+    rh3     = &msg->payload[hlen];
+    type    = rh3[1];
+    if (type>RH3_6LOTH_TYPE_4) {
+        openserial_printError(
+            COMPONENT_IPHC,
+            ERR_6LOWPAN_UNSUPPORTED,
+            (errorparameter_t)14,
+            (errorparameter_t)type
+        );
+        return E_FAIL;
     }
+    addrLen = RH3_6LOTH_ADDRLEN(type);
+    memcpy(&firstAddr.addr_128b[16-addrLen],&rh3[2],addrLen);
     
     packetfunctions_ip128bToMac64b(&firstAddr,&temp_prefix,&temp_addr64);
     if (
-        packetfunctions_sameAddress(&temp_prefix,idmanager_getMyID(ADDR_PREFIX)) &&
-        packetfunctions_sameAddress(&temp_addr64,idmanager_getMyID(ADDR_64B))
+        packetfunctions_sameAddress(&temp_prefix,idmanager_getMyID(ADDR_PREFIX))==FALSE ||
+        packetfunctions_sameAddress(&temp_addr64,idmanager_getMyID(ADDR_64B))==FALSE
     ){
-        size = temp_8b & RH3_6LOTH_SIZE_MASK;
-        if (size > 0){
-            // there are at least 2 entries in the header, 
-            // the router removes the first entry and decrements the Size (by 1) 
-            size -= 1;
-            packetfunctions_tossHeader(msg,hlen);
-            packetfunctions_reserveHeaderSize(msg,2);
-            msg->payload[0] = CRITICAL_6LORH | size;
-            msg->payload[1] = type;
-            // get next hop
-            memcpy(&nextAddr,&firstAddr,sizeof(open_addr_t));
-            switch(type){
-            case RH3_6LOTH_TYPE_0:
-                memcpy(&nextAddr.addr_128b[15],msg->payload+2,1);
-                break;
-            case RH3_6LOTH_TYPE_1:
-                memcpy(&nextAddr.addr_128b[14],msg->payload+2,2);
-                break;
-            case RH3_6LOTH_TYPE_2:
-                memcpy(&nextAddr.addr_128b[12],msg->payload+2,4);
-                break;
-            case RH3_6LOTH_TYPE_3:
-                memcpy(&nextAddr.addr_128b[8],msg->payload+2,8);
-                break;
-            case RH3_6LOTH_TYPE_4:
-                memcpy(&nextAddr.addr_128b[0],msg->payload+2,16);
-                break;
-            }
-            packetfunctions_ip128bToMac64b(
-                &nextAddr,
-                &temp_prefix,
-                &msg->l2_nextORpreviousHop
-            );
-        } else {
-            temp_8b   = *((uint8_t*)(msg->payload)+hlen);
-            next_type = *((uint8_t*)(msg->payload)+hlen+1);
-            if (
-                (temp_8b & FORMAT_6LORH_MASK) == CRITICAL_6LORH &&
-                next_type<=RH3_6LOTH_TYPE_4
-            ) {
-                // there is another RH3-6LoRH following, check the type
-                if (next_type >= type){
-                    packetfunctions_tossHeader(msg,hlen);
-                    // get next hop
-                    memcpy(&nextAddr,&firstAddr,sizeof(open_addr_t));
-                    switch(next_type){
-                    case RH3_6LOTH_TYPE_0:
-                        memcpy(&nextAddr.addr_128b[15],msg->payload+2,1);
-                        break;
-                    case RH3_6LOTH_TYPE_1:
-                        memcpy(&nextAddr.addr_128b[14],msg->payload+2,2);
-                        break;
-                    case RH3_6LOTH_TYPE_2:
-                        memcpy(&nextAddr.addr_128b[12],msg->payload+2,4);
-                        break;
-                    case RH3_6LOTH_TYPE_3:
-                        memcpy(&nextAddr.addr_128b[8],msg->payload+2,8);
-                        break;
-                    case RH3_6LOTH_TYPE_4:
-                        memcpy(&nextAddr.addr_128b[0],msg->payload+2,16);
-                        break;
-                    }
-                    packetfunctions_ip128bToMac64b(
-                        &nextAddr,
-                        &temp_prefix,
-                        &msg->l2_nextORpreviousHop
-                    );
-                } else {
-                    hlen += 2;
-                    switch(next_type){
-                    case RH3_6LOTH_TYPE_0:
-                        memcpy(&firstAddr.addr_128b[15],msg->payload+hlen,1);
-                        hlen += 1;
-                        break;
-                    case RH3_6LOTH_TYPE_1:
-                        memcpy(&firstAddr.addr_128b[14],msg->payload+hlen,2);
-                        hlen += 2;
-                        break;
-                    case RH3_6LOTH_TYPE_2:
-                        memcpy(&firstAddr.addr_128b[12],msg->payload+hlen,4);
-                        hlen += 4;
-                        break;
-                    case RH3_6LOTH_TYPE_3:
-                        memcpy(&firstAddr.addr_128b[8],msg->payload+hlen,8);
-                        hlen += 8;
-                        break;
-                    }
-                    next_size = temp_8b & RH3_6LOTH_SIZE_MASK;
-                    packetfunctions_tossHeader(msg,hlen);
-                    if (next_size>0){
-                        next_size -= 1;
-                        packetfunctions_reserveHeaderSize(msg,2);
-                        msg->payload[0] = CRITICAL_6LORH | next_size;
-                        msg->payload[1] = next_type;
-                    }
-                    // add first address
-                    switch(type){
-                    case RH3_6LOTH_TYPE_0:
-                        packetfunctions_reserveHeaderSize(msg,1);
-                        msg->payload[0] = firstAddr.addr_128b[15];
-                        break;
-                    case RH3_6LOTH_TYPE_1:
-                        packetfunctions_reserveHeaderSize(msg,2);
-                        memcpy(&msg->payload[0],&firstAddr.addr_128b[14],2);
-                        break;
-                    case RH3_6LOTH_TYPE_2:
-                        packetfunctions_reserveHeaderSize(msg,4);
-                        memcpy(&msg->payload[0],&firstAddr.addr_128b[12],4);
-                        break;
-                    case RH3_6LOTH_TYPE_3:
-                        packetfunctions_reserveHeaderSize(msg,8);
-                        memcpy(&msg->payload[0],&firstAddr.addr_128b[8],8);
-                        break;
-                    case RH3_6LOTH_TYPE_4:
-                        packetfunctions_reserveHeaderSize(msg,16);
-                        memcpy(&msg->payload[0],&firstAddr.addr_128b[0],16);
-                        break;
-                    }
-                    packetfunctions_reserveHeaderSize(msg,2);
-                    msg->payload[0] = CRITICAL_6LORH | 0;
-                    msg->payload[1] = type;
-                    packetfunctions_ip128bToMac64b(
-                        &firstAddr,
-                        &temp_prefix,
-                        &msg->l2_nextORpreviousHop
-                    );
-                }
-            } else {
-                // there is no next RH3-6loRH, remove current one
-                packetfunctions_tossHeader(msg,hlen);
-                packetfunctions_ip128bToMac64b(
-                    &msg->l3_destinationAdd,
-                    &temp_prefix,
-                    &msg->l2_nextORpreviousHop
-                );
-            }
-        }
-    } else {
         // log error
         openserial_printError(
             COMPONENT_IPHC,
@@ -667,30 +652,73 @@ owerror_t forwarding_send_internal_SourceRouting(
             (errorparameter_t)16,
             (errorparameter_t)(temp_addr64.addr_64b[7])
         );
+        return E_FAIL;
+    }
+    
+    size = rh3[0] & RH3_6LOTH_SIZE_MASK;
+    next_rh3 = &rh3[2+addrLen];
+    if (size > 0){
+        // there are at least 2 entries in the header, 
+        // the router removes the first entry and decrements the Size (by 1) 
+        rh3[0] = CRITICAL_6LORH | (size-1);
+        // get next hop
+        memcpy(&firstAddr.addr_128b[16-addrLen],next_rh3,addrLen);
+        forwarding_compactHeader(msg,hlen+2,addrLen);
+        packetfunctions_ip128bToMac64b(&firstAddr,&temp_prefix,&msg->l2_nextORpreviousHop);
+    } else if (
+        (next_rh3[0] & FORMAT_6LORH_MASK) == CRITICAL_6LORH &&
+        next_rh3[1]<=RH3_6LOTH_TYPE_4
+    ) {
+        // there is another RH3-6LoRH following, check the type
+        next_type    = next_rh3[1];
+        next_size    = next_rh3[0] & RH3_6LOTH_SIZE_MASK;
+        next_addrLen = RH3_6LOTH_ADDRLEN(next_type);
+        // get next hop
+        memcpy(&firstAddr.addr_128b[16-next_addrLen],&next_rh3[2],next_addrLen);
+        if (next_type >= type){
+            // remove the current RH3-6LoRH
+            forwarding_compactHeader(msg,hlen,2+addrLen);
+        } else {
+            // the next hop is written in place of my address, with the
+            // current type, as it can not be compressed against mine anymore
+            memcpy(&rh3[2],&firstAddr.addr_128b[16-addrLen],addrLen);
+            if (next_size>0){
+                next_rh3[0] = CRITICAL_6LORH | (next_size-1);
+                forwarding_compactHeader(msg,(uint8_t)(next_rh3-msg->payload)+2,next_addrLen);
+            } else {
+                forwarding_compactHeader(msg,(uint8_t)(next_rh3-msg->payload),2+next_addrLen);
+            }
+        }
+        packetfunctions_ip128bToMac64b(&firstAddr,&temp_prefix,&msg->l2_nextORpreviousHop);
+    } else {
+        // there is no next RH3-6loRH, remove current one
+        forwarding_compactHeader(msg,hlen,2+addrLen);
+        packetfunctions_ip128bToMac64b(
+            &msg->l3_destinationAdd,
+            &temp_prefix,
+            &msg->l2_nextORpreviousHop
+        );
     }
-    // copy RH3s before toss them
+    
+    // update the RPI for the next hop, the headers behind it did not move
     if (
         ipv6_outer_header->src.type != ADDR_NONE &&
         ipv6_outer_header->hopByhop_option != NULL
     ){
-        // check the length of RH3s
-        RH3_length += ipv6_outer_header->hopByhop_option-msg->payload;
-        memcpy(&RH_copy[RH_length],msg->payload,RH3_length);
-        packetfunctions_tossHeader(msg,RH3_length);
-        RH_length += RH3_length;
-        
-        // retrieve hop-by-hop header (includes RPL option)
+        rpi_offset = (uint8_t)(ipv6_outer_header->hopByhop_option-msg->payload);
         rpi_length = iphc_retrieveIPv6HopByHopHeader(
-                          msg,
+                          ipv6_outer_header->hopByhop_option,
                           rpl_option
                      );
-     
-        // toss the headers
-        packetfunctions_tossHeader(
-            msg,
-            rpi_length
-        );
-      
+        
+        // the IP in IP 6LoRH follows, with the hop limit as 3rd byte
+        if (
+            (ipv6_outer_header->hopByhop_option[rpi_length] & FORMAT_6LORH_MASK) == ELECTIVE_6LoRH &&
+            ipv6_outer_header->hopByhop_option[rpi_length+1] == IPECAP_6LOTH_TYPE
+        ) {
+            *hopLimit = &ipv6_outer_header->hopByhop_option[rpi_length+2];
+        }
+        
         flags = rpl_option->flags;
         senderRank = rpl_option->senderRank;
         if ((flags & O_FLAG)!=O_FLAG){
@@ -716,23 +744,25 @@ owerror_t forwarding_send_internal_SourceRouting(
             );
         }
         forwarding_createRplOption(rpl_option, rpl_option->flags);
-        // toss the IP in IP 6LoRH
-        packetfunctions_tossHeader(msg, ipv6_outer_header->header_length);
-    } else {
-        RH3_length = 0;
+        iphc_rewriteIPv6HopByHopHeader(msg,rpi_offset,rpi_length,rpl_option);
     }
     
-    // send to next lower layer
-    return iphc_sendFromForwarding(
-        msg,
-        ipv6_outer_header,
-        ipv6_inner_header,
-        rpl_option,
-        &ipv6_outer_header->flow_label,
-        &RH_copy[0],
-        RH_length,
-        PCKTFORWARD
-    );
+    return E_SUCCESS;
+}
+
+/**
+\brief Remove bytes from the headers of a packet, in place.
+
+The headers before the removed bytes slide forward to fill the gap, the ones
+after do not move.
+
+\param[in,out] msg    The packet.
+\param[in]     offset Offset of the bytes to remove, from msg->payload.
+\param[in]     len    Number of bytes to remove.
+*/
+void forwarding_compactHeader(OpenQueueEntry_t* msg, uint8_t offset, uint8_t len) {
+    memmove(msg->payload+len,msg->payload,offset);
+    packetfunctions_tossHeader(msg,len);
 }
 
 
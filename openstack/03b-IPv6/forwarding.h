@@ -19,6 +19,13 @@ enum {
    PCKTSEND        = 2, // used by the node to indicate is sending a packet
 };
 
+// how forwarding_getNextHop() found the next hop
+enum {
+   ROUTE_DIRECT    = 0, // broadcast, or 1-hop neighbor
+   ROUTE_DOWN      = 1, // storing-mode routing table, towards my sub-DODAG
+   ROUTE_UP        = 2, // default route, through one of my parents
+};
+
 enum {
    O_FLAG          = 0x10,
    R_FLAG          = 0x08,
@@ -60,6 +67,14 @@ void      forwarding_receive(
    ipv6_header_iht*     ipv6_inner_header,
    rpl_option_ht*       rpl_option
 );
+// also called by the 03oos_sourcerouting benchmark
+owerror_t forwarding_consumeSourceRoute(
+   OpenQueueEntry_t*    msg,
+   ipv6_header_iht*     ipv6_outer_header,
+   ipv6_header_iht*     ipv6_inner_header,
+   rpl_option_ht*       rpl_option,
+   uint8_t**            hopLimit
+);
 
 /**
 \}
@@ -25,6 +25,9 @@ void sendDIO(void);
 void icmpv6rpl_timer_DAO_cb(opentimer_id_t id);
 void icmpv6rpl_timer_DAO_task(void);
 void sendDAO(void);
+#ifdef RPL_STORING_MODE
+void ageRoutes(void);
+#endif
 
 //=========================== public ==========================================
 
@@ -74,8 +77,9 @@ void icmpv6rpl_init() {
    
    icmpv6rpl_vars.dioPeriod                 = TIMER_DIO_TIMEOUT;
    dioPeriod                                = icmpv6rpl_vars.dioPeriod - 0x80 + (openrandom_get16b()&0xff);
-   icmpv6rpl_vars.timerIdDIO                = opentimers_start(
+   icmpv6rpl_vars.timerIdDIO                = opentimers_startWithSlack(
                                                 dioPeriod,
+                                                TIMER_DIO_SLACK,
                                                 TIMER_PERIODIC,
                                                 TIME_MS,
                                                 icmpv6rpl_timer_DIO_cb
@@ -122,8 +126,9 @@ void icmpv6rpl_init() {
    
    icmpv6rpl_vars.daoPeriod                 = TIMER_DAO_TIMEOUT;
    daoPeriod                                = icmpv6rpl_vars.daoPeriod - 0x80 + (openrandom_get16b()&0xff);
-   icmpv6rpl_vars.timerIdDAO                = opentimers_start(
+   icmpv6rpl_vars.timerIdDAO                = opentimers_startWithSlack(
                                                 daoPeriod,
+                                                TIMER_DAO_SLACK,
                                                 TIMER_PERIODIC,
                                                 TIME_MS,
                                                 icmpv6rpl_timer_DAO_cb
@@ -253,6 +258,74 @@ void icmpv6rpl_receive(OpenQueueEntry_t* msg) {
    openqueue_freePacketBuffer(msg);
 }
 
+#ifdef RPL_STORING_MODE
+/**
+\brief Learn a downward route from a DAO this mote relays towards the root.
+
+The DAO of a mote of my sub-DODAG reaches me from the child which is on the
+way to that mote, so that child is the next hop to reach it.
+
+\param[in] source128b     The IPv6 address of the mote which sent the DAO.
+\param[in] previousHop64b The EUI64 of the neighbor I received the DAO from.
+*/
+void icmpv6rpl_indicateRelayedDAO(open_addr_t* source128b, open_addr_t* previousHop64b) {
+   uint8_t i;
+   uint8_t routeIdx;
+   
+   // only motes of my DODAG are routed, by their IID
+   if (memcmp(&(source128b->addr_128b[0]),idmanager_getMyID(ADDR_PREFIX)->prefix,8)!=0) {
+      return;
+   }
+   
+   // refresh the route to that mote, or take a free entry, or the oldest one
+   routeIdx = 0;
+   for (i=0;i<MAXNUMROUTES;i++) {
+      if (
+            icmpv6rpl_vars.routes[i].lifetime>0 &&
+            memcmp(icmpv6rpl_vars.routes[i].targetIID,&(source128b->addr_128b[8]),8)==0
+         ) {
+         routeIdx = i;
+         break;
+      }
+      if (icmpv6rpl_vars.routes[i].lifetime<icmpv6rpl_vars.routes[routeIdx].lifetime) {
+         routeIdx = i;
+      }
+   }
+   
+   memcpy(icmpv6rpl_vars.routes[routeIdx].targetIID,&(source128b->addr_128b[8]),8);
+   memcpy(icmpv6rpl_vars.routes[routeIdx].nextHop,previousHop64b->addr_64b,8);
+   icmpv6rpl_vars.routes[routeIdx].lifetime = ROUTE_LIFETIME;
+}
+
+/**
+\brief Look up the routing table for a destination in my sub-DODAG.
+
+\param[in]  destination128b The IPv6 destination address.
+\param[out] nextHop64b      Where to write the EUI64 of the next hop to.
+
+\returns TRUE if a route was found, FALSE otherwise.
+*/
+bool icmpv6rpl_getRouteNextHop(open_addr_t* destination128b, open_addr_t* nextHop64b) {
+   uint8_t i;
+   
+   if (memcmp(&(destination128b->addr_128b[0]),idmanager_getMyID(ADDR_PREFIX)->prefix,8)!=0) {
+      return FALSE;
+   }
+   
+   for (i=0;i<MAXNUMROUTES;i++) {
+      if (
+            icmpv6rpl_vars.routes[i].lifetime>0 &&
+            memcmp(icmpv6rpl_vars.routes[i].targetIID,&(destination128b->addr_128b[8]),8)==0
+         ) {
+         nextHop64b->type = ADDR_64B;
+         memcpy(nextHop64b->addr_64b,icmpv6rpl_vars.routes[i].nextHop,8);
+         return TRUE;
+      }
+   }
+   return FALSE;
+}
+#endif
+
 //=========================== private =========================================
 
 //===== DIO-related
@@ -394,6 +467,11 @@ void icmpv6rpl_timer_DAO_task() {
    // send DAO
    sendDAO();
    
+#ifdef RPL_STORING_MODE
+   // age the routing table
+   ageRoutes();
+#endif
+   
    // arm the DAO timer with this new value
    daoPeriod = icmpv6rpl_vars.daoPeriod - 0x80 + (openrandom_get16b()&0xff);
    opentimers_setPeriod(
@@ -411,6 +489,7 @@ void sendDAO() {
    uint8_t              nbrIdx;             // running neighbor index
    uint8_t              numTransitParents,numTargetParents;  // the number of parents indicated in transit option
    open_addr_t         address;
+   open_addr_t         prefParent;
    open_addr_t*        prefix;
    
    if (ieee154e_isSynch()==FALSE) {
@@ -466,31 +545,39 @@ void sendDAO() {
    
    //===== fill in packet
    
-   //NOTE: limit to preferrred parent only the number of DAO transit addresses to send
-   
    //=== transit option -- from RFC 6550, page 55 - 1 transit information header per parent is required. 
-   //getting only preferred parent as transit
+   //one transit per parent of my parent set, the preferred parent is the most preferred path
    numTransitParents=0;
-   neighbors_getPreferredParentEui64(&address);
-   packetfunctions_writeAddress(msg,&address,OW_BIG_ENDIAN);
-   prefix=idmanager_getMyID(ADDR_PREFIX);
-   packetfunctions_writeAddress(msg,prefix,OW_BIG_ENDIAN);
-   // update transit info fields
-   // from rfc6550 p.55 -- Variable, depending on whether or not the DODAG ParentAddress subfield is present.
-   // poipoi xv: it is not very clear if this includes all fields in the header. or as target info 2 bytes are removed.
-   // using the same pattern as in target information.
-   icmpv6rpl_vars.dao_transit.optionLength  = LENGTH_ADDR128b + sizeof(icmpv6rpl_dao_transit_ht)-2;
-   icmpv6rpl_vars.dao_transit.PathControl=0; //todo. this is to set the preference of this parent.      
-   icmpv6rpl_vars.dao_transit.type=OPTION_TRANSIT_INFORMATION_TYPE;
-           
-   // write transit info in packet
-   packetfunctions_reserveHeaderSize(msg,sizeof(icmpv6rpl_dao_transit_ht));
-   memcpy(
-          ((icmpv6rpl_dao_transit_ht*)(msg->payload)),
-          &(icmpv6rpl_vars.dao_transit),
-          sizeof(icmpv6rpl_dao_transit_ht)
-   );
-   numTransitParents++;
+   neighbors_getPreferredParentEui64(&prefParent); // also promotes one if needed
+   for (nbrIdx=0;nbrIdx<MAXNUMNEIGHBORS;nbrIdx++) {
+      if (neighbors_isParent(nbrIdx)==FALSE) {
+         continue;
+      }
+      neighbors_getNeighbor(&address,ADDR_64B,nbrIdx);
+      packetfunctions_writeAddress(msg,&address,OW_BIG_ENDIAN);
+      prefix=idmanager_getMyID(ADDR_PREFIX);
+      packetfunctions_writeAddress(msg,prefix,OW_BIG_ENDIAN);
+      // update transit info fields
+      // from rfc6550 p.55 -- Variable, depending on whether or not the DODAG ParentAddress subfield is present.
+      // poipoi xv: it is not very clear if this includes all fields in the header. or as target info 2 bytes are removed.
+      // using the same pattern as in target information.
+      icmpv6rpl_vars.dao_transit.optionLength  = LENGTH_ADDR128b + sizeof(icmpv6rpl_dao_transit_ht)-2;
+      if (packetfunctions_sameAddress(&address,&prefParent)==TRUE) {
+         icmpv6rpl_vars.dao_transit.PathControl = PC_PREFPARENT_DAO_Transit_Info;
+      } else {
+         icmpv6rpl_vars.dao_transit.PathControl = PC_BACKUPPARENT_DAO_Transit_Info;
+      }
+      icmpv6rpl_vars.dao_transit.type=OPTION_TRANSIT_INFORMATION_TYPE;
+      
+      // write transit info in packet
+      packetfunctions_reserveHeaderSize(msg,sizeof(icmpv6rpl_dao_transit_ht));
+      memcpy(
+             ((icmpv6rpl_dao_transit_ht*)(msg->payload)),
+             &(icmpv6rpl_vars.dao_transit),
+             sizeof(icmpv6rpl_dao_transit_ht)
+      );
+      numTransitParents++;
+   }
    
    //target information is required. RFC 6550 page 55.
    /*
@@ -566,6 +653,25 @@ void sendDAO() {
    }
 }
 
+#ifdef RPL_STORING_MODE
+//===== routing table
+
+/**
+\brief Expire the routes to the motes whose DAOs I stopped relaying.
+
+Called once per DAO period.
+*/
+void ageRoutes() {
+   uint8_t i;
+   
+   for (i=0;i<MAXNUMROUTES;i++) {
+      if (icmpv6rpl_vars.routes[i].lifetime>0) {
+         icmpv6rpl_vars.routes[i].lifetime--;
+      }
+   }
+}
+#endif
+
 void icmpv6rpl_setDIOPeriod(uint16_t dioPeriod){
    uint32_t        dioPeriodRandom;
    
@@ -14,6 +14,15 @@
 
 #define TIMER_DIO_TIMEOUT         10000
 #define TIMER_DAO_TIMEOUT         60000
+// how late the DIO/DAO timers may fire, to share wakeups with other timers
+#define TIMER_DIO_SLACK           1000
+#define TIMER_DAO_SLACK           6000
+
+// storing-mode routing table, see RPL_STORING_MODE
+#ifndef MAXNUMROUTES
+#define MAXNUMROUTES              16
+#endif
+#define ROUTE_LIFETIME            3    // in DAO periods, without hearing the target's DAO
 
 // Non-Storing Mode of Operation (1)
 #define MOP_DIO_A                 0<<5
@@ -49,6 +58,10 @@
 #define PC4_A_DAO_Transit_Info    0<<1
 #define PC4_B_DAO_Transit_Info    0<<0
 
+// path control of the transit option of the preferred parent (PC1), and of the backup parents (PC2)
+#define PC_PREFPARENT_DAO_Transit_Info    (1<<7|1<<6)
+#define PC_BACKUPPARENT_DAO_Transit_Info  (1<<5|1<<4)
+
 #define Prf_A_dio_options         0<<4
 #define Prf_B_dio_options         0<<3
 
@@ -134,6 +147,15 @@ typedef struct {
 } icmpv6rpl_dao_target_ht;
 END_PACK
 
+/**
+\brief Downward route, learnt from the DAO of the target.
+*/
+typedef struct {
+   uint8_t         targetIID[8];       ///< IID of the destination, its prefix is mine.
+   uint8_t         nextHop[8];         ///< EUI64 of the child the DAO came from.
+   uint8_t         lifetime;           ///< remaining DAO periods, 0 if the entry is free.
+} icmpv6rpl_route_t;
+
 //=========================== module variables ================================
 
 typedef struct {
@@ -153,6 +175,10 @@ typedef struct {
    opentimer_id_t            timerIdDAO;              ///< ID of the timer used to send DAOs.
    uint32_t                  daoPeriod;               ///< duration, in ms, of a timerIdDAO timeout.
    uint8_t                   delayDAO;                ///< number of timerIdDIO events before actually sending a DAO.
+#ifdef RPL_STORING_MODE
+   // routing table
+   icmpv6rpl_route_t         routes[MAXNUMROUTES];    ///< routes to the motes of my sub-DODAG.
+#endif
 } icmpv6rpl_vars_t;
 
 //=========================== prototypes ======================================
@@ -165,6 +191,10 @@ uint8_t  icmpv6rpl_getRPLIntanceID(void);
 void     icmpv6rpl_getRPLDODAGid(uint8_t* address_128b);
 void     icmpv6rpl_setDIOPeriod(uint16_t dioPeriod);
 void     icmpv6rpl_setDAOPeriod(uint16_t daoPeriod);
+#ifdef RPL_STORING_MODE
+void     icmpv6rpl_indicateRelayedDAO(open_addr_t* source128b, open_addr_t* previousHop64b);
+bool     icmpv6rpl_getRouteNextHop(open_addr_t* destination128b, open_addr_t* nextHop64b);
+#endif
 /**
 \}
 \}
@@ -83,7 +83,7 @@ owerror_t opentcp_send(OpenQueueEntry_t* msg) {             //[command] data
    msg->l4_protocol          = IANA_TCP;
    msg->l4_sourcePortORicmpv6Type       = tcp_vars.myPort;
    msg->l4_destination_port  = tcp_vars.hisPort;
-   msg->l4_payload           = msg->payload;
+   msg->l4_payload           = (uint8_t)(msg->payload-msg->packet);
    msg->l4_length            = msg->length;
    memcpy(&(msg->l3_destinationAdd),&tcp_vars.hisIPv6Address,sizeof(open_addr_t));
    tcp_vars.dataToSend = msg;
@@ -208,7 +208,7 @@ void opentcp_receive(OpenQueueEntry_t* msg) {
    bool shouldIlisten;
    msg->owner                     = COMPONENT_OPENTCP;
    msg->l4_protocol               = IANA_TCP;
-   msg->l4_payload                = msg->payload;
+   msg->l4_payload                = (uint8_t)(msg->payload-msg->packet);
    msg->l4_length                 = msg->length;
    msg->l4_sourcePortORicmpv6Type = packetfunctions_ntohs((uint8_t*)&(((tcp_ht*)msg->payload)->source_port));
    msg->l4_destination_port       = packetfunctions_ntohs((uint8_t*)&(((tcp_ht*)msg->payload)->destination_port));
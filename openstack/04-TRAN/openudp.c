@@ -22,7 +22,7 @@ void openudp_init() {
 owerror_t openudp_send(OpenQueueEntry_t* msg) {
    msg->owner       = COMPONENT_OPENUDP;
    msg->l4_protocol = IANA_UDP;
-   msg->l4_payload  = msg->payload;
+   msg->l4_payload  = (uint8_t)(msg->payload-msg->packet);
    msg->l4_length   = msg->length;
    packetfunctions_reserveHeaderSize(msg,sizeof(udp_ht));
    packetfunctions_htons(msg->l4_sourcePortORicmpv6Type,&(msg->payload[0]));
@@ -105,7 +105,7 @@ void openudp_receive(OpenQueueEntry_t* msg) {
          opencoap_receive(msg);
          break;
       case WKP_UDP_RINGMASTER:
-         if (msg->l4_payload[0] > 90) {
+         if (msg->packet[msg->l4_payload] > 90) {
             rrt_sendCoAPMsg('B', NULL);
          }
 
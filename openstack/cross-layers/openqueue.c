@@ -9,9 +9,33 @@
 
 openqueue_vars_t openqueue_vars;
 
+// full-size buffers reserved for, and held at most by, each traffic class
+static const uint8_t openqueue_classReserved[OPENQUEUE_CLASS_MAX] = {
+   OPENQUEUE_RESERVED_CONTROL,
+   OPENQUEUE_RESERVED_SIXTOP,
+   0,
+   OPENQUEUE_RESERVED_LOCAL,
+};
+static const uint8_t openqueue_classMax[OPENQUEUE_CLASS_MAX] = {
+   OPENQUEUE_NUM_FULL,
+   OPENQUEUE_NUM_FULL,
+   OPENQUEUE_MAX_FORWARDED,
+   OPENQUEUE_NUM_FULL,
+};
+
 //=========================== prototypes ======================================
 
 void openqueue_reset_entry(OpenQueueEntry_t* entry);
+OpenQueueEntry_t* openqueue_allocate(uint8_t creator, bool full);
+void openqueue_compact(OpenQueueEntry_t* entry);
+uint8_t openqueue_rebase(uint8_t position, uint8_t first, uint8_t shift);
+uint8_t openqueue_classOf(uint8_t creator);
+bool openqueue_classAdmits(uint8_t cls, OpenQueueEntry_t* except);
+bool openqueue_updateIndex(uint8_t i);
+OpenQueueEntry_t* openqueue_listHead(uint8_t listId);
+void openqueue_linkInsert(openqueue_list_t* list, openqueue_link_t* links, uint8_t i, bool atHead);
+void openqueue_linkRemove(openqueue_list_t* list, openqueue_link_t* links, uint8_t i);
+uint8_t openqueue_neighborBucket(open_addr_t* neighbor);
 
 //=========================== public ==========================================
 
@@ -22,9 +46,27 @@ void openqueue_reset_entry(OpenQueueEntry_t* entry);
 */
 void openqueue_init() {
    uint8_t i;
+   
+   // all lists are empty
+   memset(&openqueue_vars.list[0],OPENQUEUE_NONE,sizeof(openqueue_vars.list));
+   memset(&openqueue_vars.bucket[0],OPENQUEUE_NONE,sizeof(openqueue_vars.bucket));
+   // all frame buffers are free
+   memset(&openqueue_vars.fullBufInUse[0],FALSE,sizeof(openqueue_vars.fullBufInUse));
+   memset(&openqueue_vars.smallBufInUse[0],FALSE,sizeof(openqueue_vars.smallBufInUse));
    for (i=0;i<QUEUELENGTH;i++){
+      openqueue_vars.listId[i]   = OPENQUEUE_LIST_NONE;
+      openqueue_vars.bucketId[i] = OPENQUEUE_NONE;
+      openqueue_vars.queue[i].owner  = COMPONENT_NULL;
+      openqueue_vars.queue[i].packet = NULL;
       openqueue_reset_entry(&(openqueue_vars.queue[i]));
    }
+   openqueue_vars.numFullInUse     = 0;
+   openqueue_vars.numSmallInUse    = 0;
+   openqueue_vars.maxFullInUse     = 0;
+   openqueue_vars.maxSmallInUse    = 0;
+   openqueue_vars.numSmallFallback = 0;
+   openqueue_vars.numCompacted     = 0;
+   memset(&openqueue_vars.numDropped[0],0,sizeof(openqueue_vars.numDropped));
 }
 
 /**
@@ -46,6 +88,44 @@ bool debugPrint_queue() {
    return TRUE;
 }
 
+/**
+\brief Trigger this module to print its memory usage, over serial.
+
+\returns TRUE if this function printed something, FALSE otherwise.
+*/
+bool debugPrint_queueMemory() {
+   debugOpenQueueMemory_t output;
+   
+   output.entrySize        = sizeof(OpenQueueEntry_t);
+   output.totalSize        = sizeof(openqueue_vars_t);
+   output.numFull          = OPENQUEUE_NUM_FULL;
+   output.numSmall         = OPENQUEUE_NUM_SMALL;
+   output.fullSize         = LENGTH_PACKET_BUFFER;
+   output.smallSize        = OPENQUEUE_SMALL_PACKET_SIZE;
+   output.numFullInUse     = openqueue_vars.numFullInUse;
+   output.numSmallInUse    = openqueue_vars.numSmallInUse;
+   output.maxFullInUse     = openqueue_vars.maxFullInUse;
+   output.maxSmallInUse    = openqueue_vars.maxSmallInUse;
+   output.numSmallFallback = openqueue_vars.numSmallFallback;
+   output.numCompacted     = openqueue_vars.numCompacted;
+   openserial_printStatus(STATUS_QUEUEMEM,(uint8_t*)&output,sizeof(debugOpenQueueMemory_t));
+   return TRUE;
+}
+
+/**
+\brief Trigger this module to print the number of packets dropped per traffic
+   class, over serial.
+
+\returns TRUE if this function printed something, FALSE otherwise.
+*/
+bool debugPrint_queueDrops() {
+   uint16_t output[OPENQUEUE_CLASS_MAX];
+   
+   memcpy(&output[0],&openqueue_vars.numDropped[0],sizeof(output));
+   openserial_printStatus(STATUS_QUEUEDROPS,(uint8_t*)&output,sizeof(output));
+   return TRUE;
+}
+
 //======= called by any component
 
 /**
@@ -61,29 +141,37 @@ get a new packet buffer to start creating a new packet.
          it could not be allocated (buffer full or not synchronized).
 */
 OpenQueueEntry_t* openqueue_getFreePacketBuffer(uint8_t creator) {
-   uint8_t i;
+   OpenQueueEntry_t* pkt;
    INTERRUPT_DECLARATION();
    DISABLE_INTERRUPTS();
-   
-   // refuse to allocate if we're not in sync
-   if (ieee154e_isSynch()==FALSE && creator > COMPONENT_IEEE802154E){
-     ENABLE_INTERRUPTS();
-     return NULL;
-   }
-   
-   // if you get here, I will try to allocate a buffer for you
-   
-   // walk through queue and find free entry
-   for (i=0;i<QUEUELENGTH;i++) {
-      if (openqueue_vars.queue[i].owner==COMPONENT_NULL) {
-         openqueue_vars.queue[i].creator=creator;
-         openqueue_vars.queue[i].owner=COMPONENT_OPENQUEUE;
-         ENABLE_INTERRUPTS(); 
-         return &openqueue_vars.queue[i];
+   pkt = openqueue_allocate(creator,TRUE);
+   ENABLE_INTERRUPTS();
+   return pkt;
+}
+
+/**
+\brief Request a new (free) packet buffer, for a short frame.
+
+Same as openqueue_getFreePacketBuffer(), for frames (ACKs, KAs) which fit in
+OPENQUEUE_SMALL_PACKET_SIZE bytes, header, footer and security included. A
+full-size buffer is returned if no small one is available.
+
+\returns A pointer to the queue entry when it could be allocated, or NULL when
+         it could not be allocated (buffer full or not synchronized).
+*/
+OpenQueueEntry_t* openqueue_getFreeSmallPacketBuffer(uint8_t creator) {
+   OpenQueueEntry_t* pkt;
+   INTERRUPT_DECLARATION();
+   DISABLE_INTERRUPTS();
+   pkt = openqueue_allocate(creator,FALSE);
+   if (pkt==NULL) {
+      pkt = openqueue_allocate(creator,TRUE);
+      if (pkt!=NULL && openqueue_vars.numSmallFallback<0xff) {
+         openqueue_vars.numSmallFallback++;
       }
    }
    ENABLE_INTERRUPTS();
-   return NULL;
+   return pkt;
 }
 
 
@@ -154,100 +242,476 @@ void openqueue_removeAllOwnedBy(uint8_t owner) {
    ENABLE_INTERRUPTS();
 }
 
-//======= called by RES
+/**
+\brief Change the owner of a packet buffer.
 
-OpenQueueEntry_t* openqueue_sixtopGetSentPacket() {
-   uint8_t i;
+Components hand a packet to COMPONENT_SIXTOP_TO_IEEE802154E or
+COMPONENT_IEEE802154E_TO_SIXTOP through this function (rather than by writing
+pkt->owner), so the packet gets indexed for the lookups below.
+
+A frame handed to COMPONENT_SIXTOP_TO_IEEE802154E is moved to a small buffer
+if it fits, freeing its full-size one; pointers into the frame taken before
+this call are then stale, the positions kept in the entry are updated.
+
+\param pkt   The packet buffer.
+\param owner The identifier of the new owner, taken in COMPONENT_*.
+*/
+void openqueue_setOwner(OpenQueueEntry_t* pkt, uint8_t owner) {
    INTERRUPT_DECLARATION();
    DISABLE_INTERRUPTS();
-   for (i=0;i<QUEUELENGTH;i++) {
-      if (openqueue_vars.queue[i].owner==COMPONENT_IEEE802154E_TO_SIXTOP &&
-          openqueue_vars.queue[i].creator!=COMPONENT_IEEE802154E) {
-         ENABLE_INTERRUPTS();
-         return &openqueue_vars.queue[i];
-      }
+   pkt->owner = owner;
+   if (owner==COMPONENT_SIXTOP_TO_IEEE802154E) {
+      openqueue_compact(pkt);
    }
+   openqueue_updateIndex((uint8_t)(pkt-&openqueue_vars.queue[0]));
    ENABLE_INTERRUPTS();
-   return NULL;
 }
 
-OpenQueueEntry_t* openqueue_sixtopGetReceivedPacket() {
+//======= called by forwarding
+
+/**
+\brief Check a packet which is about to be relayed against the share of the
+   queue for relayed packets.
+
+When OPENQUEUE_MAX_FORWARDED relayed packets already hold a full-size buffer,
+either this packet is refused (OPENQUEUE_DROP_TAIL), or the oldest of them which
+was never transmitted is dropped to make room for it (OPENQUEUE_DROP_HEAD).
+
+\param pkt The packet, with creator COMPONENT_FORWARDING.
+
+\returns E_SUCCESS if the packet can be relayed.
+\returns E_FAIL if the packet has to be dropped; the caller frees it.
+*/
+owerror_t openqueue_admitForwarded(OpenQueueEntry_t* pkt) {
+#if OPENQUEUE_FORWARDED_DROP==OPENQUEUE_DROP_HEAD
    uint8_t i;
+   uint8_t next;
+#endif
    INTERRUPT_DECLARATION();
    DISABLE_INTERRUPTS();
-   for (i=0;i<QUEUELENGTH;i++) {
-      if (openqueue_vars.queue[i].owner==COMPONENT_IEEE802154E_TO_SIXTOP &&
-          openqueue_vars.queue[i].creator==COMPONENT_IEEE802154E) {
+   
+   if (openqueue_classAdmits(OPENQUEUE_CLASS_FORWARDED,pkt)==TRUE) {
+      ENABLE_INTERRUPTS();
+      return E_SUCCESS;
+   }
+   
+   // one relayed packet is dropped either way
+   if (openqueue_vars.numDropped[OPENQUEUE_CLASS_FORWARDED]<0xffff) {
+      openqueue_vars.numDropped[OPENQUEUE_CLASS_FORWARDED]++;
+   }
+   
+#if OPENQUEUE_FORWARDED_DROP==OPENQUEUE_DROP_HEAD
+   // the TX list is in the order packets were handed to the MAC
+   i = openqueue_vars.list[OPENQUEUE_LIST_TX].head;
+   while (i!=OPENQUEUE_NONE) {
+      next = openqueue_vars.listLink[i].next;
+      if (
+            openqueue_updateIndex(i)==FALSE                                &&
+            openqueue_vars.queue[i].creator==COMPONENT_FORWARDING          &&
+            openqueue_vars.queue[i].packetSize==LENGTH_PACKET_BUFFER       &&
+            openqueue_vars.queue[i].l2_numTxAttempts==0
+         ) {
+         openqueue_reset_entry(&(openqueue_vars.queue[i]));
          ENABLE_INTERRUPTS();
-         return &openqueue_vars.queue[i];
+         return E_SUCCESS;
       }
+      i = next;
    }
+#endif
+   
    ENABLE_INTERRUPTS();
-   return NULL;
+   return E_FAIL;
+}
+
+//======= called by RES
+
+OpenQueueEntry_t* openqueue_sixtopGetSentPacket() {
+   OpenQueueEntry_t* pkt;
+   INTERRUPT_DECLARATION();
+   DISABLE_INTERRUPTS();
+   pkt = openqueue_listHead(OPENQUEUE_LIST_SENT);
+   ENABLE_INTERRUPTS();
+   return pkt;
+}
+
+OpenQueueEntry_t* openqueue_sixtopGetReceivedPacket() {
+   OpenQueueEntry_t* pkt;
+   INTERRUPT_DECLARATION();
+   DISABLE_INTERRUPTS();
+   pkt = openqueue_listHead(OPENQUEUE_LIST_RECEIVED);
+   ENABLE_INTERRUPTS();
+   return pkt;
 }
 
 //======= called by IEEE80215E
 
 OpenQueueEntry_t* openqueue_macGetDataPacket(open_addr_t* toNeighbor) {
-   uint8_t i;
+   OpenQueueEntry_t* pkt;
+   uint8_t           i;
+   uint8_t           next;
    INTERRUPT_DECLARATION();
    DISABLE_INTERRUPTS();
+   pkt = NULL;
    if (toNeighbor->type==ADDR_64B) {
-      // a neighbor is specified, look for a packet unicast to that neigbhbor
-      for (i=0;i<QUEUELENGTH;i++) {
-         if (openqueue_vars.queue[i].owner==COMPONENT_SIXTOP_TO_IEEE802154E &&
-            packetfunctions_sameAddress(toNeighbor,&openqueue_vars.queue[i].l2_nextORpreviousHop)) {
-            ENABLE_INTERRUPTS();
-            return &openqueue_vars.queue[i];
+      // a neighbor is specified, look for the oldest packet unicast to that
+      // neighbor, in its bucket only
+      i = openqueue_vars.bucket[openqueue_neighborBucket(toNeighbor)].head;
+      while (i!=OPENQUEUE_NONE) {
+         next = openqueue_vars.bucketLink[i].next;
+         if (
+               openqueue_updateIndex(i)==FALSE &&
+               packetfunctions_sameAddress(toNeighbor,&openqueue_vars.queue[i].l2_nextORpreviousHop)
+            ) {
+            pkt = &openqueue_vars.queue[i];
+            break;
          }
+         i = next;
       }
    } else if (toNeighbor->type==ADDR_ANYCAST) {
-      // anycast case: look for a packet which is either not created by RES
+      // anycast case: the oldest packet which is either not created by RES
       // or an KA (created by RES, but not broadcast)
-      for (i=0;i<QUEUELENGTH;i++) {
-         if (openqueue_vars.queue[i].owner==COMPONENT_SIXTOP_TO_IEEE802154E &&
-             ( openqueue_vars.queue[i].creator!=COMPONENT_SIXTOP ||
-                (
-                   openqueue_vars.queue[i].creator==COMPONENT_SIXTOP &&
-                   packetfunctions_isBroadcastMulticast(&(openqueue_vars.queue[i].l2_nextORpreviousHop))==FALSE
-                )
-             )
+      pkt = openqueue_listHead(OPENQUEUE_LIST_TX);
+   }
+   ENABLE_INTERRUPTS();
+   return pkt;
+}
+
+/**
+\brief Tell whether another data packet is waiting for the same neighbor.
+
+Used by IEEE802154E to decide whether to set the frame pending bit of the
+frame it is about to transmit (pkt), i.e. whether the next slot should be used
+to continue the burst to that neighbor.
+
+\param[in] pkt The packet being transmitted.
+
+\returns TRUE if another unicast packet to the same neighbor is queued.
+*/
+bool openqueue_macIsDataPending(OpenQueueEntry_t* pkt) {
+   bool              returnVal;
+   uint8_t           i;
+   uint8_t           next;
+   INTERRUPT_DECLARATION();
+   DISABLE_INTERRUPTS();
+   returnVal = FALSE;
+   if (pkt->l2_nextORpreviousHop.type==ADDR_64B) {
+      i = openqueue_vars.bucket[openqueue_neighborBucket(&pkt->l2_nextORpreviousHop)].head;
+      while (i!=OPENQUEUE_NONE) {
+         next = openqueue_vars.bucketLink[i].next;
+         if (
+               &openqueue_vars.queue[i]!=pkt   &&
+               openqueue_updateIndex(i)==FALSE &&
+               packetfunctions_sameAddress(&pkt->l2_nextORpreviousHop,&openqueue_vars.queue[i].l2_nextORpreviousHop)
             ) {
-            ENABLE_INTERRUPTS();
-            return &openqueue_vars.queue[i];
+            returnVal = TRUE;
+            break;
          }
+         i = next;
       }
    }
    ENABLE_INTERRUPTS();
-   return NULL;
+   return returnVal;
 }
 
 OpenQueueEntry_t* openqueue_macGetEBPacket() {
-   uint8_t i;
+   OpenQueueEntry_t* pkt;
    INTERRUPT_DECLARATION();
    DISABLE_INTERRUPTS();
-   for (i=0;i<QUEUELENGTH;i++) {
-      if (openqueue_vars.queue[i].owner==COMPONENT_SIXTOP_TO_IEEE802154E &&
-          openqueue_vars.queue[i].creator==COMPONENT_SIXTOP              &&
-          packetfunctions_isBroadcastMulticast(&(openqueue_vars.queue[i].l2_nextORpreviousHop))) {
-         ENABLE_INTERRUPTS();
-         return &openqueue_vars.queue[i];
+   pkt = openqueue_listHead(OPENQUEUE_LIST_EB);
+   ENABLE_INTERRUPTS();
+   return pkt;
+}
+
+//======= called by neighbors
+
+/**
+\brief Count the unicast packets waiting to be sent to a neighbor.
+
+Used to balance upstream traffic over the parent set.
+
+\param[in] toNeighbor The EUI64 of the neighbor.
+
+\returns The number of unicast packets queued for that neighbor.
+*/
+uint8_t openqueue_getNumDataPackets(open_addr_t* toNeighbor) {
+   uint8_t           returnVal;
+   uint8_t           i;
+   uint8_t           next;
+   INTERRUPT_DECLARATION();
+   DISABLE_INTERRUPTS();
+   returnVal = 0;
+   i = openqueue_vars.bucket[openqueue_neighborBucket(toNeighbor)].head;
+   while (i!=OPENQUEUE_NONE) {
+      next = openqueue_vars.bucketLink[i].next;
+      if (
+            openqueue_updateIndex(i)==FALSE &&
+            packetfunctions_sameAddress(toNeighbor,&openqueue_vars.queue[i].l2_nextORpreviousHop)
+         ) {
+         returnVal++;
       }
+      i = next;
    }
    ENABLE_INTERRUPTS();
-   return NULL;
+   return returnVal;
 }
 
 //=========================== private =========================================
 
+/**
+\brief Take a free entry and lend it a free frame buffer.
+
+\note Called with interrupts disabled.
+
+\param creator The identifier of the component, taken in COMPONENT_*.
+\param full    TRUE for a full-size buffer, FALSE for a small one.
+
+Full-size buffers are only given within the quotas of the creator's traffic
+class; refusals are counted as drops of that class.
+
+\returns A pointer to the entry, or NULL if no buffer is free (or not
+   synchronized).
+*/
+OpenQueueEntry_t* openqueue_allocate(uint8_t creator, bool full) {
+   OpenQueueEntry_t* entry;
+   uint8_t           i;
+   uint8_t           cls;
+   
+   // refuse to allocate if we're not in sync
+   if (ieee154e_isSynch()==FALSE && creator > COMPONENT_IEEE802154E){
+     return NULL;
+   }
+   
+   // refuse to allocate beyond the quotas of this traffic class
+   if (full==TRUE) {
+      cls = openqueue_classOf(creator);
+      if (openqueue_classAdmits(cls,NULL)==FALSE) {
+         if (openqueue_vars.numDropped[cls]<0xffff) {
+            openqueue_vars.numDropped[cls]++;
+         }
+         return NULL;
+      }
+   }
+   
+   // if you get here, I will try to allocate a buffer for you
+   
+   // there is one entry per buffer, so a free entry is left if a buffer is
+   entry = NULL;
+   for (i=0;i<QUEUELENGTH;i++) {
+      if (openqueue_vars.queue[i].owner==COMPONENT_NULL) {
+         entry = &openqueue_vars.queue[i];
+         break;
+      }
+   }
+   if (entry==NULL) {
+      return NULL;
+   }
+   
+   // walk through the buffers and find a free one
+   if (full==TRUE) {
+      for (i=0;i<OPENQUEUE_NUM_FULL;i++) {
+         if (openqueue_vars.fullBufInUse[i]==FALSE) {
+            openqueue_vars.fullBufInUse[i] = TRUE;
+            entry->packet                  = &(openqueue_vars.fullBuf[i][0]);
+            entry->packetSize              = LENGTH_PACKET_BUFFER;
+            // maintain memory usage stats
+            openqueue_vars.numFullInUse++;
+            if (openqueue_vars.numFullInUse>openqueue_vars.maxFullInUse) {
+               openqueue_vars.maxFullInUse = openqueue_vars.numFullInUse;
+            }
+            break;
+         }
+      }
+   } else {
+      for (i=0;i<OPENQUEUE_NUM_SMALL;i++) {
+         if (openqueue_vars.smallBufInUse[i]==FALSE) {
+            openqueue_vars.smallBufInUse[i] = TRUE;
+            entry->packet                   = &(openqueue_vars.smallBuf[i][0]);
+            entry->packetSize               = OPENQUEUE_SMALL_PACKET_SIZE;
+            // maintain memory usage stats
+            openqueue_vars.numSmallInUse++;
+            if (openqueue_vars.numSmallInUse>openqueue_vars.maxSmallInUse) {
+               openqueue_vars.maxSmallInUse = openqueue_vars.numSmallInUse;
+            }
+            break;
+         }
+      }
+   }
+   if (entry->packet==NULL) {
+      return NULL;
+   }
+   
+   entry->creator = creator;
+   entry->owner   = COMPONENT_OPENQUEUE;
+   entry->payload = &(entry->packet[entry->packetSize-3-IEEE802154_SECURITY_TAG_LEN]); // Footer is longer if security is used
+   return entry;
+}
+
+/**
+\brief Move a frame queued for the MAC from its full-size buffer to a small one.
+
+Nothing is done if the entry already holds a small buffer, if the frame does
+not fit in one with the same footer room, or if no small buffer is free.
+
+\note Called with interrupts disabled.
+
+\param entry The entry.
+*/
+void openqueue_compact(OpenQueueEntry_t* entry) {
+   uint8_t first;
+   uint8_t shift;
+   uint8_t i;
+   
+   first = (uint8_t)(entry->payload-entry->packet);
+   shift = LENGTH_PACKET_BUFFER-OPENQUEUE_SMALL_PACKET_SIZE;
+   if (entry->packetSize!=LENGTH_PACKET_BUFFER || first<shift) {
+      return;
+   }
+   
+   for (i=0;i<OPENQUEUE_NUM_SMALL;i++) {
+      if (openqueue_vars.smallBufInUse[i]==FALSE) {
+         break;
+      }
+   }
+   if (i==OPENQUEUE_NUM_SMALL) {
+      return;
+   }
+   
+   // the frame and its footer room keep their place from the end of the buffer
+   memcpy(&(openqueue_vars.smallBuf[i][first-shift]),entry->payload,LENGTH_PACKET_BUFFER-first);
+   openqueue_vars.smallBufInUse[i] = TRUE;
+   openqueue_vars.fullBufInUse[(entry->packet-&(openqueue_vars.fullBuf[0][0]))/LENGTH_PACKET_BUFFER] = FALSE;
+   entry->packet     = &(openqueue_vars.smallBuf[i][0]);
+   entry->packetSize = OPENQUEUE_SMALL_PACKET_SIZE;
+   entry->payload    = &(entry->packet[first-shift]);
+   
+   // move the positions kept within the frame
+   entry->l4_payload            = openqueue_rebase(entry->l4_payload,first,shift);
+   entry->l2_payload            = openqueue_rebase(entry->l2_payload,first,shift);
+   entry->l2_sixtop_cellObjects = openqueue_rebase(entry->l2_sixtop_cellObjects,first,shift);
+   entry->l2_ASNpayload         = openqueue_rebase(entry->l2_ASNpayload,first,shift);
+   entry->l2_FrameCounter       = openqueue_rebase(entry->l2_FrameCounter,first,shift);
+   
+   // maintain memory usage stats
+   openqueue_vars.numFullInUse--;
+   openqueue_vars.numSmallInUse++;
+   if (openqueue_vars.numSmallInUse>openqueue_vars.maxSmallInUse) {
+      openqueue_vars.maxSmallInUse = openqueue_vars.numSmallInUse;
+   }
+   if (openqueue_vars.numCompacted<0xff) {
+      openqueue_vars.numCompacted++;
+   }
+}
+
+/**
+\brief Position in a small buffer of a position kept in a full-size one.
+
+\param position The position in the full-size buffer, 0 if none.
+\param first    Position of the first byte copied to the small buffer.
+\param shift    Difference between the sizes of the buffers.
+
+\returns The position in the small buffer, 0 if none or if it was before the
+   frame.
+*/
+uint8_t openqueue_rebase(uint8_t position, uint8_t first, uint8_t shift) {
+   if (position<first) {
+      return 0;
+   }
+   return position-shift;
+}
+
+/**
+\brief Traffic class of the packets created by a component.
+
+\param creator The identifier of the component, taken in COMPONENT_*.
+
+\returns The class, taken in OPENQUEUE_CLASS_*.
+*/
+uint8_t openqueue_classOf(uint8_t creator) {
+   switch (creator) {
+      case COMPONENT_RADIO:
+      case COMPONENT_IEEE802154E:
+      case COMPONENT_SIXTOP:
+      case COMPONENT_ICMPv6:
+      case COMPONENT_ICMPv6RPL:
+         return OPENQUEUE_CLASS_CONTROL;
+      case COMPONENT_SIXTOP_RES:
+         return OPENQUEUE_CLASS_SIXTOP;
+      case COMPONENT_FORWARDING:
+         return OPENQUEUE_CLASS_FORWARDED;
+      default:
+         return OPENQUEUE_CLASS_LOCAL;
+   }
+}
+
+/**
+\brief Check whether a traffic class can hold one more full-size buffer.
+
+The class must stay within its maximum, and enough free buffers must remain
+for the reservations the other classes have not used yet.
+
+\note Called with interrupts disabled.
+
+\param cls    The class, taken in OPENQUEUE_CLASS_*.
+\param except An entry already in use which is not counted, or NULL.
+
+\returns TRUE if the class can hold one more buffer, FALSE otherwise.
+*/
+bool openqueue_classAdmits(uint8_t cls, OpenQueueEntry_t* except) {
+   uint8_t numInUse[OPENQUEUE_CLASS_MAX];
+   uint8_t numFree;
+   uint8_t numOwed;
+   uint8_t i;
+   
+   // count the full-size buffers in use, per class
+   memset(&numInUse[0],0,sizeof(numInUse));
+   numFree = OPENQUEUE_NUM_FULL;
+   for (i=0;i<QUEUELENGTH;i++) {
+      if (
+            openqueue_vars.queue[i].owner!=COMPONENT_NULL                &&
+            openqueue_vars.queue[i].packetSize==LENGTH_PACKET_BUFFER     &&
+            &openqueue_vars.queue[i]!=except
+         ) {
+         numFree--;
+         numInUse[openqueue_classOf(openqueue_vars.queue[i].creator)]++;
+      }
+   }
+   
+   if (numInUse[cls]>=openqueue_classMax[cls]) {
+      return FALSE;
+   }
+   
+   // free entries the other classes are still entitled to
+   numOwed = 0;
+   for (i=0;i<OPENQUEUE_CLASS_MAX;i++) {
+      if (i!=cls && numInUse[i]<openqueue_classReserved[i]) {
+         numOwed += openqueue_classReserved[i]-numInUse[i];
+      }
+   }
+   return (numFree>numOwed)?TRUE:FALSE;
+}
+
 void openqueue_reset_entry(OpenQueueEntry_t* entry) {
+   // give the frame buffer back, maintain memory usage stats
+   if (entry->packet!=NULL) {
+      if (entry->packetSize==LENGTH_PACKET_BUFFER) {
+         openqueue_vars.fullBufInUse[(entry->packet-&(openqueue_vars.fullBuf[0][0]))/LENGTH_PACKET_BUFFER] = FALSE;
+         openqueue_vars.numFullInUse--;
+      } else {
+         openqueue_vars.smallBufInUse[(entry->packet-&(openqueue_vars.smallBuf[0][0]))/OPENQUEUE_SMALL_PACKET_SIZE] = FALSE;
+         openqueue_vars.numSmallInUse--;
+      }
+   }
    //admin
    entry->creator                      = COMPONENT_NULL;
    entry->owner                        = COMPONENT_NULL;
-   entry->payload                      = &(entry->packet[127 - IEEE802154_SECURITY_TAG_LEN]); // Footer is longer if security is used
+   openqueue_updateIndex((uint8_t)(entry-&openqueue_vars.queue[0]));
+   entry->packet                       = NULL;
+   entry->packetSize                   = 0;
+   entry->payload                      = NULL;
    entry->length                       = 0;
    //l4
    entry->l4_protocol                  = IANA_UNDEFINED;
+   entry->l4_payload                   = 0;
    //l3
    entry->l3_destinationAdd.type       = ADDR_NONE;
    entry->l3_sourceAdd.type            = ADDR_NONE;
@@ -255,8 +719,145 @@ void openqueue_reset_entry(OpenQueueEntry_t* entry) {
    entry->l2_nextORpreviousHop.type    = ADDR_NONE;
    entry->l2_frameType                 = IEEE154_TYPE_UNDEFINED;
    entry->l2_retriesLeft               = 0;
+   entry->l2_payload                   = 0;
+   entry->l2_sixtop_cellObjects        = 0;
+   entry->l2_ASNpayload                = 0;
    entry->l2_IEListPresent             = 0;
    entry->l2_payloadIEpresent          = 0;
    //l2-security
    entry->l2_securityLevel             = 0;
+   entry->l2_FrameCounter              = 0;
+}
+
+/**
+\brief Move a packet to the list (and bucket) matching its owner and creator.
+
+Writing pkt->owner directly, without calling openqueue_setOwner(), leaves the
+entry in a list it no longer belongs to. The lookups call this function on
+each entry they consider, which evicts such stale entries.
+
+\param i Index of the entry in the queue.
+
+\returns TRUE if the entry was moved, FALSE if its index was up-to-date.
+*/
+bool openqueue_updateIndex(uint8_t i) {
+   OpenQueueEntry_t* entry;
+   uint8_t           listId;
+   uint8_t           bucketId;
+   bool              atHead;
+   
+   entry    = &openqueue_vars.queue[i];
+   listId   = OPENQUEUE_LIST_NONE;
+   bucketId = OPENQUEUE_NONE;
+   
+   // find where the entry belongs
+   switch (entry->owner) {
+      case COMPONENT_SIXTOP_TO_IEEE802154E:
+         if (
+               entry->creator==COMPONENT_SIXTOP &&
+               packetfunctions_isBroadcastMulticast(&(entry->l2_nextORpreviousHop))==TRUE
+            ) {
+            listId   = OPENQUEUE_LIST_EB;
+         } else {
+            listId   = OPENQUEUE_LIST_TX;
+            if (entry->l2_nextORpreviousHop.type==ADDR_64B) {
+               bucketId = openqueue_neighborBucket(&(entry->l2_nextORpreviousHop));
+            }
+         }
+         break;
+      case COMPONENT_IEEE802154E_TO_SIXTOP:
+         if (entry->creator==COMPONENT_IEEE802154E) {
+            listId   = OPENQUEUE_LIST_RECEIVED;
+         } else {
+            listId   = OPENQUEUE_LIST_SENT;
+         }
+         break;
+      default:
+         break;
+   }
+   
+   if (listId==openqueue_vars.listId[i] && bucketId==openqueue_vars.bucketId[i]) {
+      return FALSE;
+   }
+   
+   // unlink from where it is
+   if (openqueue_vars.listId[i]!=OPENQUEUE_LIST_NONE) {
+      openqueue_linkRemove(&openqueue_vars.list[openqueue_vars.listId[i]],&openqueue_vars.listLink[0],i);
+   }
+   if (openqueue_vars.bucketId[i]!=OPENQUEUE_NONE) {
+      openqueue_linkRemove(&openqueue_vars.bucket[openqueue_vars.bucketId[i]],&openqueue_vars.bucketLink[0],i);
+   }
+   
+   // link at the tail of where it belongs, or at the head for a packet the
+   // MAC hands back for a retransmission, so it keeps precedence over the
+   // packets queued after it
+   atHead   = (listId==OPENQUEUE_LIST_TX && entry->l2_numTxAttempts>0);
+   if (listId!=OPENQUEUE_LIST_NONE) {
+      openqueue_linkInsert(&openqueue_vars.list[listId],&openqueue_vars.listLink[0],i,atHead);
+   }
+   if (bucketId!=OPENQUEUE_NONE) {
+      openqueue_linkInsert(&openqueue_vars.bucket[bucketId],&openqueue_vars.bucketLink[0],i,atHead);
+   }
+   openqueue_vars.listId[i]   = listId;
+   openqueue_vars.bucketId[i] = bucketId;
+   
+   return TRUE;
+}
+
+/**
+\brief Oldest entry of a list, after evicting the stale entries at its head.
+
+\param listId The list, taken in OPENQUEUE_LIST_*.
+
+\returns A pointer to the entry, or NULL if the list is empty.
+*/
+OpenQueueEntry_t* openqueue_listHead(uint8_t listId) {
+   uint8_t i;
+   
+   while ((i=openqueue_vars.list[listId].head)!=OPENQUEUE_NONE) {
+      if (openqueue_updateIndex(i)==FALSE) {
+         return &openqueue_vars.queue[i];
+      }
+   }
+   return NULL;
+}
+
+void openqueue_linkInsert(openqueue_list_t* list, openqueue_link_t* links, uint8_t i, bool atHead) {
+   if (atHead==TRUE) {
+      links[i].prev = OPENQUEUE_NONE;
+      links[i].next = list->head;
+      if (list->head==OPENQUEUE_NONE) {
+         list->tail = i;
+      } else {
+         links[list->head].prev = i;
+      }
+      list->head    = i;
+   } else {
+      links[i].prev = list->tail;
+      links[i].next = OPENQUEUE_NONE;
+      if (list->tail==OPENQUEUE_NONE) {
+         list->head = i;
+      } else {
+         links[list->tail].next = i;
+      }
+      list->tail    = i;
+   }
+}
+
+void openqueue_linkRemove(openqueue_list_t* list, openqueue_link_t* links, uint8_t i) {
+   if (links[i].prev==OPENQUEUE_NONE) {
+      list->head = links[i].next;
+   } else {
+      links[links[i].prev].next = links[i].next;
+   }
+   if (links[i].next==OPENQUEUE_NONE) {
+      list->tail = links[i].prev;
+   } else {
+      links[links[i].next].prev = links[i].prev;
+   }
+}
+
+uint8_t openqueue_neighborBucket(open_addr_t* neighbor) {
+   // the last bytes of an EUI-64 are the ones which differ between motes
+   return (neighbor->addr_64b[6]^neighbor->addr_64b[7])&(OPENQUEUE_NUM_BUCKETS-1);
 }
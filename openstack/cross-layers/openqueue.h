@@ -13,7 +13,46 @@
 
 //=========================== define ==========================================
 
-#define QUEUELENGTH  10
+// each entry in use holds one frame buffer: a full-size one while the packet is
+// built or received, a small one once queued for the MAC if the frame fits
+#define OPENQUEUE_NUM_FULL           5
+#define OPENQUEUE_NUM_SMALL          8
+#define QUEUELENGTH                  (OPENQUEUE_NUM_FULL+OPENQUEUE_NUM_SMALL)
+#define OPENQUEUE_SMALL_PACKET_SIZE  64 // fits a secured ACK or KA, with the same footer room as a full buffer
+
+// traffic classes, by creator
+enum {
+   OPENQUEUE_CLASS_CONTROL   = 0,   // MAC, EBs/KAs, RPL and ICMPv6
+   OPENQUEUE_CLASS_SIXTOP    = 1,   // 6P commands
+   OPENQUEUE_CLASS_FORWARDED = 2,   // relayed data
+   OPENQUEUE_CLASS_LOCAL     = 3,   // data generated by this mote
+   OPENQUEUE_CLASS_MAX       = 4,
+};
+
+// full-size buffers a class can always get, as the other classes can not take them
+#define OPENQUEUE_RESERVED_CONTROL   2
+#define OPENQUEUE_RESERVED_SIXTOP    1
+#define OPENQUEUE_RESERVED_LOCAL     1
+// at most that many full-size buffers hold relayed data
+#define OPENQUEUE_MAX_FORWARDED      (OPENQUEUE_NUM_FULL/2)
+
+// what to drop when a relayed packet exceeds OPENQUEUE_MAX_FORWARDED
+#define OPENQUEUE_DROP_TAIL          0    // the new packet
+#define OPENQUEUE_DROP_HEAD          1    // the oldest relayed packet not yet transmitted
+#define OPENQUEUE_FORWARDED_DROP     OPENQUEUE_DROP_TAIL
+
+#define OPENQUEUE_NONE         0xff // no entry, entries are indexed by uint8_t
+#define OPENQUEUE_NUM_BUCKETS  8    // TX neighbor hash buckets, power of 2
+
+// the lists packets are indexed in, depending on their owner
+enum {
+   OPENQUEUE_LIST_NONE       = 0,   // not indexed
+   OPENQUEUE_LIST_TX         = 1,   // owned by COMPONENT_SIXTOP_TO_IEEE802154E, except EBs
+   OPENQUEUE_LIST_EB         = 2,   // EBs owned by COMPONENT_SIXTOP_TO_IEEE802154E
+   OPENQUEUE_LIST_SENT       = 3,   // owned by COMPONENT_IEEE802154E_TO_SIXTOP, sent by the MAC
+   OPENQUEUE_LIST_RECEIVED   = 4,   // owned by COMPONENT_IEEE802154E_TO_SIXTOP, received by the MAC
+   OPENQUEUE_LIST_MAX        = 5,
+};
 
 //=========================== typedef =========================================
 
@@ -22,10 +61,58 @@ typedef struct {
    uint8_t  owner;
 } debugOpenQueueEntry_t;
 
+BEGIN_PACK
+typedef struct {
+   uint16_t entrySize;              // bytes of metadata per entry
+   uint16_t totalSize;              // bytes used by this module: entries, frame buffers and indexes
+   uint8_t  numFull;                // number of full-size buffers
+   uint8_t  numSmall;               // number of small buffers
+   uint8_t  fullSize;               // bytes per full-size buffer
+   uint8_t  smallSize;              // bytes per small buffer
+   uint8_t  numFullInUse;
+   uint8_t  numSmallInUse;
+   uint8_t  maxFullInUse;           // high watermark
+   uint8_t  maxSmallInUse;          // high watermark
+   uint8_t  numSmallFallback;       // small buffer requests served with a full-size one
+   uint8_t  numCompacted;           // queued frames moved to a small buffer
+} debugOpenQueueMemory_t;
+END_PACK
+
+typedef struct {
+   uint8_t  head;                   // oldest entry, OPENQUEUE_NONE if empty
+   uint8_t  tail;                   // newest entry, OPENQUEUE_NONE if empty
+} openqueue_list_t;
+
+typedef struct {
+   uint8_t  prev;
+   uint8_t  next;
+} openqueue_link_t;
+
 //=========================== module variables ================================
 
 typedef struct {
    OpenQueueEntry_t queue[QUEUELENGTH];
+   // frame buffers, lent to the entries
+   uint8_t          fullBuf[OPENQUEUE_NUM_FULL][LENGTH_PACKET_BUFFER];
+   uint8_t          smallBuf[OPENQUEUE_NUM_SMALL][OPENQUEUE_SMALL_PACKET_SIZE];
+   bool             fullBufInUse[OPENQUEUE_NUM_FULL];
+   bool             smallBufInUse[OPENQUEUE_NUM_SMALL];
+   uint8_t          numFullInUse;
+   uint8_t          numSmallInUse;
+   uint8_t          maxFullInUse;
+   uint8_t          maxSmallInUse;
+   uint8_t          numSmallFallback;
+   uint8_t          numCompacted;
+   // traffic classes
+   uint16_t         numDropped[OPENQUEUE_CLASS_MAX]; // packets refused or dropped, per class
+   // index of the packets handed between sixtop and the MAC
+   uint8_t          listId[QUEUELENGTH];     // OPENQUEUE_LIST_* the entry is in
+   openqueue_link_t listLink[QUEUELENGTH];
+   openqueue_list_t list[OPENQUEUE_LIST_MAX];
+   // unicast TX packets, hashed by next hop
+   uint8_t          bucketId[QUEUELENGTH];   // bucket the entry is in, OPENQUEUE_NONE if none
+   openqueue_link_t bucketLink[QUEUELENGTH];
+   openqueue_list_t bucket[OPENQUEUE_NUM_BUCKETS];
 } openqueue_vars_t;
 
 //=========================== prototypes ======================================
@@ -33,17 +120,26 @@ typedef struct {
 // admin
 void               openqueue_init(void);
 bool               debugPrint_queue(void);
+bool               debugPrint_queueMemory(void);
+bool               debugPrint_queueDrops(void);
 // called by any component
 OpenQueueEntry_t*  openqueue_getFreePacketBuffer(uint8_t creator);
+OpenQueueEntry_t*  openqueue_getFreeSmallPacketBuffer(uint8_t creator);
 owerror_t         openqueue_freePacketBuffer(OpenQueueEntry_t* pkt);
 void               openqueue_removeAllCreatedBy(uint8_t creator);
 void               openqueue_removeAllOwnedBy(uint8_t owner);
+void               openqueue_setOwner(OpenQueueEntry_t* pkt, uint8_t owner);
+// called by forwarding
+owerror_t          openqueue_admitForwarded(OpenQueueEntry_t* pkt);
 // called by res
 OpenQueueEntry_t*  openqueue_sixtopGetSentPacket(void);
 OpenQueueEntry_t*  openqueue_sixtopGetReceivedPacket(void);
 // called by IEEE80215E
 OpenQueueEntry_t*  openqueue_macGetDataPacket(open_addr_t* toNeighbor);
 OpenQueueEntry_t*  openqueue_macGetEBPacket(void);
+bool               openqueue_macIsDataPending(OpenQueueEntry_t* pkt);
+// called by neighbors
+uint8_t            openqueue_getNumDataPackets(open_addr_t* toNeighbor);
 
 /**
 \}
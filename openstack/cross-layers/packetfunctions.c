@@ -278,7 +278,7 @@ void packetfunctions_reserveHeaderSize(OpenQueueEntry_t* pkt, uint8_t header_len
 void packetfunctions_tossHeader(OpenQueueEntry_t* pkt, uint8_t header_length) {
    pkt->payload += header_length;
    pkt->length  -= header_length;
-   if ( (uint8_t*)(pkt->payload) > (uint8_t*)(pkt->packet+126) ) {
+   if ( (uint8_t*)(pkt->payload) > (uint8_t*)(pkt->packet+pkt->packetSize-4) ) {
       openserial_printError(COMPONENT_PACKETFUNCTIONS,ERR_HEADER_TOO_LONG,
                             (errorparameter_t)1,
                             (errorparameter_t)pkt->length);
@@ -305,29 +305,25 @@ void packetfunctions_tossFooter(OpenQueueEntry_t* pkt, uint8_t header_length) {
 
 //======= packet duplication
 // function duplicates a frame from one OpenQueueEntry structure to the other,
-// updating pointers to the new memory location. Used to make a local copy of
-// the frame before transmission (where it can possibly be encrypted). 
+// at the same offset in the frame buffer, so only the payload pointer needs
+// updating. Used to make a local copy of the frame before transmission (where
+// it can possibly be encrypted). 
 void packetfunctions_duplicatePacket(OpenQueueEntry_t* dst, OpenQueueEntry_t* src) {
-   // make a copy of the frame
+   uint8_t* dstPacket;
+   uint8_t  dstPacketSize;
+   
+   // make a copy of the metadata, keeping dst's frame buffer
+   dstPacket          = dst->packet;
+   dstPacketSize      = dst->packetSize;
    memcpy(dst, src, sizeof(OpenQueueEntry_t));
+   dst->packet        = dstPacket;
+   dst->packetSize    = dstPacketSize;
+   
+   // make a copy of the frame (dst's buffer is at least as large as src's)
+   memcpy(dst->packet, src->packet, src->packetSize);
 
    // Calculate where payload starts in the buffer
    dst->payload = &dst->packet[src->payload - src->packet]; // update pointers
-
-   // update l2_FrameCounter pointer
-   dst->l2_FrameCounter = dst->payload + (src->l2_FrameCounter - src->payload);
-
-   // update l2_ASNpayload pointer
-   dst->l2_ASNpayload = dst->payload + (src->l2_ASNpayload - src->payload);
-
-   // update l2_scheduleIE_cellObjects pointer
-   dst->l2_sixtop_cellObjects = dst->payload + (src->l2_sixtop_cellObjects - src->payload);
-
-   // update l2_payload pointer
-   dst->l2_payload = dst->payload + (src->l2_payload - src->payload);
-
-   // update l4_payload pointer
-   dst->l4_payload = dst->payload + (src->l4_payload - src->payload);
 }
 
 //======= CRC calculation
@@ -22,6 +22,7 @@
 #include "schedule.h"
 #include "sixtop.h"
 #include "neighbors.h"
+#include "otf.h"
 //-- 03a-IPHC
 #include "openbridge.h"
 #include "iphc.h"
@@ -64,6 +65,7 @@ void openstack_init(void) {
    schedule_init();
    sixtop_init();
    neighbors_init();
+   otf_init();
    //-- 03a-IPHC
    openbridge_init();
    iphc_init();
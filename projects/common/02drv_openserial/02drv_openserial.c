@@ -104,12 +104,16 @@ void sixtop_setEBPeriod(void){}
 void sixtop_setKaPeriod(void){}
 void sixtop_setHandler(void){}
 void sixtop_request(void){}
+void sixtop_requestInBurstSlotframe(void){}
 void sixtop_addORremoveCellByInfo(void){}
 void sixtop_setIsResponseEnabled(void){}
 void neighbors_setMyDAGrank(void){}
 void neighbors_getPreferredParentEui64(void){}
 void schedule_setFrameLength(void){}
+void schedule_setMaxActiveSlots(void){}
+void schedule_getFrameHandle(void){}
 void ieee154e_setSlotDuration(void){}
+void ieee154e_setTimeslotTemplate(void){}
 void ieee154e_setIsSecurityEnabled(void){}
 void ieee154e_setIsAckEnabled(void){}
 
@@ -131,6 +135,9 @@ bool debugPrint_asn(void) {
 bool debugPrint_macStats(void) {
    return FALSE;
 }
+bool debugPrint_slotProfile(void) {
+   return FALSE;
+}
 bool debugPrint_schedule(void) {
    return FALSE;
 }
@@ -140,6 +147,12 @@ bool debugPrint_backoff(void) {
 bool debugPrint_queue(void) {
    return FALSE;
 }
+bool debugPrint_queueMemory(void) {
+   return FALSE;
+}
+bool debugPrint_queueDrops(void) {
+   return FALSE;
+}
 bool debugPrint_neighbors(void) {
    return FALSE;
 }
@@ -1,47 +1,127 @@
 /**
-\brief This is a program which shows how to use the "opentimers "driver module.
+\brief This is a program which stress-tests the "opentimers" driver module.
 
 Since the driver modules for different platforms have the same declaration, you
-can use this project with any platform.
+can use this project with any platform, including the "python" board to run it
+on the host.
 
-This application allows you to verify the correct functioning of the opentimers
-drivers. It starts 3 periodic timers, with periods APP_DLY_TIMER0_ms,
-APP_DLY_TIMER1_ms and APP_DLY_TIMER2_ms. Each timer is attached an LED (error.
-radio and sync). When you run the application, you should see the LEDs
-"counting".
+This application starts OPENTIMERSTEST_NUM_TIMERS periodic timers (all the
+timers of the driver but one), each with a different period. Every time a timer
+fires, the time elapsed since it last fired is compared to its period:
+- the expiry jitter is the absolute difference between both, in ticks of the
+  bsp_timer
+- the drift is the difference between the time the timer fired at and the time
+  it was started at plus a whole number of periods. Unlike the jitter, it adds
+  up over the run, so it catches deadlines which slowly shift.
+- the callback also checks that the id it is called with is the handle that
+  opentimers_start() returned for that timer
+
+Every time board_sleep() returns, a short one-shot "probe" timer is started
+with the last free timer. It is earlier than the pending compare event most of
+the time, which exercises moving the compare event earlier; this must not shift
+the periodic timers.
+
+The timers are started with OPENTIMERSTEST_SLACK_TICKS of slack. With a
+non-zero slack, the jitter must stay below the slack, and the number of
+bsp_timer compare events avoided by coalescing is reported.
+
+After OPENTIMERSTEST_NUM_EXPIRIES expiries, the callback stops all the timers
+and starts them again with their periods shifted by one timer, so the next run
+exercises stopping and starting timers from within a timer callback.
+
+CPU cost is read from the host's clock() in simulation, and from the bsp_timer
+counter (32kHz ticks) on real hardware. It is reported as the time to start and
+to stop all the timers, and as the average time between two expiries spent
+outside of board_sleep(). On real hardware, the frame debugpin is high while
+the timers are started and the slot debugpin while they are stopped, so the
+per-operation cost can also be measured with a logic analyzer.
+
+When a run completes:
+- the error LED toggles
+- the results are available in app_vars (and printed in simulation)
+- a new run starts
 
 \author Thomas Watteyne <watteyne@eecs.berkeley.edu>, August 2014.
 */
 
 #include "stdint.h"
 #include "stdio.h"
+#include "string.h"
 // bsp modules required
 #include "board.h"
+#include "bsp_timer.h"
+#include "debugpins.h"
 #include "leds.h"
 // driver modules required
 #include "opentimers.h"
 
 //=========================== defines =========================================
 
-#define APP_DLY_TIMER0_ms   400
-#define APP_DLY_TIMER1_ms   800
-#define APP_DLY_TIMER2_ms  1600
+#define OPENTIMERSTEST_NUM_TIMERS          (MAX_NUM_TIMERS-1) // the last one is the probe
+#define OPENTIMERSTEST_NUM_EXPIRIES        10000
+#define OPENTIMERSTEST_PERIOD_BASE_TICKS   328 // ~10ms
+#define OPENTIMERSTEST_PERIOD_STEP_TICKS   37
+#define OPENTIMERSTEST_SLACK_TICKS         0
+#define OPENTIMERSTEST_PROBE_TICKS         5
+#define OPENTIMERSTEST_PERIOD(idx)         (OPENTIMERSTEST_PERIOD_BASE_TICKS+(idx)*OPENTIMERSTEST_PERIOD_STEP_TICKS)
+
+#ifdef OPENSIM
+#include "time.h"
+typedef uint32_t bench_time_t;
+#define OPENTIMERSTEST_GET_TIME()          ((bench_time_t)clock())
+#else
+typedef PORT_TIMER_WIDTH bench_time_t;
+#define OPENTIMERSTEST_GET_TIME()          bsp_timer_get_currentValue()
+#endif
 
 //=========================== variables =======================================
 
-/*
 typedef struct {
-   
+   // timers
+   opentimer_id_t   timerId[OPENTIMERSTEST_NUM_TIMERS];   // handle of each timer
+   uint32_t         period[OPENTIMERSTEST_NUM_TIMERS];    // period of each timer, in ticks
+   PORT_TIMER_WIDTH lastFired[OPENTIMERSTEST_NUM_TIMERS]; // when each timer last fired
+   uint32_t         expected[OPENTIMERSTEST_NUM_TIMERS];  // when each timer should fire next
+   uint8_t          idToIdx[MAX_NUM_TIMERS];              // handle -> timer
+   uint8_t          numRuns;
+   // time, extended to 32 bits
+   PORT_TIMER_WIDTH lastNow;
+   uint32_t         now;
+   // probe timer
+   opentimer_id_t   probeId;
+   bool             probeRunning;
+   uint32_t         numProbes;
+   // current run
+   bench_time_t     runStart;
+   uint32_t         numExpiries;
+   uint32_t         sumJitter;
+   PORT_TIMER_WIDTH maxJitter;
+   uint32_t         maxDrift;
+   uint16_t         numBadId;
+   bench_time_t     startTime;
+   bench_time_t     stopTime;
+   // results of the last complete run
+   uint32_t         lastNumExpiries;
+   uint32_t         lastSumJitter;
+   PORT_TIMER_WIDTH lastMaxJitter;
+   uint32_t         lastMaxDrift;
+   uint32_t         lastNumProbes;
+   uint16_t         lastNumBadId;
+   bench_time_t     lastStartTime;
+   bench_time_t     lastStopTime;
+   bench_time_t     lastRunTime;
+   opentimers_stats_t lastStats;
 } app_vars_t;
 
 app_vars_t app_vars;
-*/
 
 //=========================== prototypes ======================================
 
-void cb_timer0(void);
-void cb_timer1(void);
-void cb_timer2(void);
+void timerstress_startAll(void);
+void timerstress_stopAll(void);
+void timerstress_updateNow(void);
+void timerstress_cb(opentimer_id_t id);
+void timerstress_probe_cb(opentimer_id_t id);
 
 //=========================== main ============================================
 
@@ -49,45 +129,193 @@ void cb_timer2(void);
 \brief The program starts executing here.
 */
 int mote_main(void) {
+
+   memset(&app_vars,0,sizeof(app_vars_t));
+
    board_init();
    opentimers_init();
-   
-   opentimers_start(
-      APP_DLY_TIMER0_ms,     // duration
-      TIMER_PERIODIC,        // type
-      TIME_MS,               // timetype
-      cb_timer0              // callback
-   );
-   
-   opentimers_start(
-      APP_DLY_TIMER1_ms,     // duration
-      TIMER_PERIODIC,        // type
-      TIME_MS,               // timetype
-      cb_timer1              // callback
-   );
-   
-   opentimers_start(
-      APP_DLY_TIMER2_ms,     // duration
-      TIMER_PERIODIC,        // type
-      TIME_MS,               // timetype
-      cb_timer2              // callback
-   );
-   
+
+   timerstress_startAll();
+
    while(1) {
       board_sleep();
+      if (app_vars.probeRunning==FALSE) {
+         app_vars.probeId = opentimers_start(
+            OPENTIMERSTEST_PROBE_TICKS,  // duration
+            TIMER_ONESHOT,               // type
+            TIME_TICS,                   // timetype
+            timerstress_probe_cb         // callback
+         );
+         if (app_vars.probeId==TOO_MANY_TIMERS_ERROR) {
+            // not expected, the last timer is kept for the probe
+            leds_error_blink();
+            board_reset();
+         }
+         app_vars.probeRunning = TRUE;
+         app_vars.numProbes++;
+      }
+   }
+}
+
+//=========================== private =========================================
+
+void timerstress_startAll(void) {
+   bench_time_t     start;
+   uint8_t          idx;
+
+   debugpins_frame_set();
+   start = OPENTIMERSTEST_GET_TIME();
+
+   for (idx=0;idx<OPENTIMERSTEST_NUM_TIMERS;idx++) {
+      // shift the periods by one timer every run
+      app_vars.period[idx]  = OPENTIMERSTEST_PERIOD((idx+app_vars.numRuns)%OPENTIMERSTEST_NUM_TIMERS);
+      app_vars.timerId[idx] = opentimers_startWithSlack(
+         app_vars.period[idx],  // duration
+         OPENTIMERSTEST_SLACK_TICKS, // slack
+         TIMER_PERIODIC,        // type
+         TIME_TICS,             // timetype
+         timerstress_cb         // callback
+      );
+      if (app_vars.timerId[idx]==TOO_MANY_TIMERS_ERROR) {
+         // not expected, all timers are free
+         leds_error_blink();
+         board_reset();
+      }
+      app_vars.idToIdx[app_vars.timerId[idx]] = idx;
+   }
+
+   app_vars.startTime = (bench_time_t)(OPENTIMERSTEST_GET_TIME()-start);
+   debugpins_frame_clr();
+
+   // all timers count from the last compare event of the bsp_timer
+   timerstress_updateNow();
+   for (idx=0;idx<OPENTIMERSTEST_NUM_TIMERS;idx++) {
+      app_vars.lastFired[idx] = app_vars.lastNow;
+      app_vars.expected[idx]  = app_vars.now+app_vars.period[idx];
    }
+   app_vars.runStart = OPENTIMERSTEST_GET_TIME();
+}
+
+void timerstress_stopAll(void) {
+   bench_time_t start;
+   uint8_t      idx;
+
+   debugpins_slot_set();
+   start = OPENTIMERSTEST_GET_TIME();
+
+   for (idx=0;idx<OPENTIMERSTEST_NUM_TIMERS;idx++) {
+      opentimers_stop(app_vars.timerId[idx]);
+   }
+
+   app_vars.stopTime = (bench_time_t)(OPENTIMERSTEST_GET_TIME()-start);
+   debugpins_slot_clr();
+}
+
+/**
+\brief Extend the bsp_timer counter to 32 bits.
+
+Called at least once per wrap around of the counter, since the longest period
+is much shorter than that.
+ */
+void timerstress_updateNow(void) {
+   PORT_TIMER_WIDTH now;
+
+   now                = bsp_timer_get_currentValue();
+   app_vars.now      += (PORT_TIMER_WIDTH)(now-app_vars.lastNow);
+   app_vars.lastNow   = now;
 }
 
 //=========================== callbacks =======================================
 
-void cb_timer0(void) {
+void timerstress_cb(opentimer_id_t id) {
+   PORT_TIMER_WIDTH now;
+   PORT_TIMER_WIDTH elapsed;
+   PORT_TIMER_WIDTH jitter;
+   uint32_t         drift;
+   uint8_t          idx;
+
+   timerstress_updateNow();
+   now = app_vars.lastNow;
+
+   // make sure the handle still designates the same timer
+   idx = app_vars.idToIdx[id];
+   if (idx>=OPENTIMERSTEST_NUM_TIMERS || app_vars.timerId[idx]!=id) {
+      app_vars.numBadId++;
+      return;
+   }
+
+   // expiry jitter
+   elapsed = (PORT_TIMER_WIDTH)(now-app_vars.lastFired[idx]);
+   if (elapsed>app_vars.period[idx]) {
+      jitter = (PORT_TIMER_WIDTH)(elapsed-app_vars.period[idx]);
+   } else {
+      jitter = (PORT_TIMER_WIDTH)(app_vars.period[idx]-elapsed);
+   }
+   app_vars.lastFired[idx] = now;
+   app_vars.sumJitter     += jitter;
+   if (jitter>app_vars.maxJitter) {
+      app_vars.maxJitter   = jitter;
+   }
+
+   // drift since the timer was started
+   if ((int32_t)(app_vars.now-app_vars.expected[idx])>=0) {
+      drift = app_vars.now-app_vars.expected[idx];
+   } else {
+      drift = app_vars.expected[idx]-app_vars.now;
+   }
+   app_vars.expected[idx] += app_vars.period[idx];
+   if (drift>app_vars.maxDrift) {
+      app_vars.maxDrift    = drift;
+   }
+
+   app_vars.numExpiries++;
+   if (app_vars.numExpiries<OPENTIMERSTEST_NUM_EXPIRIES) {
+      return;
+   }
+
+   // publish the results of this run
+   timerstress_stopAll();
+   app_vars.lastRunTime     = (bench_time_t)(OPENTIMERSTEST_GET_TIME()-app_vars.runStart);
+   app_vars.lastNumExpiries = app_vars.numExpiries;
+   app_vars.lastSumJitter   = app_vars.sumJitter;
+   app_vars.lastMaxJitter   = app_vars.maxJitter;
+   app_vars.lastMaxDrift    = app_vars.maxDrift;
+   app_vars.lastNumProbes   = app_vars.numProbes;
+   app_vars.lastNumBadId    = app_vars.numBadId;
+   app_vars.lastStartTime   = app_vars.startTime;
+   app_vars.lastStopTime    = app_vars.stopTime;
+   opentimers_getStats(&app_vars.lastStats);   // since boot
+#ifdef OPENSIM
+   printf(
+      "02drv_opentimers: %u timers, %lu expiries, jitter max %u avg %lu/%lu ticks, drift max %lu ticks, %lu probes, %u bad ids, start %lu us, stop %lu us, %lu ns/expiry, %lu arms, %lu avoided\n",
+      (unsigned)OPENTIMERSTEST_NUM_TIMERS,
+      (unsigned long)app_vars.lastNumExpiries,
+      (unsigned)app_vars.lastMaxJitter,
+      (unsigned long)app_vars.lastSumJitter,
+      (unsigned long)app_vars.lastNumExpiries,
+      (unsigned long)app_vars.lastMaxDrift,
+      (unsigned long)app_vars.lastNumProbes,
+      (unsigned)app_vars.lastNumBadId,
+      (unsigned long)(((uint64_t)app_vars.lastStartTime*1000000)/CLOCKS_PER_SEC),
+      (unsigned long)(((uint64_t)app_vars.lastStopTime *1000000)/CLOCKS_PER_SEC),
+      (unsigned long)(((uint64_t)app_vars.lastRunTime  *1000000000)/CLOCKS_PER_SEC/app_vars.lastNumExpiries),
+      (unsigned long)app_vars.lastStats.numArms,
+      (unsigned long)app_vars.lastStats.numArmsAvoided
+   );
+#endif
    leds_error_toggle();
-}
 
-void cb_timer1(void) {
-   leds_radio_toggle();
+   // start a new run
+   app_vars.numRuns++;
+   app_vars.numExpiries = 0;
+   app_vars.sumJitter   = 0;
+   app_vars.maxJitter   = 0;
+   app_vars.maxDrift    = 0;
+   app_vars.numProbes   = 0;
+   app_vars.numBadId    = 0;
+   timerstress_startAll();
 }
 
-void cb_timer2(void) {
-   leds_sync_toggle();
-}
\ No newline at end of file
+void timerstress_probe_cb(opentimer_id_t id) {
+   app_vars.probeRunning = FALSE;
+}
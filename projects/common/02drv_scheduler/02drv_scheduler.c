@@ -0,0 +1,150 @@
+/**
+\brief This is a program which benchmarks the "openos" scheduler.
+
+Since the kernel is the same for every platform, you can use this project with
+any platform, including the "python" board to run it on the host.
+
+The scheduler is kept under load: each round, a round task fills all remaining
+task containers with tasks of mixed priorities (pushed from the most to the
+least urgent), then lets the scheduler drain them. The time spent pushing and
+draining is accumulated over SCHEDBENCH_NUM_ROUNDS rounds.
+
+Time is read from the host's clock() in simulation, and from the bsp_timer
+counter (32kHz ticks) on real hardware. On real hardware, the frame debugpin is
+high during each push burst and the slot debugpin during each drain, so the
+per-operation cost can also be measured with a logic analyzer.
+
+When a run completes:
+- the error LED toggles
+- the results are available in app_vars (and printed in simulation)
+- a new run starts
+*/
+
+#include "stdint.h"
+#include "stdio.h"
+#include "string.h"
+// bsp modules required
+#include "board.h"
+#include "bsp_timer.h"
+#include "debugpins.h"
+#include "leds.h"
+// kernel
+#include "scheduler.h"
+
+//=========================== defines =========================================
+
+#define SCHEDBENCH_NUM_ROUNDS     1000
+#define SCHEDBENCH_NUM_LOAD       (TASK_LIST_DEPTH-2) // leaves room for the running and the round-done tasks
+
+#ifdef OPENSIM
+#include "time.h"
+typedef uint32_t bench_time_t;
+#define SCHEDBENCH_GET_TIME()     ((bench_time_t)clock())
+#else
+typedef PORT_TIMER_WIDTH bench_time_t;
+#define SCHEDBENCH_GET_TIME()     bsp_timer_get_currentValue()
+#endif
+
+//=========================== variables =======================================
+
+typedef struct {
+   uint16_t     numRounds;
+   bench_time_t pushStart;
+   bench_time_t drainStart;
+   uint32_t     pushTime;          // accumulated over the current run
+   uint32_t     drainTime;         // accumulated over the current run
+   uint32_t     numPushes;
+   uint32_t     numPops;
+   // results of the last complete run
+   uint32_t     lastPushTime;
+   uint32_t     lastDrainTime;
+   uint32_t     lastNumOps;
+} app_vars_t;
+
+app_vars_t app_vars;
+
+//=========================== prototypes ======================================
+
+void schedbench_task_round(void);
+void schedbench_task_load(void);
+void schedbench_task_roundDone(void);
+
+//=========================== main ============================================
+
+/**
+\brief The program starts executing here.
+*/
+int mote_main(void) {
+   
+   memset(&app_vars,0,sizeof(app_vars_t));
+   
+   board_init();
+   scheduler_init();
+   
+   scheduler_push_task(schedbench_task_round,TASKPRIO_MAX);
+   
+   scheduler_start();
+   return 0; // this line should never be reached
+}
+
+//=========================== tasks ===========================================
+
+void schedbench_task_round(void) {
+   uint8_t i;
+   
+   debugpins_frame_set();
+   app_vars.pushStart = SCHEDBENCH_GET_TIME();
+   
+   // load the scheduler, visiting every priority level
+   for (i=0;i<SCHEDBENCH_NUM_LOAD;i++) {
+      scheduler_push_task(
+         schedbench_task_load,
+         (task_prio_t)(TASKPRIO_SIXTOP_NOTIF_RX+(i%(TASKPRIO_MAX-TASKPRIO_SIXTOP_NOTIF_RX)))
+      );
+   }
+   scheduler_push_task(schedbench_task_roundDone,TASKPRIO_MAX);
+   
+   app_vars.drainStart = SCHEDBENCH_GET_TIME();
+   debugpins_frame_clr();
+   debugpins_slot_set();
+   
+   app_vars.pushTime  += (bench_time_t)(app_vars.drainStart-app_vars.pushStart);
+   app_vars.numPushes += SCHEDBENCH_NUM_LOAD+1;
+}
+
+void schedbench_task_load(void) {
+   app_vars.numPops++;
+}
+
+void schedbench_task_roundDone(void) {
+   app_vars.numPops++;
+   
+   app_vars.drainTime += (bench_time_t)(SCHEDBENCH_GET_TIME()-app_vars.drainStart);
+   debugpins_slot_clr();
+   
+   app_vars.numRounds++;
+   if (app_vars.numRounds==SCHEDBENCH_NUM_ROUNDS) {
+      // publish the results of this run
+      app_vars.lastPushTime  = app_vars.pushTime;
+      app_vars.lastDrainTime = app_vars.drainTime;
+      app_vars.lastNumOps    = app_vars.numPushes;
+#ifdef OPENSIM
+      printf(
+         "02drv_scheduler: %lu push/pop, push %lu us, drain %lu us\n",
+         (unsigned long)app_vars.lastNumOps,
+         (unsigned long)(((uint64_t)app_vars.lastPushTime *1000000)/CLOCKS_PER_SEC),
+         (unsigned long)(((uint64_t)app_vars.lastDrainTime*1000000)/CLOCKS_PER_SEC)
+      );
+#endif
+      leds_error_toggle();
+      
+      // start a new run
+      app_vars.numRounds  = 0;
+      app_vars.pushTime   = 0;
+      app_vars.drainTime  = 0;
+      app_vars.numPushes  = 0;
+      app_vars.numPops    = 0;
+   }
+   
+   scheduler_push_task(schedbench_task_round,TASKPRIO_MAX);
+}
@@ -0,0 +1,398 @@
+/**
+\brief This is a program which checks the schedule walks two slotframes at the
+same time, as IEEE802154E does once the burst slotframe was added to it.
+
+Since it only uses the stack's code, you can use this project with any
+platform, including the "python" board to run it on the host. Do not run it
+within reach of an OpenWSN network: a mote which hears an EB synchronizes, and
+the schedule is then walked by IEEE802154E as well.
+
+The burst slotframe (SCHEDULE_BURST_SLOTFRAME_LENGTH slots) is added next to
+the minimal slotframe (SLOTFRAME_LENGTH slots, with its shared cell and serial
+RX cells), with the cells of each scenario of sfcheck_scenarios[]. The lengths
+are coprime, so that every cell of one slotframe falls on the same ASN as
+every cell of the other, every SLOTFRAME_LENGTH*SCHEDULE_BURST_SLOTFRAME_LENGTH
+slots.
+
+The schedule is then walked as IEEE802154E does, from one active slot to the
+next, over SFCHECK_NUM_SLOTS slots. At each slot, the cell the schedule uses
+is checked against the one expected:
+- none, if no slotframe has an active slot at that ASN, in which case the
+  schedule must not stop at it.
+- the one of the minimal slotframe, if it has an active slot at that ASN,
+  which has the lowest handle.
+- the one of the burst slotframe, otherwise.
+Halfway through, a cell is added to the minimal slotframe, to check the walk
+takes it into account from the next active slot on.
+
+When a run completes:
+- the error LED toggles
+- the results are available in app_vars (and printed in simulation)
+- a new run starts
+*/
+
+#include "stdint.h"
+#include "stdio.h"
+#include "string.h"
+// stack initialization
+#include "opendefs.h"
+#include "board.h"
+#include "leds.h"
+#include "scheduler.h"
+#include "openstack.h"
+#include "schedule.h"
+
+//=========================== defines =========================================
+
+#define SFCHECK_NUM_SLOTS         (3*SLOTFRAME_LENGTH*SCHEDULE_BURST_SLOTFRAME_LENGTH)
+#define SFCHECK_MAX_CELLS         MAXACTIVESLOTS
+#define SFCHECK_NEIGHBOR_MINIMAL  0x01 // last byte of the neighbor of the cell added to the minimal slotframe
+#define SFCHECK_NEIGHBOR_BURST    0x02 // last byte of the neighbor of the cells of the burst slotframe
+#define SFCHECK_NO_CELL           0xff // no cell expected
+
+//=========================== variables =======================================
+
+typedef struct {
+   slotOffset_t      minimalSlotOffset;        // slot offset of the minimal slotframe when the burst slotframe is added
+   slotOffset_t      burstCells[SCHEDULE_BURST_SLOTFRAME_MAXACTIVESLOTS];
+   slotOffset_t      addedCell;                // cell added to the minimal slotframe halfway
+} sfcheck_scenario_t;
+
+static const sfcheck_scenario_t sfcheck_scenarios[] = {
+   // the burst cells collide with the shared cell, then with the added cell
+   { 0, {0, 3},  5},
+   // the burst cells collide with the serial RX cells
+   { 4, {1, 6},  8},
+   // from the last slot offset of the minimal slotframe
+   {10, {2, 5},  9},
+};
+
+#define SFCHECK_NUM_SCENARIOS     (sizeof(sfcheck_scenarios)/sizeof(sfcheck_scenario_t))
+
+// a cell of the schedule, as expected
+typedef struct {
+   uint8_t           frameHandle;
+   slotOffset_t      slotOffset;
+   cellType_t        type;
+   uint8_t           neighbor;                 // last byte of its neighbor
+} sfcheck_cell_t;
+
+typedef struct {
+   sfcheck_cell_t    cells[SFCHECK_MAX_CELLS];
+   uint8_t           numCells;
+   slotOffset_t      minimalSlotOffset;        // slot offset of the current slot in each slotframe
+   slotOffset_t      burstSlotOffset;
+   uint8_t           scenario;                 // scenario of the current step
+   // results of the last complete run, per scenario
+   uint16_t          numActiveSlots[SFCHECK_NUM_SCENARIOS];
+   uint16_t          numCollisions[SFCHECK_NUM_SCENARIOS];  // slots at which both slotframes are active
+   uint16_t          numBurstSlots[SFCHECK_NUM_SCENARIOS];  // slots at which only the burst slotframe is
+   uint8_t           numMismatches;
+} app_vars_t;
+
+app_vars_t app_vars;
+
+//=========================== prototypes ======================================
+
+void      sfcheck_task_step(void);
+void      sfcheck_addCell(
+   uint8_t              frameHandle,
+   slotOffset_t         slotOffset,
+   cellType_t           type,
+   bool                 shared,
+   uint8_t              neighbor
+);
+void      sfcheck_removeCells(uint8_t frameHandle, uint8_t neighbor);
+uint8_t   sfcheck_expectedCell(uint8_t frameHandle, slotOffset_t slotOffset);
+void      sfcheck_checkSlot(bool isActive);
+
+//=========================== main ============================================
+
+/**
+\brief The program starts executing here.
+*/
+int mote_main(void) {
+   slotOffset_t slotOffset;
+
+   memset(&app_vars,0,sizeof(app_vars_t));
+
+   board_init();
+   scheduler_init();
+   openstack_init();
+
+   // the minimal schedule, as learnt from the EB of the network joined
+   schedule_setFrameLength(SLOTFRAME_LENGTH);
+   sfcheck_addCell(
+      SCHEDULE_MINIMAL_6TISCH_DEFAULT_SLOTFRAME_HANDLE,
+      SCHEDULE_MINIMAL_6TISCH_SLOTOFFSET,
+      CELLTYPE_TXRX,
+      TRUE,
+      0
+   );
+   // the serial RX cells schedule_init() added
+   for (slotOffset=0;slotOffset<NUMSERIALRX;slotOffset++) {
+      app_vars.cells[app_vars.numCells].frameHandle = SCHEDULE_MINIMAL_6TISCH_DEFAULT_SLOTFRAME_HANDLE;
+      app_vars.cells[app_vars.numCells].slotOffset  = SCHEDULE_MINIMAL_6TISCH_SLOTOFFSET+SCHEDULE_MINIMAL_6TISCH_ACTIVE_CELLS+slotOffset;
+      app_vars.cells[app_vars.numCells].type        = CELLTYPE_SERIALRX;
+      app_vars.cells[app_vars.numCells].neighbor    = 0;
+      app_vars.numCells++;
+   }
+
+   scheduler_push_task(sfcheck_task_step,TASKPRIO_MAX);
+
+   scheduler_start();
+   return 0; // this line should never be reached
+}
+
+//=========================== tasks ===========================================
+
+void sfcheck_task_step(void) {
+   const sfcheck_scenario_t* scenario;
+   slotOffset_t              nextActiveSlotOffset;
+   uint16_t                  slot;
+   bool                      isAdded;
+   uint8_t                   i;
+#ifdef OPENSIM
+   uint8_t                   s;
+#endif
+
+   scenario = &sfcheck_scenarios[app_vars.scenario];
+
+   // add the burst slotframe and its cells, the ASN is 0 until synchronized
+   if (
+         schedule_addSlotframe(
+            SCHEDULE_BURST_SLOTFRAME_HANDLE,
+            SCHEDULE_BURST_SLOTFRAME_LENGTH,
+            SCHEDULE_BURST_SLOTFRAME_MAXACTIVESLOTS
+         )!=E_SUCCESS
+      ) {
+      app_vars.numMismatches++;
+   }
+   for (i=0;i<SCHEDULE_BURST_SLOTFRAME_MAXACTIVESLOTS;i++) {
+      sfcheck_addCell(
+         SCHEDULE_BURST_SLOTFRAME_HANDLE,
+         scenario->burstCells[i],
+         CELLTYPE_TX,
+         FALSE,
+         SFCHECK_NEIGHBOR_BURST
+      );
+   }
+   schedule_syncSlotOffset(scenario->minimalSlotOffset);
+   app_vars.minimalSlotOffset = scenario->minimalSlotOffset;
+   app_vars.burstSlotOffset   = 0;
+
+   // walk the schedule as IEEE802154E does
+   isAdded              = FALSE;
+   nextActiveSlotOffset = schedule_getNextActiveSlotOffset();
+   for (slot=0;slot<SFCHECK_NUM_SLOTS;slot++) {
+      app_vars.minimalSlotOffset = (app_vars.minimalSlotOffset+1)%SLOTFRAME_LENGTH;
+      app_vars.burstSlotOffset   = (app_vars.burstSlotOffset+1)%SCHEDULE_BURST_SLOTFRAME_LENGTH;
+      if (app_vars.minimalSlotOffset!=nextActiveSlotOffset) {
+         sfcheck_checkSlot(FALSE);
+         continue;
+      }
+      schedule_advanceSlot();
+      sfcheck_checkSlot(TRUE);
+      if (isAdded==FALSE && slot>=SFCHECK_NUM_SLOTS/2) {
+         sfcheck_addCell(
+            SCHEDULE_MINIMAL_6TISCH_DEFAULT_SLOTFRAME_HANDLE,
+            scenario->addedCell,
+            CELLTYPE_TX,
+            FALSE,
+            SFCHECK_NEIGHBOR_MINIMAL
+         );
+         isAdded = TRUE;
+      }
+      nextActiveSlotOffset = schedule_getNextActiveSlotOffset();
+   }
+
+   // back to the minimal schedule
+   sfcheck_removeCells(SCHEDULE_MINIMAL_6TISCH_DEFAULT_SLOTFRAME_HANDLE,SFCHECK_NEIGHBOR_MINIMAL);
+   sfcheck_removeCells(SCHEDULE_BURST_SLOTFRAME_HANDLE,SFCHECK_NEIGHBOR_BURST);
+   if (schedule_removeSlotframe(SCHEDULE_BURST_SLOTFRAME_HANDLE)!=E_SUCCESS) {
+      app_vars.numMismatches++;
+   }
+
+   // next step
+   app_vars.scenario++;
+   if (app_vars.scenario==SFCHECK_NUM_SCENARIOS) {
+#ifdef OPENSIM
+      for (s=0;s<SFCHECK_NUM_SCENARIOS;s++) {
+         printf(
+            "03oos_slotframes: scenario %d, %d active slots, %d collisions, %d burst slots\n",
+            s,
+            app_vars.numActiveSlots[s],
+            app_vars.numCollisions[s],
+            app_vars.numBurstSlots[s]
+         );
+      }
+      printf("03oos_slotframes: %d mismatches\n",app_vars.numMismatches);
+#endif
+      leds_error_toggle();
+
+      // start a new run
+      app_vars.scenario      = 0;
+      app_vars.numMismatches = 0;
+      memset(app_vars.numActiveSlots,0,sizeof(app_vars.numActiveSlots));
+      memset(app_vars.numCollisions,0,sizeof(app_vars.numCollisions));
+      memset(app_vars.numBurstSlots,0,sizeof(app_vars.numBurstSlots));
+   }
+
+   scheduler_push_task(sfcheck_task_step,TASKPRIO_MAX);
+}
+
+//=========================== private =========================================
+
+/**
+\brief Add a cell to the schedule, and to the cells expected.
+
+\param[in] frameHandle The handle of its slotframe.
+\param[in] slotOffset  Its slot offset in that slotframe.
+\param[in] type        Its type.
+\param[in] shared      Whether it is shared.
+\param[in] neighbor    The last byte of its neighbor, ADDR_ANYCAST if 0.
+*/
+void sfcheck_addCell(
+      uint8_t      frameHandle,
+      slotOffset_t slotOffset,
+      cellType_t   type,
+      bool         shared,
+      uint8_t      neighbor
+   ) {
+   open_addr_t address;
+
+   memset(&address,0,sizeof(open_addr_t));
+   if (neighbor==0) {
+      address.type          = ADDR_ANYCAST;
+   } else {
+      address.type          = ADDR_64B;
+      address.addr_64b[7]   = neighbor;
+   }
+   if (
+         schedule_addActiveSlot(
+            frameHandle,
+            slotOffset,
+            type,
+            shared,
+            0,
+            &address
+         )!=E_SUCCESS ||
+         app_vars.numCells==SFCHECK_MAX_CELLS
+      ) {
+      app_vars.numMismatches++;
+      return;
+   }
+
+   app_vars.cells[app_vars.numCells].frameHandle = frameHandle;
+   app_vars.cells[app_vars.numCells].slotOffset  = slotOffset;
+   app_vars.cells[app_vars.numCells].type        = type;
+   app_vars.cells[app_vars.numCells].neighbor    = neighbor;
+   app_vars.numCells++;
+}
+
+/**
+\brief Remove the cells with a neighbor of a slotframe from the schedule, and
+   from the cells expected.
+
+\param[in] frameHandle The handle of the slotframe.
+\param[in] neighbor    The last byte of the neighbor.
+*/
+void sfcheck_removeCells(uint8_t frameHandle, uint8_t neighbor) {
+   open_addr_t address;
+   uint8_t     i;
+
+   memset(&address,0,sizeof(open_addr_t));
+   address.type        = ADDR_64B;
+   address.addr_64b[7] = neighbor;
+
+   i = 0;
+   while (i<app_vars.numCells) {
+      if (
+            app_vars.cells[i].frameHandle!=frameHandle ||
+            app_vars.cells[i].neighbor!=neighbor
+         ) {
+         i++;
+         continue;
+      }
+      if (schedule_removeActiveSlot(frameHandle,app_vars.cells[i].slotOffset,&address)!=E_SUCCESS) {
+         app_vars.numMismatches++;
+      }
+      app_vars.numCells--;
+      app_vars.cells[i] = app_vars.cells[app_vars.numCells];
+   }
+}
+
+/**
+\brief Get the cell expected at a slot offset of a slotframe.
+
+\returns The index of the cell in app_vars.cells, SFCHECK_NO_CELL if the slot
+   is not active in that slotframe.
+*/
+uint8_t sfcheck_expectedCell(uint8_t frameHandle, slotOffset_t slotOffset) {
+   uint8_t i;
+
+   for (i=0;i<app_vars.numCells;i++) {
+      if (
+            app_vars.cells[i].frameHandle==frameHandle &&
+            app_vars.cells[i].slotOffset==slotOffset
+         ) {
+         return i;
+      }
+   }
+   return SFCHECK_NO_CELL;
+}
+
+/**
+\brief Check the cell the schedule uses at the current slot.
+
+\param[in] isActive Whether the schedule stopped at this slot, as an active one.
+*/
+void sfcheck_checkSlot(bool isActive) {
+   uint8_t          minimal;
+   uint8_t          burst;
+   uint8_t          i;
+   sfcheck_cell_t*  expected;
+   scheduleEntry_t* entry;
+
+   minimal = sfcheck_expectedCell(SCHEDULE_MINIMAL_6TISCH_DEFAULT_SLOTFRAME_HANDLE,app_vars.minimalSlotOffset);
+   burst   = sfcheck_expectedCell(SCHEDULE_BURST_SLOTFRAME_HANDLE,app_vars.burstSlotOffset);
+
+   // the slotframe with the lowest handle wins
+   if (minimal!=SFCHECK_NO_CELL) {
+      i = minimal;
+      if (burst!=SFCHECK_NO_CELL) {
+         app_vars.numCollisions[app_vars.scenario]++;
+      }
+   } else {
+      i = burst;
+      if (burst!=SFCHECK_NO_CELL) {
+         app_vars.numBurstSlots[app_vars.scenario]++;
+      }
+   }
+
+   if (isActive==FALSE) {
+      if (i!=SFCHECK_NO_CELL) {
+         // an active slot was skipped
+         app_vars.numMismatches++;
+      }
+      return;
+   }
+
+   app_vars.numActiveSlots[app_vars.scenario]++;
+   if (i==SFCHECK_NO_CELL) {
+      // stopped at a slot no slotframe has active
+      app_vars.numMismatches++;
+      return;
+   }
+   expected = &app_vars.cells[i];
+   entry    = schedule_getCurrentScheduleEntry();
+   if (
+         entry==NULL                                  ||
+         entry->slotOffset!=expected->slotOffset      ||
+         entry->type!=expected->type                  ||
+         entry->neighbor.addr_64b[7]!=expected->neighbor ||
+         schedule_getType()!=expected->type
+      ) {
+      app_vars.numMismatches++;
+   }
+}
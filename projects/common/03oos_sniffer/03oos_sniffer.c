@@ -164,7 +164,8 @@ void openbridge_triggerData(void){return;}
 
 void sixtop_setEBPeriod(uint8_t ebPeriod){return;}
 void sixtop_addORremoveCellByInfo(uint8_t code,open_addr_t* neighbor,cellInfo_ht* cellInfo){return;}
-void sixtop_request(uint8_t code,open_addr_t* neighbor, uint8_t numCells){return;}
+owerror_t sixtop_request(uint8_t code,open_addr_t* neighbor, uint8_t numCells){return E_FAIL;}
+owerror_t sixtop_requestInBurstSlotframe(uint8_t code,open_addr_t* neighbor, uint8_t numCells){return E_FAIL;}
 void sixtop_setHandler(six2six_handler_t handler){return;}
 void sixtop_setIsResponseEnabled(bool isEnabled){return;}
 void ieee154e_setSingleChannel(uint8_t channel){return;}
@@ -174,7 +175,10 @@ void neighbors_setMyDAGrank(uint16_t rank) {return;}
 void sixtop_setKaPeriod(uint16_t kaPeriod) {return;}
 void ieee154e_setIsSecurityEnabled(bool isEnabled) {return;}
 void ieee154e_setSlotDuration(uint16_t duration) {return;}
+owerror_t ieee154e_setTimeslotTemplate(uint8_t id) {return E_FAIL;}
 void schedule_setFrameLength(uint16_t frameLength) {return;}
+owerror_t schedule_setMaxActiveSlots(uint8_t frameHandle, uint8_t maxActiveSlots) {return E_FAIL;}
+uint8_t schedule_getFrameHandle(void) {return 0;}
 void icmpv6rpl_writeDODAGid(uint8_t* dodagid) {return;}
 void ieee154e_setIsAckEnabled(bool isEnabled) {return;}
 void ieee154e_getAsn(uint8_t* array) {return;}
@@ -185,9 +189,12 @@ void schedule_startDAGroot(void) {return;}
 bool debugPrint_asn(void)       {return TRUE;}
 bool debugPrint_isSync(void)    {return TRUE;}
 bool debugPrint_macStats(void)  {return TRUE;}
+bool debugPrint_slotProfile(void) {return TRUE;}
 bool debugPrint_schedule(void)  {return TRUE;}
 bool debugPrint_backoff(void)   {return TRUE;}
 bool debugPrint_queue(void)     {return TRUE;}
+bool debugPrint_queueMemory(void) {return TRUE;}
+bool debugPrint_queueDrops(void) {return TRUE;}
 bool debugPrint_neighbors(void) {return TRUE;}
 bool debugPrint_myDAGrank(void) {return TRUE;}
 bool debugPrint_kaPeriod(void)  {return TRUE;}
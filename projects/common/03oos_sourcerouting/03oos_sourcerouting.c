@@ -0,0 +1,1007 @@
+/**
+\brief This is a program which benchmarks the processing of source routed
+packets by the forwarding module.
+
+Since it only uses the stack's code, you can use this project with any
+platform, including the "python" board to run it on the host.
+
+A relaying mote consumes its entry in the RH3-6LoRHs of each source routed
+packet it forwards. The benchmark builds the packet of each scenario of
+srbench_scenarios[], as received by this mote, and has it processed
+SRBENCH_NUM_PACKETS times, by:
+- SRBENCH_MODE_RESET: nothing, this is the cost of rebuilding the packet.
+- SRBENCH_MODE_INPLACE: forwarding_consumeSourceRoute(), which updates the
+  headers in place within the packet buffer, then the hop limit update of
+  iphc_sendFromForwardingInPlace().
+- SRBENCH_MODE_BASELINE: srbench_baselineSourceRoute(), the copy-based
+  processing forwarding used before, which copies the headers to a 127-byte
+  array on the stack, then srbench_baselineSendFromForwarding(), which
+  rebuilds them in front of the packet as IPHC used to.
+Both modes are checked to produce the same packet, next hop and hop limits.
+The stack used by each is measured by painting the stack below the caller
+before the call, and counting the bytes overwritten by it.
+
+The scenarios cover the RH3-6LoRH types 0 to 4, the last hop of the route, a
+next RH3-6LoRH of a larger and of a smaller type, unknown elective 6LoRHs in
+front of the RH3-6LoRHs, and packets from outside the network, with an
+RPI-6LoRH whose length changes and an IP-in-IP 6LoRH whose hop limit is
+decremented.
+
+Time is read from the host's clock() in simulation, and from the bsp_timer
+counter (32kHz ticks) on real hardware. On real hardware, the frame debugpin is
+high while the packets of a step are processed.
+
+When a run completes:
+- the error LED toggles
+- the results are available in app_vars (and printed in simulation)
+- a new run starts
+*/
+
+#include "stdint.h"
+#include "stdio.h"
+#include "string.h"
+// stack initialization
+#include "opendefs.h"
+#include "board.h"
+#include "bsp_timer.h"
+#include "debugpins.h"
+#include "leds.h"
+#include "scheduler.h"
+#include "openstack.h"
+// needed for spoofing
+#include "idmanager.h"
+#include "packetfunctions.h"
+#include "openserial.h"
+#include "neighbors.h"
+#include "icmpv6rpl.h"
+#include "iphc.h"
+#include "forwarding.h"
+
+//=========================== defines =========================================
+
+#define SRBENCH_NUM_PACKETS       10000
+#define SRBENCH_LEN_PAYLOAD       40   // stands for the inner IPHC header and UDP
+#define SRBENCH_LEN_ELECTIVE      8    // length of the unknown elective 6LoRHs
+#define SRBENCH_ELECTIVE_TYPE     0x3f // type of the unknown elective 6LoRHs
+#define SRBENCH_SENDER_RANK       0x0100
+#define SRBENCH_NO_RH3            0xff // no RH3-6LoRH after mine
+#define SRBENCH_NO_RPI            0xff // neither RPI-6LoRH nor IP-in-IP 6LoRH
+#define SRBENCH_STACK_PAINT       512
+#define SRBENCH_PAINT             0xa5
+
+enum {
+   SRBENCH_MODE_RESET             = 0,
+   SRBENCH_MODE_INPLACE           = 1,
+   SRBENCH_MODE_BASELINE          = 2,
+   SRBENCH_NUM_MODES              = 3,
+};
+
+#ifdef OPENSIM
+#include "time.h"
+typedef uint32_t bench_time_t;
+#define SRBENCH_GET_TIME()        ((bench_time_t)clock())
+#else
+typedef PORT_TIMER_WIDTH bench_time_t;
+#define SRBENCH_GET_TIME()        bsp_timer_get_currentValue()
+#endif
+
+//=========================== variables =======================================
+
+// the 6LoRHs of a received packet, in front of its IPHC header
+typedef struct {
+   bool              elective;                 // unknown elective 6LoRH in front
+   uint8_t           type;                     // type of the RH3-6LoRH starting with my address
+   uint8_t           numAddr;                  // number of addresses in it
+   uint8_t           nextType;                 // type of the RH3-6LoRH after it, SRBENCH_NO_RH3 if none
+   uint8_t           nextNumAddr;              // number of addresses in it
+   uint8_t           rpiFlags;                 // flags of the RPI-6LoRH, SRBENCH_NO_RPI if none
+} srbench_scenario_t;
+
+static const srbench_scenario_t srbench_scenarios[] = {
+   // each type, followed by 3 more hops
+   {FALSE, RH3_6LOTH_TYPE_0, 4, SRBENCH_NO_RH3,   0, SRBENCH_NO_RPI},
+   {FALSE, RH3_6LOTH_TYPE_1, 4, SRBENCH_NO_RH3,   0, SRBENCH_NO_RPI},
+   {FALSE, RH3_6LOTH_TYPE_2, 4, SRBENCH_NO_RH3,   0, SRBENCH_NO_RPI},
+   {FALSE, RH3_6LOTH_TYPE_3, 4, SRBENCH_NO_RH3,   0, SRBENCH_NO_RPI},
+   {FALSE, RH3_6LOTH_TYPE_4, 4, SRBENCH_NO_RH3,   0, SRBENCH_NO_RPI},
+   // last hop of the route, the next hop is the destination
+   {FALSE, RH3_6LOTH_TYPE_3, 1, SRBENCH_NO_RH3,   0, SRBENCH_NO_RPI},
+   // next RH3-6LoRH of a larger type, mine is removed
+   {FALSE, RH3_6LOTH_TYPE_1, 1, RH3_6LOTH_TYPE_3, 3, SRBENCH_NO_RPI},
+   // next RH3-6LoRH of a smaller type, its first address replaces mine
+   {FALSE, RH3_6LOTH_TYPE_3, 1, RH3_6LOTH_TYPE_1, 3, SRBENCH_NO_RPI},
+   // same, the next RH3-6LoRH only had that address and is removed
+   {FALSE, RH3_6LOTH_TYPE_4, 1, RH3_6LOTH_TYPE_0, 1, SRBENCH_NO_RPI},
+   // unknown elective 6LoRH in front
+   {TRUE,  RH3_6LOTH_TYPE_2, 3, SRBENCH_NO_RH3,   0, SRBENCH_NO_RPI},
+   // from outside the network, the RPI-6LoRH grows by a byte (K flag cleared)
+   {FALSE, RH3_6LOTH_TYPE_3, 3, SRBENCH_NO_RH3,   0, O_FLAG|I_FLAG|K_FLAG},
+   // all of the above, the RPI-6LoRH shrinks by a byte (I flag set)
+   {TRUE,  RH3_6LOTH_TYPE_4, 1, RH3_6LOTH_TYPE_1, 2, O_FLAG},
+};
+
+#define SRBENCH_NUM_SCENARIOS     (sizeof(srbench_scenarios)/sizeof(srbench_scenario_t))
+
+// the DAG root IPHC assumes when the IP-in-IP 6LoRH elides the source
+static const uint8_t srbench_dagroot_mac64b[] = {0x02,
+   0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01
+};
+
+typedef struct {
+   OpenQueueEntry_t  entry;                    // not from openqueue, which needs synchronization
+   uint8_t           packet[LENGTH_PACKET_BUFFER];
+   OpenQueueEntry_t* pkt;
+   ipv6_header_iht   outer;
+   ipv6_header_iht   inner;
+   rpl_option_ht     rpl_option;
+   open_addr_t       dagroot;                  // address of the DAG root, also the DODAGID
+   uint8_t           scenario;                 // scenario of the current step
+   uint8_t           mode;                     // mode of the current step
+   // results of the last complete run, per scenario
+   uint32_t          time[SRBENCH_NUM_SCENARIOS][SRBENCH_NUM_MODES];
+   uint16_t          stack[SRBENCH_NUM_SCENARIOS][SRBENCH_NUM_MODES];
+   uint8_t           numMismatches;
+   volatile uint8_t* stackArea;                // the last painted stack area
+   // used to check the modes against each other
+   uint8_t           check[LENGTH_PACKET_BUFFER];
+   uint8_t           checkLength;
+   open_addr_t       checkNextHop;
+   owerror_t         checkError;
+   uint8_t           checkOuterHopLimit;
+   uint8_t           checkInnerHopLimit;
+} app_vars_t;
+
+app_vars_t app_vars;
+
+//=========================== prototypes ======================================
+
+void      srbench_task_step(void);
+void      srbench_buildPacket(const srbench_scenario_t* scenario);
+void      srbench_prependRh3(
+   open_addr_t*         me,
+   uint8_t              type,
+   uint8_t              firstHop,
+   uint8_t              numAddr
+);
+owerror_t srbench_process(uint8_t mode);
+void      srbench_paintStack(void);
+uint16_t  srbench_usedStack(void);
+void      srbench_check(void);
+owerror_t srbench_baselineSourceRoute(
+   OpenQueueEntry_t*    msg,
+   ipv6_header_iht*     ipv6_outer_header,
+   ipv6_header_iht*     ipv6_inner_header,
+   rpl_option_ht*       rpl_option
+);
+owerror_t srbench_baselineSendFromForwarding(
+   OpenQueueEntry_t*    msg,
+   ipv6_header_iht*     ipv6_outer_header,
+   ipv6_header_iht*     ipv6_inner_header,
+   rpl_option_ht*       rpl_option,
+   uint8_t*             rh3_copy,
+   uint8_t              rh3_length
+);
+void      srbench_baselinePrependRpi(
+   OpenQueueEntry_t*    msg,
+   rpl_option_ht*       rpl_option
+);
+void      srbench_baselineCreateRplOption(
+   rpl_option_ht*       rpl_option,
+   uint8_t              flags
+);
+
+//=========================== main ============================================
+
+/**
+\brief The program starts executing here.
+*/
+int mote_main(void) {
+
+   memset(&app_vars,0,sizeof(app_vars_t));
+
+   board_init();
+   scheduler_init();
+   openstack_init();
+
+   app_vars.pkt             = &app_vars.entry;
+   app_vars.pkt->creator    = COMPONENT_FORWARDING;
+   app_vars.pkt->owner      = COMPONENT_FORWARDING;
+   app_vars.pkt->packet     = &app_vars.packet[0];
+   app_vars.pkt->packetSize = LENGTH_PACKET_BUFFER;
+
+   // the DODAGID, compression reference of the RH3-6LoRHs behind an IP-in-IP 6LoRH
+   packetfunctions_mac64bToIp128b(
+      idmanager_getMyID(ADDR_PREFIX),
+      (open_addr_t*)srbench_dagroot_mac64b,
+      &app_vars.dagroot
+   );
+   icmpv6rpl_writeDODAGid(app_vars.dagroot.addr_128b);
+
+   scheduler_push_task(srbench_task_step,TASKPRIO_MAX);
+
+   scheduler_start();
+   return 0; // this line should never be reached
+}
+
+//=========================== tasks ===========================================
+
+void srbench_task_step(void) {
+   const srbench_scenario_t* scenario;
+   bench_time_t              start;
+   uint16_t                  i;
+   uint16_t                  used;
+#ifdef OPENSIM
+   uint8_t                   s;
+#endif
+
+   scenario = &srbench_scenarios[app_vars.scenario];
+
+   // time the processing of the packets
+   debugpins_frame_set();
+   start = SRBENCH_GET_TIME();
+   for (i=0;i<SRBENCH_NUM_PACKETS;i++) {
+      srbench_buildPacket(scenario);
+      srbench_process(app_vars.mode);
+   }
+   app_vars.time[app_vars.scenario][app_vars.mode] = (bench_time_t)(SRBENCH_GET_TIME()-start);
+   debugpins_frame_clr();
+
+   // measure the stack used by the processing
+   srbench_buildPacket(scenario);
+   srbench_paintStack();
+   srbench_process(app_vars.mode);
+   used = srbench_usedStack();
+   app_vars.stack[app_vars.scenario][app_vars.mode] = used;
+
+   // next step
+   app_vars.mode++;
+   if (app_vars.mode==SRBENCH_NUM_MODES) {
+      srbench_check();
+      app_vars.mode = SRBENCH_MODE_RESET;
+      app_vars.scenario++;
+   }
+
+   if (app_vars.scenario==SRBENCH_NUM_SCENARIOS) {
+#ifdef OPENSIM
+      for (s=0;s<SRBENCH_NUM_SCENARIOS;s++) {
+         printf(
+            "03oos_sourcerouting: scenario %2d, in place %lu ns %d B, baseline %lu ns %d B\n",
+            s,
+            (unsigned long)((((uint64_t)(app_vars.time[s][SRBENCH_MODE_INPLACE]-app_vars.time[s][SRBENCH_MODE_RESET]))*1000000000)/CLOCKS_PER_SEC/SRBENCH_NUM_PACKETS),
+            app_vars.stack[s][SRBENCH_MODE_INPLACE]-app_vars.stack[s][SRBENCH_MODE_RESET],
+            (unsigned long)((((uint64_t)(app_vars.time[s][SRBENCH_MODE_BASELINE]-app_vars.time[s][SRBENCH_MODE_RESET]))*1000000000)/CLOCKS_PER_SEC/SRBENCH_NUM_PACKETS),
+            app_vars.stack[s][SRBENCH_MODE_BASELINE]-app_vars.stack[s][SRBENCH_MODE_RESET]
+         );
+      }
+      printf("03oos_sourcerouting: %d mismatches\n",app_vars.numMismatches);
+#endif
+      leds_error_toggle();
+
+      // start a new run
+      app_vars.scenario      = 0;
+      app_vars.numMismatches = 0;
+   }
+
+   scheduler_push_task(srbench_task_step,TASKPRIO_MAX);
+}
+
+//=========================== private =========================================
+
+/**
+\brief Build the packet of a scenario, as received by this mote.
+
+The hops share all but the last byte of this mote's address, the destination
+comes after the last of them. Without IP-in-IP 6LoRH, the compression reference
+of the first RH3-6LoRH is the inner source address, which also does, so every
+type can be used. With one, the packet comes from another prefix through the
+DAG root, the reference is the DODAGID, and the type must be 3 or 4.
+
+\param[in] scenario The 6LoRHs to build.
+*/
+void srbench_buildPacket(const srbench_scenario_t* scenario) {
+   OpenQueueEntry_t* msg;
+   open_addr_t       me;
+   uint8_t           numHops;
+
+   msg          = app_vars.pkt;
+   msg->payload = &msg->packet[msg->packetSize];
+   msg->length  = 0;
+
+   me.type = ADDR_128B;
+   memcpy(&me.addr_128b[0],idmanager_getMyID(ADDR_PREFIX)->prefix,8);
+   memcpy(&me.addr_128b[8],idmanager_getMyID(ADDR_64B)->addr_64b,8);
+
+   numHops = scenario->numAddr;
+   if (scenario->nextType!=SRBENCH_NO_RH3) {
+      numHops += scenario->nextNumAddr;
+   }
+
+   memset(&app_vars.outer,0,sizeof(ipv6_header_iht));
+   memset(&app_vars.inner,0,sizeof(ipv6_header_iht));
+   memset(&app_vars.rpl_option,0,sizeof(rpl_option_ht));
+   app_vars.outer.src.type  = ADDR_NONE;
+   app_vars.inner.hop_limit = IPHC_DEFAULT_HOP_LIMIT;
+   memcpy(&app_vars.inner.src,&me,sizeof(open_addr_t));
+   app_vars.inner.src.addr_128b[15] ^= 0x80;
+   memcpy(&app_vars.inner.dest,&me,sizeof(open_addr_t));
+   app_vars.inner.dest.addr_128b[15] += numHops;
+
+   // the rest of the packet
+   packetfunctions_reserveHeaderSize(msg,SRBENCH_LEN_PAYLOAD);
+   memset(msg->payload,0x55,SRBENCH_LEN_PAYLOAD);
+
+   if (scenario->rpiFlags!=SRBENCH_NO_RPI) {
+      app_vars.inner.src.addr_128b[0] ^= 0xff;
+
+      // the IP-in-IP 6LoRH, the source is the DAG root and elided
+      packetfunctions_reserveHeaderSize(msg,3);
+      msg->payload[0] = ELECTIVE_6LoRH | 1;
+      msg->payload[1] = IPECAP_6LOTH_TYPE;
+      msg->payload[2] = IPHC_DEFAULT_HOP_LIMIT;
+      app_vars.outer.header_length = 3;
+      app_vars.outer.hop_limit     = IPHC_DEFAULT_HOP_LIMIT;
+      memcpy(&app_vars.outer.src,&app_vars.dagroot,sizeof(open_addr_t));
+
+      // the RPI-6LoRH, in the global instance 0
+      if ((scenario->rpiFlags & K_FLAG)==0) {
+         packetfunctions_reserveHeaderSize(msg,2);
+         msg->payload[0] = (uint8_t)(SRBENCH_SENDER_RANK>>8);
+         msg->payload[1] = (uint8_t)(SRBENCH_SENDER_RANK&0xff);
+      } else {
+         packetfunctions_reserveHeaderSize(msg,1);
+         msg->payload[0] = (uint8_t)(SRBENCH_SENDER_RANK>>8);
+      }
+      if ((scenario->rpiFlags & I_FLAG)==0) {
+         packetfunctions_reserveHeaderSize(msg,1);
+         msg->payload[0] = 0;
+      }
+      packetfunctions_reserveHeaderSize(msg,2);
+      msg->payload[0] = CRITICAL_6LORH | scenario->rpiFlags;
+      msg->payload[1] = RPI_6LOTH_TYPE;
+      app_vars.outer.hopByhop_option = msg->payload;
+   }
+
+   // the RH3-6LoRHs
+   if (scenario->nextType!=SRBENCH_NO_RH3) {
+      srbench_prependRh3(&me,scenario->nextType,scenario->numAddr,scenario->nextNumAddr);
+   }
+   srbench_prependRh3(&me,scenario->type,0,scenario->numAddr);
+
+   // the unknown elective 6LoRH
+   if (scenario->elective==TRUE) {
+      packetfunctions_reserveHeaderSize(msg,2+SRBENCH_LEN_ELECTIVE);
+      msg->payload[0] = ELECTIVE_6LoRH | SRBENCH_LEN_ELECTIVE;
+      msg->payload[1] = SRBENCH_ELECTIVE_TYPE;
+      memset(&msg->payload[2],0x33,SRBENCH_LEN_ELECTIVE);
+   }
+}
+
+/**
+\brief Prepend an RH3-6LoRH to the packet.
+
+\param[in] me       This mote's address, hop i is this address plus i.
+\param[in] type     The type of the RH3-6LoRH.
+\param[in] firstHop The hop of its first address.
+\param[in] numAddr  The number of addresses in it.
+*/
+void srbench_prependRh3(open_addr_t* me, uint8_t type, uint8_t firstHop, uint8_t numAddr) {
+   OpenQueueEntry_t* msg;
+   uint8_t           addrLen;
+   uint8_t           i;
+
+   msg     = app_vars.pkt;
+   addrLen = RH3_6LOTH_ADDRLEN(type);
+   for (i=numAddr;i>0;i--) {
+      packetfunctions_reserveHeaderSize(msg,addrLen);
+      memcpy(msg->payload,&me->addr_128b[16-addrLen],addrLen);
+      msg->payload[addrLen-1] += firstHop+i-1;
+   }
+   packetfunctions_reserveHeaderSize(msg,2);
+   msg->payload[0] = CRITICAL_6LORH | (numAddr-1);
+   msg->payload[1] = type;
+}
+
+/**
+\brief Process the packet with the given mode.
+*/
+owerror_t srbench_process(uint8_t mode) {
+   uint8_t* hopLimit;
+
+   switch (mode) {
+      case SRBENCH_MODE_INPLACE:
+         if (
+            forwarding_consumeSourceRoute(
+               app_vars.pkt,
+               &app_vars.outer,
+               &app_vars.inner,
+               &app_vars.rpl_option,
+               &hopLimit
+            )==E_FAIL
+         ) {
+            return E_FAIL;
+         }
+         // as iphc_sendFromForwardingInPlace()
+         if (hopLimit!=NULL) {
+            (*hopLimit)--;
+            app_vars.outer.hop_limit = *hopLimit;
+         } else {
+            app_vars.inner.hop_limit--;
+         }
+         return E_SUCCESS;
+      case SRBENCH_MODE_BASELINE:
+         return srbench_baselineSourceRoute(
+            app_vars.pkt,
+            &app_vars.outer,
+            &app_vars.inner,
+            &app_vars.rpl_option
+         );
+      default:
+         return E_SUCCESS;
+   }
+}
+
+/**
+\brief Paint the stack below the caller.
+*/
+void srbench_paintStack(void) {
+   volatile uint8_t area[SRBENCH_STACK_PAINT];
+   uint16_t         i;
+
+   for (i=0;i<SRBENCH_STACK_PAINT;i++) {
+      area[i] = SRBENCH_PAINT;
+   }
+   app_vars.stackArea = area;
+}
+
+/**
+\brief Count the bytes of the stack used since srbench_paintStack().
+
+Must be called from the same function as srbench_paintStack().
+
+\returns The number of painted bytes overwritten.
+*/
+uint16_t srbench_usedStack(void) {
+   uint16_t i;
+
+   // the stack grows down, stackArea[0] is the deepest byte
+   for (i=0;i<SRBENCH_STACK_PAINT && app_vars.stackArea[i]==SRBENCH_PAINT;i++);
+   return SRBENCH_STACK_PAINT-i;
+}
+
+/**
+\brief Check the in place and baseline processing produce the same packet.
+*/
+void srbench_check(void) {
+   const srbench_scenario_t* scenario;
+   owerror_t                 error;
+
+   scenario = &srbench_scenarios[app_vars.scenario];
+
+   srbench_buildPacket(scenario);
+   app_vars.checkError         = srbench_process(SRBENCH_MODE_INPLACE);
+   app_vars.checkLength        = app_vars.pkt->length;
+   app_vars.checkOuterHopLimit = app_vars.outer.hop_limit;
+   app_vars.checkInnerHopLimit = app_vars.inner.hop_limit;
+   memcpy(app_vars.check,app_vars.pkt->payload,app_vars.pkt->length);
+   memcpy(&app_vars.checkNextHop,&app_vars.pkt->l2_nextORpreviousHop,sizeof(open_addr_t));
+
+   srbench_buildPacket(scenario);
+   error = srbench_process(SRBENCH_MODE_BASELINE);
+   if (
+      error!=E_SUCCESS                                                       ||
+      error!=app_vars.checkError                                             ||
+      app_vars.pkt->length!=app_vars.checkLength                             ||
+      memcmp(app_vars.check,app_vars.pkt->payload,app_vars.checkLength)!=0   ||
+      packetfunctions_sameAddress(&app_vars.checkNextHop,&app_vars.pkt->l2_nextORpreviousHop)==FALSE ||
+      app_vars.outer.hop_limit!=app_vars.checkOuterHopLimit                  ||
+      app_vars.inner.hop_limit!=app_vars.checkInnerHopLimit
+   ) {
+      app_vars.numMismatches++;
+   }
+}
+
+//=== baseline, the copy-based processing forwarding and IPHC used before
+
+/**
+\brief Port of forwarding_send_internal_SourceRouting(), as it was before the
+   headers were processed in place.
+
+The unknown elective 6LoRHs are copied to a 127-byte array on the stack and
+tossed, the RH3-6LoRHs tossed and rebuilt. With an RPI-6LoRH, the RH3-6LoRHs
+are copied too, and the RPI and IP-in-IP 6LoRHs parsed and tossed, for
+srbench_baselineSendFromForwarding() to rebuild them.
+*/
+owerror_t srbench_baselineSourceRoute(
+    OpenQueueEntry_t* msg,
+    ipv6_header_iht*  ipv6_outer_header,
+    ipv6_header_iht*  ipv6_inner_header,
+    rpl_option_ht*    rpl_option
+    ) {
+    uint8_t              temp_8b;
+    uint8_t              type;
+    uint8_t              next_type;
+    uint8_t              size;
+    uint8_t              next_size;
+    uint8_t              hlen;
+    open_addr_t          firstAddr;
+    open_addr_t          nextAddr;
+    open_addr_t          temp_prefix;
+    open_addr_t          temp_addr64;
+
+    uint8_t              rpi_length;
+    uint8_t              flags;
+    uint16_t             senderRank;
+
+    uint8_t              RH_copy[127];
+    uint8_t              RH_length;
+
+    uint8_t              RH3_length;
+
+    uint8_t sizeRH=0;
+
+    memset(&RH_copy[0],0,127);
+    RH3_length = 0;
+    RH_length = 0;
+    memcpy(&msg->l3_destinationAdd,&ipv6_inner_header->dest,sizeof(open_addr_t));
+    memcpy(&msg->l3_sourceAdd,&ipv6_inner_header->src,sizeof(open_addr_t));
+
+    // initial first Address by compression reference
+    firstAddr.type = ADDR_128B;
+    if (ipv6_outer_header->src.type != ADDR_NONE){
+        if (rpl_option->rplInstanceID == 0){
+            icmpv6rpl_getRPLDODAGid(&firstAddr.addr_128b[0]);
+        }
+    } else {
+        memcpy(&firstAddr,&ipv6_inner_header->src,sizeof(open_addr_t));
+    }
+
+    hlen = 0;
+
+    temp_8b = *((uint8_t*)(msg->payload)+hlen);
+    type    = *((uint8_t*)(msg->payload)+hlen+1);
+
+    //copy and toss any unknown 6LoRHE
+    while((temp_8b&FORMAT_6LORH_MASK) == ELECTIVE_6LoRH){
+        sizeRH = temp_8b & IPINIP_LEN_6LORH_MASK;
+        memcpy(&RH_copy[RH_length], msg->payload, sizeRH+2);
+        packetfunctions_tossHeader(msg, sizeRH+2);
+        RH_length += 2 + sizeRH;
+        temp_8b = *((uint8_t*)(msg->payload)+hlen);
+        type    = *((uint8_t*)(msg->payload)+hlen+1);
+    }
+
+    hlen += 2;
+
+    // get the first address
+    switch(type){
+    case RH3_6LOTH_TYPE_0:
+        memcpy(&firstAddr.addr_128b[15],msg->payload+hlen,1);
+        hlen += 1;
+        break;
+    case RH3_6LOTH_TYPE_1:
+        memcpy(&firstAddr.addr_128b[14],msg->payload+hlen,2);
+        hlen += 2;
+        break;
+    case RH3_6LOTH_TYPE_2:
+        memcpy(&firstAddr.addr_128b[12],msg->payload+hlen,4);
+        hlen += 4;
+        break;
+    case RH3_6LOTH_TYPE_3:
+        memcpy(&firstAddr.addr_128b[8],msg->payload+hlen,8);
+        hlen += 8;
+        break;
+    case RH3_6LOTH_TYPE_4:
+        memcpy(&firstAddr.addr_128b[0],msg->payload+hlen,16);
+        hlen += 16;
+        break;
+    }
+
+    packetfunctions_ip128bToMac64b(&firstAddr,&temp_prefix,&temp_addr64);
+    if (
+        packetfunctions_sameAddress(&temp_prefix,idmanager_getMyID(ADDR_PREFIX)) &&
+        packetfunctions_sameAddress(&temp_addr64,idmanager_getMyID(ADDR_64B))
+    ){
+        size = temp_8b & RH3_6LOTH_SIZE_MASK;
+        if (size > 0){
+            // there are at least 2 entries in the header,
+            // the router removes the first entry and decrements the Size (by 1)
+            size -= 1;
+            packetfunctions_tossHeader(msg,hlen);
+            packetfunctions_reserveHeaderSize(msg,2);
+            msg->payload[0] = CRITICAL_6LORH | size;
+            msg->payload[1] = type;
+            // get next hop
+            memcpy(&nextAddr,&firstAddr,sizeof(open_addr_t));
+            switch(type){
+            case RH3_6LOTH_TYPE_0:
+                memcpy(&nextAddr.addr_128b[15],msg->payload+2,1);
+                break;
+            case RH3_6LOTH_TYPE_1:
+                memcpy(&nextAddr.addr_128b[14],msg->payload+2,2);
+                break;
+            case RH3_6LOTH_TYPE_2:
+                memcpy(&nextAddr.addr_128b[12],msg->payload+2,4);
+                break;
+            case RH3_6LOTH_TYPE_3:
+                memcpy(&nextAddr.addr_128b[8],msg->payload+2,8);
+                break;
+            case RH3_6LOTH_TYPE_4:
+                memcpy(&nextAddr.addr_128b[0],msg->payload+2,16);
+                break;
+            }
+            packetfunctions_ip128bToMac64b(
+                &nextAddr,
+                &temp_prefix,
+                &msg->l2_nextORpreviousHop
+            );
+        } else {
+            temp_8b   = *((uint8_t*)(msg->payload)+hlen);
+            next_type = *((uint8_t*)(msg->payload)+hlen+1);
+            if (
+                (temp_8b & FORMAT_6LORH_MASK) == CRITICAL_6LORH &&
+                next_type<=RH3_6LOTH_TYPE_4
+            ) {
+                // there is another RH3-6LoRH following, check the type
+                if (next_type >= type){
+                    packetfunctions_tossHeader(msg,hlen);
+                    // get next hop
+                    memcpy(&nextAddr,&firstAddr,sizeof(open_addr_t));
+                    switch(next_type){
+                    case RH3_6LOTH_TYPE_0:
+                        memcpy(&nextAddr.addr_128b[15],msg->payload+2,1);
+                        break;
+                    case RH3_6LOTH_TYPE_1:
+                        memcpy(&nextAddr.addr_128b[14],msg->payload+2,2);
+                        break;
+                    case RH3_6LOTH_TYPE_2:
+                        memcpy(&nextAddr.addr_128b[12],msg->payload+2,4);
+                        break;
+                    case RH3_6LOTH_TYPE_3:
+                        memcpy(&nextAddr.addr_128b[8],msg->payload+2,8);
+                        break;
+                    case RH3_6LOTH_TYPE_4:
+                        memcpy(&nextAddr.addr_128b[0],msg->payload+2,16);
+                        break;
+                    }
+                    packetfunctions_ip128bToMac64b(
+                        &nextAddr,
+                        &temp_prefix,
+                        &msg->l2_nextORpreviousHop
+                    );
+                } else {
+                    hlen += 2;
+                    switch(next_type){
+                    case RH3_6LOTH_TYPE_0:
+                        memcpy(&firstAddr.addr_128b[15],msg->payload+hlen,1);
+                        hlen += 1;
+                        break;
+                    case RH3_6LOTH_TYPE_1:
+                        memcpy(&firstAddr.addr_128b[14],msg->payload+hlen,2);
+                        hlen += 2;
+                        break;
+                    case RH3_6LOTH_TYPE_2:
+                        memcpy(&firstAddr.addr_128b[12],msg->payload+hlen,4);
+                        hlen += 4;
+                        break;
+                    case RH3_6LOTH_TYPE_3:
+                        memcpy(&firstAddr.addr_128b[8],msg->payload+hlen,8);
+                        hlen += 8;
+                        break;
+                    }
+                    next_size = temp_8b & RH3_6LOTH_SIZE_MASK;
+                    packetfunctions_tossHeader(msg,hlen);
+                    if (next_size>0){
+                        next_size -= 1;
+                        packetfunctions_reserveHeaderSize(msg,2);
+                        msg->payload[0] = CRITICAL_6LORH | next_size;
+                        msg->payload[1] = next_type;
+                    }
+                    // add first address
+                    switch(type){
+                    case RH3_6LOTH_TYPE_0:
+                        packetfunctions_reserveHeaderSize(msg,1);
+                        msg->payload[0] = firstAddr.addr_128b[15];
+                        break;
+                    case RH3_6LOTH_TYPE_1:
+                        packetfunctions_reserveHeaderSize(msg,2);
+                        memcpy(&msg->payload[0],&firstAddr.addr_128b[14],2);
+                        break;
+                    case RH3_6LOTH_TYPE_2:
+                        packetfunctions_reserveHeaderSize(msg,4);
+                        memcpy(&msg->payload[0],&firstAddr.addr_128b[12],4);
+                        break;
+                    case RH3_6LOTH_TYPE_3:
+                        packetfunctions_reserveHeaderSize(msg,8);
+                        memcpy(&msg->payload[0],&firstAddr.addr_128b[8],8);
+                        break;
+                    case RH3_6LOTH_TYPE_4:
+                        packetfunctions_reserveHeaderSize(msg,16);
+                        memcpy(&msg->payload[0],&firstAddr.addr_128b[0],16);
+                        break;
+                    }
+                    packetfunctions_reserveHeaderSize(msg,2);
+                    msg->payload[0] = CRITICAL_6LORH | 0;
+                    msg->payload[1] = type;
+                    packetfunctions_ip128bToMac64b(
+                        &firstAddr,
+                        &temp_prefix,
+                        &msg->l2_nextORpreviousHop
+                    );
+                }
+            } else {
+                // there is no next RH3-6loRH, remove current one
+                packetfunctions_tossHeader(msg,hlen);
+                packetfunctions_ip128bToMac64b(
+                    &msg->l3_destinationAdd,
+                    &temp_prefix,
+                    &msg->l2_nextORpreviousHop
+                );
+            }
+        }
+    } else {
+        // log error
+        openserial_printError(
+            COMPONENT_IPHC,
+            ERR_6LOWPAN_UNSUPPORTED,
+            (errorparameter_t)16,
+            (errorparameter_t)(temp_addr64.addr_64b[7])
+        );
+    }
+    // copy RH3s before toss them
+    if (
+        ipv6_outer_header->src.type != ADDR_NONE &&
+        ipv6_outer_header->hopByhop_option != NULL
+    ){
+        // check the length of RH3s
+        RH3_length += ipv6_outer_header->hopByhop_option-msg->payload;
+        memcpy(&RH_copy[RH_length],msg->payload,RH3_length);
+        packetfunctions_tossHeader(msg,RH3_length);
+        RH_length += RH3_length;
+
+        // retrieve hop-by-hop header (includes RPL option)
+        rpi_length = iphc_retrieveIPv6HopByHopHeader(
+                          msg->payload,
+                          rpl_option
+                     );
+
+        // toss the headers
+        packetfunctions_tossHeader(
+            msg,
+            rpi_length
+        );
+
+        flags = rpl_option->flags;
+        senderRank = rpl_option->senderRank;
+        if ((flags & O_FLAG)!=O_FLAG){
+            // wrong direction
+            // log error
+            openserial_printError(
+                COMPONENT_FORWARDING,
+                ERR_WRONG_DIRECTION,
+                (errorparameter_t)flags,
+                (errorparameter_t)senderRank
+            );
+        }
+        if (senderRank > neighbors_getMyDAGrank()){
+            // loop detected
+            // set flag
+            rpl_option->flags |= R_FLAG;
+            // log error
+            openserial_printError(
+                COMPONENT_FORWARDING,
+                ERR_LOOP_DETECTED,
+                (errorparameter_t) senderRank,
+                (errorparameter_t) neighbors_getMyDAGrank()
+            );
+        }
+        srbench_baselineCreateRplOption(rpl_option, rpl_option->flags);
+        // toss the IP in IP 6LoRH
+        packetfunctions_tossHeader(msg, ipv6_outer_header->header_length);
+    } else {
+        RH3_length = 0;
+    }
+
+    // send to next lower layer
+    return srbench_baselineSendFromForwarding(
+        msg,
+        ipv6_outer_header,
+        ipv6_inner_header,
+        rpl_option,
+        &RH_copy[0],
+        RH_length
+    );
+}
+
+/**
+\brief Port of iphc_sendFromForwarding(), as it was before the headers were
+   processed in place.
+
+It stops before the page dispatch and the call to sixtop, which are the same
+for the in place processing.
+*/
+owerror_t srbench_baselineSendFromForwarding(
+    OpenQueueEntry_t* msg,
+    ipv6_header_iht*  ipv6_outer_header,
+    ipv6_header_iht*  ipv6_inner_header,
+    rpl_option_ht*    rpl_option,
+    uint8_t*          rh3_copy,
+    uint8_t           rh3_length
+    ) {
+    open_addr_t  temp_dest_prefix;
+    open_addr_t  temp_dest_mac64b;
+    open_addr_t  temp_src_prefix;
+    open_addr_t  temp_src_mac64b;
+    open_addr_t  temp_dagroot_ip128b;
+    uint8_t      sam;
+    // take ownership over the packet
+    msg->owner = COMPONENT_IPHC;
+
+    // error checking
+    if (idmanager_getIsDAGroot()==TRUE &&
+        packetfunctions_isAllRoutersMulticast(&(msg->l3_destinationAdd))==FALSE) {
+        openserial_printCritical(COMPONENT_IPHC,ERR_BRIDGE_MISMATCH,
+                            (errorparameter_t)0,
+                            (errorparameter_t)0);
+        return E_FAIL;
+    }
+
+    //discard the packet.. hop limit reached.
+    if (ipv6_outer_header->src.type != ADDR_NONE){
+        // there is IPinIP check hop limit in ip in ip encapsulation
+        if (ipv6_outer_header->hop_limit==0){
+            openserial_printError(COMPONENT_IPHC,ERR_HOP_LIMIT_REACHED,
+                                (errorparameter_t)0,
+                                (errorparameter_t)0);
+            return E_FAIL;
+        } else {
+            // decrement the packet's hop limit
+            ipv6_outer_header->hop_limit--;
+        }
+    } else {
+        if (ipv6_inner_header->hop_limit==0) {
+            openserial_printError(COMPONENT_IPHC,ERR_HOP_LIMIT_REACHED,
+                                (errorparameter_t)0,
+                                (errorparameter_t)0);
+            return E_FAIL;
+        } else {
+            // decrement the packet's hop limit
+            ipv6_inner_header->hop_limit--;
+        }
+    }
+
+    packetfunctions_ip128bToMac64b(&(msg->l3_destinationAdd),&temp_dest_prefix,&temp_dest_mac64b);
+    //xv poipoi -- get the src prefix as well
+    packetfunctions_ip128bToMac64b(&(msg->l3_sourceAdd),&temp_src_prefix,&temp_src_mac64b);
+    //XV -poipoi we want to check if the source address prefix is the same as destination prefix
+    if (packetfunctions_sameAddress(&temp_dest_prefix,&temp_src_prefix)) {
+        sam = IPHC_SAM_64B;    // no ipinip 6loRH if in the same prefix
+    } else {
+        //not the same prefix. so the packet travels to another network
+        //check if this is a source routing pkt. in case it is then the DAM is elided as it is in the SrcRouting header.
+        if (packetfunctions_isBroadcastMulticast(&(msg->l3_destinationAdd))==FALSE){
+            // ip in ip will be presented
+            sam = IPHC_SAM_128B;
+        } else {
+            // this is DIO, source address elided, multicast bit is set
+            sam = IPHC_SAM_ELIDED;
+        }
+    }
+
+    //IPinIP 6LoRH will be added at here if necessary.
+    if (packetfunctions_sameAddress(&temp_dest_prefix,&temp_src_prefix)){
+        // same network, IPinIP is elided
+    } else {
+        if (packetfunctions_isBroadcastMulticast(&(msg->l3_destinationAdd))==FALSE){
+            memset(&(temp_dagroot_ip128b),0,sizeof(open_addr_t));
+            packetfunctions_mac64bToIp128b(idmanager_getMyID(ADDR_PREFIX),(open_addr_t*)srbench_dagroot_mac64b,&(temp_dagroot_ip128b));
+            if (
+                (
+                  ipv6_outer_header->src.type == ADDR_NONE &&
+                  packetfunctions_sameAddress(&(msg->l3_sourceAdd),&(temp_dagroot_ip128b))
+                ) ||
+                (
+                  ipv6_outer_header->src.type != ADDR_NONE &&
+                  packetfunctions_sameAddress(&(ipv6_outer_header->src),&(temp_dagroot_ip128b))
+                )
+            ){
+                // hop limit
+                packetfunctions_reserveHeaderSize(msg,sizeof(uint8_t));
+                *((uint8_t*)(msg->payload)) = ipv6_outer_header->hop_limit;
+                // type
+                packetfunctions_reserveHeaderSize(msg,sizeof(uint8_t));
+                *((uint8_t*)(msg->payload)) = IPECAP_6LOTH_TYPE;
+                // length
+                packetfunctions_reserveHeaderSize(msg,sizeof(uint8_t));
+                *((uint8_t*)(msg->payload)) = ELECTIVE_6LoRH | 1;
+            } else {
+                if (sam == IPHC_SAM_128B){
+                    // encapsulate address
+                    packetfunctions_writeAddress(msg, &(msg->l3_sourceAdd),OW_BIG_ENDIAN);
+                    // hoplim
+                    packetfunctions_reserveHeaderSize(msg,sizeof(uint8_t));
+                    *((uint8_t*)(msg->payload)) = ipv6_outer_header->hop_limit;
+                    // type
+                    packetfunctions_reserveHeaderSize(msg,sizeof(uint8_t));
+                    *((uint8_t*)(msg->payload)) = IPECAP_6LOTH_TYPE;
+                    // length
+                    packetfunctions_reserveHeaderSize(msg,sizeof(uint8_t));
+                    *((uint8_t*)(msg->payload)) = ELECTIVE_6LoRH | 17;
+                }
+            }
+        } else {
+            // this is DIO, no IPinIP either
+        }
+    }
+
+    //prepend Option hop by hop header except when src routing and dst is not 0xffff
+    //-- this is a little trick as src routing is using an option header set to 0x00
+    if (
+        rpl_option->optionType==RPL_HOPBYHOP_HEADER_OPTION_TYPE &&
+        packetfunctions_isBroadcastMulticast(&(msg->l3_destinationAdd))==FALSE
+    ){
+        srbench_baselinePrependRpi(msg, rpl_option);
+    }
+
+    // copy RH3s back if length > 0
+    if (rh3_length > 0){
+        packetfunctions_reserveHeaderSize(msg,rh3_length);
+        memcpy(&msg->payload[0],&rh3_copy[0],rh3_length);
+    }
+
+    return E_SUCCESS;
+}
+
+/**
+\brief Copy of iphc_prependIPv6HopByHopHeader(), private to IPHC.
+*/
+void srbench_baselinePrependRpi(
+      OpenQueueEntry_t* msg,
+      rpl_option_ht*    rpl_option
+   ){
+   uint8_t temp_8b;
+
+   if ((rpl_option->flags & K_FLAG) == 0){
+      packetfunctions_reserveHeaderSize(msg,sizeof(uint16_t));
+      msg->payload[0] = (uint8_t)((rpl_option->senderRank&0xFF00)>>8);
+      msg->payload[1] = (uint8_t)(rpl_option->senderRank&0x00FF);
+   } else {
+      packetfunctions_reserveHeaderSize(msg,sizeof(uint8_t));
+      *((uint8_t*)(msg->payload)) = (uint8_t)((rpl_option->senderRank&0xFF00)>>8);
+   }
+
+   if ((rpl_option->flags & I_FLAG) == 0){
+      packetfunctions_reserveHeaderSize(msg,sizeof(uint8_t));
+      *((uint8_t*)(msg->payload)) = rpl_option->rplInstanceID;
+   }
+
+   packetfunctions_reserveHeaderSize(msg,sizeof(uint8_t));
+   *((uint8_t*)(msg->payload)) = RPI_6LOTH_TYPE;
+
+   temp_8b = CRITICAL_6LORH | rpl_option->flags;
+   packetfunctions_reserveHeaderSize(msg,sizeof(uint8_t));
+   *((uint8_t*)(msg->payload)) = temp_8b;
+}
+
+/**
+\brief Copy of forwarding_createRplOption(), private to forwarding.
+*/
+void srbench_baselineCreateRplOption(rpl_option_ht* rpl_option, uint8_t flags) {
+    uint8_t I,K;
+    rpl_option->optionType         = RPL_HOPBYHOP_HEADER_OPTION_TYPE;
+    rpl_option->rplInstanceID      = icmpv6rpl_getRPLIntanceID();
+    rpl_option->senderRank         = neighbors_getMyDAGrank();
+
+    if (rpl_option->rplInstanceID == 0){
+       I = 1;
+    } else {
+       I = 0;
+    }
+
+    if ((rpl_option->senderRank & 0x00FF) == 0){
+        K = 1;
+    } else {
+        K = 0;
+    }
+
+    rpl_option->flags = (flags & ~I_FLAG & ~K_FLAG) | (I<<1) | K;
+}